@@ -0,0 +1,10 @@
+#include "application.h"
+#include "stallwatchdog.h"
+
+Application::Application(int &argc, char **argv)
+    : QApplication(argc, argv) {}
+
+bool Application::notify(QObject *receiver, QEvent *event) {
+    StallWatchdog::Dispatch dispatch(receiver, event);
+    return QApplication::notify(receiver, event);
+}
@@ -0,0 +1,75 @@
+#include "blobreader.h"
+#include "sqldialect.h"
+#include "querystats.h"
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QDebug>
+#include <cstring>
+
+BlobReader::BlobReader(const QSqlDatabase &db, const QString &table, const QString &column,
+                       const QString &keyColumn, const QVariant &key, QObject *parent)
+    : QIODevice(parent), db(db), table(table), column(column), keyColumn(keyColumn), key(key) {}
+
+bool BlobReader::open(OpenMode mode) {
+    if ((mode & ReadWrite) != ReadOnly)
+        return false;
+
+    QSqlQuery q(db);
+    q.prepare(QString("SELECT %1 FROM %2 WHERE %3 = ?")
+                  .arg(SqlDialect::blobLength(db, column), table, keyColumn));
+    q.addBindValue(key);
+    if (!QUERY_EXEC(q) || !q.next() || q.value(0).isNull()) {
+        if (q.lastError().isValid())
+            qDebug() << "BlobReader::open():" << q.lastError();
+        return false;
+    }
+    // Пустое значение читать нечего - для вызывающих это то же, что его нет
+    total = q.value(0).toLongLong();
+    if (total <= 0)
+        return false;
+    chunk.clear();
+    chunkOffset = 0;
+
+    // Своя буферизация кусками: буфер QIODevice сдвинул бы pos() относительно
+    // фактического положения чтения
+    return QIODevice::open(mode | Unbuffered);
+}
+
+bool BlobReader::seek(qint64 pos) {
+    if (pos < 0 || pos > total)
+        return false;
+    return QIODevice::seek(pos);
+}
+
+bool BlobReader::fetchChunk(qint64 offset) {
+    QSqlQuery q(db);
+    q.prepare(QString("SELECT %1 FROM %2 WHERE %3 = ?")
+                  .arg(SqlDialect::blobSlice(db, column), table, keyColumn));
+    q.addBindValue(offset + 1);                 // в SQL смещения с 1
+    q.addBindValue(ChunkSize);
+    q.addBindValue(key);
+    if (!QUERY_EXEC(q) || !q.next()) {
+        qDebug() << "BlobReader: chunk at" << offset << "failed" << q.lastError();
+        return false;
+    }
+    chunk = q.value(0).toByteArray();
+    chunkOffset = offset;
+    return !chunk.isEmpty();
+}
+
+qint64 BlobReader::readData(char *data, qint64 maxSize) {
+    qint64 done = 0;
+    while (done < maxSize) {
+        const qint64 at = pos() + done;
+        if (at >= total)
+            break;
+        if (at < chunkOffset || at >= chunkOffset + chunk.size()) {
+            if (!fetchChunk(at))
+                return done ? done : -1;
+        }
+        const qint64 n = qMin(maxSize - done, chunkOffset + chunk.size() - at);
+        std::memcpy(data + done, chunk.constData() + (at - chunkOffset), size_t(n));
+        done += n;
+    }
+    return done;
+}
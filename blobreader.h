@@ -0,0 +1,47 @@
+#ifndef BLOBREADER_H
+#define BLOBREADER_H
+
+#include <QIODevice>
+#include <QSqlDatabase>
+#include <QByteArray>
+#include <QVariant>
+
+// Чтение BLOB из базы кусками по мере надобности (QImageReader и т.п.).
+//
+// Целиком значение в памяти клиента не держится: каждый кусок забирается
+// отдельным SELECT substring(...). В PostgreSQL для столбцов со STORAGE
+// EXTERNAL (см. db/migrations) сервер при этом читает только нужные
+// страницы TOAST, а не всё значение.
+class BlobReader : public QIODevice {
+public:
+    static constexpr qint64 ChunkSize = 256 * 1024;
+
+    // table/column/keyColumn - идентификаторы из кода, не пользовательский ввод
+    BlobReader(const QSqlDatabase &db, const QString &table, const QString &column,
+               const QString &keyColumn, const QVariant &key, QObject *parent = nullptr);
+
+    // Только ReadOnly; false, если строки нет, значение NULL или пустое
+    bool open(OpenMode mode) override;
+    bool isSequential() const override { return false; }
+    qint64 size() const override { return total; }
+    bool seek(qint64 pos) override;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *, qint64) override { return -1; }
+
+private:
+    bool fetchChunk(qint64 offset);
+
+    QSqlDatabase db;
+    QString      table;
+    QString      column;
+    QString      keyColumn;
+    QVariant     key;
+
+    qint64     total = 0;
+    QByteArray chunk;
+    qint64     chunkOffset = 0;
+};
+
+#endif // BLOBREADER_H
@@ -0,0 +1,71 @@
+#include "bulkinserter.h"
+#include "querystats.h"
+#include <QSqlError>
+#include <QDebug>
+
+namespace {
+// SQLITE_MAX_VARIABLE_NUMBER в старых сборках; PostgreSQL допускает 65535
+constexpr int MaxParameters = 999;
+}
+
+BulkInserter::BulkInserter(QSqlDatabase &db, const QString &table,
+                           const QStringList &columns, int batchRows)
+    : db(db), table(table), columns(columns), fullBatch(db) {
+    const int fit = qMax(1, MaxParameters / qMax(1, int(columns.size())));
+    this->batchRows = batchRows > 0 ? qMin(batchRows, fit) : fit;
+    buffer.reserve(this->batchRows * columns.size());
+}
+
+QString BulkInserter::statement(int rows) const {
+    const QString tuple = "(" + QStringList(columns.size(), QStringLiteral("?")).join(", ") + ")";
+    QStringList tuples;
+    tuples.reserve(rows);
+    for (int i = 0; i < rows; ++i)
+        tuples << tuple;
+    return QString("INSERT INTO %1 (%2) VALUES %3")
+        .arg(table, columns.join(", "), tuples.join(", "));
+}
+
+bool BulkInserter::add(const QVariantList &values) {
+    if (values.size() != columns.size()) {
+        qDebug() << "BulkInserter: ожидалось" << columns.size() << "значений для" << table
+                 << ", получено" << values.size();
+        return false;
+    }
+    buffer += values;
+    if (pendingRows() < batchRows)
+        return true;
+
+    if (!fullBatchPrepared) {
+        if (!fullBatch.prepare(statement(batchRows))) {
+            qDebug() << "BulkInserter: ошибка подготовки для" << table << fullBatch.lastError().text();
+            return false;
+        }
+        fullBatchPrepared = true;
+    }
+    return execute(fullBatch);
+}
+
+bool BulkInserter::flush() {
+    if (buffer.isEmpty())
+        return true;
+    // Хвост меньше полной пачки - разовый запрос своего размера
+    QSqlQuery tail(db);
+    if (!tail.prepare(statement(pendingRows()))) {
+        qDebug() << "BulkInserter: ошибка подготовки для" << table << tail.lastError().text();
+        return false;
+    }
+    return execute(tail);
+}
+
+bool BulkInserter::execute(QSqlQuery &query) {
+    for (int i = 0; i < buffer.size(); ++i)
+        query.bindValue(i, buffer.at(i));
+    if (!QUERY_EXEC(query)) {
+        qDebug() << "BulkInserter: ошибка вставки в" << table << query.lastError().text();
+        return false;
+    }
+    written += pendingRows();
+    buffer.clear();
+    return true;
+}
@@ -0,0 +1,42 @@
+#ifndef BULKINSERTER_H
+#define BULKINSERTER_H
+
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QString>
+#include <QStringList>
+#include <QVariantList>
+
+// Пакетная вставка строк в одну таблицу: строки копятся в буфере и уходят
+// многострочным INSERT ... VALUES (?, ...), (?, ...) - один запрос на пачку
+// вместо запроса на строку. Запрос полной пачки готовится один раз.
+//
+// Транзакцию открывает и закрывает вызывающий; flush() обязателен перед
+// commit (деструктор ничего не пишет - ошибку там некому вернуть).
+class BulkInserter {
+public:
+    // batchRows = 0 - сколько помещается в лимит параметров SQLite (999)
+    BulkInserter(QSqlDatabase &db, const QString &table, const QStringList &columns,
+                 int batchRows = 0);
+
+    bool add(const QVariantList &values);
+    bool flush();
+
+    qint64 rowsWritten() const { return written; }
+    int pendingRows() const { return buffer.size() / columns.size(); }
+
+private:
+    QString statement(int rows) const;
+    bool execute(QSqlQuery &query);
+
+    QSqlDatabase &db;
+    QString      table;
+    QStringList  columns;
+    int          batchRows;
+    QVariantList buffer;
+    QSqlQuery    fullBatch;
+    bool         fullBatchPrepared = false;
+    qint64       written = 0;
+};
+
+#endif // BULKINSERTER_H
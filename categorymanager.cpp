@@ -1,4 +1,5 @@
 #include "categorymanager.h"
+#include "querystats.h"
 #include <QSqlQuery>
 #include <QSqlError>
 
@@ -15,7 +16,7 @@ bool CategoryManager::createCategory(const QString &name, int parentId, int proj
         query.prepare("SELECT depth FROM category WHERE category_id = :parentId");
         query.bindValue(":parentId", parentId);
 
-        if (!query.exec() || !query.next()) {
+        if (!QUERY_EXEC(query) || !query.next()) {
             qDebug() << "Ошибка получения глубины родительской категории:" << query.lastError();
             return false;
         }
@@ -39,7 +40,7 @@ bool CategoryManager::createCategory(const QString &name, int parentId, int proj
     }
     //
 
-    if (!query.exec() || !query.next()) {
+    if (!QUERY_EXEC(query) || !query.next()) {
         qDebug() << "Ошибка определения позиции категории:" << query.lastError();
         return false;
     }
@@ -54,7 +55,7 @@ bool CategoryManager::createCategory(const QString &name, int parentId, int proj
     query.bindValue(":depth", depth);
     query.bindValue(":projectId", projectId);
 
-    if (!query.exec()) {
+    if (!QUERY_EXEC(query)) {
         qDebug() << "Ошибка создания категории:" << query.lastError();
         return false;
     }
@@ -69,7 +70,7 @@ bool CategoryManager::updateCategory(int categoryId, const QString &newName) {
     query.bindValue(":newName", newName);
     query.bindValue(":categoryId", categoryId);
 
-    if (!query.exec()) {
+    if (!QUERY_EXEC(query)) {
         qDebug() << "Ошибка обновления категории:" << query.lastError();
         return false;
     }
@@ -93,7 +94,7 @@ bool CategoryManager::deleteCategory(int categoryId, bool deleteAll) {
             );
         query.bindValue(":categoryId", categoryId);
 
-        if (!query.exec()) {
+        if (!QUERY_EXEC(query)) {
             qDebug() << "Ошибка удаления шаблонов связанных с категорией:" << query.lastError();
             return false;
         }
@@ -109,7 +110,7 @@ bool CategoryManager::deleteCategory(int categoryId, bool deleteAll) {
             );
         query.bindValue(":categoryId", categoryId);
 
-        if (!query.exec()) {
+        if (!QUERY_EXEC(query)) {
             qDebug() << "Ошибка удаления категории и её подкатегорий:" << query.lastError();
             return false;
         }
@@ -118,7 +119,7 @@ bool CategoryManager::deleteCategory(int categoryId, bool deleteAll) {
         query.prepare("SELECT parent_id FROM category WHERE category_id = :categoryId");
         query.bindValue(":categoryId", categoryId);
 
-        if (!query.exec() || !query.next()) {
+        if (!QUERY_EXEC(query) || !query.next()) {
             qDebug() << "Ошибка получения родительской категории:" << query.lastError();
             return false;
         }
@@ -130,7 +131,7 @@ bool CategoryManager::deleteCategory(int categoryId, bool deleteAll) {
         query.bindValue(":parentId", parentId);
         query.bindValue(":categoryId", categoryId);
 
-        if (!query.exec()) {
+        if (!QUERY_EXEC(query)) {
             qDebug() << "Ошибка перемещения шаблонов в родительскую категорию:" << query.lastError();
             return false;
         }
@@ -140,7 +141,7 @@ bool CategoryManager::deleteCategory(int categoryId, bool deleteAll) {
         query.bindValue(":parentId", parentId);
         query.bindValue(":categoryId", categoryId);
 
-        if (!query.exec()) {
+        if (!QUERY_EXEC(query)) {
             qDebug() << "Ошибка перемещения подкатегорий в родительскую категорию:" << query.lastError();
             return false;
         }
@@ -149,7 +150,7 @@ bool CategoryManager::deleteCategory(int categoryId, bool deleteAll) {
         query.prepare("DELETE FROM category WHERE category_id = :categoryId");
         query.bindValue(":categoryId", categoryId);
 
-        if (!query.exec()) {
+        if (!QUERY_EXEC(query)) {
             qDebug() << "Ошибка удаления категории:" << query.lastError();
             return false;
         }
@@ -164,7 +165,7 @@ QVector<Category> CategoryManager::getCategoriesByProject(int projectId) const {
     query.prepare("SELECT category_id, name, parent_id, position, depth, project_id FROM category WHERE project_id = :projectId ORDER BY position");
     query.bindValue(":projectId", projectId);
 
-    if (!query.exec()) {
+    if (!QUERY_EXEC(query)) {
         qDebug() << "Ошибка загрузки категорий:" << query.lastError().text();
         return categories;
     }
@@ -197,7 +198,7 @@ QVector<Category> CategoryManager::getCategoriesByProjectAndParent(int projectId
     }
     query.bindValue(":projectId", projectId);
 
-    if (!query.exec()) {
+    if (!QUERY_EXEC(query)) {
         qDebug() << "Ошибка загрузки категорий:" << query.lastError().text();
         return categories;
     }
@@ -236,7 +237,7 @@ bool CategoryManager::updateCategoryFields(int categoryId,
     if (newPosition) q.bindValue(":pos", *newPosition);
     if (newDepth)    q.bindValue(":depth", *newDepth);
 
-    if (!q.exec()) {
+    if (!QUERY_EXEC(q)) {
         qDebug() << "Ошибка updateCategoryFields:" << q.lastError().text();
         return false;
     }
@@ -247,7 +248,7 @@ QString CategoryManager::getCategoryName(int categoryId) const {
     QSqlQuery q(db);
     q.prepare("SELECT name FROM category WHERE category_id = :id");
     q.bindValue(":id", categoryId);
-    if (!q.exec()) {
+    if (!QUERY_EXEC(q)) {
         qDebug() << "getCategoryName: SQL error:" << q.lastError().text();
         return QString();
     }
@@ -256,3 +257,25 @@ QString CategoryManager::getCategoryName(int categoryId) const {
     }
     return QString();
 }
+
+std::optional<Category> CategoryManager::getCategory(int categoryId) const {
+    QSqlQuery q(db);
+    q.prepare("SELECT category_id, name, parent_id, position, depth, project_id "
+              "FROM category WHERE category_id = :id");
+    q.bindValue(":id", categoryId);
+    if (!QUERY_EXEC(q)) {
+        qDebug() << "getCategory: SQL error:" << q.lastError().text();
+        return std::nullopt;
+    }
+    if (!q.next())
+        return std::nullopt;
+
+    Category category;
+    category.categoryId = q.value(0).toInt();
+    category.name       = q.value(1).toString();
+    category.parentId   = q.value(2).isNull() ? -1 : q.value(2).toInt();
+    category.position   = q.value(3).toInt();
+    category.depth      = q.value(4).toInt();
+    category.projectId  = q.value(5).toInt();
+    return category;
+}
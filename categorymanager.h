@@ -4,6 +4,7 @@
 #include <QVector>
 #include <QString>
 #include <QSqlDatabase>
+#include <optional>
 
 struct Category {
     int categoryId;
@@ -27,6 +28,7 @@ public:
     QVector<Category> getCategoriesByProjectAndParent(int projectId, const QVariant &parentId);
 
     QString getCategoryName(int categoryId) const;
+    std::optional<Category> getCategory(int categoryId) const;     // parentId = -1 у корневых
 
     bool updateCategoryFields(int categoryId,
                               std::optional<int> newParentId,
@@ -71,3 +71,27 @@ void DeleteColumnCommand::undo() {
     }
     panel->saveTableData();
 }
+
+ReplaceTextCommand::ReplaceTextCommand(ReplaceManager *manager,
+                                       QVector<ReplaceChange> changes,
+                                       const QString &find,
+                                       const QString &replacement,
+                                       QUndoCommand *parent)
+    : QUndoCommand(parent),
+    manager(manager),
+    changes(std::move(changes))
+{
+    setText(QObject::tr("Replace \"%1\" with \"%2\"").arg(find, replacement));
+}
+
+void ReplaceTextCommand::redo() {
+    if (applied)
+        return;
+    applied = manager->apply(changes, false);
+}
+
+void ReplaceTextCommand::undo() {
+    if (!applied)
+        return;
+    applied = !manager->apply(changes, true);
+}
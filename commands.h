@@ -5,6 +5,7 @@
 #include <QString>
 #include <QUndoCommand>
 #include <QVector>
+#include "replacemanager.h"
 
 struct CellData {
     int row, col;
@@ -52,4 +53,23 @@ private:
     QVector<CellData> backupCol;
 };
 
+// Замена текста по всему проекту. Сама замена уже выполнена
+// ReplaceManager::replaceAll(); команда хранит старые и новые значения
+class ReplaceTextCommand : public QUndoCommand {
+public:
+    ReplaceTextCommand(ReplaceManager *manager,
+                       QVector<ReplaceChange> changes,
+                       const QString &find,
+                       const QString &replacement,
+                       QUndoCommand *parent = nullptr);
+
+    void redo() override;
+    void undo() override;
+
+private:
+    ReplaceManager *manager;
+    QVector<ReplaceChange> changes;
+    bool applied = true;            // первый redo() при push() - пропускаем
+};
+
 #endif // COMMANDS_H
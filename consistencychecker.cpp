@@ -0,0 +1,434 @@
+#include "consistencychecker.h"
+#include "projectsnapshot.h"
+#include "templatemanager.h"
+#include "htmlscanner.h"
+#include "querystats.h"
+#include "sqldialect.h"
+#include <QtConcurrent>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QHash>
+#include <QSet>
+#include <QDebug>
+#include <algorithm>
+#include <climits>
+#include <functional>
+
+using Kind = ConsistencyIssue::Kind;
+
+namespace {
+
+quint64 cellKey(int row, int col) {
+    return (quint64(quint32(row)) << 32) | quint32(col);
+}
+
+// Перенумерация занятых индексов в 1..N. Переносятся только индексы
+// с ячейками; строки, целиком закрытые объединением, лишь держат место.
+// Перенос вверх (from < to) идёт с конца, вниз - с начала: цель всегда свободна
+QVector<QPair<int, int>> compaction(const QVector<int> &occupied, const QSet<int> &withCells) {
+    QVector<QPair<int, int>> up, down;
+    for (int i = 0; i < occupied.size(); ++i) {
+        const int from = occupied[i];
+        const int to = i + 1;
+        if (from == to || !withCells.contains(from))
+            continue;
+        (from < to ? up : down).append({from, to});
+    }
+    std::reverse(up.begin(), up.end());
+    return up + down;
+}
+
+} // namespace
+
+int ConsistencyReport::repairableCount() const {
+    return int(std::count_if(issues.cbegin(), issues.cend(),
+                             [](const ConsistencyIssue &i) { return i.repairable; }));
+}
+
+ConsistencyChecker::ConsistencyChecker(QSqlDatabase &db) : db(db) {}
+
+ConsistencyChecker::~ConsistencyChecker() {}
+
+QString ConsistencyChecker::kindName(Kind kind) {
+    switch (kind) {
+    case Kind::SpanOverlap:       return QStringLiteral("Overlapping merge");
+    case Kind::SpanOutOfBounds:   return QStringLiteral("Merge outside the table");
+    case Kind::SpanMarkers:       return QStringLiteral("Stale merge markers");
+    case Kind::IndexGap:          return QStringLiteral("Row/column numbering gap");
+    case Kind::HeaderInterleaved: return QStringLiteral("Header below content");
+    case Kind::CategoryPosition:  return QStringLiteral("Category numbering");
+    case Kind::TemplatePosition:  return QStringLiteral("Duplicate position");
+    case Kind::CategoryDepth:     return QStringLiteral("Category depth");
+    case Kind::OrphanGraph:       return QStringLiteral("Orphaned graph record");
+    case Kind::DuplicateGraph:    return QStringLiteral("Duplicate graph records");
+    }
+    return QString();
+}
+
+bool ConsistencyChecker::check(int projectId, ConsistencyReport &report) {
+    report = ConsistencyReport();
+    ProjectSnapshot snapshot;
+    if (!snapshot.load(db, projectId, ProjectSnapshot::RawCells))
+        return false;
+    report.projectId = projectId;
+
+    // Дерево - отдельной задачей, пока пул разбирает шаблоны
+    auto tree = QtConcurrent::run([&snapshot]() { return checkTree(snapshot); });
+    const auto parts = QtConcurrent::blockingMapped(
+        snapshot.templateOrder(),
+        [&snapshot](int index) { return checkTemplate(snapshot.templates()[index]); });
+
+    merge(report, tree.result());
+    for (const ConsistencyReport &part : parts)
+        merge(report, part);
+    return true;
+}
+
+void ConsistencyChecker::merge(ConsistencyReport &into, const ConsistencyReport &part) {
+    into.issues        += part.issues;
+    into.spanFixes     += part.spanFixes;
+    into.remaps        += part.remaps;
+    into.categoryFixes += part.categoryFixes;
+    into.positionFixes += part.positionFixes;
+    into.orphanGraphs  += part.orphanGraphs;
+}
+
+ConsistencyReport ConsistencyChecker::checkTemplate(const SnapshotTemplate &t) {
+    ConsistencyReport r;
+    const QString where = t.path + ' ' + HtmlScanner::plainText(t.name);
+    auto add = [&](Kind kind, const QString &text, bool repairable) {
+        r.issues.append({kind, t.templateId, t.categoryId, where + ": " + text, repairable});
+    };
+
+    if (t.type == "graph") {
+        if (t.graphRows > 1)
+            add(Kind::DuplicateGraph, QString("%1 graph records instead of one").arg(t.graphRows),
+                false);
+        return r;
+    }
+    if (t.graphRows > 0) {
+        add(Kind::OrphanGraph, QString("graph record on a %1 template").arg(t.type), true);
+        r.orphanGraphs.append(t.templateId);
+    }
+    if (t.cells.isEmpty())
+        return r;
+
+    // По строкам, затем по столбцам: владельцы объединений в порядке чтения
+    QVector<SnapshotCell> cells = t.cells;
+    std::sort(cells.begin(), cells.end(), [](const SnapshotCell &a, const SnapshotCell &b) {
+        return a.row != b.row ? a.row < b.row : a.col < b.col;
+    });
+
+    int maxRow = INT_MIN, maxCol = INT_MIN;
+    int maxHeader = INT_MIN, minContent = INT_MAX;
+    QSet<int> rowsWithCells, colsWithCells;
+    for (const SnapshotCell &c : cells) {
+        maxRow = qMax(maxRow, c.row);
+        maxCol = qMax(maxCol, c.col);
+        rowsWithCells.insert(c.row);
+        colsWithCells.insert(c.col);
+        if (c.header)
+            maxHeader = qMax(maxHeader, c.row);
+        else
+            minContent = qMin(minContent, c.row);
+    }
+
+    // Заголовок должен быть целиком выше содержимого: строка с ячейками
+    // обоих типов тоже сюда попадает
+    if (maxHeader != INT_MIN && minContent != INT_MAX && maxHeader >= minContent)
+        add(Kind::HeaderInterleaved,
+            QString("header row %1 is not above content row %2").arg(maxHeader).arg(minContent),
+            false);
+
+    // Объединения принимаются в порядке чтения. Задевшее уже принятое
+    // снимается, вылезающее за таблицу обрезается - так его показывает GridStore
+    QHash<quint64, QPair<int, int>> accepted;     // владелец -> (rowSpan, colSpan)
+    QSet<quint64> covered;
+    QSet<int> coveredRows, coveredCols;
+    for (const SnapshotCell &c : cells) {
+        if (c.rowSpan < 1 || c.colSpan < 1 || (c.rowSpan == 1 && c.colSpan == 1))
+            continue;
+        int rs = c.rowSpan;
+        int cs = c.colSpan;
+        if (c.row + rs - 1 > maxRow || c.col + cs - 1 > maxCol) {
+            rs = qMin(rs, maxRow - c.row + 1);
+            cs = qMin(cs, maxCol - c.col + 1);
+            add(Kind::SpanOutOfBounds,
+                QString("merge at row %1, column %2 is cut to %3x%4")
+                    .arg(c.row).arg(c.col).arg(rs).arg(cs),
+                true);
+            if (rs == 1 && cs == 1)
+                continue;
+        }
+
+        bool free = true;
+        for (int dr = 0; dr < rs && free; ++dr)
+            for (int dc = 0; dc < cs && free; ++dc)
+                free = !covered.contains(cellKey(c.row + dr, c.col + dc));
+        if (!free) {
+            add(Kind::SpanOverlap,
+                QString("merge at row %1, column %2 (%3x%4) overlaps another merge and is removed")
+                    .arg(c.row).arg(c.col).arg(c.rowSpan).arg(c.colSpan),
+                true);
+            continue;
+        }
+        for (int dr = 0; dr < rs; ++dr) {
+            coveredRows.insert(c.row + dr);
+            for (int dc = 0; dc < cs; ++dc)
+                covered.insert(cellKey(c.row + dr, c.col + dc));
+        }
+        for (int dc = 0; dc < cs; ++dc)
+            coveredCols.insert(c.col + dc);
+        accepted.insert(cellKey(c.row, c.col), {rs, cs});
+    }
+
+    // Метки ячеек: владелец - свой размер, закрытая - 0/0, остальные - 1/1
+    int staleMarkers = 0;
+    for (const SnapshotCell &c : cells) {
+        const quint64 key = cellKey(c.row, c.col);
+        QPair<int, int> want(1, 1);
+        const auto own = accepted.constFind(key);
+        if (own != accepted.cend())
+            want = *own;
+        else if (covered.contains(key))
+            want = {0, 0};
+        if (c.rowSpan == want.first && c.colSpan == want.second)
+            continue;
+        r.spanFixes.append({t.templateId, c.header, c.row, c.col, want.first, want.second});
+        // о снятых и обрезанных владельцах уже сказано выше
+        if (c.rowSpan <= 1 && c.colSpan <= 1)
+            ++staleMarkers;
+    }
+    if (staleMarkers > 0)
+        add(Kind::SpanMarkers,
+            QString("%1 cells are marked as merged but belong to no merge").arg(staleMarkers), true);
+
+    // Пропуски в нумерации: индекс без ячеек и вне объединений
+    auto checkGaps = [&](bool rows) {
+        const QSet<int> &withCells = rows ? rowsWithCells : colsWithCells;
+        const QSet<int> occupiedSet = withCells + (rows ? coveredRows : coveredCols);
+        QVector<int> occupied(occupiedSet.cbegin(), occupiedSet.cend());
+        std::sort(occupied.begin(), occupied.end());
+        if (occupied.first() == 1 && occupied.last() == occupied.size())
+            return;
+        const auto moves = compaction(occupied, withCells);
+        if (moves.isEmpty())
+            return;
+        add(Kind::IndexGap,
+            QString("%1 runs from %2 to %3 for %4 %5")
+                .arg(rows ? "row_index" : "col_index")
+                .arg(occupied.first()).arg(occupied.last()).arg(occupied.size())
+                .arg(rows ? "rows" : "columns"),
+            true);
+        r.remaps.append({t.templateId, rows, moves});
+    };
+    checkGaps(true);
+    checkGaps(false);
+    return r;
+}
+
+ConsistencyReport ConsistencyChecker::checkTree(const ProjectSnapshot &snapshot) {
+    ConsistencyReport r;
+    const auto &cats = snapshot.categories();
+    const auto &tmpls = snapshot.templates();
+
+    // Подкатегории и шаблоны делят одну нумерацию родителя (createCategory и
+    // createTemplate берут MAX по обоим) - проверяется общий список: 1..N без
+    // повторов. При равных position категория идёт раньше шаблона
+    struct Sibling { int position; bool category; int index; };
+    auto checkSiblings = [&](const QVector<int> &children, const QVector<int> &templates,
+                             int parentId, const QString &where) {
+        QVector<Sibling> siblings;
+        for (int child : children)
+            siblings.append({cats[child].position, true, child});
+        for (int t : templates)
+            siblings.append({tmpls[t].position, false, t});
+        std::stable_sort(siblings.begin(), siblings.end(),
+                         [](const Sibling &a, const Sibling &b) { return a.position < b.position; });
+
+        bool ok = true, duplicates = false;
+        for (int i = 0; i < siblings.size(); ++i) {
+            ok = ok && siblings[i].position == i + 1;
+            duplicates = duplicates || (i > 0 && siblings[i].position == siblings[i - 1].position);
+        }
+        if (ok)
+            return;
+        // Повтор делает порядок, а с ним и путь экспорта, неопределённым
+        r.issues.append({duplicates ? Kind::TemplatePosition : Kind::CategoryPosition, -1, parentId,
+                         where + (duplicates
+                                      ? QString(": several items share a position")
+                                      : QString(": categories and templates are not numbered 1 to %1")
+                                            .arg(siblings.size())),
+                         true});
+        for (int i = 0; i < siblings.size(); ++i) {
+            const Sibling &s = siblings[i];
+            if (s.position == i + 1)
+                continue;
+            if (s.category)
+                r.categoryFixes.append({cats[s.index].categoryId, i + 1, -1});
+            else
+                r.positionFixes.append({tmpls[s.index].templateId, i + 1});
+        }
+    };
+
+    std::function<void(int, int)> walk = [&](int index, int depth) {
+        const SnapshotCategory &cat = cats[index];
+        const QString where = cat.path + ' ' + HtmlScanner::plainText(cat.name);
+        if (cat.depth != depth) {
+            r.issues.append({Kind::CategoryDepth, -1, cat.categoryId,
+                             where + QString(": depth is %1, expected %2").arg(cat.depth).arg(depth),
+                             true});
+            r.categoryFixes.append({cat.categoryId, -1, depth});
+        }
+
+        checkSiblings(cat.children, cat.templates, cat.categoryId, where);
+        for (int child : cat.children)
+            walk(child, depth + 1);
+    };
+
+    checkSiblings(snapshot.roots(), {}, -1, QStringLiteral("Project"));
+    for (int root : snapshot.roots())
+        walk(root, 0);
+    return r;
+}
+
+int ConsistencyChecker::repair(const ConsistencyReport &stale) {
+    if (stale.repairableCount() == 0)
+        return 0;
+    if (!db.transaction()) {
+        qDebug() << "ConsistencyChecker: не удалось начать транзакцию" << db.lastError();
+        return -1;
+    }
+    auto fail = [&](const QSqlQuery &q, const char *what) {
+        qDebug() << "ConsistencyChecker::repair:" << what << q.lastError().text();
+        db.rollback();
+        return -1;
+    };
+
+    // Между проверкой и правкой проект могли изменить. В PostgreSQL строки
+    // категорий и шаблонов блокируются до COMMIT (правки шаблонов ждут на
+    // claimVersion), SQLite пишет и так по одному; затем проверка повторяется
+    if (!SqlDialect::isSqlite(db)) {
+        QSqlQuery lock(db);
+        lock.prepare("SELECT 1 FROM category WHERE project_id = ? FOR UPDATE");
+        lock.addBindValue(stale.projectId);
+        if (!QUERY_EXEC(lock))
+            return fail(lock, "lock categories");
+        lock.prepare("SELECT 1 FROM template WHERE category_id IN "
+                     "(SELECT category_id FROM category WHERE project_id = ?) FOR UPDATE");
+        lock.addBindValue(stale.projectId);
+        if (!QUERY_EXEC(lock))
+            return fail(lock, "lock templates");
+    }
+    ConsistencyReport report;
+    if (!check(stale.projectId, report)) {
+        db.rollback();
+        return -1;
+    }
+    // Применяются исправления свежей проверки, но только если она нашла то
+    // же, что видел пользователь: иначе он подтверждал другой список
+    auto descriptions = [](const ConsistencyReport &r) {
+        QStringList list;
+        for (const ConsistencyIssue &issue : r.issues)
+            list << issue.description;
+        return list;
+    };
+    if (descriptions(report) != descriptions(stale)) {
+        qDebug() << "ConsistencyChecker::repair: проект изменился после проверки";
+        db.rollback();
+        return -1;
+    }
+    const int fixable = report.repairableCount();
+
+    QSet<int> touched;
+
+    // Ячейки копии (duplicateTemplate) проверка видела у владельца, а правка
+    // идёт по template_id - сначала каждый шаблон получает собственные
+    QSet<int> cellTemplates;
+    for (const auto &f : report.spanFixes)
+        cellTemplates.insert(f.templateId);
+    for (const auto &m : report.remaps)
+        cellTemplates.insert(m.templateId);
+    for (int tid : std::as_const(cellTemplates)) {
+        if (!TemplateManager::materializeContent(db, tid)) {
+            db.rollback();
+            return -1;
+        }
+    }
+
+    // 1. Метки объединений - по индексам, какими их видела проверка
+    QSqlQuery span(db);
+    span.prepare("UPDATE grid_cells SET row_span = ?, col_span = ? "
+                 "WHERE template_id = ? AND cell_type = ? AND row_index = ? AND col_index = ?");
+    for (const auto &f : report.spanFixes) {
+        span.bindValue(0, f.rowSpan);
+        span.bindValue(1, f.colSpan);
+        span.bindValue(2, f.templateId);
+        span.bindValue(3, f.header ? "header" : "content");
+        span.bindValue(4, f.row);
+        span.bindValue(5, f.col);
+        if (!QUERY_EXEC(span))
+            return fail(span, "span");
+        touched.insert(f.templateId);
+    }
+
+    // 2. Перенумерация строк и столбцов
+    QSqlQuery moveRow(db), moveCol(db);
+    moveRow.prepare("UPDATE grid_cells SET row_index = ? WHERE template_id = ? AND row_index = ?");
+    moveCol.prepare("UPDATE grid_cells SET col_index = ? WHERE template_id = ? AND col_index = ?");
+    for (const auto &m : report.remaps) {
+        QSqlQuery &q = m.rows ? moveRow : moveCol;
+        for (const auto &move : m.moves) {
+            q.bindValue(0, move.second);
+            q.bindValue(1, m.templateId);
+            q.bindValue(2, move.first);
+            if (!QUERY_EXEC(q))
+                return fail(q, "remap");
+        }
+        touched.insert(m.templateId);
+    }
+
+    // 3. Дерево
+    QSqlQuery catPos(db), catDepth(db), tmplPos(db);
+    catPos.prepare("UPDATE category SET position = ? WHERE category_id = ?");
+    catDepth.prepare("UPDATE category SET depth = ? WHERE category_id = ?");
+    tmplPos.prepare("UPDATE template SET position = ? WHERE template_id = ?");
+    for (const auto &f : report.categoryFixes) {
+        QSqlQuery &q = f.position >= 0 ? catPos : catDepth;
+        q.bindValue(0, f.position >= 0 ? f.position : f.depth);
+        q.bindValue(1, f.categoryId);
+        if (!QUERY_EXEC(q))
+            return fail(q, "category");
+    }
+    for (const auto &f : report.positionFixes) {
+        tmplPos.bindValue(0, f.position);
+        tmplPos.bindValue(1, f.templateId);
+        if (!QUERY_EXEC(tmplPos))
+            return fail(tmplPos, "template position");
+    }
+
+    // 4. Лишние строки graph
+    QSqlQuery graph(db);
+    graph.prepare("DELETE FROM graph WHERE template_id = ?");
+    for (int templateId : report.orphanGraphs) {
+        graph.bindValue(0, templateId);
+        if (!QUERY_EXEC(graph))
+            return fail(graph, "graph");
+    }
+
+    // Открытые редакторы шаблонов увидят конфликт версии, а не старую сетку
+    for (int templateId : std::as_const(touched)) {
+        if (!TemplateManager::claimVersion(db, templateId)) {
+            qDebug() << "ConsistencyChecker::repair: не удалось обновить версию" << templateId;
+            db.rollback();
+            return -1;
+        }
+    }
+
+    if (!db.commit()) {
+        qDebug() << "ConsistencyChecker::repair: commit" << db.lastError();
+        db.rollback();
+        return -1;
+    }
+    return fixable;
+}
@@ -0,0 +1,89 @@
+#ifndef CONSISTENCYCHECKER_H
+#define CONSISTENCYCHECKER_H
+
+#include <QVector>
+#include <QString>
+#include <QPair>
+#include <QSqlDatabase>
+
+class ProjectSnapshot;
+struct SnapshotTemplate;
+
+struct ConsistencyIssue {
+    enum class Kind {
+        SpanOverlap,          // объединение пересекает другое
+        SpanOutOfBounds,      // объединение выходит за последнюю строку/столбец
+        SpanMarkers,          // метки 0/0 закрытых ячеек не совпадают с объединениями
+        IndexGap,             // пропуски в row_index / col_index
+        HeaderInterleaved,    // строки заголовка ниже строк содержимого
+        CategoryPosition,     // номера подкатегорий и шаблонов родителя не 1..N
+        TemplatePosition,     // одинаковые position у детей одного родителя
+        CategoryDepth,        // depth не равен глубине в дереве
+        OrphanGraph,          // строка graph у шаблона, который не график
+        DuplicateGraph        // у графика несколько строк graph
+    };
+
+    Kind    kind;
+    int     templateId = -1;
+    int     categoryId = -1;
+    QString description;
+    bool    repairable = false;
+};
+
+// Итог проверки проекта. Исправления собирают сами проверки;
+// применяет их ConsistencyChecker::repair()
+class ConsistencyReport {
+public:
+    int projectId = -1;
+    QVector<ConsistencyIssue> issues;
+
+    bool isClean() const { return issues.isEmpty(); }
+    int repairableCount() const;
+
+private:
+    friend class ConsistencyChecker;
+
+    // Индексы ячеек - как в базе, до перенумерации
+    struct SpanFix      { int templateId; bool header; int row; int col; int rowSpan; int colSpan; };
+    struct IndexRemap   { int templateId; bool rows; QVector<QPair<int, int>> moves; };  // в порядке применения
+    struct CategoryFix  { int categoryId; int position; int depth; };                    // -1 - не менять
+    struct PositionFix  { int templateId; int position; };
+
+    QVector<SpanFix>     spanFixes;
+    QVector<IndexRemap>  remaps;
+    QVector<CategoryFix> categoryFixes;
+    QVector<PositionFix> positionFixes;
+    QVector<int>         orphanGraphs;     // template_id
+};
+
+// Проверка целостности проекта перед экспортом.
+//
+// Проект загружается снимком (ProjectSnapshot::RawCells, индексы как в базе),
+// дальше проверки шаблонов идут параллельно в пуле QtConcurrent, а проверка
+// дерева категорий - отдельной задачей рядом с ними. База во время проверки
+// не трогается; repair() повторяет проверку в своей транзакции и применяет
+// её исправления
+class ConsistencyChecker {
+public:
+    explicit ConsistencyChecker(QSqlDatabase &db);
+    ~ConsistencyChecker();
+
+    // false - проект не загрузился (report пуст)
+    bool check(int projectId, ConsistencyReport &report);
+
+    // Исправить всё, что можно; число исправленных проблем или -1.
+    // -1 и тогда, когда проект изменился и report уже не совпадает с базой
+    int repair(const ConsistencyReport &report);
+
+    static QString kindName(ConsistencyIssue::Kind kind);
+
+private:
+    // Проверки работают только со снимком и могут идти в разных потоках
+    static ConsistencyReport checkTemplate(const SnapshotTemplate &t);
+    static ConsistencyReport checkTree(const ProjectSnapshot &snapshot);
+    static void merge(ConsistencyReport &into, const ConsistencyReport &part);
+
+    QSqlDatabase &db;
+};
+
+#endif // CONSISTENCYCHECKER_H
@@ -1,8 +1,15 @@
 #include "databasehandler.h"
+#include "schemamigrator.h"
 #include <QSqlQuery>
 #include <QSqlError>
+#include <QRegularExpression>
 #include <QCoreApplication>
 #include <QMessageBox>
+#include <QThread>
+#include <QStandardPaths>
+#include <QDir>
+#include <QCryptographicHash>
+#include <utility>
 
 DatabaseHandler::DatabaseHandler(const QString &host, int port,
                                  const QString &dbName,
@@ -23,28 +30,62 @@ DatabaseHandler::DatabaseHandler(const QString &host, int port,
     db.setPassword(password);
     //db.setConnectOptions("requiressl=1");
 
-    // Инициализация менеджеров
-    projectManager  = new ProjectManager(db);
-    categoryManager = new CategoryManager(db);
-    templateManager = new TemplateManager(db);
-    tableManager    = new TableManager(db);
+    createManagers();
+}
+
+DatabaseHandler::DatabaseHandler(const QString &sqliteFile, QObject *parent)
+    : QObject(parent) {
+    const QString driver = SqlDialect::driverName(DbBackend::Sqlite);
+    if (QSqlDatabase::contains("main_connection")
+        && QSqlDatabase::database("main_connection", false).driverName() == driver) {
+        db = QSqlDatabase::database("main_connection", false);
+    } else {
+        if (QSqlDatabase::contains("main_connection"))
+            QSqlDatabase::removeDatabase("main_connection");
+        db = QSqlDatabase::addDatabase(driver, "main_connection");
+    }
+
+    db.setDatabaseName(sqliteFile);
+    db.setConnectOptions("QSQLITE_BUSY_TIMEOUT=5000");
+
+    createManagers();
 }
 
 
 DatabaseHandler::DatabaseHandler(QSqlDatabase &db, QObject *parent)
     : QObject(parent), db(db) {
 
-    projectManager = new ProjectManager(db);
+    createManagers();
+}
+
+void DatabaseHandler::createManagers() {
+    notifyTimer.setSingleShot(true);
+    notifyTimer.setInterval(150);
+    connect(&notifyTimer, &QTimer::timeout, this, &DatabaseHandler::flushNotifications);
+
+    // Менеджеры держат ссылку на db и не зависят от выбранного бэкенда
+    projectManager  = new ProjectManager(db);
     categoryManager = new CategoryManager(db);
     templateManager = new TemplateManager(db);
-    tableManager = new TableManager(db);
+    tableManager    = new TableManager(db);
+    searchManager   = new SearchManager(db);
+    replaceManager  = new ReplaceManager(db);
+    importManager   = new ImportManager(db);
+    consistencyChecker = new ConsistencyChecker(db);
+    versionManager  = new VersionManager(db);
 }
 
 DatabaseHandler::~DatabaseHandler() {
+    stopReplicaSync();
     delete projectManager;
     delete categoryManager;
     delete templateManager;
     delete tableManager;
+    delete searchManager;
+    delete replaceManager;
+    delete importManager;
+    delete consistencyChecker;
+    delete versionManager;
     if (db.isOpen()) {
         db.close();
     }
@@ -68,6 +109,26 @@ TableManager* DatabaseHandler::getTableManager() {
     return tableManager;
 }
 
+SearchManager* DatabaseHandler::getSearchManager() {
+    return searchManager;
+}
+
+ReplaceManager* DatabaseHandler::getReplaceManager() {
+    return replaceManager;
+}
+
+ImportManager* DatabaseHandler::getImportManager() {
+    return importManager;
+}
+
+ConsistencyChecker* DatabaseHandler::getConsistencyChecker() {
+    return consistencyChecker;
+}
+
+VersionManager* DatabaseHandler::getVersionManager() {
+    return versionManager;
+}
+
 bool DatabaseHandler::connectToDatabase() {
 
     if (!db.open()) {
@@ -75,9 +136,137 @@ bool DatabaseHandler::connectToDatabase() {
         QMessageBox::critical(nullptr, "Error", "Couldn't connect to the database: " + db.lastError().text());
         return false;
     }
+
+    // PRAGMA для SQLite, первичное создание схемы в новом файле и миграции
+    SchemaMigrator migrator(db);
+    if (!SqlDialect::configureConnection(db) || !SqlDialect::ensureSchema(db) || !migrator.migrate()) {
+        QMessageBox::critical(nullptr, "Error", "Couldn't prepare the database schema: " + db.lastError().text());
+        db.close();
+        return false;
+    }
+
+    // Проверка планов частых запросов (для разработки, включается переменной окружения)
+    if (qEnvironmentVariableIsSet("AUTOTLG_CHECK_INDEXES")) {
+        for (const QString &sql : migrator.unindexedHotQueries())
+            qWarning() << "Запрос читает таблицу без индекса:" << sql;
+    }
+
+    // Без ленты изменений приложение работает, просто без живого обновления
+    if (!SqlDialect::isSqlite(db) && !subscribeToChanges())
+        qDebug() << "Лента изменений недоступна, обновление только вручную";
+    return true;
+}
+
+bool DatabaseHandler::subscribeToChanges() {
+    // Триггеры ленты ставит миграция 009; при подключении только LISTEN
+    QSqlDriver *driver = db.driver();
+    if (!driver->hasFeature(QSqlDriver::EventNotifications))
+        return false;
+    connect(driver, &QSqlDriver::notification,
+            this, &DatabaseHandler::onNotification, Qt::UniqueConnection);
+    return driver->subscribedToNotifications().contains(ChangeChannel)
+        || driver->subscribeToNotification(ChangeChannel);
+}
+
+void DatabaseHandler::onNotification(const QString &name, QSqlDriver::NotificationSource source,
+                                     const QVariant &payload) {
+    if (name != ChangeChannel || source == QSqlDriver::SelfSource)
+        return;         // свои изменения панели уже показали
+
+    // "<таблица>:<I|U|D>:<id>:<project_id>"
+    const QStringList parts = payload.toString().split(':');
+    if (parts.size() < 3)
+        return;
+    const QString table = parts[0];
+    const bool removed  = (parts[1] == "D");
+    const int id        = parts[2].toInt();
+    bool okProject = false;
+    const int projectId = parts.value(3).toInt(&okProject);
+
+    if (table == "grid_cells") {
+        pendingCells.insert(id);
+    } else {
+        auto &pending = (table == "category") ? pendingCategories : pendingTemplates;
+        PendingChange &ch = pending[id];
+        if (okProject)
+            ch.projectId = projectId;
+        ch.removed = removed;      // побеждает последнее событие
+    }
+    if (!notifyTimer.isActive())
+        notifyTimer.start();
+}
+
+void DatabaseHandler::flushNotifications() {
+    // Категории раньше шаблонов: шаблону нужен узел родительской категории
+    const auto categories = std::exchange(pendingCategories, {});
+    const auto templates  = std::exchange(pendingTemplates, {});
+    const auto cells      = std::exchange(pendingCells, {});
+
+    for (auto it = categories.cbegin(); it != categories.cend(); ++it)
+        emit remoteCategoryChanged(it->projectId, it.key(), it->removed);
+    for (auto it = templates.cbegin(); it != templates.cend(); ++it)
+        emit remoteTemplateChanged(it->projectId, it.key(), it->removed);
+    for (int templateId : cells) {
+        if (!templates.value(templateId).removed)
+            emit remoteCellsChanged(templateId);
+    }
+}
+
+DbBackend DatabaseHandler::backend() const {
+    return SqlDialect::backend(db);
+}
+
+QString DatabaseHandler::replicaFileFor(const RemoteParams &remote) {
+    QString key = QString("%1_%2_%3_%4").arg(remote.host).arg(remote.port)
+                      .arg(remote.dbName, remote.user);
+    key.replace(QRegularExpression("[^A-Za-z0-9_.-]"), "_");
+    return QDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation))
+        .filePath("replicas/" + key + ".db");
+}
+
+QString DatabaseHandler::cacheDirectory() const {
+    // Разные базы с одинаковыми id проектов не должны делить кэш, в том числе
+    // пересозданная база по тому же адресу - у неё другая метка (миграция 011)
+    QString epoch;
+    QSqlQuery q(db);
+    if (q.exec("SELECT epoch FROM database_epoch WHERE id = 1") && q.next())
+        epoch = q.value(0).toString();
+    const QString identity = QString("%1|%2|%3|%4|%5").arg(db.driverName(), db.hostName())
+                                 .arg(db.port()).arg(db.databaseName(), epoch);
+    const QString key = QString::fromLatin1(
+        QCryptographicHash::hash(identity.toUtf8(), QCryptographicHash::Sha1).toHex().left(16));
+    return QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation))
+        .filePath("db_" + key);
+}
+
+bool DatabaseHandler::startReplicaSync(const RemoteParams &remote) {
+    if (engine)
+        return true;
+    if (!SqlDialect::isSqlite(db) || !SyncEngine::prepareReplica(db)) {
+        QMessageBox::critical(nullptr, "Error", "Couldn't prepare the local replica: " + db.lastError().text());
+        return false;
+    }
+
+    syncThread = new QThread(this);
+    engine = new SyncEngine(db.databaseName(), remote);
+    engine->moveToThread(syncThread);
+    connect(syncThread, &QThread::started,  engine, &SyncEngine::start);
+    connect(syncThread, &QThread::finished, engine, &QObject::deleteLater);
+    syncThread->start();
     return true;
 }
 
+void DatabaseHandler::stopReplicaSync() {
+    if (!engine)
+        return;
+    // Соединения потока синхронизации закрываются в нём же
+    QMetaObject::invokeMethod(engine, &SyncEngine::stop, Qt::BlockingQueuedConnection);
+    syncThread->quit();
+    syncThread->wait();
+    engine = nullptr;
+    syncThread = nullptr;
+}
+
 void DatabaseHandler::disconnectFromDatabase() {
     QSqlDatabase db = QSqlDatabase::database();
     if (db.isOpen()) db.close();
@@ -3,10 +3,23 @@
 
 #include <QObject>
 #include <QSqlDatabase>
+#include <QSqlDriver>
+#include <QTimer>
+#include <QMap>
+#include <QSet>
 #include "projectmanager.h"
 #include "categorymanager.h"
 #include "templatemanager.h"
 #include "tablemanager.h"
+#include "searchmanager.h"
+#include "replacemanager.h"
+#include "importmanager.h"
+#include "consistencychecker.h"
+#include "versionmanager.h"
+#include "sqldialect.h"
+#include "syncengine.h"
+
+class QThread;
 
 class DatabaseHandler : public QObject {
     Q_OBJECT
@@ -16,6 +29,8 @@ public:
                              const QString &user,
                              const QString &password,
                              QObject *parent = nullptr);
+    // Локальная база SQLite в файле (работа без сервера)
+    explicit DatabaseHandler(const QString &sqliteFile, QObject *parent = nullptr);
     DatabaseHandler(QSqlDatabase &db, QObject *parent = nullptr);
     ~DatabaseHandler();
 
@@ -24,6 +39,11 @@ public:
     CategoryManager* getCategoryManager();
     TemplateManager* getTemplateManager();
     TableManager* getTableManager();
+    SearchManager* getSearchManager();
+    ReplaceManager* getReplaceManager();
+    ImportManager* getImportManager();
+    ConsistencyChecker* getConsistencyChecker();
+    VersionManager* getVersionManager();
 
     // Подключение к бд
     bool connectToDatabase();
@@ -31,12 +51,62 @@ public:
     // Отключение от бд
     void disconnectFromDatabase();
 
+    DbBackend backend() const;
+
+    // Режим локальной реплики: основное соединение открыто на файле реплики,
+    // с сервером работает только SyncEngine в отдельном потоке
+    bool startReplicaSync(const RemoteParams &remote);
+    SyncEngine* syncEngine() const { return engine; }
+    static QString replicaFileFor(const RemoteParams &remote);
+
+    // Каталог локальных кэшей этой базы (фрагменты экспорта и т.п.)
+    QString cacheDirectory() const;
+
+    // Канал LISTEN/NOTIFY с изменениями других пользователей
+    static constexpr const char *ChangeChannel = "autotlg_changes";
+
+signals:
+    // Изменения, сделанные другими клиентами (только PostgreSQL).
+    // projectId = -1, если проект неизвестен (например, каскадное удаление)
+    void remoteCategoryChanged(int projectId, int categoryId, bool removed);
+    void remoteTemplateChanged(int projectId, int templateId, bool removed);
+    void remoteCellsChanged(int templateId);
+
+private slots:
+    void onNotification(const QString &name, QSqlDriver::NotificationSource source,
+                        const QVariant &payload);
+    void flushNotifications();
+
 private:
+    bool subscribeToChanges();
+
+    // Уведомления копятся и отправляются пачкой: сохранение шаблона
+    // или перенумерация дерева приходят десятками подряд
+    struct PendingChange {
+        int  projectId = -1;
+        bool removed   = false;
+    };
+    QMap<int, PendingChange> pendingCategories;
+    QMap<int, PendingChange> pendingTemplates;
+    QSet<int>                pendingCells;
+    QTimer                   notifyTimer;
+
+    void createManagers();
+    void stopReplicaSync();
+
+    QThread    *syncThread = nullptr;
+    SyncEngine *engine = nullptr;
+
     QSqlDatabase db;
     ProjectManager *projectManager;
     CategoryManager *categoryManager;
     TemplateManager *templateManager;
     TableManager *tableManager;
+    SearchManager *searchManager;
+    ReplaceManager *replaceManager;
+    ImportManager *importManager;
+    ConsistencyChecker *consistencyChecker;
+    VersionManager *versionManager;
 };
 
 #endif // DATABASEHANDLER_H
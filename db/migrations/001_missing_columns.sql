@@ -0,0 +1,14 @@
+-- Столбцы, которые код использует, но которых нет в начальной схеме.
+-- ADD COLUMN пропускается, если столбец уже есть (см. SchemaMigrator).
+
+ALTER TABLE project ADD COLUMN study TEXT;
+ALTER TABLE project ADD COLUMN sponsor TEXT;
+ALTER TABLE project ADD COLUMN cut_date DATE;
+ALTER TABLE project ADD COLUMN version TEXT;
+
+ALTER TABLE template ADD COLUMN approved BOOLEAN NOT NULL DEFAULT FALSE;
+ALTER TABLE template ADD COLUMN related_template_id INTEGER NULL
+    REFERENCES template(template_id) ON DELETE SET NULL;
+
+-- Версия для оптимистичной блокировки (TemplateManager::claimVersion)
+ALTER TABLE template ADD COLUMN version INTEGER NOT NULL DEFAULT 1;
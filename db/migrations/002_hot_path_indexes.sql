@@ -0,0 +1,22 @@
+-- Индексы под запросы менеджеров; первичные ключи покрывают остальное
+-- (grid_cells: template_id, cell_type, row_index, col_index).
+
+-- Дерево проекта: корневые категории и сортировка (CategoryManager)
+CREATE INDEX IF NOT EXISTS idx_category_project_parent_position
+    ON category (project_id, parent_id, position);
+
+-- Подкатегории, рекурсивное удаление и каскад ON DELETE по parent_id
+CREATE INDEX IF NOT EXISTS idx_category_parent
+    ON category (parent_id);
+
+-- Шаблоны категории в порядке дерева (TemplateManager::getTemplatesForCategory)
+CREATE INDEX IF NOT EXISTS idx_template_category_position
+    ON template (category_id, position);
+
+-- ON DELETE SET NULL для связанных шаблонов
+CREATE INDEX IF NOT EXISTS idx_template_related
+    ON template (related_template_id);
+
+-- Изображение графика по шаблону и каскадное удаление
+CREATE INDEX IF NOT EXISTS idx_graph_template
+    ON graph (template_id);
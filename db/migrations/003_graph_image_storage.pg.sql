@@ -0,0 +1,7 @@
+-- Изображения графиков читаются кусками (BlobReader: substring(image FROM ? FOR ?)).
+-- EXTERNAL = TOAST без сжатия: substring читает только нужные страницы,
+-- а PNG/JPEG всё равно уже сжаты. Действует для новых и перезаписанных значений.
+-- В SQLite аналога нет, миграция только для PostgreSQL.
+
+ALTER TABLE graph ALTER COLUMN image SET STORAGE EXTERNAL;
+ALTER TABLE graph_library ALTER COLUMN image SET STORAGE EXTERNAL;
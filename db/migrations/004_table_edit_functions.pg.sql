@@ -0,0 +1,188 @@
+-- Структурные правки таблицы шаблона на сервере: один вызов вместо цепочки
+-- SELECT + UPDATE/INSERT из клиента. Логика повторяет TableManager (C++ путь
+-- остаётся для SQLite). Каждая функция выполняется атомарно и увеличивает
+-- template.version, как TemplateManager::claimVersion() в EditTransaction на
+-- клиенте - поэтому этот путь завершает её через commit(false).
+--
+-- Сдвиг строк/столбцов делается в два шага через отрицательные индексы:
+-- одним UPDATE ... SET row_index = row_index + 1 первичный ключ нарушился бы
+-- на промежуточных строках.
+
+CREATE OR REPLACE FUNCTION autotlg_touch_template(p_tid INT) RETURNS VOID AS $$
+BEGIN
+    UPDATE template SET version = version + 1 WHERE template_id = p_tid;
+END;
+$$ LANGUAGE plpgsql;
+
+-- Имя столбца из HTML заголовка: без тегов, &nbsp; -> пробел,
+-- последняя непустая строка, пробелы сжаты
+CREATE OR REPLACE FUNCTION autotlg_header_name(p_html TEXT) RETURNS TEXT AS $$
+DECLARE
+    lines TEXT[];
+    i     INT;
+BEGIN
+    lines := regexp_split_to_array(
+                 replace(regexp_replace(COALESCE(p_html, ''), '<[^>]*>', '', 'g'), chr(160), ' '),
+                 '[\r\n]+');
+    FOR i IN REVERSE COALESCE(array_length(lines, 1), 0)..1 LOOP
+        IF lines[i] <> '' THEN
+            RETURN btrim(regexp_replace(lines[i], '\s+', ' ', 'g'));
+        END IF;
+    END LOOP;
+    RETURN '';
+END;
+$$ LANGUAGE plpgsql IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION autotlg_insert_row(p_tid INT, p_before INT, p_header BOOLEAN,
+                                              p_content TEXT) RETURNS BOOLEAN AS $$
+BEGIN
+    UPDATE grid_cells SET row_index = -(row_index + 1)
+     WHERE template_id = p_tid AND row_index >= p_before;
+    UPDATE grid_cells SET row_index = -row_index
+     WHERE template_id = p_tid AND row_index < 0;
+
+    -- Для header-строки текст только в первом столбце
+    INSERT INTO grid_cells (template_id, cell_type, row_index, col_index, content)
+    SELECT p_tid, CASE WHEN p_header THEN 'header' ELSE 'content' END, p_before, d.col_index,
+           CASE WHEN p_header AND d.col_index = d.first_col THEN p_content END
+      FROM (SELECT col_index, MIN(col_index) OVER () AS first_col
+              FROM (SELECT DISTINCT col_index FROM grid_cells WHERE template_id = p_tid) c) d;
+
+    PERFORM autotlg_touch_template(p_tid);
+    RETURN TRUE;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE OR REPLACE FUNCTION autotlg_insert_column(p_tid INT, p_before INT,
+                                                 p_content TEXT) RETURNS BOOLEAN AS $$
+BEGIN
+    UPDATE grid_cells SET col_index = -(col_index + 1)
+     WHERE template_id = p_tid AND col_index >= p_before;
+    UPDATE grid_cells SET col_index = -col_index
+     WHERE template_id = p_tid AND col_index < 0;
+
+    -- Новая ячейка в каждой строке; текст - только в самой верхней header-ячейке
+    INSERT INTO grid_cells (template_id, cell_type, row_index, col_index, content)
+    SELECT p_tid, d.cell_type, d.row_index, p_before,
+           CASE WHEN d.cell_type = 'header' AND d.row_index = d.first_row THEN p_content END
+      FROM (SELECT row_index, cell_type, MIN(row_index) OVER () AS first_row
+              FROM (SELECT DISTINCT row_index, cell_type
+                      FROM grid_cells WHERE template_id = p_tid) c) d;
+
+    PERFORM autotlg_touch_template(p_tid);
+    RETURN TRUE;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE OR REPLACE FUNCTION autotlg_merge_cells(p_tid INT, p_type TEXT, p_row INT, p_col INT,
+                                               p_rs INT, p_cs INT) RETURNS BOOLEAN AS $$
+BEGIN
+    -- Прежние объединения внутри области поглощаются, задетые частично - ошибка
+    IF EXISTS (
+        SELECT 1 FROM grid_cells o
+         WHERE o.template_id = p_tid
+           AND (o.row_span > 1 OR o.col_span > 1)
+           AND o.row_index <= p_row + p_rs - 1 AND o.row_index + o.row_span - 1 >= p_row
+           AND o.col_index <= p_col + p_cs - 1 AND o.col_index + o.col_span - 1 >= p_col
+           AND NOT (o.row_index >= p_row AND o.row_index + o.row_span <= p_row + p_rs
+                    AND o.col_index >= p_col AND o.col_index + o.col_span <= p_col + p_cs)) THEN
+        RETURN FALSE;
+    END IF;
+
+    UPDATE grid_cells SET row_span = p_rs, col_span = p_cs
+     WHERE template_id = p_tid AND cell_type = p_type
+       AND row_index = p_row AND col_index = p_col;
+
+    -- Остальные ячейки области становятся «теневыми»
+    UPDATE grid_cells SET row_span = 0, col_span = 0
+     WHERE template_id = p_tid AND cell_type = p_type
+       AND row_index BETWEEN p_row AND p_row + p_rs - 1
+       AND col_index BETWEEN p_col AND p_col + p_cs - 1
+       AND NOT (row_index = p_row AND col_index = p_col);
+
+    PERFORM autotlg_touch_template(p_tid);
+    RETURN TRUE;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE OR REPLACE FUNCTION autotlg_unmerge_cells(p_tid INT, p_type TEXT, p_row INT,
+                                                 p_col INT) RETURNS BOOLEAN AS $$
+DECLARE
+    o RECORD;
+BEGIN
+    -- Объединение, в которое входит ячейка (она может быть и «внутренней»)
+    SELECT row_index, col_index, row_span, col_span INTO o
+      FROM grid_cells
+     WHERE template_id = p_tid
+       AND (row_span > 1 OR col_span > 1)
+       AND p_row BETWEEN row_index AND row_index + row_span - 1
+       AND p_col BETWEEN col_index AND col_index + col_span - 1
+     LIMIT 1;
+    IF NOT FOUND THEN
+        RETURN TRUE;                    -- объединения нет, менять нечего
+    END IF;
+
+    UPDATE grid_cells SET row_span = 1, col_span = 1
+     WHERE template_id = p_tid AND cell_type = p_type
+       AND row_index BETWEEN o.row_index AND o.row_index + o.row_span - 1
+       AND col_index BETWEEN o.col_index AND o.col_index + o.col_span - 1;
+
+    PERFORM autotlg_touch_template(p_tid);
+    RETURN TRUE;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE OR REPLACE FUNCTION autotlg_generate_group_columns(p_tid INT,
+                                                          p_names TEXT[]) RETURNS BOOLEAN AS $$
+DECLARE
+    n      INT := COALESCE(array_length(p_names, 1), 0);
+    group1 INT;
+    i      INT;
+BEGIN
+    IF n < 1 THEN
+        RETURN FALSE;
+    END IF;
+
+    -- Первая колонка, заголовок которой начинается с "group"
+    SELECT MIN(col_index) INTO group1
+      FROM grid_cells
+     WHERE template_id = p_tid AND cell_type = 'header'
+       AND lower(autotlg_header_name(content)) LIKE 'group%';
+    IF group1 IS NULL THEN
+        RETURN FALSE;
+    END IF;
+
+    -- Первая группа получает первое имя, остальные group-колонки удаляются
+    UPDATE grid_cells SET content = p_names[1]
+     WHERE template_id = p_tid AND cell_type = 'header' AND col_index = group1;
+
+    DELETE FROM grid_cells
+     WHERE template_id = p_tid
+       AND col_index IN (SELECT col_index FROM grid_cells
+                          WHERE template_id = p_tid AND cell_type = 'header'
+                            AND col_index > group1
+                            AND lower(autotlg_header_name(content)) LIKE 'group%');
+
+    -- Место под группы 2..N справа от первой
+    IF n > 1 THEN
+        UPDATE grid_cells SET col_index = -(col_index + n - 1)
+         WHERE template_id = p_tid AND col_index > group1;
+        UPDATE grid_cells SET col_index = -col_index
+         WHERE template_id = p_tid AND col_index < 0;
+    END IF;
+
+    -- Новые группы: заголовок и копия содержимого первой группы
+    FOR i IN 2..n LOOP
+        INSERT INTO grid_cells (template_id, cell_type, row_index, col_index, content)
+        VALUES (p_tid, 'header', 1, group1 + i - 1, p_names[i]);
+
+        INSERT INTO grid_cells (template_id, cell_type, row_index, col_index, content)
+        SELECT p_tid, 'content', row_index, group1 + i - 1, content
+          FROM grid_cells
+         WHERE template_id = p_tid AND cell_type = 'content' AND col_index = group1;
+    END LOOP;
+
+    PERFORM autotlg_touch_template(p_tid);
+    RETURN TRUE;
+END;
+$$ LANGUAGE plpgsql;
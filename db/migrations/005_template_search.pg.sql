@@ -0,0 +1,85 @@
+-- Полнотекстовый поиск шаблонов: имя, подзаголовок, примечания и текст
+-- ячеек без HTML. Документ шаблона хранится отдельной строкой и
+-- пересчитывается триггерами; конфигурация 'simple' - тексты смешанные
+-- (русский/английский), стемминг одного языка портил бы другой.
+-- Веса: A - имя, B - подзаголовок, C - примечания, D - ячейки.
+
+CREATE TABLE IF NOT EXISTS template_search (
+    template_id INT PRIMARY KEY REFERENCES template(template_id) ON DELETE CASCADE,
+    document    TSVECTOR NOT NULL
+);
+
+CREATE INDEX IF NOT EXISTS idx_template_search_document
+    ON template_search USING GIN (document);
+
+-- Текст из HTML QTextEdit: без <head>/<style>, тегов и основных сущностей
+CREATE OR REPLACE FUNCTION autotlg_strip_html(p_html TEXT) RETURNS TEXT AS $$
+    SELECT replace(replace(replace(replace(replace(
+               regexp_replace(
+                   regexp_replace(COALESCE(p_html, ''), '<(head|style)[^>]*>.*?</\1>', ' ', 'gi'),
+                   '<[^>]*>', ' ', 'g'),
+               '&nbsp;', ' '), chr(160), ' '), '&lt;', '<'), '&gt;', '>'), '&amp;', '&');
+$$ LANGUAGE sql IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION autotlg_refresh_search(p_tid INT) RETURNS VOID AS $$
+BEGIN
+    INSERT INTO template_search (template_id, document)
+    SELECT t.template_id,
+           setweight(to_tsvector('simple', autotlg_strip_html(t.name)), 'A')
+        || setweight(to_tsvector('simple', autotlg_strip_html(t.subtitle)), 'B')
+        || setweight(to_tsvector('simple', autotlg_strip_html(t.notes) || ' '
+                                           || autotlg_strip_html(t.programming_notes)), 'C')
+        || setweight(to_tsvector('simple',
+                         COALESCE((SELECT string_agg(autotlg_strip_html(g.content), ' ')
+                                     FROM grid_cells g
+                                    WHERE g.template_id = t.template_id), '')), 'D')
+      FROM template t
+     WHERE t.template_id = p_tid
+    ON CONFLICT (template_id) DO UPDATE SET document = EXCLUDED.document;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE OR REPLACE FUNCTION autotlg_search_template() RETURNS trigger AS $$
+BEGIN
+    PERFORM autotlg_refresh_search(NEW.template_id);
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+-- Как и уведомления: ячейки пишутся пачками, один пересчёт на шаблон
+CREATE OR REPLACE FUNCTION autotlg_search_cells() RETURNS trigger AS $$
+DECLARE
+    tid INT;
+BEGIN
+    FOR tid IN SELECT DISTINCT template_id FROM changed_rows LOOP
+        PERFORM autotlg_refresh_search(tid);
+    END LOOP;
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+DROP TRIGGER IF EXISTS autotlg_template_search ON template;
+CREATE TRIGGER autotlg_template_search
+    AFTER INSERT OR UPDATE OF name, subtitle, notes, programming_notes ON template
+    FOR EACH ROW EXECUTE FUNCTION autotlg_search_template();
+
+DROP TRIGGER IF EXISTS autotlg_cells_search_ins ON grid_cells;
+CREATE TRIGGER autotlg_cells_search_ins
+    AFTER INSERT ON grid_cells
+    REFERENCING NEW TABLE AS changed_rows
+    FOR EACH STATEMENT EXECUTE FUNCTION autotlg_search_cells();
+
+DROP TRIGGER IF EXISTS autotlg_cells_search_upd ON grid_cells;
+CREATE TRIGGER autotlg_cells_search_upd
+    AFTER UPDATE ON grid_cells
+    REFERENCING NEW TABLE AS changed_rows
+    FOR EACH STATEMENT EXECUTE FUNCTION autotlg_search_cells();
+
+DROP TRIGGER IF EXISTS autotlg_cells_search_del ON grid_cells;
+CREATE TRIGGER autotlg_cells_search_del
+    AFTER DELETE ON grid_cells
+    REFERENCING OLD TABLE AS changed_rows
+    FOR EACH STATEMENT EXECUTE FUNCTION autotlg_search_cells();
+
+-- Документы для уже существующих шаблонов
+SELECT autotlg_refresh_search(template_id) FROM template;
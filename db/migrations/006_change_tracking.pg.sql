@@ -0,0 +1,42 @@
+-- Номер последнего изменения шаблона для инкрементального экспорта:
+-- фрагмент XML из кэша годится, пока change_seq шаблона не сдвинулся.
+-- Правки ячеек сюда приходят через template.version (claimVersion, функции
+-- 004), графики меняются без шаблона - у них свой триггер.
+
+CREATE SEQUENCE IF NOT EXISTS autotlg_change_seq;
+
+ALTER TABLE template ADD COLUMN IF NOT EXISTS change_seq BIGINT NOT NULL DEFAULT 0;
+ALTER TABLE template ALTER COLUMN change_seq SET DEFAULT nextval('autotlg_change_seq');
+
+CREATE OR REPLACE FUNCTION autotlg_template_changed() RETURNS trigger AS $$
+BEGIN
+    NEW.change_seq := nextval('autotlg_change_seq');
+    RETURN NEW;
+END;
+$$ LANGUAGE plpgsql;
+
+DROP TRIGGER IF EXISTS autotlg_template_change_seq ON template;
+CREATE TRIGGER autotlg_template_change_seq
+    BEFORE UPDATE ON template
+    FOR EACH ROW
+    WHEN (OLD.* IS DISTINCT FROM NEW.*)
+    EXECUTE FUNCTION autotlg_template_changed();
+
+CREATE OR REPLACE FUNCTION autotlg_graph_changed() RETURNS trigger AS $$
+DECLARE
+    tid INT;
+BEGIN
+    IF TG_OP = 'DELETE' THEN
+        tid := OLD.template_id;
+    ELSE
+        tid := NEW.template_id;
+    END IF;
+    UPDATE template SET change_seq = nextval('autotlg_change_seq') WHERE template_id = tid;
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+DROP TRIGGER IF EXISTS autotlg_graph_change_seq ON graph;
+CREATE TRIGGER autotlg_graph_change_seq
+    AFTER INSERT OR UPDATE OR DELETE ON graph
+    FOR EACH ROW EXECUTE FUNCTION autotlg_graph_changed();
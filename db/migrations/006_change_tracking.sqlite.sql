@@ -0,0 +1,59 @@
+-- Номер последнего изменения шаблона для инкрементального экспорта
+-- (см. 006_change_tracking.pg.sql). Последовательностей в SQLite нет -
+-- счётчик хранится в одной строке change_counter. Триггер шаблона
+-- перечисляет столбцы явно: собственное обновление change_seq его не будит.
+
+ALTER TABLE template ADD COLUMN change_seq INTEGER NOT NULL DEFAULT 0;
+
+CREATE TABLE IF NOT EXISTS change_counter (
+    id    INTEGER PRIMARY KEY CHECK (id = 1),
+    value INTEGER NOT NULL
+);
+INSERT OR IGNORE INTO change_counter (id, value) VALUES (1, 0);
+
+DROP TRIGGER IF EXISTS autotlg_template_change_ins;
+CREATE TRIGGER autotlg_template_change_ins
+    AFTER INSERT ON template
+BEGIN
+    UPDATE change_counter SET value = value + 1 WHERE id = 1;
+    UPDATE template SET change_seq = (SELECT value FROM change_counter WHERE id = 1)
+     WHERE template_id = NEW.template_id;
+END;
+
+DROP TRIGGER IF EXISTS autotlg_template_change_upd;
+CREATE TRIGGER autotlg_template_change_upd
+    AFTER UPDATE OF name, subtitle, category_id, notes, programming_notes, position,
+                    is_dynamic, approved, related_template_id, template_type, version
+    ON template
+BEGIN
+    UPDATE change_counter SET value = value + 1 WHERE id = 1;
+    UPDATE template SET change_seq = (SELECT value FROM change_counter WHERE id = 1)
+     WHERE template_id = NEW.template_id;
+END;
+
+DROP TRIGGER IF EXISTS autotlg_graph_change_ins;
+CREATE TRIGGER autotlg_graph_change_ins
+    AFTER INSERT ON graph
+BEGIN
+    UPDATE change_counter SET value = value + 1 WHERE id = 1;
+    UPDATE template SET change_seq = (SELECT value FROM change_counter WHERE id = 1)
+     WHERE template_id = NEW.template_id;
+END;
+
+DROP TRIGGER IF EXISTS autotlg_graph_change_upd;
+CREATE TRIGGER autotlg_graph_change_upd
+    AFTER UPDATE ON graph
+BEGIN
+    UPDATE change_counter SET value = value + 1 WHERE id = 1;
+    UPDATE template SET change_seq = (SELECT value FROM change_counter WHERE id = 1)
+     WHERE template_id = NEW.template_id;
+END;
+
+DROP TRIGGER IF EXISTS autotlg_graph_change_del;
+CREATE TRIGGER autotlg_graph_change_del
+    AFTER DELETE ON graph
+BEGIN
+    UPDATE change_counter SET value = value + 1 WHERE id = 1;
+    UPDATE template SET change_seq = (SELECT value FROM change_counter WHERE id = 1)
+     WHERE template_id = OLD.template_id;
+END;
@@ -0,0 +1,43 @@
+-- Замороженные версии проекта со структурным разделением (VersionManager).
+-- Содержимое шаблона и дерево категорий хранятся сериализованными в
+-- version_blob, одинаковые данные - одной строкой (ключ - SHA-1).
+-- version_template содержит только изменения относительно родительской
+-- версии: шаблон, чей change_seq не сдвинулся, в новую версию не пишется.
+-- Место шаблона (category_id, position) лежит в самой строке, а не в blob:
+-- сдвиг позиций при вставке соседа не порождает новых копий ячеек.
+-- blob_id NULL - шаблон удалён в этой версии.
+
+CREATE TABLE IF NOT EXISTS version_blob (
+    blob_id SERIAL PRIMARY KEY,
+    digest  TEXT NOT NULL UNIQUE,
+    data    BYTEA NOT NULL
+);
+ALTER TABLE version_blob ALTER COLUMN data SET STORAGE EXTERNAL;
+
+CREATE TABLE IF NOT EXISTS project_version (
+    version_id        SERIAL PRIMARY KEY,
+    project_id        INTEGER NOT NULL REFERENCES project(project_id) ON DELETE CASCADE,
+    parent_version_id INTEGER NULL REFERENCES project_version(version_id) ON DELETE CASCADE,
+    label             TEXT NOT NULL,
+    created_at        TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP,
+    tree_blob_id      INTEGER NOT NULL REFERENCES version_blob(blob_id),
+    template_count    INTEGER NOT NULL,
+    stored_count      INTEGER NOT NULL
+);
+
+CREATE TABLE IF NOT EXISTS version_template (
+    version_id  INTEGER NOT NULL REFERENCES project_version(version_id) ON DELETE CASCADE,
+    template_id INTEGER NOT NULL,
+    change_seq  BIGINT NOT NULL,
+    category_id INTEGER NULL,
+    position    INTEGER NOT NULL DEFAULT 0,
+    blob_id     INTEGER NULL REFERENCES version_blob(blob_id),
+    PRIMARY KEY (version_id, template_id)
+);
+
+CREATE INDEX IF NOT EXISTS idx_project_version_project
+    ON project_version (project_id, version_id);
+CREATE INDEX IF NOT EXISTS idx_project_version_parent
+    ON project_version (parent_version_id);
+CREATE INDEX IF NOT EXISTS idx_version_template_blob
+    ON version_template (blob_id);
@@ -0,0 +1,40 @@
+-- Замороженные версии проекта (см. 007_project_versions.pg.sql)
+
+CREATE TABLE IF NOT EXISTS version_blob (
+    blob_id INTEGER PRIMARY KEY AUTOINCREMENT,
+    digest  TEXT NOT NULL UNIQUE,
+    data    BLOB NOT NULL
+);
+
+CREATE TABLE IF NOT EXISTS project_version (
+    version_id        INTEGER PRIMARY KEY AUTOINCREMENT,
+    project_id        INTEGER NOT NULL,
+    parent_version_id INTEGER NULL,
+    label             TEXT NOT NULL,
+    created_at        TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP,
+    tree_blob_id      INTEGER NOT NULL,
+    template_count    INTEGER NOT NULL,
+    stored_count      INTEGER NOT NULL,
+    FOREIGN KEY (project_id) REFERENCES project(project_id) ON DELETE CASCADE,
+    FOREIGN KEY (parent_version_id) REFERENCES project_version(version_id) ON DELETE CASCADE,
+    FOREIGN KEY (tree_blob_id) REFERENCES version_blob(blob_id)
+);
+
+CREATE TABLE IF NOT EXISTS version_template (
+    version_id  INTEGER NOT NULL,
+    template_id INTEGER NOT NULL,
+    change_seq  INTEGER NOT NULL,
+    category_id INTEGER NULL,
+    position    INTEGER NOT NULL DEFAULT 0,
+    blob_id     INTEGER NULL,
+    PRIMARY KEY (version_id, template_id),
+    FOREIGN KEY (version_id) REFERENCES project_version(version_id) ON DELETE CASCADE,
+    FOREIGN KEY (blob_id) REFERENCES version_blob(blob_id)
+);
+
+CREATE INDEX IF NOT EXISTS idx_project_version_project
+    ON project_version (project_id, version_id);
+CREATE INDEX IF NOT EXISTS idx_project_version_parent
+    ON project_version (parent_version_id);
+CREATE INDEX IF NOT EXISTS idx_version_template_blob
+    ON version_template (blob_id);
@@ -0,0 +1,56 @@
+-- Копия шаблона (TemplateManager::duplicateTemplate) не копирует ячейки,
+-- а ссылается на шаблон, которому они принадлежат: content_source_id.
+-- Цепочек нет - копия копии ссылается сразу на владельца. Собственные
+-- ячейки копия получает при первой записи (TemplateManager::materializeContent).
+
+ALTER TABLE template ADD COLUMN IF NOT EXISTS content_source_id INTEGER NULL
+    REFERENCES template(template_id) ON DELETE SET NULL;
+
+CREATE INDEX IF NOT EXISTS idx_template_content_source
+    ON template (content_source_id) WHERE content_source_id IS NOT NULL;
+
+-- Удаляется владелец ячеек: копии забирают их себе. Ссылку обнуляет
+-- ON DELETE SET NULL - сами строки копий триггер не трогает, иначе
+-- каскадное удаление категории упало бы на уже изменённой строке
+CREATE OR REPLACE FUNCTION autotlg_release_content() RETURNS trigger AS $$
+BEGIN
+    INSERT INTO grid_cells (template_id, cell_type, row_index, col_index,
+                            row_span, col_span, content, colour)
+    SELECT d.template_id, g.cell_type, g.row_index, g.col_index,
+           g.row_span, g.col_span, g.content, g.colour
+      FROM template d
+      JOIN grid_cells g ON g.template_id = OLD.template_id
+     WHERE d.content_source_id = OLD.template_id;
+    RETURN OLD;
+END;
+$$ LANGUAGE plpgsql;
+
+DROP TRIGGER IF EXISTS autotlg_template_release_content ON template;
+CREATE TRIGGER autotlg_template_release_content
+    BEFORE DELETE ON template
+    FOR EACH ROW EXECUTE FUNCTION autotlg_release_content();
+
+-- Поиск (005): текст ячеек берётся у владельца
+CREATE OR REPLACE FUNCTION autotlg_refresh_search(p_tid INT) RETURNS VOID AS $$
+BEGIN
+    INSERT INTO template_search (template_id, document)
+    SELECT t.template_id,
+           setweight(to_tsvector('simple', autotlg_strip_html(t.name)), 'A')
+        || setweight(to_tsvector('simple', autotlg_strip_html(t.subtitle)), 'B')
+        || setweight(to_tsvector('simple', autotlg_strip_html(t.notes) || ' '
+                                           || autotlg_strip_html(t.programming_notes)), 'C')
+        || setweight(to_tsvector('simple',
+                         COALESCE((SELECT string_agg(autotlg_strip_html(g.content), ' ')
+                                     FROM grid_cells g
+                                    WHERE g.template_id = COALESCE(t.content_source_id,
+                                                                   t.template_id)), '')), 'D')
+      FROM template t
+     WHERE t.template_id = p_tid
+    ON CONFLICT (template_id) DO UPDATE SET document = EXCLUDED.document;
+END;
+$$ LANGUAGE plpgsql;
+
+DROP TRIGGER IF EXISTS autotlg_template_search ON template;
+CREATE TRIGGER autotlg_template_search
+    AFTER INSERT OR UPDATE OF name, subtitle, notes, programming_notes, content_source_id ON template
+    FOR EACH ROW EXECUTE FUNCTION autotlg_search_template();
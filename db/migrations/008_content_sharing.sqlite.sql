@@ -0,0 +1,23 @@
+-- Общие ячейки копий шаблона (см. 008_content_sharing.pg.sql)
+
+ALTER TABLE template ADD COLUMN content_source_id INTEGER NULL
+    REFERENCES template(template_id) ON DELETE SET NULL;
+
+CREATE INDEX IF NOT EXISTS idx_template_content_source
+    ON template (content_source_id) WHERE content_source_id IS NOT NULL;
+
+-- Удаляется владелец ячеек: копии забирают их себе
+DROP TRIGGER IF EXISTS autotlg_template_release_content;
+CREATE TRIGGER autotlg_template_release_content
+    BEFORE DELETE ON template
+    WHEN EXISTS (SELECT 1 FROM template WHERE content_source_id = OLD.template_id)
+BEGIN
+    INSERT INTO grid_cells (template_id, cell_type, row_index, col_index,
+                            row_span, col_span, content, colour)
+    SELECT d.template_id, g.cell_type, g.row_index, g.col_index,
+           g.row_span, g.col_span, g.content, g.colour
+      FROM template d
+      JOIN grid_cells g ON g.template_id = OLD.template_id
+     WHERE d.content_source_id = OLD.template_id;
+    UPDATE template SET content_source_id = NULL WHERE content_source_id = OLD.template_id;
+END;
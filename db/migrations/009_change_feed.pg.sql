@@ -0,0 +1,73 @@
+-- Лента изменений для обновления у других пользователей (LISTEN autotlg_changes).
+-- Полезная нагрузка: "<таблица>:<I|U|D>:<id>:<project_id>", project_id может быть пустым.
+-- Одинаковые уведомления в одной транзакции PostgreSQL доставляет один раз.
+-- Раньше ставилось клиентом при подключении: DROP IF EXISTS заменяет те триггеры.
+
+CREATE OR REPLACE FUNCTION autotlg_notify_change() RETURNS trigger AS $$
+DECLARE
+    rec        RECORD;
+    entity_id  INT;
+    project    INT;
+BEGIN
+    IF TG_OP = 'DELETE' THEN
+        rec := OLD;
+    ELSE
+        rec := NEW;
+    END IF;
+
+    IF TG_TABLE_NAME = 'category' THEN
+        entity_id := rec.category_id;
+        project   := rec.project_id;
+    ELSE
+        entity_id := rec.template_id;
+        -- при каскадном удалении категории её строки уже нет, project останется NULL
+        SELECT c.project_id INTO project FROM category c WHERE c.category_id = rec.category_id;
+    END IF;
+
+    PERFORM pg_notify('autotlg_changes',
+                      concat_ws(':', TG_TABLE_NAME, left(TG_OP, 1), entity_id, COALESCE(project::text, '')));
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+-- Ячейки меняются пачками (сохранение шаблона переписывает все строки),
+-- поэтому триггер уровня оператора: одно уведомление на шаблон
+CREATE OR REPLACE FUNCTION autotlg_notify_cells() RETURNS trigger AS $$
+DECLARE
+    tid INT;
+BEGIN
+    FOR tid IN SELECT DISTINCT template_id FROM changed_rows LOOP
+        PERFORM pg_notify('autotlg_changes', concat_ws(':', 'grid_cells', left(TG_OP, 1), tid, ''));
+    END LOOP;
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+DROP TRIGGER IF EXISTS autotlg_category_notify ON category;
+CREATE TRIGGER autotlg_category_notify
+    AFTER INSERT OR UPDATE OR DELETE ON category
+    FOR EACH ROW EXECUTE FUNCTION autotlg_notify_change();
+
+DROP TRIGGER IF EXISTS autotlg_template_notify ON template;
+CREATE TRIGGER autotlg_template_notify
+    AFTER INSERT OR UPDATE OR DELETE ON template
+    FOR EACH ROW EXECUTE FUNCTION autotlg_notify_change();
+
+-- Таблицы переходов допускают только одно событие на триггер
+DROP TRIGGER IF EXISTS autotlg_cells_notify_ins ON grid_cells;
+CREATE TRIGGER autotlg_cells_notify_ins
+    AFTER INSERT ON grid_cells
+    REFERENCING NEW TABLE AS changed_rows
+    FOR EACH STATEMENT EXECUTE FUNCTION autotlg_notify_cells();
+
+DROP TRIGGER IF EXISTS autotlg_cells_notify_upd ON grid_cells;
+CREATE TRIGGER autotlg_cells_notify_upd
+    AFTER UPDATE ON grid_cells
+    REFERENCING NEW TABLE AS changed_rows
+    FOR EACH STATEMENT EXECUTE FUNCTION autotlg_notify_cells();
+
+DROP TRIGGER IF EXISTS autotlg_cells_notify_del ON grid_cells;
+CREATE TRIGGER autotlg_cells_notify_del
+    AFTER DELETE ON grid_cells
+    REFERENCING OLD TABLE AS changed_rows
+    FOR EACH STATEMENT EXECUTE FUNCTION autotlg_notify_cells();
@@ -0,0 +1,50 @@
+-- Поиск (005): пересчёт документа шаблона один раз на транзакцию.
+-- Триггеры ячеек уровня оператора пересчитывали весь текст шаблона на каждый
+-- INSERT, а сохранение таблицы вставляет ячейки по одной - O(ячеек²) на запись.
+-- Теперь триггеры только отмечают шаблон в очереди, а пересчёт делает
+-- отложенный триггер при COMMIT: одна строка очереди - один пересчёт.
+
+CREATE TABLE IF NOT EXISTS template_search_dirty (
+    template_id INT PRIMARY KEY         -- без ссылки: шаблон мог быть удалён в той же транзакции
+);
+
+-- Шаблон и копии, читающие его ячейки (008)
+CREATE OR REPLACE FUNCTION autotlg_flush_search() RETURNS trigger AS $$
+DECLARE
+    tid INT;
+BEGIN
+    DELETE FROM template_search_dirty WHERE template_id = NEW.template_id;
+    IF NOT FOUND THEN
+        RETURN NULL;
+    END IF;
+    FOR tid IN SELECT NEW.template_id
+               UNION
+               SELECT template_id FROM template WHERE content_source_id = NEW.template_id LOOP
+        PERFORM autotlg_refresh_search(tid);
+    END LOOP;
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+DROP TRIGGER IF EXISTS autotlg_search_dirty_flush ON template_search_dirty;
+CREATE CONSTRAINT TRIGGER autotlg_search_dirty_flush
+    AFTER INSERT ON template_search_dirty
+    DEFERRABLE INITIALLY DEFERRED
+    FOR EACH ROW EXECUTE FUNCTION autotlg_flush_search();
+
+CREATE OR REPLACE FUNCTION autotlg_search_template() RETURNS trigger AS $$
+BEGIN
+    INSERT INTO template_search_dirty (template_id) VALUES (NEW.template_id)
+    ON CONFLICT (template_id) DO NOTHING;
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE OR REPLACE FUNCTION autotlg_search_cells() RETURNS trigger AS $$
+BEGIN
+    INSERT INTO template_search_dirty (template_id)
+    SELECT DISTINCT template_id FROM changed_rows
+    ON CONFLICT (template_id) DO NOTHING;
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
@@ -0,0 +1,11 @@
+-- Метка базы для кэшей на стороне клиента (кэш фрагментов экспорта):
+-- пересозданная база с теми же id шаблонов и заново начатыми change_seq
+-- получает новую метку, и старый кэш ей не достаётся.
+
+CREATE TABLE IF NOT EXISTS database_epoch (
+    id    INT PRIMARY KEY CHECK (id = 1),
+    epoch TEXT NOT NULL
+);
+INSERT INTO database_epoch (id, epoch)
+VALUES (1, md5(random()::text || clock_timestamp()::text))
+ON CONFLICT (id) DO NOTHING;
@@ -0,0 +1,7 @@
+-- Метка базы для кэшей на стороне клиента (см. 011_database_epoch.pg.sql).
+
+CREATE TABLE IF NOT EXISTS database_epoch (
+    id    INTEGER PRIMARY KEY CHECK (id = 1),
+    epoch TEXT NOT NULL
+);
+INSERT OR IGNORE INTO database_epoch (id, epoch) VALUES (1, lower(hex(randomblob(16))));
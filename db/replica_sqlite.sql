@@ -0,0 +1,154 @@
+-- Служебные таблицы локальной реплики (SQLite поверх db/schema_sqlite.sql).
+-- Скрипт идемпотентен и выполняется при каждом открытии реплики.
+
+-- Флаги синхронизации; 'applying' = '1' пока SyncEngine пишет данные с сервера
+CREATE TABLE IF NOT EXISTS sync_meta (
+    key TEXT PRIMARY KEY,
+    value TEXT
+);
+
+-- Изменённые локально объекты. id растёт при каждом изменении (AUTOINCREMENT
+-- не переиспользует значения), поэтому отметку, поставленную во время
+-- отправки, нельзя случайно снять по устаревшему id.
+CREATE TABLE IF NOT EXISTS sync_dirty (
+    id INTEGER PRIMARY KEY AUTOINCREMENT,
+    entity TEXT NOT NULL CHECK (entity IN ('project','category','template')),
+    entity_id INTEGER NOT NULL,
+    deleted INTEGER NOT NULL DEFAULT 0,
+    UNIQUE (entity, entity_id)
+);
+
+-- Состояние шаблона на момент последней синхронизации:
+-- remote_fp - отпечаток на сервере, local_fp - отпечаток локальной копии
+CREATE TABLE IF NOT EXISTS sync_base (
+    template_id INTEGER PRIMARY KEY,
+    remote_fp TEXT,
+    local_fp TEXT
+);
+
+-- Шаблоны, изменённые и локально, и на сервере
+CREATE TABLE IF NOT EXISTS sync_conflict (
+    template_id INTEGER PRIMARY KEY,
+    remote_fp TEXT,
+    detected_at TEXT NOT NULL DEFAULT CURRENT_TIMESTAMP
+);
+
+-- Проекты, содержимое которых держится в реплике
+CREATE TABLE IF NOT EXISTS sync_project (
+    project_id INTEGER PRIMARY KEY
+);
+
+-- Локально созданные строки получают ключи из отдельного диапазона,
+-- чтобы не пересекаться с ключами сервера до отправки
+INSERT INTO sqlite_sequence (name, seq)
+SELECT t.name, 0 FROM (SELECT 'project' AS name UNION ALL SELECT 'category' UNION ALL SELECT 'template') t
+WHERE NOT EXISTS (SELECT 1 FROM sqlite_sequence s WHERE s.name = t.name);
+
+UPDATE sqlite_sequence SET seq = 1000000000
+WHERE name IN ('project','category','template') AND seq < 1000000000;
+
+-- Триггеры журнала изменений
+CREATE TRIGGER IF NOT EXISTS sync_project_ins AFTER INSERT ON project
+WHEN NOT EXISTS (SELECT 1 FROM sync_meta WHERE key = 'applying' AND value = '1')
+BEGIN
+    INSERT OR REPLACE INTO sync_dirty (entity, entity_id, deleted) VALUES ('project', NEW.project_id, 0);
+END;
+
+CREATE TRIGGER IF NOT EXISTS sync_project_upd AFTER UPDATE ON project
+WHEN NOT EXISTS (SELECT 1 FROM sync_meta WHERE key = 'applying' AND value = '1')
+BEGIN
+    INSERT OR REPLACE INTO sync_dirty (entity, entity_id, deleted) VALUES ('project', NEW.project_id, 0);
+END;
+
+CREATE TRIGGER IF NOT EXISTS sync_project_del AFTER DELETE ON project
+WHEN NOT EXISTS (SELECT 1 FROM sync_meta WHERE key = 'applying' AND value = '1')
+BEGIN
+    INSERT OR REPLACE INTO sync_dirty (entity, entity_id, deleted) VALUES ('project', OLD.project_id, 1);
+    DELETE FROM sync_project WHERE project_id = OLD.project_id;
+END;
+
+CREATE TRIGGER IF NOT EXISTS sync_category_ins AFTER INSERT ON category
+WHEN NOT EXISTS (SELECT 1 FROM sync_meta WHERE key = 'applying' AND value = '1')
+BEGIN
+    INSERT OR REPLACE INTO sync_dirty (entity, entity_id, deleted) VALUES ('category', NEW.category_id, 0);
+END;
+
+CREATE TRIGGER IF NOT EXISTS sync_category_upd AFTER UPDATE ON category
+WHEN NOT EXISTS (SELECT 1 FROM sync_meta WHERE key = 'applying' AND value = '1')
+BEGIN
+    INSERT OR REPLACE INTO sync_dirty (entity, entity_id, deleted) VALUES ('category', NEW.category_id, 0);
+END;
+
+CREATE TRIGGER IF NOT EXISTS sync_category_del AFTER DELETE ON category
+WHEN NOT EXISTS (SELECT 1 FROM sync_meta WHERE key = 'applying' AND value = '1')
+BEGIN
+    INSERT OR REPLACE INTO sync_dirty (entity, entity_id, deleted) VALUES ('category', OLD.category_id, 1);
+END;
+
+CREATE TRIGGER IF NOT EXISTS sync_template_ins AFTER INSERT ON template
+WHEN NOT EXISTS (SELECT 1 FROM sync_meta WHERE key = 'applying' AND value = '1')
+BEGIN
+    INSERT OR REPLACE INTO sync_dirty (entity, entity_id, deleted) VALUES ('template', NEW.template_id, 0);
+END;
+
+CREATE TRIGGER IF NOT EXISTS sync_template_upd AFTER UPDATE ON template
+WHEN NOT EXISTS (SELECT 1 FROM sync_meta WHERE key = 'applying' AND value = '1')
+BEGIN
+    INSERT OR REPLACE INTO sync_dirty (entity, entity_id, deleted) VALUES ('template', NEW.template_id, 0);
+END;
+
+CREATE TRIGGER IF NOT EXISTS sync_template_del AFTER DELETE ON template
+WHEN NOT EXISTS (SELECT 1 FROM sync_meta WHERE key = 'applying' AND value = '1')
+BEGIN
+    INSERT OR REPLACE INTO sync_dirty (entity, entity_id, deleted) VALUES ('template', OLD.template_id, 1);
+END;
+
+-- Ячейки и графики помечают свой шаблон; при каскадном удалении шаблона
+-- (строки template уже нет) отметка deleted = 1 не перезаписывается
+CREATE TRIGGER IF NOT EXISTS sync_cells_ins AFTER INSERT ON grid_cells
+WHEN NOT EXISTS (SELECT 1 FROM sync_meta WHERE key = 'applying' AND value = '1')
+BEGIN
+    INSERT OR REPLACE INTO sync_dirty (entity, entity_id, deleted)
+    SELECT 'template', NEW.template_id, 0
+    WHERE EXISTS (SELECT 1 FROM template WHERE template_id = NEW.template_id);
+END;
+
+CREATE TRIGGER IF NOT EXISTS sync_cells_upd AFTER UPDATE ON grid_cells
+WHEN NOT EXISTS (SELECT 1 FROM sync_meta WHERE key = 'applying' AND value = '1')
+BEGIN
+    INSERT OR REPLACE INTO sync_dirty (entity, entity_id, deleted)
+    SELECT 'template', NEW.template_id, 0
+    WHERE EXISTS (SELECT 1 FROM template WHERE template_id = NEW.template_id);
+END;
+
+CREATE TRIGGER IF NOT EXISTS sync_cells_del AFTER DELETE ON grid_cells
+WHEN NOT EXISTS (SELECT 1 FROM sync_meta WHERE key = 'applying' AND value = '1')
+BEGIN
+    INSERT OR REPLACE INTO sync_dirty (entity, entity_id, deleted)
+    SELECT 'template', OLD.template_id, 0
+    WHERE EXISTS (SELECT 1 FROM template WHERE template_id = OLD.template_id);
+END;
+
+CREATE TRIGGER IF NOT EXISTS sync_graph_ins AFTER INSERT ON graph
+WHEN NOT EXISTS (SELECT 1 FROM sync_meta WHERE key = 'applying' AND value = '1')
+BEGIN
+    INSERT OR REPLACE INTO sync_dirty (entity, entity_id, deleted)
+    SELECT 'template', NEW.template_id, 0
+    WHERE EXISTS (SELECT 1 FROM template WHERE template_id = NEW.template_id);
+END;
+
+CREATE TRIGGER IF NOT EXISTS sync_graph_upd AFTER UPDATE ON graph
+WHEN NOT EXISTS (SELECT 1 FROM sync_meta WHERE key = 'applying' AND value = '1')
+BEGIN
+    INSERT OR REPLACE INTO sync_dirty (entity, entity_id, deleted)
+    SELECT 'template', NEW.template_id, 0
+    WHERE EXISTS (SELECT 1 FROM template WHERE template_id = NEW.template_id);
+END;
+
+CREATE TRIGGER IF NOT EXISTS sync_graph_del AFTER DELETE ON graph
+WHEN NOT EXISTS (SELECT 1 FROM sync_meta WHERE key = 'applying' AND value = '1')
+BEGIN
+    INSERT OR REPLACE INTO sync_dirty (entity, entity_id, deleted)
+    SELECT 'template', OLD.template_id, 0
+    WHERE EXISTS (SELECT 1 FROM template WHERE template_id = OLD.template_id);
+END;
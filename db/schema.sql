@@ -28,6 +28,7 @@ CREATE TABLE template (
     position INT NOT NULL,
     is_dynamic BOOLEAN,
     template_type TEXT NOT NULL CHECK (template_type IN ('table','listing','graph')),
+    version INT NOT NULL DEFAULT 1,  -- растёт при каждом изменении (оптимистичная блокировка)
     FOREIGN KEY (category_id) REFERENCES category(category_id) ON DELETE CASCADE
 );
 
@@ -0,0 +1,73 @@
+-- Схема локальной базы SQLite (та же структура, что и db/schema.sql)
+-- SERIAL -> INTEGER PRIMARY KEY AUTOINCREMENT, BYTEA -> BLOB
+
+-- Создание таблицы проектов
+CREATE TABLE project (
+    project_id INTEGER PRIMARY KEY AUTOINCREMENT,
+    name TEXT NOT NULL,
+    template_style TEXT,
+    study TEXT,
+    sponsor TEXT,
+    cut_date DATE,
+    version TEXT
+);
+
+-- Создание таблицы категорий
+CREATE TABLE category (
+    category_id INTEGER PRIMARY KEY AUTOINCREMENT,
+    name TEXT NOT NULL,
+    parent_id INTEGER NULL,
+    position INTEGER NOT NULL,
+    depth INTEGER NOT NULL,
+    project_id INTEGER NOT NULL,
+    FOREIGN KEY (parent_id) REFERENCES category(category_id) ON DELETE CASCADE,
+    FOREIGN KEY (project_id) REFERENCES project(project_id) ON DELETE CASCADE
+);
+
+-- Создание таблицы шаблонов
+CREATE TABLE template (
+    template_id INTEGER PRIMARY KEY AUTOINCREMENT,
+    name TEXT NOT NULL,
+    subtitle TEXT,
+    category_id INTEGER NOT NULL,
+    notes TEXT,
+    programming_notes TEXT,
+    position INTEGER NOT NULL,
+    is_dynamic BOOLEAN,
+    approved BOOLEAN NOT NULL DEFAULT 0,
+    related_template_id INTEGER NULL,
+    template_type TEXT NOT NULL CHECK (template_type IN ('table','listing','graph')),
+    version INTEGER NOT NULL DEFAULT 1,  -- растёт при каждом изменении (оптимистичная блокировка)
+    FOREIGN KEY (category_id) REFERENCES category(category_id) ON DELETE CASCADE,
+    FOREIGN KEY (related_template_id) REFERENCES template(template_id) ON DELETE SET NULL
+);
+
+-- Ячейки (заголовочные и содержимого)
+CREATE TABLE grid_cells (
+    template_id INTEGER NOT NULL,
+    cell_type TEXT NOT NULL CHECK (cell_type IN ('header','content')),
+    row_index INTEGER NOT NULL,
+    col_index INTEGER NOT NULL,
+    row_span INTEGER NOT NULL DEFAULT 1,
+    col_span INTEGER NOT NULL DEFAULT 1,
+    content TEXT,
+    colour TEXT,
+    PRIMARY KEY (template_id, cell_type, row_index, col_index),
+    FOREIGN KEY (template_id) REFERENCES template(template_id) ON DELETE CASCADE
+);
+
+-- Создание таблицы графиков
+CREATE TABLE graph (
+    template_id INTEGER NOT NULL,
+    name TEXT,
+    graph_type TEXT,
+    image BLOB,
+    FOREIGN KEY (template_id) REFERENCES template(template_id) ON DELETE CASCADE
+);
+
+-- Создание таблицы библиотеки графиков
+CREATE TABLE graph_library (
+    name TEXT NOT NULL,
+    graph_type TEXT PRIMARY KEY,
+    image BLOB
+);
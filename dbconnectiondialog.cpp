@@ -4,11 +4,19 @@
 #include <QMessageBox>
 #include <QStringListModel>
 #include <QComboBox>
+#include <QFileDialog>
+#include <QStandardPaths>
+#include <QDir>
 
 DBConnectionDialog::DBConnectionDialog(QWidget *parent)
     : QDialog(parent)
 {
     setWindowTitle(tr("Parameters connection to the database"));
+    backendCombo = new QComboBox(this);
+    backendCombo->addItem(tr("PostgreSQL server"), int(DbBackend::Postgres));
+    backendCombo->addItem(tr("Local file (SQLite)"), int(DbBackend::Sqlite));
+    fileEdit     = new QLineEdit(this);
+    browseButton = new QPushButton(tr("Browse..."), this);
     hostEdit    = new QLineEdit(this);
     portEdit    = new QLineEdit(this);
     dbNameEdit  = new QLineEdit(this);
@@ -16,6 +24,7 @@ DBConnectionDialog::DBConnectionDialog(QWidget *parent)
     passEdit    = new QLineEdit(this);
     passEdit->setEchoMode(QLineEdit::Password);
     saveCheck   = new QCheckBox("Save");
+    replicaCheck = new QCheckBox(tr("Work offline with a local replica"), this);
 
     okButton     = new QPushButton(tr("Connect"), this);
     cancelButton = new QPushButton(tr("Cancel"), this);
@@ -46,12 +55,19 @@ DBConnectionDialog::DBConnectionDialog(QWidget *parent)
     dbNameEdit->setCompleter(dbCompleter);
     userEdit->setCompleter(userCompleter);
 
+    auto *fileLay = new QHBoxLayout;
+    fileLay->addWidget(fileEdit, 1);
+    fileLay->addWidget(browseButton);
+
     auto *form = new QFormLayout;
+    form->addRow(tr("Storage:"),     backendCombo);
+    form->addRow(tr("File:"),        fileLay);
     form->addRow(tr("Host:"),        hostEdit);
     form->addRow(tr("Port:"),        portEdit);
     form->addRow(tr("Database Name:"),      dbNameEdit);
     form->addRow(tr("Username:"), userEdit);
     form->addRow(tr("Password:"),      passEdit);
+    form->addRow("", replicaCheck);
     form->addRow("", saveCheck);
 
     auto *btnLay = new QHBoxLayout;
@@ -64,8 +80,31 @@ DBConnectionDialog::DBConnectionDialog(QWidget *parent)
     mainLay->addLayout(btnLay);
 
     loadSettings();
+    updateBackendFields();
+
+    connect(backendCombo, QOverload<int>::of(&QComboBox::currentIndexChanged),
+            this, &DBConnectionDialog::updateBackendFields);
+    connect(browseButton, &QPushButton::clicked, this, [this](){
+        QString path = QFileDialog::getSaveFileName(this, tr("Local database file"),
+                                                    localFile(),
+                                                    tr("SQLite database (*.db *.sqlite)"),
+                                                    nullptr,
+                                                    QFileDialog::DontConfirmOverwrite);
+        if (!path.isEmpty())
+            fileEdit->setText(path);
+    });
 
     connect(okButton, &QPushButton::clicked, this, [this](){
+        if (backend() == DbBackend::Sqlite) {
+            if (localFile().isEmpty()) {
+                QMessageBox::warning(this, tr("Error"), tr("Specify the database file."));
+                return;
+            }
+            if (saveCheck->isChecked())
+                saveSettings();
+            accept();
+            return;
+        }
         if (host().isEmpty() || databaseName().isEmpty() || userName().isEmpty()) {
             QMessageBox::warning(this, tr("Error"), tr("All fields must be filled in."));
             return;
@@ -82,6 +121,21 @@ QString DBConnectionDialog::port()           const { return portEdit->text(); }
 QString DBConnectionDialog::databaseName()   const { return dbNameEdit->text(); }
 QString DBConnectionDialog::userName()       const { return userEdit->text(); }
 QString DBConnectionDialog::password()       const { return passEdit->text(); }
+QString DBConnectionDialog::localFile()      const { return fileEdit->text().trimmed(); }
+bool DBConnectionDialog::useLocalReplica()   const { return replicaCheck->isChecked(); }
+
+DbBackend DBConnectionDialog::backend() const {
+    return static_cast<DbBackend>(backendCombo->currentData().toInt());
+}
+
+void DBConnectionDialog::updateBackendFields() {
+    const bool local = (backend() == DbBackend::Sqlite);
+    fileEdit->setEnabled(local);
+    browseButton->setEnabled(local);
+    for (QLineEdit *e : {hostEdit, portEdit, dbNameEdit, userEdit, passEdit})
+        e->setEnabled(!local);
+    replicaCheck->setEnabled(!local);
+}
 
 void DBConnectionDialog::loadSettings() {
     QSettings s;
@@ -95,10 +149,24 @@ void DBConnectionDialog::loadSettings() {
     portCompleter->setModel(new QStringListModel(ports, portCompleter));
     dbCompleter->setModel(new QStringListModel(dbs, dbCompleter));
     userCompleter->setModel(new QStringListModel(users, userCompleter));
+
+    const int savedBackend = s.value("db/backend", int(DbBackend::Postgres)).toInt();
+    backendCombo->setCurrentIndex(qMax(0, backendCombo->findData(savedBackend)));
+    fileEdit->setText(s.value("db/localFile",
+                              QDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation))
+                                  .filePath("autoshell.db")).toString());
+    replicaCheck->setChecked(s.value("db/useReplica", false).toBool());
 }
 
 void DBConnectionDialog::saveSettings() {
     QSettings s;
+    s.setValue("db/backend", int(backend()));
+    s.setValue("db/useReplica", useLocalReplica());
+    if (backend() == DbBackend::Sqlite) {
+        s.setValue("db/localFile", localFile());
+        return;
+    }
+
     // загружаем старые списки и добавляем новый элемент (если его там нет)
     auto addUnique = [&](const QString &key, const QString &value){
         auto list = s.value(key).toStringList();
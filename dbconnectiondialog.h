@@ -6,6 +6,8 @@
 #include <QCheckBox>
 #include <QPushButton>
 #include <QCompleter>
+#include <QComboBox>
+#include "sqldialect.h"
 
 class DBConnectionDialog : public QDialog {
     Q_OBJECT
@@ -18,9 +20,15 @@ public:
     QString userName() const;
     QString password() const;
 
+    DbBackend backend() const;
+    QString localFile() const;      // путь к файлу SQLite
+    bool useLocalReplica() const;   // работа с сервером через локальную реплику
 
 
 private:
+    QComboBox   *backendCombo;
+    QLineEdit   *fileEdit;
+    QPushButton *browseButton;
     QLineEdit   *hostEdit;
     QLineEdit    *portEdit;
     QLineEdit   *dbNameEdit;
@@ -29,6 +37,7 @@ private:
     QPushButton *okButton;
     QPushButton *cancelButton;
     QCheckBox *saveCheck;
+    QCheckBox *replicaCheck;
 
     QCompleter   *hostCompleter;
     QCompleter   *portCompleter;
@@ -37,6 +46,7 @@ private:
 
     void loadSettings();
     void saveSettings();
+    void updateBackendFields();
 };
 
 #endif // DBCONNECTIONDIALOG_H
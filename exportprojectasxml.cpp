@@ -5,6 +5,50 @@
 #include <QRegularExpression>
 #include <QStandardPaths>
 #include <QDate>
+#include <QBuffer>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QDataStream>
+#include <memory>
+#include "gzipdevice.h"
+
+namespace {
+
+// Формат файла кэша; увеличить при любом изменении вывода renderTemplate
+constexpr quint32 CacheMagic   = 0x41544c58;   // "ATLX"
+constexpr quint32 CacheVersion = 2;
+
+// Пишет записи внутри временного <MAIN>, чтобы отступы совпали с их местом
+// в итоговом файле; сам <MAIN> при выдаче отрезается
+class FragmentWriter {
+public:
+    explicit FragmentWriter(bool compact) : buffer(&bytes), xml(&buffer), compact(compact) {
+        buffer.open(QIODevice::WriteOnly);
+        xml.setAutoFormatting(!compact);
+        xml.writeStartElement("MAIN");
+    }
+    QXmlStreamWriter& writer() { return xml; }
+
+    // "<MAIN>\n    <TABLE>...</TABLE>\n</MAIN>" -> "\n    <TABLE>...</TABLE>"
+    QByteArray finish() {
+        xml.writeEndElement();
+        buffer.close();
+        static const QByteArray open("<MAIN>");
+        const QByteArray close(compact ? "</MAIN>" : "\n</MAIN>");
+        if (!bytes.startsWith(open))        // ничего не записано: <MAIN/>
+            return QByteArray();
+        return bytes.mid(open.size(), bytes.lastIndexOf(close) - open.size());
+    }
+
+private:
+    QByteArray       bytes;
+    QBuffer          buffer;
+    QXmlStreamWriter xml;
+    bool             compact;
+};
+
+} // namespace
 
 ExportProjectAsXml::ExportProjectAsXml(ProjectManager* projectManager,
                                        CategoryManager* categoryManager,
@@ -16,25 +60,118 @@ ExportProjectAsXml::ExportProjectAsXml(ProjectManager* projectManager,
     tableManager(tableManager) {}
 
 bool ExportProjectAsXml::exportProject(int projectId, const QString& filename) {
-    QFile file(filename);
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    // Пишем во временный файл рядом: прежний экспорт заменяется только
+    // целиком записанным, при любой ошибке остаётся как был
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly))
         return false;
 
-    QXmlStreamWriter xml(&file);
-    xml.setAutoFormatting(true);
-    xml.writeStartDocument();
-    xml.writeStartElement("MAIN");
+    // Сжатие - прослойкой между фрагментами и файлом
+    std::unique_ptr<GzipDevice> gzip;
+    QIODevice* out = &file;
+    if (compression == Compression::Gzip) {
+        gzip = std::make_unique<GzipDevice>(&file);
+        if (!gzip->open(QIODevice::WriteOnly)) {
+            file.cancelWriting();
+            return false;
+        }
+        out = gzip.get();
+    }
+
+    // Шаблон, чей change_seq не сдвинулся и чьё окружение (путь, главы,
+    // заглушки) то же, берётся из кэша без обращения к ячейкам
+    changeSeqs = templateManager->getChangeSequences(projectId);
+    changeCounter = templateManager->getChangeCounter();
+    loadCache(projectId);
+    written.clear();
+    renderedCount = reusedCount = 0;
+    writeFailed = false;
+
+    // То же, что дают writeStartDocument/writeStartElement/writeEndDocument
+    writeBytes(*out, compact ? "<?xml version=\"1.0\" encoding=\"UTF-8\"?><MAIN>"
+                             : "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<MAIN>");
+    writeBytes(*out, renderProjectBlock(projectId));
+    dumpCategory(*out, projectId, QVariant(), QString(), QStringList());
+    writeBytes(*out, compact ? "</MAIN>" : "\n</MAIN>\n");
+
+    if (gzip && !gzip->finish())
+        writeFailed = true;
+    if (writeFailed)
+        file.cancelWriting();
+    const bool ok = file.commit();
+    if (ok)
+        saveCache(projectId);
+    cached.clear();
+    qDebug() << "Экспорт XML: отрисовано шаблонов" << renderedCount
+             << ", из кэша" << reusedCount;
+    return ok;
+}
 
-    writeProjectBlock(xml, projectId);
-    dumpCategory(xml, projectId, QVariant(), QString(), QList<Category>());
+QString ExportProjectAsXml::cacheFile(int projectId) const {
+    if (cacheDir.isEmpty())
+        return QString();
+    // Фрагменты компактного режима другие - у него свой кэш
+    return QDir(cacheDir).filePath(QString("export_project_%1%2.xmlcache")
+                                       .arg(projectId).arg(compact ? "_compact" : ""));
+}
 
-    xml.writeEndElement(); // MAIN
-    xml.writeEndDocument();
-    file.close();
-    return true;
+void ExportProjectAsXml::writeBytes(QIODevice& out, const QByteArray& bytes) {
+    if (!writeFailed && out.write(bytes) != bytes.size())
+        writeFailed = true;
 }
 
-void ExportProjectAsXml::writeProjectBlock(QXmlStreamWriter& xml, int projectId) {
+void ExportProjectAsXml::loadCache(int projectId) {
+    cached.clear();
+    QFile f(cacheFile(projectId));
+    if (cacheDir.isEmpty() || !f.open(QIODevice::ReadOnly))
+        return;
+
+    QDataStream in(&f);
+    quint32 magic = 0, version = 0, count = 0;
+    qint64 counter = 0;
+    in >> magic >> version >> counter >> count;
+    if (magic != CacheMagic || version != CacheVersion)
+        return;
+    // Счётчик изменений пошёл назад: база восстановлена из копии, и те же
+    // change_seq могут достаться другому содержимому
+    if (changeCounter < 0 || counter > changeCounter) {
+        qDebug() << "Кэш экспорта от другого состояния базы, будет пересоздан:" << f.fileName();
+        return;
+    }
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        qint32 templateId = 0;
+        Fragment frag;
+        in >> templateId >> frag.changeSeq >> frag.context >> frag.xml
+           >> frag.tookTablePlaceholder >> frag.tookGraphPlaceholder;
+        cached.insert(templateId, frag);
+    }
+    if (in.status() != QDataStream::Ok) {
+        qDebug() << "Кэш экспорта повреждён, будет пересоздан:" << f.fileName();
+        cached.clear();
+    }
+}
+
+void ExportProjectAsXml::saveCache(int projectId) const {
+    if (cacheDir.isEmpty() || changeCounter < 0 || !QDir().mkpath(cacheDir))
+        return;
+    // Пишутся только шаблоны этого экспорта - удалённые из кэша выпадают
+    QSaveFile f(cacheFile(projectId));
+    if (!f.open(QIODevice::WriteOnly))
+        return;
+    QDataStream out(&f);
+    out << CacheMagic << CacheVersion << changeCounter << quint32(written.size());
+    for (auto it = written.cbegin(); it != written.cend(); ++it) {
+        const Fragment& frag = it.value();
+        out << qint32(it.key()) << frag.changeSeq << frag.context << frag.xml
+            << frag.tookTablePlaceholder << frag.tookGraphPlaceholder;
+    }
+    if (!f.commit())
+        qDebug() << "Не удалось сохранить кэш экспорта:" << f.errorString();
+}
+
+QByteArray ExportProjectAsXml::renderProjectBlock(int projectId) {
+    FragmentWriter writer(compact);
+    QXmlStreamWriter& xml = writer.writer();
     auto writeProj = [&](const QString& var, const QString& val, const QString& pos) {
         xml.writeStartElement("PROJECT");
         xml.writeTextElement("Variable", var);
@@ -49,21 +186,22 @@ void ExportProjectAsXml::writeProjectBlock(QXmlStreamWriter& xml, int projectId)
     writeProj("CutDate", details.cutDate.toString("dd.MM.yyyy"), "Footnote");
     writeProj("dtfolder", projectManager->getProjectName(projectId), "");
     writeProj("TempleteStyle", projectManager->getProjectStyle(projectId), "");
+    return writer.finish();
 }
 
-void ExportProjectAsXml::dumpCategory(QXmlStreamWriter& xml,
+void ExportProjectAsXml::dumpCategory(QIODevice& out,
                                       int projectId,
                                       const QVariant& parentId,
                                       const QString& path,
-                                      const QList<Category>& ancestors) {
+                                      const QStringList& chapters) {
     bool firstTableOrListing = true;
     bool firstGraph = true;
 
     const auto cats = categoryManager->getCategoriesByProjectAndParent(projectId, parentId);
     for (const Category& cat : cats) {
-        // добавить этого предка в цепочку
-        QList<Category> chain = ancestors;
-        chain.append(cat);
+        // добавить эту главу в цепочку (имя очищается один раз на категорию)
+        QStringList chain = chapters;
+        chain.append(stripHtml(cat.name));
 
         // обновить путь
         QString catPath = path.isEmpty()
@@ -75,215 +213,251 @@ void ExportProjectAsXml::dumpCategory(QXmlStreamWriter& xml,
         // обход шаблонов
         for (int idx = 0; idx < tmpls.size(); ++idx) {
             const Template& t = tmpls[idx];
+            const QString fullPath = catPath + '.' + QString::number(idx + 1);
+
+            // Всё, что влияет на фрагмент помимо самого шаблона
+            QByteArray context = fullPath.toUtf8();
+            context += '\x1f';
+            context += chain.join(QChar(0x1e)).toUtf8();
+            context += '\x1f';
+            context += firstTableOrListing ? '1' : '0';
+            context += firstGraph ? '1' : '0';
+
+            const auto seq = changeSeqs.constFind(t.templateId);
+            const auto hit = cached.constFind(t.templateId);
+            Fragment frag;
+            if (seq != changeSeqs.cend() && hit != cached.cend()
+                && hit->changeSeq == *seq && hit->context == context) {
+                frag = *hit;
+                ++reusedCount;
+            } else {
+                frag = renderTemplate(t, fullPath, chain, firstTableOrListing, firstGraph);
+                // без change_seq (шаблон создан во время экспорта) в кэш не попадёт
+                frag.changeSeq = seq != changeSeqs.cend() ? *seq : -1;
+                frag.context = context;
+                ++renderedCount;
+            }
 
-            // полный и подчёркнутый путь
-            QString fullPath = catPath + '.' + QString::number(idx + 1);
-            QString underscored = fullPath;
-            underscored.replace('.', '_');
-
-            // определить теги
-            QString type = templateManager->getTemplateType(t.templateId);
-            QString tag    = (type == "listing" ? "LISTING" : (type == "table" ? "TABLE" : "GRATH"));
-            QString prefix = (type == "listing" ? "List" : (type == "table" ? "Tab" : "Fig"));
-
-            if (type == "table" || type == "listing") {
-                // получить матрицу таблицы или листинга
-                TableMatrix mtx = templateManager->getTableData(t.templateId);
-                if (mtx.isEmpty())
-                    continue;
-
-                // для объединения ячеек
-                auto findOwner = [&](int r, int c) -> QPair<int,int>
-                {
-                    for (int rr = r; rr >= 0; --rr)
-                        for (int cc = c; cc >= 0; --cc) {
-                            const Cell& probe = mtx[rr][cc];
-                            if (probe.rowSpan > 0 && probe.colSpan > 0) {
-                                bool inRowSpan = rr + probe.rowSpan - 1 >= r;
-                                bool inColSpan = cc + probe.colSpan - 1 >= c;
-                                if (inRowSpan && inColSpan)
-                                    return { rr, cc };           // нашли владельца
-                            }
-                        }
-                    return { r, c };                              // fallback
-                };
-
-                // сколько строк — заголовков
-                int headerRows = tableManager->getRowCountForHeader(t.templateId);
-                int maxColumns = mtx.isEmpty() ? 0 : mtx[0].size();
-
-
-                //  Заголовки в <TABLE>…</TABLE> или <LISTING>…</LISTING>
-                for (int hr = 0; hr < headerRows; ++hr) {
-                    if (firstTableOrListing && hr == 0) {
-                        // строка заглушка "x" только для первой таблицы/листинга
-                        xml.writeStartElement(tag);
-                        for (int lvl = 0; lvl < chain.size(); ++lvl)
-                            xml.writeTextElement(QString("CHAPTER%1").arg(lvl+1), "x");
-                        xml.writeTextElement("TabID",     "x");
-                        xml.writeTextElement("TabName",   "x");
-                        xml.writeTextElement("Path",      "x");
-                        xml.writeTextElement("Subtitle",  "x");
-                        xml.writeTextElement("Notes",     "x");
-                        xml.writeTextElement("ProgNotes", "x");
-                        xml.writeTextElement("color",     "x");
-                        xml.writeTextElement("OrderHeader","x");
-                        xml.writeTextElement("font", "x");
-                        xml.writeTextElement("fontsize", "x");
-                        xml.writeTextElement("nestedheader", "x");
-                        xml.writeTextElement("columns", "x");
-                        for (int c = 0; c < maxColumns; ++c) {
-                            const QString base = QString("ColHeader%1").arg(c+1); // Keep original for placeholder
-                            xml.writeTextElement(base,               "x");
-                            xml.writeTextElement(QString("ColHeaderStyleBold%1").arg(c+1),       "x");
-                            xml.writeTextElement(QString("ColHeaderStyleItalic%1").arg(c+1),     "x");
-                            xml.writeTextElement(QString("ColHeaderStyleUnderline%1").arg(c+1),  "x");
-                            xml.writeTextElement(QString("ColHeaderAlign%1").arg(c+1),           "x");
-                        }
-                        xml.writeEndElement();
-                        firstTableOrListing = false; // Mark as no longer the first
-                    }
-                    // первый заголовок
-                    xml.writeStartElement(tag);
-                    for (int lvl = 0; lvl < chain.size(); ++lvl)
-                        xml.writeTextElement(QString("CHAPTER%1").arg(lvl+1),
-                                             stripHtml(categoryManager->getCategoryName(chain[lvl].categoryId)));
-                    xml.writeTextElement("TabID",   QString("%1_%2").arg(prefix, underscored));
-                    xml.writeTextElement("TabName", stripHtml(fullPath + ' ' + t.name));
-                    xml.writeTextElement("Path",    fullPath);
-                    xml.writeTextElement("Subtitle",
-                                         stripHtml(templateManager->getSubtitleForTemplate(t.templateId)));
-                    xml.writeTextElement("Notes",
-                                         stripHtml(templateManager->getNotesForTemplate(t.templateId)));
-                    QString progHtml = templateManager->getProgrammingNotesForTemplate(t.templateId);
-                    xml.writeTextElement("ProgNotes", stripHtml(progHtml));
-                    QRegularExpression cre("color\\s*:\\s*(#[0-9A-Fa-f]{6})");
-                    auto m = cre.match(progHtml);
-                    xml.writeTextElement("color", m.hasMatch() ? m.captured(1) : QString());
-                    xml.writeTextElement("OrderHeader", QString("%1").arg(hr+1,3,10,QChar('0')));
-
-                    // Font and Fontsize
-                    QRegularExpression fontRe("font-family\\s*:\\s*([^;]+)");
-                    QRegularExpression fontSizeRe("font-size\\s*:\\s*([^;]+)");
-                    auto fontMatch = fontRe.match(progHtml);
-                    auto fontSizeMatch = fontSizeRe.match(progHtml);
-                    xml.writeTextElement("font", fontMatch.hasMatch() ? stripHtml(fontMatch.captured(1)) : QString());
-                    xml.writeTextElement("fontsize", fontSizeMatch.hasMatch() ? stripHtml(fontSizeMatch.captured(1)) : QString());
-                    xml.writeTextElement("nestedheader", QString::number(headerRows));
-                    xml.writeTextElement("columns", QString::number(maxColumns));
-
-                    for (int c = 0; c < mtx[hr].size(); ++c) {
-                        auto own = findOwner(hr, c);
-                        QString h = mtx[own.first][own.second].text;
-                        xml.writeTextElement(QString("ColHeader%1").arg(c+1), stripHtml(h)); // Renamed here
-                        writeCellStyles(xml, h, "ColHeader", c+1);
-                    }
-                    xml.writeEndElement();
-                }
+            writeBytes(out, frag.xml);
+            if (frag.tookTablePlaceholder)
+                firstTableOrListing = false;
+            if (frag.tookGraphPlaceholder)
+                firstGraph = false;
+            if (frag.changeSeq >= 0)
+                written.insert(t.templateId, frag);
+        }
 
-                // Данные строк в <TABLE_SHELLS>…</TABLE_SHELLS>
-                for (int r = headerRows; r < mtx.size(); ++r) {
-                    if (firstTableOrListing && r == headerRows) { // This condition will likely not be true due to previous flag reset
-                        // placeholder
-                        xml.writeStartElement(tag + "_SHELLS");
-                        xml.writeTextElement("TabID", "x");
-                        xml.writeTextElement("Order", "x");
-                        xml.writeTextElement("commontext", "x"); // Placeholder for commontext
-                        for (int c = 0; c < maxColumns; ++c) {
-                            xml.writeTextElement(QString("Col%1").arg(c+1),               "x"); // Renamed here
-                            xml.writeTextElement(QString("ColStyleBold%1").arg(c+1),       "x");
-                            xml.writeTextElement(QString("ColStyleItalic%1").arg(c+1),     "x");
-                            xml.writeTextElement(QString("ColStyleUnderline%1").arg(c+1),  "x");
-                            xml.writeTextElement(QString("ColAlign%1").arg(c+1),           "x");
-                        }
-                        xml.writeEndElement();
-                    }
-                    // actual first row
-                    xml.writeStartElement(tag + "_SHELLS");
-                    xml.writeTextElement("TabID", QString("%1_%2").arg(prefix, underscored));
-                    xml.writeTextElement("Order", QString("%1").arg(r-headerRows+1,3,10,QChar('0')));
-
-                    bool rowHasMergedCells = false;
-                    for (int c = 0; c < mtx[r].size(); ++c) {
-                        auto own = findOwner(r, c);
-                        if (mtx[own.first][own.second].colSpan > 1) {
-                            rowHasMergedCells = true;
-                            break;
-                        }
-                    }
-                    if (rowHasMergedCells) {
-                        xml.writeTextElement("commontext", "Y");
-                    }
-
-                    for (int c = 0; c < mtx[r].size(); ++c) {
-                        auto own = findOwner(r, c);
-                        QString cell = mtx[own.first][own.second].text;
-                        xml.writeTextElement(QString("Col%1").arg(c+1), stripHtml(cell)); // Renamed here
-                        writeCellStyles(xml, cell, "Col", c+1);
-                    }
-                    xml.writeEndElement();
-                }
-            } else { // GRATH
-                if (firstGraph) {
-                    xml.writeStartElement(tag);
-                    // строка заглушка для графиков
-                    for (int lvl = 0; lvl < chain.size(); ++lvl)
-                        xml.writeTextElement(QString("CHAPTER%1").arg(lvl+1),   "x");
-                    xml.writeTextElement("TabID",     "x");
-                    xml.writeTextElement("TabName",   "x");
-                    xml.writeTextElement("Order",     "1");
-                    xml.writeTextElement("Subtitle",  "x");
-                    xml.writeTextElement("Notes",     "x");
-                    xml.writeTextElement("ProgNotes", "x");
-                    xml.writeTextElement("color",     "x");
-                    xml.writeTextElement("grtype",     "x");
-                    xml.writeTextElement("font", "x");
-                    xml.writeTextElement("fontsize", "x");
-                    xml.writeEndElement();
-                    firstGraph = false; // Mark as no longer the first
-                }
+        // рекурсия
+        dumpCategory(out, projectId, cat.categoryId, catPath, chain);
+    }
+}
 
+ExportProjectAsXml::Fragment ExportProjectAsXml::renderTemplate(const Template& t,
+                                                                const QString& fullPath,
+                                                                const QStringList& chapters,
+                                                                bool firstTableOrListing,
+                                                                bool firstGraph) {
+    Fragment frag;
+    const bool tableFlagOnEntry = firstTableOrListing;
+    const bool graphFlagOnEntry = firstGraph;
+    FragmentWriter writer(compact);
+    QXmlStreamWriter& xml = writer.writer();
+
+    // подчёркнутый путь
+    QString underscored = fullPath;
+    underscored.replace('.', '_');
+
+    // определить теги
+    const QString type = templateManager->getTemplateType(t.templateId);
+    QString tag    = (type == "listing" ? "LISTING" : (type == "table" ? "TABLE" : "GRATH"));
+    QString prefix = (type == "listing" ? "List" : (type == "table" ? "Tab" : "Fig"));
+
+    if (type == "table" || type == "listing") {
+        // получить матрицу таблицы или листинга
+        const GridStore grid = templateManager->getTableData(t.templateId);
+        if (grid.isEmpty())
+            return frag;
+
+        // владелец объединения, в которое входит ячейка (O(1))
+        auto findOwner = [&](int r, int c) -> QPair<int,int>
+        {
+            const QPoint own = grid.owner(r, c);
+            return { own.y(), own.x() };
+        };
+
+        // сколько строк — заголовков
+        int headerRows = tableManager->getRowCountForHeader(t.templateId);
+        int maxColumns = grid.columnCount();
+
+
+        //  Заголовки в <TABLE>…</TABLE> или <LISTING>…</LISTING>
+        for (int hr = 0; hr < headerRows; ++hr) {
+            if (firstTableOrListing && hr == 0) {
+                // строка заглушка "x" только для первой таблицы/листинга
                 xml.writeStartElement(tag);
-                // вывод основной информации по графику
-                for (int lvl = 0; lvl < chain.size(); ++lvl) {
-                    xml.writeTextElement(
-                        QString("CHAPTER%1").arg(lvl+1),
-                        stripHtml(categoryManager->getCategoryName(chain[lvl].categoryId))
-                        );
+                for (int lvl = 0; lvl < chapters.size(); ++lvl)
+                    xml.writeTextElement(QString("CHAPTER%1").arg(lvl+1), "x");
+                xml.writeTextElement("TabID",     "x");
+                xml.writeTextElement("TabName",   "x");
+                xml.writeTextElement("Path",      "x");
+                xml.writeTextElement("Subtitle",  "x");
+                xml.writeTextElement("Notes",     "x");
+                xml.writeTextElement("ProgNotes", "x");
+                xml.writeTextElement("color",     "x");
+                xml.writeTextElement("OrderHeader","x");
+                xml.writeTextElement("font", "x");
+                xml.writeTextElement("fontsize", "x");
+                xml.writeTextElement("nestedheader", "x");
+                xml.writeTextElement("columns", "x");
+                for (int c = 0; c < maxColumns; ++c) {
+                    const QString base = QString("ColHeader%1").arg(c+1); // Keep original for placeholder
+                    xml.writeTextElement(base,               "x");
+                    xml.writeTextElement(QString("ColHeaderStyleBold%1").arg(c+1),       "x");
+                    xml.writeTextElement(QString("ColHeaderStyleItalic%1").arg(c+1),     "x");
+                    xml.writeTextElement(QString("ColHeaderStyleUnderline%1").arg(c+1),  "x");
+                    xml.writeTextElement(QString("ColHeaderAlign%1").arg(c+1),           "x");
                 }
-                xml.writeTextElement("TabID", QString("%1_%2").arg(prefix, underscored));
-                xml.writeTextElement("TabName", stripHtml(t.name));
-                xml.writeTextElement("Order", QString::number(1));
-                xml.writeTextElement("Subtitle",
-                                     stripHtml(templateManager->getSubtitleForTemplate(t.templateId)));
-                xml.writeTextElement("Notes",
-                                     stripHtml(templateManager->getNotesForTemplate(t.templateId)));
-                QString progHtml = templateManager->getProgrammingNotesForTemplate(t.templateId);
-                xml.writeTextElement("ProgNotes", stripHtml(progHtml));
-                QRegularExpression colorRe("color\\s*:\\s*(#[0-9A-Fa-f]{6})");
-                auto match = colorRe.match(progHtml);
-                xml.writeTextElement("color", match.hasMatch() ? match.captured(1) : QString());
-                xml.writeTextElement("grtype",
-                                     stripHtml(templateManager->getGraphType(t.templateId)));
-
-                // Font and Fontsize for graphs
-                QRegularExpression fontRe("font-family\\s*:\\s*([^;]+)");
-                QRegularExpression fontSizeRe("font-size\\s*:\\s*([^;]+)");
-                auto fontMatch = fontRe.match(progHtml);
-                auto fontSizeMatch = fontSizeRe.match(progHtml);
-                xml.writeTextElement("font", fontMatch.hasMatch() ? stripHtml(fontMatch.captured(1)) : QString());
-                xml.writeTextElement("fontsize", fontSizeMatch.hasMatch() ? stripHtml(fontSizeMatch.captured(1)) : QString());
+                xml.writeEndElement();
+                firstTableOrListing = false; // Mark as no longer the first
+            }
+            // первый заголовок
+            xml.writeStartElement(tag);
+            for (int lvl = 0; lvl < chapters.size(); ++lvl)
+                xml.writeTextElement(QString("CHAPTER%1").arg(lvl+1), chapters[lvl]);
+            xml.writeTextElement("TabID",   QString("%1_%2").arg(prefix, underscored));
+            xml.writeTextElement("TabName", stripHtml(fullPath + ' ' + t.name));
+            xml.writeTextElement("Path",    fullPath);
+            xml.writeTextElement("Subtitle",
+                                 stripHtml(templateManager->getSubtitleForTemplate(t.templateId)));
+            xml.writeTextElement("Notes",
+                                 stripHtml(templateManager->getNotesForTemplate(t.templateId)));
+            QString progHtml = templateManager->getProgrammingNotesForTemplate(t.templateId);
+            xml.writeTextElement("ProgNotes", stripHtml(progHtml));
+            QRegularExpression cre("color\\s*:\\s*(#[0-9A-Fa-f]{6})");
+            auto m = cre.match(progHtml);
+            xml.writeTextElement("color", m.hasMatch() ? m.captured(1) : QString());
+            xml.writeTextElement("OrderHeader", QString("%1").arg(hr+1,3,10,QChar('0')));
+
+            // Font and Fontsize
+            QRegularExpression fontRe("font-family\\s*:\\s*([^;]+)");
+            QRegularExpression fontSizeRe("font-size\\s*:\\s*([^;]+)");
+            auto fontMatch = fontRe.match(progHtml);
+            auto fontSizeMatch = fontSizeRe.match(progHtml);
+            xml.writeTextElement("font", fontMatch.hasMatch() ? stripHtml(fontMatch.captured(1)) : QString());
+            xml.writeTextElement("fontsize", fontSizeMatch.hasMatch() ? stripHtml(fontSizeMatch.captured(1)) : QString());
+            xml.writeTextElement("nestedheader", QString::number(headerRows));
+            xml.writeTextElement("columns", QString::number(maxColumns));
+
+            for (int c = 0; c < maxColumns; ++c) {
+                auto own = findOwner(hr, c);
+                QString h = grid.text(own.first, own.second);
+                xml.writeTextElement(QString("ColHeader%1").arg(c+1), stripHtml(h)); // Renamed here
+                writeCellStyles(xml, h, "ColHeader", c+1);
+            }
+            xml.writeEndElement();
+        }
 
+        // Данные строк в <TABLE_SHELLS>…</TABLE_SHELLS>
+        for (int r = headerRows; r < grid.rowCount(); ++r) {
+            if (firstTableOrListing && r == headerRows) { // This condition will likely not be true due to previous flag reset
+                // placeholder
+                xml.writeStartElement(tag + "_SHELLS");
+                xml.writeTextElement("TabID", "x");
+                xml.writeTextElement("Order", "x");
+                xml.writeTextElement("commontext", "x"); // Placeholder for commontext
+                for (int c = 0; c < maxColumns; ++c) {
+                    xml.writeTextElement(QString("Col%1").arg(c+1),               "x"); // Renamed here
+                    xml.writeTextElement(QString("ColStyleBold%1").arg(c+1),       "x");
+                    xml.writeTextElement(QString("ColStyleItalic%1").arg(c+1),     "x");
+                    xml.writeTextElement(QString("ColStyleUnderline%1").arg(c+1),  "x");
+                    xml.writeTextElement(QString("ColAlign%1").arg(c+1),           "x");
+                }
                 xml.writeEndElement();
             }
+            // actual first row
+            xml.writeStartElement(tag + "_SHELLS");
+            xml.writeTextElement("TabID", QString("%1_%2").arg(prefix, underscored));
+            xml.writeTextElement("Order", QString("%1").arg(r-headerRows+1,3,10,QChar('0')));
+
+            bool rowHasMergedCells = false;
+            for (int c = 0; c < maxColumns; ++c) {
+                auto own = findOwner(r, c);
+                if (grid.colSpan(own.first, own.second) > 1) {
+                    rowHasMergedCells = true;
+                    break;
+                }
+            }
+            if (rowHasMergedCells) {
+                xml.writeTextElement("commontext", "Y");
+            }
+
+            for (int c = 0; c < maxColumns; ++c) {
+                auto own = findOwner(r, c);
+                QString cell = grid.text(own.first, own.second);
+                xml.writeTextElement(QString("Col%1").arg(c+1), stripHtml(cell)); // Renamed here
+                writeCellStyles(xml, cell, "Col", c+1);
+            }
+            xml.writeEndElement();
+        }
+    } else { // GRATH
+        if (firstGraph) {
+            xml.writeStartElement(tag);
+            // строка заглушка для графиков
+            for (int lvl = 0; lvl < chapters.size(); ++lvl)
+                xml.writeTextElement(QString("CHAPTER%1").arg(lvl+1),   "x");
+            xml.writeTextElement("TabID",     "x");
+            xml.writeTextElement("TabName",   "x");
+            xml.writeTextElement("Order",     "1");
+            xml.writeTextElement("Subtitle",  "x");
+            xml.writeTextElement("Notes",     "x");
+            xml.writeTextElement("ProgNotes", "x");
+            xml.writeTextElement("color",     "x");
+            xml.writeTextElement("grtype",     "x");
+            xml.writeTextElement("font", "x");
+            xml.writeTextElement("fontsize", "x");
+            xml.writeEndElement();
+            firstGraph = false; // Mark as no longer the first
         }
 
-        // рекурсия
-        dumpCategory(xml, projectId, cat.categoryId, catPath, chain);
-    }
-}
+        xml.writeStartElement(tag);
+        // вывод основной информации по графику
+        for (int lvl = 0; lvl < chapters.size(); ++lvl) {
+            xml.writeTextElement(
+                QString("CHAPTER%1").arg(lvl+1),
+                chapters[lvl]
+                );
+        }
+        xml.writeTextElement("TabID", QString("%1_%2").arg(prefix, underscored));
+        xml.writeTextElement("TabName", stripHtml(t.name));
+        xml.writeTextElement("Order", QString::number(1));
+        xml.writeTextElement("Subtitle",
+                             stripHtml(templateManager->getSubtitleForTemplate(t.templateId)));
+        xml.writeTextElement("Notes",
+                             stripHtml(templateManager->getNotesForTemplate(t.templateId)));
+        QString progHtml = templateManager->getProgrammingNotesForTemplate(t.templateId);
+        xml.writeTextElement("ProgNotes", stripHtml(progHtml));
+        QRegularExpression colorRe("color\\s*:\\s*(#[0-9A-Fa-f]{6})");
+        auto match = colorRe.match(progHtml);
+        xml.writeTextElement("color", match.hasMatch() ? match.captured(1) : QString());
+        xml.writeTextElement("grtype",
+                             stripHtml(templateManager->getGraphType(t.templateId)));
+
+        // Font and Fontsize for graphs
+        QRegularExpression fontRe("font-family\\s*:\\s*([^;]+)");
+        QRegularExpression fontSizeRe("font-size\\s*:\\s*([^;]+)");
+        auto fontMatch = fontRe.match(progHtml);
+        auto fontSizeMatch = fontSizeRe.match(progHtml);
+        xml.writeTextElement("font", fontMatch.hasMatch() ? stripHtml(fontMatch.captured(1)) : QString());
+        xml.writeTextElement("fontsize", fontSizeMatch.hasMatch() ? stripHtml(fontSizeMatch.captured(1)) : QString());
 
+        xml.writeEndElement();
+    }
 
+    frag.xml = writer.finish();
+    frag.tookTablePlaceholder = tableFlagOnEntry && !firstTableOrListing;
+    frag.tookGraphPlaceholder = graphFlagOnEntry && !firstGraph;
+    return frag;
+}
 
 QString ExportProjectAsXml::stripHtml(const QString& html) const {
     QTextDocument doc;
@@ -329,12 +503,18 @@ void ExportProjectAsXml::writeCellStyles(QXmlStreamWriter& xml,
     }
 
 
-    xml.writeTextElement(QString("%1StyleBold%2").arg(tagBase).arg(colIndex),
-                         bold ? "Y" : QString());
-    xml.writeTextElement(QString("%1StyleItalic%2").arg(tagBase).arg(colIndex),
-                         italic ? "Y" : QString());
-    xml.writeTextElement(QString("%1StyleUnderline%2").arg(tagBase).arg(colIndex),
-                         underline ? "Y" : QString());
+    // Флаги почти всегда пусты: в компактном режиме <Tag/> вместо <Tag></Tag>
+    auto writeFlag = [&](const QString& name, bool on) {
+        if (on)
+            xml.writeTextElement(name, "Y");
+        else if (compact)
+            xml.writeEmptyElement(name);
+        else
+            xml.writeTextElement(name, QString());
+    };
+    writeFlag(QString("%1StyleBold%2").arg(tagBase).arg(colIndex), bold);
+    writeFlag(QString("%1StyleItalic%2").arg(tagBase).arg(colIndex), italic);
+    writeFlag(QString("%1StyleUnderline%2").arg(tagBase).arg(colIndex), underline);
     xml.writeTextElement(QString("%1Align%2").arg(tagBase).arg(colIndex), align);
 }
 
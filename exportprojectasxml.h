@@ -2,7 +2,11 @@
 #define EXPORTPROJECTASXML_H
 
 #include <QString>
+#include <QStringList>
 #include <QVariant>
+#include <QHash>
+#include <QByteArray>
+#include <QIODevice>
 #include <QXmlStreamWriter>
 #include "projectmanager.h"
 #include "categorymanager.h"
@@ -16,19 +20,64 @@ public:
                        TemplateManager* templateManager,
                        TableManager* tableManager);
 
+    // Каталог кэша фрагментов (DatabaseHandler::cacheDirectory()). Без него
+    // каждый экспорт заново отрисовывает все шаблоны
+    void setCacheDirectory(const QString& dir) { cacheDir = dir; }
+
+    enum class Compression { None, Gzip };
+    // Без отступов и переводов строк, пустые стили ячеек - <Tag/>
+    void setCompact(bool on) { compact = on; }
+    // Сжатие потоком при записи, файл целиком в памяти не собирается
+    void setCompression(Compression c) { compression = c; }
+
     bool exportProject(int projectId, const QString& filename);
+
+    // Статистика последнего экспорта
+    int renderedTemplates() const { return renderedCount; }
+    int reusedTemplates() const { return reusedCount; }
+
 private:
+    // Отрисованный XML одного шаблона и условия, при которых он ещё годен
+    struct Fragment {
+        qint64     changeSeq = -1;
+        QByteArray context;            // путь, главы и флаги заглушек на входе
+        QByteArray xml;
+        bool       tookTablePlaceholder = false;   // сбросил firstTableOrListing
+        bool       tookGraphPlaceholder = false;   // сбросил firstGraph
+    };
+
     ProjectManager*  projectManager;
     CategoryManager* categoryManager;
     TemplateManager* templateManager;
     TableManager* tableManager;
 
-    void writeProjectBlock(QXmlStreamWriter& xml, int projectId);
-    void dumpCategory(QXmlStreamWriter& xml,
+    QString cacheDir;
+    bool compact = false;
+    Compression compression = Compression::None;
+    bool writeFailed = false;
+    QHash<int, qint64>   changeSeqs;   // template_id -> change_seq на момент экспорта
+    qint64 changeCounter = -1;         // счётчик change_seq базы на момент экспорта
+    QHash<int, Fragment> cached;       // кэш прошлого экспорта
+    QHash<int, Fragment> written;      // фрагменты этого экспорта - новый кэш
+    int renderedCount = 0;
+    int reusedCount = 0;
+
+    QString cacheFile(int projectId) const;
+    void loadCache(int projectId);
+    void saveCache(int projectId) const;
+
+    QByteArray renderProjectBlock(int projectId);
+    void dumpCategory(QIODevice& out,
                       int projectId,
                       const QVariant& parentId,
                       const QString& path,
-                      const QList<Category>& ancestors);
+                      const QStringList& chapters);
+    Fragment renderTemplate(const Template& t,
+                            const QString& fullPath,
+                            const QStringList& chapters,
+                            bool firstTableOrListing,
+                            bool firstGraph);
+    void writeBytes(QIODevice& out, const QByteArray& bytes);
     QString stripHtml(const QString& html) const;
     void writeCellStyles(QXmlStreamWriter& xml,
                          const QString& htmlCell,
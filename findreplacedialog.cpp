@@ -0,0 +1,113 @@
+#include "findreplacedialog.h"
+#include "commands.h"
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QFormLayout>
+#include <QHeaderView>
+#include <QMessageBox>
+#include <QApplication>
+
+FindReplaceDialog::FindReplaceDialog(ReplaceManager *manager, int projectId,
+                                     QUndoStack *undoStack, QWidget *parent)
+    : QDialog(parent), manager(manager), projectId(projectId), undoStack(undoStack) {
+    setWindowTitle(tr("Find and replace in project"));
+    resize(700, 480);
+
+    findEdit    = new QLineEdit(this);
+    replaceEdit = new QLineEdit(this);
+    caseCheck   = new QCheckBox(tr("Match case"), this);
+
+    QFormLayout *form = new QFormLayout;
+    form->addRow(tr("Find:"), findEdit);
+    form->addRow(tr("Replace with:"), replaceEdit);
+    form->addRow(QString(), caseCheck);
+
+    previewTree = new QTreeWidget(this);
+    previewTree->setColumnCount(5);
+    previewTree->setHeaderLabels({tr("Template"), tr("Cells"), tr("Subtitle"), tr("Notes"),
+                                  tr("Programming notes")});
+    previewTree->setRootIsDecorated(false);
+    previewTree->header()->setSectionResizeMode(0, QHeaderView::Stretch);
+
+    summaryLabel  = new QLabel(this);
+    previewButton = new QPushButton(tr("Preview"), this);
+    replaceButton = new QPushButton(tr("Replace all"), this);
+    QPushButton *closeButton = new QPushButton(tr("Close"), this);
+    replaceButton->setEnabled(false);
+
+    QHBoxLayout *buttons = new QHBoxLayout;
+    buttons->addWidget(summaryLabel);
+    buttons->addStretch();
+    buttons->addWidget(previewButton);
+    buttons->addWidget(replaceButton);
+    buttons->addWidget(closeButton);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addLayout(form);
+    layout->addWidget(previewTree);
+    layout->addLayout(buttons);
+
+    connect(previewButton, &QPushButton::clicked, this, &FindReplaceDialog::showPreview);
+    connect(findEdit, &QLineEdit::returnPressed, this, &FindReplaceDialog::showPreview);
+    connect(replaceButton, &QPushButton::clicked, this, &FindReplaceDialog::replaceAll);
+    connect(closeButton, &QPushButton::clicked, this, &QDialog::close);
+    // Предпросмотр устарел - заменять можно только после нового
+    auto invalidate = [this]() {
+        replaceButton->setEnabled(false);
+    };
+    connect(findEdit, &QLineEdit::textChanged, this, invalidate);
+    connect(caseCheck, &QCheckBox::toggled, this, invalidate);
+}
+
+void FindReplaceDialog::showPreview() {
+    previewTree->clear();
+    summaryLabel->clear();
+    if (findEdit->text().isEmpty())
+        return;
+
+    emit aboutToReplace();          // предпросмотр должен видеть несохранённые правки
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    const QVector<ReplacePreview> found =
+        manager->preview(projectId, findEdit->text(), caseCheck->isChecked());
+    QApplication::restoreOverrideCursor();
+
+    int cells = 0;
+    for (const ReplacePreview &p : found) {
+        QTreeWidgetItem *item = new QTreeWidgetItem(previewTree);
+        item->setText(0, p.templateName);
+        item->setText(1, p.cells ? QString::number(p.cells) : QString());
+        item->setText(2, p.subtitle ? QString("✓") : QString());
+        item->setText(3, p.notes ? QString("✓") : QString());
+        item->setText(4, p.programmingNotes ? QString("✓") : QString());
+        cells += p.cells;
+    }
+    summaryLabel->setText(tr("%1 templates, %2 cells").arg(found.size()).arg(cells));
+    replaceButton->setEnabled(!found.isEmpty());
+}
+
+void FindReplaceDialog::replaceAll() {
+    const QString find = findEdit->text();
+    const QString replacement = replaceEdit->text();
+    if (find.isEmpty())
+        return;
+
+    emit aboutToReplace();
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    auto changes = manager->replaceAll(projectId, find, replacement, caseCheck->isChecked());
+    QApplication::restoreOverrideCursor();
+    if (!changes) {
+        QMessageBox::warning(this, tr("Error"), tr("Replacement failed, nothing was changed."));
+        return;
+    }
+
+    const QSet<int> touched = ReplaceManager::templatesOf(*changes);
+    summaryLabel->setText(tr("Replaced %1 values in %2 templates")
+                              .arg(changes->size()).arg(touched.size()));
+    previewTree->clear();
+    replaceButton->setEnabled(false);
+    if (changes->isEmpty())
+        return;
+
+    undoStack->push(new ReplaceTextCommand(manager, std::move(*changes), find, replacement));
+    emit templatesChanged(touched);
+}
@@ -0,0 +1,43 @@
+#ifndef FINDREPLACEDIALOG_H
+#define FINDREPLACEDIALOG_H
+
+#include <QDialog>
+#include <QLineEdit>
+#include <QCheckBox>
+#include <QPushButton>
+#include <QTreeWidget>
+#include <QLabel>
+#include <QUndoStack>
+#include "replacemanager.h"
+
+// Поиск и замена по всем шаблонам проекта с предпросмотром.
+// Замена попадает в undoStack одной командой
+class FindReplaceDialog : public QDialog {
+    Q_OBJECT
+public:
+    FindReplaceDialog(ReplaceManager *manager, int projectId, QUndoStack *undoStack,
+                      QWidget *parent = nullptr);
+
+signals:
+    void aboutToReplace();                          // сохранить открытые правки
+    void templatesChanged(const QSet<int> &templateIds);
+
+private slots:
+    void showPreview();
+    void replaceAll();
+
+private:
+    ReplaceManager *manager;
+    int             projectId;
+    QUndoStack     *undoStack;
+
+    QLineEdit   *findEdit;
+    QLineEdit   *replaceEdit;
+    QCheckBox   *caseCheck;
+    QTreeWidget *previewTree;
+    QLabel      *summaryLabel;
+    QPushButton *previewButton;
+    QPushButton *replaceButton;
+};
+
+#endif // FINDREPLACEDIALOG_H
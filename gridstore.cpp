@@ -0,0 +1,35 @@
+#include "gridstore.h"
+
+GridStore::GridStore(int rows, int cols) {
+    reset(rows, cols);
+}
+
+void GridStore::reset(int rowCount, int colCount) {
+    rows = qMax(0, rowCount);
+    cols = qMax(0, colCount);
+    cells.fill(Slot(), rows * cols);
+    arena.clear();
+    spanIdx.clear();
+}
+
+QStringView GridStore::textView(int row, int col) const {
+    const Slot &s = cells[index(row, col)];
+    return QStringView(arena).mid(s.textOffset, s.textLength);
+}
+
+void GridStore::setText(int row, int col, QStringView text) {
+    // Прежний текст ячейки остаётся в буфере: таблица заполняется один раз
+    // при загрузке, правки идут через виджет, а не через GridStore
+    Slot &s = cells[index(row, col)];
+    s.textOffset = quint32(arena.size());
+    s.textLength = quint32(text.size());
+    arena.append(text);
+}
+
+void GridStore::setSpan(int row, int col, int rowSpan, int colSpan) {
+    // Объединение не выходит за границы таблицы; пересекающиеся
+    // (испорченные данные) пропускаются
+    rowSpan = qBound(1, rowSpan, rows - row);
+    colSpan = qBound(1, colSpan, cols - col);
+    spanIdx.addSpan(row, col, rowSpan, colSpan);
+}
@@ -0,0 +1,66 @@
+#ifndef GRIDSTORE_H
+#define GRIDSTORE_H
+
+#include <QVector>
+#include <QString>
+#include <QStringView>
+#include <QColor>
+#include "spanindex.h"
+
+// Компактное представление таблицы шаблона (строки и столбцы 0-based).
+//
+// Все ячейки лежат в одном непрерывном массиве по строкам, цвет хранится
+// как 32-битный RGBA, текст всех ячеек - в одном общем буфере (ячейка
+// хранит только смещение и длину). Объединения - отдельной таблицей:
+// у большинства ячеек их нет.
+class GridStore {
+public:
+    static constexpr QRgb DefaultColour = 0xFFFFFFFF;   // белый
+
+    GridStore() = default;
+    GridStore(int rows, int cols);
+
+    void reset(int rows, int cols);
+    void reserveText(qsizetype chars) { arena.reserve(chars); }
+
+    int  rowCount() const    { return rows; }
+    int  columnCount() const { return cols; }
+    bool isEmpty() const     { return rows == 0 || cols == 0; }
+
+    // Текст ячейки; представление действительно до следующего setText()
+    QStringView textView(int row, int col) const;
+    QString     text(int row, int col) const { return textView(row, col).toString(); }
+    void        setText(int row, int col, QStringView text);
+
+    QRgb    rgba(int row, int col) const { return cells[index(row, col)].colour; }
+    QColor  colour(int row, int col) const { return QColor::fromRgba(rgba(row, col)); }
+    void    setColour(int row, int col, QRgb colour) { cells[index(row, col)].colour = colour; }
+
+    // Как в базе: 1 - обычная ячейка, >1 - владелец объединения,
+    // 0 - ячейка закрыта объединением
+    int  rowSpan(int row, int col) const   { return spanIdx.rowSpan(row, col); }
+    int  colSpan(int row, int col) const   { return spanIdx.colSpan(row, col); }
+    bool isCovered(int row, int col) const { return spanIdx.isCovered(row, col); }
+    QPoint owner(int row, int col) const   { return spanIdx.owner(row, col); }
+    void setSpan(int row, int col, int rowSpan, int colSpan);
+
+    const SpanIndex &spanIndex() const { return spanIdx; }
+    const QVector<SpanIndex::Area> &spans() const { return spanIdx.areas(); }
+
+private:
+    struct Slot {
+        quint32 textOffset = 0;
+        quint32 textLength = 0;
+        QRgb    colour     = DefaultColour;
+    };
+
+    int index(int row, int col) const { return row * cols + col; }
+
+    int rows = 0;
+    int cols = 0;
+    QVector<Slot>   cells;          // rows * cols
+    QString         arena;          // текст всех ячеек подряд
+    SpanIndex       spanIdx;
+};
+
+#endif // GRIDSTORE_H
@@ -0,0 +1,83 @@
+#include "gzipdevice.h"
+#include <QDebug>
+#include <zlib.h>
+#include <limits>
+
+namespace {
+constexpr int ChunkSize = 64 * 1024;
+}
+
+struct GzipDevice::Stream {
+    z_stream zs {};
+    bool     active = false;
+    char     out[ChunkSize];
+};
+
+GzipDevice::GzipDevice(QIODevice *sink, int level)
+    : d(new Stream), sink(sink), level(level) {}
+
+GzipDevice::~GzipDevice() {
+    close();
+}
+
+bool GzipDevice::open(OpenMode mode) {
+    if ((mode & ReadOnly) || !(mode & WriteOnly) || !sink || !sink->isWritable()) {
+        setErrorString(QStringLiteral("gzip: only writing to an open device is supported"));
+        return false;
+    }
+    d->zs = z_stream {};
+    // 15 + 16: окно 32 КБ и заголовок gzip вместо zlib
+    if (deflateInit2(&d->zs, level, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        setErrorString(QStringLiteral("gzip: deflateInit2 failed"));
+        return false;
+    }
+    d->active = true;
+    return QIODevice::open(mode | Unbuffered);
+}
+
+bool GzipDevice::finish() {
+    if (!d->active)
+        return true;
+    // Z_FINISH сбрасывает остаток и пишет хвост gzip
+    const bool ok = deflateInput(Z_FINISH);
+    if (!ok)
+        qWarning() << "GzipDevice: stream finished with error:" << errorString();
+    deflateEnd(&d->zs);
+    d->active = false;
+    QIODevice::close();
+    return ok;
+}
+
+qint64 GzipDevice::writeData(const char *data, qint64 len) {
+    // avail_in - 32-битный: большие куски подаются частями
+    qint64 done = 0;
+    while (done < len) {
+        const uInt part = uInt(qMin<qint64>(len - done, std::numeric_limits<uInt>::max()));
+        d->zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data + done));
+        d->zs.avail_in = part;
+        if (!deflateInput(Z_NO_FLUSH))
+            return -1;
+        done += part;
+    }
+    return len;
+}
+
+bool GzipDevice::deflateInput(int flush) {
+    int rc = Z_OK;
+    do {
+        d->zs.next_out = reinterpret_cast<Bytef *>(d->out);
+        d->zs.avail_out = ChunkSize;
+        rc = deflate(&d->zs, flush);
+        if (rc == Z_STREAM_ERROR) {
+            setErrorString(QStringLiteral("gzip: deflate failed"));
+            return false;
+        }
+        const qint64 produced = ChunkSize - d->zs.avail_out;
+        if (produced > 0 && sink->write(d->out, produced) != produced) {
+            setErrorString(QStringLiteral("gzip: ") + sink->errorString());
+            return false;
+        }
+        // Пока выходной буфер заполняется целиком, у zlib есть ещё данные
+    } while (d->zs.avail_out == 0 || (flush == Z_FINISH && rc != Z_STREAM_END));
+    return true;
+}
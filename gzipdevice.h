@@ -0,0 +1,36 @@
+#ifndef GZIPDEVICE_H
+#define GZIPDEVICE_H
+
+#include <QIODevice>
+#include <memory>
+
+// Сжатие gzip на лету поверх другого устройства, только запись.
+// Данные уходят в приёмник блоками по мере заполнения буфера zlib,
+// поэтому весь файл в памяти не собирается. close() дописывает хвост
+// потока (CRC и длину); сам приёмник не закрывается
+class GzipDevice : public QIODevice {
+public:
+    // level: 1 - быстрее, 9 - плотнее; -1 - по умолчанию zlib (6)
+    explicit GzipDevice(QIODevice *sink, int level = -1);
+    ~GzipDevice() override;
+
+    bool open(OpenMode mode) override;
+    // Дописать хвост потока и закрыть; false - приёмник не принял данные
+    bool finish();
+    void close() override { finish(); }
+    bool isSequential() const override { return true; }
+
+protected:
+    qint64 readData(char *, qint64) override { return -1; }
+    qint64 writeData(const char *data, qint64 len) override;
+
+private:
+    bool deflateInput(int flush);
+
+    struct Stream;
+    std::unique_ptr<Stream> d;
+    QIODevice *sink;
+    int level;
+};
+
+#endif // GZIPDEVICE_H
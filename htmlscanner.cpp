@@ -0,0 +1,239 @@
+#include "htmlscanner.h"
+#include <QLatin1String>
+
+namespace {
+
+bool isSpace(QChar c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+bool is(QStringView name, const char *tag) {
+    return name.compare(QLatin1String(tag), Qt::CaseInsensitive) == 0;
+}
+
+// После этих тегов текст продолжается с новой строки
+bool isBlockTag(QStringView name) {
+    static const char *const blocks[] = {
+        "p", "div", "br", "li", "tr", "table", "ul", "ol", "blockquote", "pre", "hr",
+        "h1", "h2", "h3", "h4", "h5", "h6"
+    };
+    for (const char *tag : blocks)
+        if (is(name, tag))
+            return true;
+    return false;
+}
+
+// Содержимое этих тегов - не текст
+bool isSkippedTag(QStringView name) {
+    return is(name, "head") || is(name, "style") || is(name, "script") || is(name, "title");
+}
+
+// Значение CSS-свойства в атрибутах тега: "font-weight:600;" -> "600"
+QStringView cssValue(QStringView attrs, QLatin1String property) {
+    const qsizetype at = attrs.indexOf(property, 0, Qt::CaseInsensitive);
+    if (at < 0)
+        return {};
+    qsizetype i = at + property.size();
+    while (i < attrs.size() && isSpace(attrs[i]))
+        ++i;
+    if (i >= attrs.size() || attrs[i] != ':')
+        return {};
+    ++i;
+    qsizetype end = i;
+    while (end < attrs.size() && attrs[end] != ';' && attrs[end] != '"' && attrs[end] != '\'')
+        ++end;
+    return attrs.mid(i, end - i).trimmed();
+}
+
+// Значение HTML-атрибута: align="center" / align=center
+QStringView attrValue(QStringView attrs, QLatin1String attr) {
+    for (qsizetype at = attrs.indexOf(attr, 0, Qt::CaseInsensitive); at >= 0;
+         at = attrs.indexOf(attr, at + 1, Qt::CaseInsensitive)) {
+        if (at > 0 && !isSpace(attrs[at - 1]))
+            continue;                               // часть другого имени (text-align)
+        qsizetype i = at + attr.size();
+        while (i < attrs.size() && isSpace(attrs[i]))
+            ++i;
+        if (i >= attrs.size() || attrs[i] != '=')
+            continue;
+        ++i;
+        while (i < attrs.size() && isSpace(attrs[i]))
+            ++i;
+        const bool quoted = i < attrs.size() && (attrs[i] == '"' || attrs[i] == '\'');
+        const QChar quote = quoted ? attrs[i++] : QChar();
+        qsizetype end = i;
+        while (end < attrs.size()
+               && (quoted ? attrs[end] != quote : !isSpace(attrs[end]) && attrs[end] != '/'))
+            ++end;
+        return attrs.mid(i, end - i);
+    }
+    return {};
+}
+
+QChar alignCode(QStringView value) {
+    if (is(value, "right"))
+        return 'r';
+    if (is(value, "center") || is(value, "justify"))
+        return 'c';
+    if (is(value, "left"))
+        return 'l';
+    return QChar();
+}
+
+void applyTag(QStringView name, QStringView attrs, HtmlSummary &out, bool &alignSeen) {
+    if (is(name, "b") || is(name, "strong"))
+        out.bold = true;
+    else if (is(name, "i") || is(name, "em"))
+        out.italic = true;
+    else if (is(name, "u"))
+        out.underline = true;
+
+    if (attrs.isEmpty())
+        return;
+    const QStringView weight = cssValue(attrs, QLatin1String("font-weight"));
+    if (is(weight, "bold")
+        || (weight.size() == 3 && weight[0] >= '6' && weight[0] <= '9' && weight.endsWith(u"00")))
+        out.bold = true;
+    if (is(cssValue(attrs, QLatin1String("font-style")), "italic"))
+        out.italic = true;
+    if (cssValue(attrs, QLatin1String("text-decoration")).startsWith(u"underline", Qt::CaseInsensitive))
+        out.underline = true;
+
+    // Как и в экспорте XML, считается первое встреченное выравнивание
+    if (!alignSeen) {
+        QChar code = alignCode(attrValue(attrs, QLatin1String("align")));
+        if (code.isNull())
+            code = alignCode(cssValue(attrs, QLatin1String("text-align")));
+        if (!code.isNull()) {
+            out.align = code;
+            alignSeen = true;
+        }
+    }
+}
+
+// &amp; &#160; &#xA0; ... -> символ; QChar() - неизвестная сущность
+QChar decodeEntity(QStringView name) {
+    if (name.startsWith('#')) {
+        bool ok = false;
+        const uint code = (name.size() > 1 && (name[1] == 'x' || name[1] == 'X'))
+                              ? name.mid(2).toUInt(&ok, 16)
+                              : name.mid(1).toUInt(&ok, 10);
+        if (!ok)
+            return QChar();
+        if (code == 0xA0)
+            return ' ';
+        return code <= 0xFFFF ? QChar(char16_t(code)) : QChar(QChar::ReplacementCharacter);
+    }
+    if (name == u"amp")  return '&';
+    if (name == u"lt")   return '<';
+    if (name == u"gt")   return '>';
+    if (name == u"quot") return '"';
+    if (name == u"apos") return '\'';
+    if (name == u"nbsp") return ' ';     // toPlainText() тоже отдаёт обычный пробел
+    return QChar();
+}
+
+} // namespace
+
+HtmlSummary HtmlScanner::scan(QStringView html) {
+    HtmlSummary out;
+    QString &text = out.text;
+    text.reserve(html.size());
+    bool pendingSpace = false;
+    bool pendingBreak = false;
+    bool alignSeen = false;
+
+    // Пробелы и переводы строк копятся и пишутся только перед следующим
+    // символом: так края обрезаются без второго прохода
+    auto put = [&](QChar ch) {
+        if (!text.isEmpty()) {
+            if (pendingBreak)
+                text += '\n';
+            else if (pendingSpace)
+                text += ' ';
+        }
+        pendingBreak = pendingSpace = false;
+        text += ch;
+    };
+
+    const qsizetype n = html.size();
+    for (qsizetype i = 0; i < n; ++i) {
+        const QChar ch = html[i];
+
+        if (ch == '<') {
+            if (html.mid(i, 4) == u"<!--") {
+                const qsizetype end = html.indexOf(u"-->", i + 4);
+                i = end < 0 ? n : end + 2;
+                continue;
+            }
+            qsizetype j = i + 1;
+            const bool closing = j < n && html[j] == '/';
+            if (closing)
+                ++j;
+            const qsizetype nameStart = j;
+            while (j < n && html[j].isLetterOrNumber())
+                ++j;
+            const QStringView name = html.mid(nameStart, j - nameStart);
+            const bool declaration = j < n && (html[j] == '!' || html[j] == '?');
+            if (name.isEmpty() && !declaration) {
+                put(ch);                            // одиночный '<' в простом тексте
+                continue;
+            }
+
+            // конец тега; '>' внутри кавычек атрибута его не закрывает
+            QChar quote;
+            qsizetype end = j;
+            for (; end < n; ++end) {
+                const QChar c = html[end];
+                if (!quote.isNull()) {
+                    if (c == quote)
+                        quote = QChar();
+                } else if (c == '"' || c == '\'') {
+                    quote = c;
+                } else if (c == '>') {
+                    break;
+                }
+            }
+            const QStringView attrs = html.mid(j, end - j);
+            i = end;
+            if (name.isEmpty())                     // <!DOCTYPE>, <?xml?>
+                continue;
+
+            if (!closing && isSkippedTag(name)) {
+                const QString close = "</" + name.toString();
+                const qsizetype at = html.indexOf(close, end, Qt::CaseInsensitive);
+                const qsizetype gt = at < 0 ? -1 : html.indexOf('>', at);
+                i = gt < 0 ? n : gt;
+                continue;
+            }
+            if (isBlockTag(name))
+                pendingBreak = true;
+            else if (is(name, "td") || is(name, "th"))
+                pendingSpace = true;
+            if (!closing)
+                applyTag(name, attrs, out, alignSeen);
+            continue;
+        }
+
+        if (ch == '&') {
+            const qsizetype semi = html.indexOf(';', i + 1);
+            if (semi > i + 1 && semi - i <= 10) {
+                const QChar decoded = decodeEntity(html.mid(i + 1, semi - i - 1));
+                if (!decoded.isNull()) {
+                    put(decoded);
+                    i = semi;
+                    continue;
+                }
+            }
+            put(ch);
+            continue;
+        }
+
+        if (isSpace(ch)) {
+            pendingSpace = true;
+            continue;
+        }
+        put(ch);
+    }
+    return out;
+}
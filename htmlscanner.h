@@ -0,0 +1,28 @@
+#ifndef HTMLSCANNER_H
+#define HTMLSCANNER_H
+
+#include <QString>
+#include <QStringView>
+#include <QChar>
+
+// Текст и оформление ячейки, извлечённые из HTML
+struct HtmlSummary {
+    QString text;              // блоки через '\n', пробелы схлопнуты, края обрезаны
+    bool    bold      = false;
+    bool    italic    = false;
+    bool    underline = false;
+    QChar   align     = 'l';   // l / c / r; по ширине - как c (см. writeCellStyles)
+};
+
+// Разбор HTML из QTextEdit одним проходом, без QTextDocument.
+// Понимает то, что пишет сам QTextEdit: блоки p/div/br/li/tr, сущности,
+// теги b/i/u и inline-стили начертания и выравнивания. <head>, <style>
+// и <script> пропускаются целиком. Простой текст возвращается как есть
+// (со схлопнутыми пробелами)
+class HtmlScanner {
+public:
+    static HtmlSummary scan(QStringView html);
+    static QString plainText(QStringView html) { return scan(html).text; }
+};
+
+#endif // HTMLSCANNER_H
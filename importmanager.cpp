@@ -0,0 +1,700 @@
+#include "importmanager.h"
+#include "bulkinserter.h"
+#include "querystats.h"
+#include "sqldialect.h"
+#include "rowsource.h"
+#include "templatemanager.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QDate>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QXmlStreamReader>
+#include <QDebug>
+
+namespace {
+
+using Record = QHash<QString, QString>;
+
+const QString DefaultColour = QStringLiteral("#FFFFFF");
+const QStringList GridColumns = {"template_id", "cell_type", "row_index", "col_index",
+                                 "row_span", "col_span", "content", "colour"};
+
+// Текст из экспорта обратно в HTML: переводы строк экспорт заменил на "~"
+QString richText(const QString &plain) {
+    QString html = plain.toHtmlEscaped();
+    html.replace('~', "<br/>");
+    return html;
+}
+
+// Ячейка: текст плюс флаги <base>StyleBold<N>, ...Italic, ...Underline, <base>Align<N>
+QString cellHtml(const Record &rec, const QString &base, int col) {
+    const QString text = rec.value(base + QString::number(col));
+    if (text.isEmpty())
+        return QString();
+
+    const QString n = QString::number(col);
+    QString html = richText(text);
+    if (rec.value(base + "StyleBold" + n) == "Y")      html = "<b>" + html + "</b>";
+    if (rec.value(base + "StyleItalic" + n) == "Y")    html = "<i>" + html + "</i>";
+    if (rec.value(base + "StyleUnderline" + n) == "Y") html = "<u>" + html + "</u>";
+
+    const QString align = rec.value(base + "Align" + n);
+    if (align == "c")
+        html = "<p align=\"center\">" + html + "</p>";
+    else if (align == "r")
+        html = "<p align=\"right\">" + html + "</p>";
+    return html;
+}
+
+// Программные заметки: цвет и шрифт экспорт вынес в отдельные поля
+QString progNotesHtml(const Record &rec) {
+    const QString text = rec.value("ProgNotes");
+    if (text.isEmpty())
+        return QString();
+
+    QStringList style;
+    if (!rec.value("color").isEmpty())    style << "color:" + rec.value("color");
+    if (!rec.value("font").isEmpty())     style << "font-family:" + rec.value("font");
+    if (!rec.value("fontsize").isEmpty()) style << "font-size:" + rec.value("fontsize");
+    if (style.isEmpty())
+        return richText(text);
+    return QString("<span style=\"%1\">%2</span>").arg(style.join("; ").toHtmlEscaped(),
+                                                        richText(text));
+}
+
+// "Tab_2_3_1" -> "2.3.1"
+QString pathFromTabId(const QString &tabId) {
+    QString path = tabId.mid(tabId.indexOf('_') + 1);
+    path.replace('_', '.');
+    return path;
+}
+
+// Состояние одного импорта: соответствие номеров из файла созданным строкам
+class XmlProjectReader {
+public:
+    XmlProjectReader(QSqlDatabase &db, const QString &projectName)
+        : db(db)
+        , projectName(projectName)
+        , cells(db, "grid_cells", GridColumns)
+        , graphs(db, "graph", {"template_id", "name", "graph_type"})
+        , categoryInsert(db)
+        , templateInsert(db) {}
+
+    bool read(QIODevice *device);
+    int projectId() const { return project; }
+    QString error;
+
+private:
+    bool handleRecord(const QString &tag, const Record &rec);
+    bool ensureProject();
+    int categoryFor(const QStringList &segments, const Record &rec);
+    int templateFor(const QString &tabId, const QString &type, const Record &rec);
+    bool addHeaderRow(int templateId, const Record &rec);
+    bool addContentRow(int templateId, const Record &rec);
+    bool copyGraphImages();
+    bool fail(const QString &message) {
+        if (error.isEmpty())
+            error = message;
+        return false;
+    }
+
+    QSqlDatabase &db;
+    QString projectName;
+    int project = -1;
+    Record projectVars;                 // Variable -> Value из записей PROJECT
+
+    QHash<QString, int> categories;     // "2.3" -> category_id
+    QHash<QString, int> templates;      // TabID -> template_id
+    QHash<int, int>     headerRows;     // template_id -> строк заголовка
+
+    BulkInserter cells;
+    BulkInserter graphs;
+    QSqlQuery    categoryInsert;
+    QSqlQuery    templateInsert;
+};
+
+bool XmlProjectReader::read(QIODevice *device) {
+    // Запросы на узел дерева готовятся один раз на весь файл
+    if (!categoryInsert.prepare("INSERT INTO category (name, parent_id, position, depth, project_id) "
+                                "VALUES (?, ?, ?, ?, ?)" + SqlDialect::returningId("category_id"))
+        || !templateInsert.prepare("INSERT INTO template (name, category_id, subtitle, notes, "
+                                   "programming_notes, position, is_dynamic, template_type) "
+                                   "VALUES (?, ?, ?, ?, ?, ?, ?, ?)"
+                                   + SqlDialect::returningId("template_id")))
+        return fail(QObject::tr("Couldn't prepare import queries: %1")
+                        .arg(categoryInsert.lastError().text() + templateInsert.lastError().text()));
+
+    QXmlStreamReader xml(device);
+    if (!xml.readNextStartElement() || xml.name() != QLatin1String("MAIN"))
+        return fail(QObject::tr("Not an AutoTLG project file: root element MAIN is missing"));
+
+    // Записи плоские: <TAG><Field>text</Field>...</TAG>
+    while (xml.readNextStartElement()) {
+        const QString tag = xml.name().toString();
+        Record rec;
+        while (xml.readNextStartElement())
+            rec.insert(xml.name().toString(), xml.readElementText());
+        if (xml.hasError())
+            break;
+        if (!handleRecord(tag, rec))
+            return false;
+    }
+    if (xml.hasError())
+        return fail(QObject::tr("XML error at line %1: %2")
+                        .arg(xml.lineNumber()).arg(xml.errorString()));
+
+    return ensureProject() && cells.flush() && graphs.flush() && copyGraphImages();
+}
+
+bool XmlProjectReader::handleRecord(const QString &tag, const Record &rec) {
+    if (tag == "PROJECT") {
+        projectVars.insert(rec.value("Variable"), rec.value("Value"));
+        return true;
+    }
+
+    QString type;
+    bool shells = false;
+    if (tag == "TABLE" || tag == "TABLE_SHELLS") {
+        type = "table";
+        shells = (tag == "TABLE_SHELLS");
+    } else if (tag == "LISTING" || tag == "LISTING_SHELLS") {
+        type = "listing";
+        shells = (tag == "LISTING_SHELLS");
+    } else if (tag == "GRATH") {
+        type = "graph";
+    } else {
+        qDebug() << "Импорт XML: неизвестная запись" << tag << "пропущена";
+        return true;
+    }
+
+    // Первая запись каждого вида - заглушка из "x"
+    const QString tabId = rec.value("TabID");
+    if (tabId.isEmpty() || tabId == "x")
+        return true;
+
+    if (!ensureProject())
+        return false;
+    const int templateId = templateFor(tabId, type, rec);
+    if (templateId < 0)
+        return false;
+
+    if (type == "graph") {
+        const QString graphType = rec.value("grtype");
+        if (!graphs.add({templateId, graphType, graphType}))
+            return fail(QObject::tr("Couldn't write graph %1").arg(tabId));
+        return true;
+    }
+    return shells ? addContentRow(templateId, rec) : addHeaderRow(templateId, rec);
+}
+
+bool XmlProjectReader::ensureProject() {
+    if (project > 0)
+        return true;
+
+    QString name = projectName;
+    if (name.isEmpty())
+        name = projectVars.value("dtfolder");
+    if (name.isEmpty())
+        name = QObject::tr("Imported project");
+
+    QSqlQuery q(db);
+    q.prepare("INSERT INTO project (name, template_style, study, sponsor, cut_date, version) "
+              "VALUES (?, ?, ?, ?, ?, ?)" + SqlDialect::returningId("project_id"));
+    q.addBindValue(name);
+    q.addBindValue(projectVars.value("TempleteStyle"));
+    q.addBindValue(projectVars.value("Study"));
+    q.addBindValue(projectVars.value("Client"));
+    q.addBindValue(QDate::fromString(projectVars.value("CutDate"), "dd.MM.yyyy"));
+    q.addBindValue(projectVars.value("Version"));
+    if (!QUERY_EXEC(q))
+        return fail(QObject::tr("Couldn't create the project: %1").arg(q.lastError().text()));
+    project = SqlDialect::insertedId(q);
+    return project > 0;
+}
+
+int XmlProjectReader::categoryFor(const QStringList &segments, const Record &rec) {
+    int parentId = -1;
+    for (int depth = 0; depth < segments.size(); ++depth) {
+        const QString key = segments.mid(0, depth + 1).join('.');
+        auto it = categories.constFind(key);
+        if (it != categories.cend()) {
+            parentId = *it;
+            continue;
+        }
+
+        // Имя главы есть в записях таблиц и графиков; без него - номер
+        QString name = rec.value(QString("CHAPTER%1").arg(depth + 1));
+        if (name.isEmpty())
+            name = key;
+        categoryInsert.bindValue(0, name);
+        categoryInsert.bindValue(1, parentId > 0 ? QVariant(parentId) : QVariant());
+        categoryInsert.bindValue(2, segments[depth].toInt());
+        categoryInsert.bindValue(3, depth);
+        categoryInsert.bindValue(4, project);
+        if (!QUERY_EXEC(categoryInsert)) {
+            fail(QObject::tr("Couldn't create category %1: %2")
+                     .arg(key, categoryInsert.lastError().text()));
+            return -1;
+        }
+        parentId = SqlDialect::insertedId(categoryInsert);
+        categories.insert(key, parentId);
+    }
+    return parentId;
+}
+
+int XmlProjectReader::templateFor(const QString &tabId, const QString &type, const Record &rec) {
+    auto it = templates.constFind(tabId);
+    if (it != templates.cend())
+        return *it;
+
+    QStringList segments = pathFromTabId(tabId).split('.');
+    if (segments.size() < 2) {
+        fail(QObject::tr("Template %1 is not inside a category").arg(tabId));
+        return -1;
+    }
+    const int position = segments.takeLast().toInt();
+    const int categoryId = categoryFor(segments, rec);
+    if (categoryId < 0)
+        return -1;
+
+    // Имя таблицы экспортируется с номером впереди: "2.3.1 Demographics"
+    QString name = rec.value("TabName");
+    const QString path = rec.value("Path");
+    if (!path.isEmpty() && name.startsWith(path + ' '))
+        name = name.mid(path.size() + 1);
+    if (name.isEmpty())
+        name = tabId;
+
+    templateInsert.bindValue(0, name);
+    templateInsert.bindValue(1, categoryId);
+    templateInsert.bindValue(2, richText(rec.value("Subtitle")));
+    templateInsert.bindValue(3, richText(rec.value("Notes")));
+    templateInsert.bindValue(4, progNotesHtml(rec));
+    templateInsert.bindValue(5, position);
+    templateInsert.bindValue(6, false);
+    templateInsert.bindValue(7, type);
+    if (!QUERY_EXEC(templateInsert)) {
+        fail(QObject::tr("Couldn't create template %1: %2")
+                 .arg(tabId, templateInsert.lastError().text()));
+        return -1;
+    }
+    const int templateId = SqlDialect::insertedId(templateInsert);
+    templates.insert(tabId, templateId);
+    return templateId;
+}
+
+bool XmlProjectReader::addHeaderRow(int templateId, const Record &rec) {
+    const int row = rec.value("OrderHeader").toInt();
+    const int columns = rec.value("columns").toInt();
+    if (row <= 0)
+        return true;
+    headerRows[templateId] = qMax(headerRows.value(templateId), rec.value("nestedheader").toInt());
+
+    for (int c = 1; c <= columns; ++c) {
+        if (!cells.add({templateId, "header", row, c, 1, 1,
+                        cellHtml(rec, "ColHeader", c), DefaultColour}))
+            return fail(QObject::tr("Couldn't write cells of %1").arg(rec.value("TabID")));
+    }
+    return true;
+}
+
+bool XmlProjectReader::addContentRow(int templateId, const Record &rec) {
+    const int order = rec.value("Order").toInt();
+    if (order <= 0)
+        return true;
+    const int row = headerRows.value(templateId) + order;
+
+    QStringList texts;
+    for (int c = 1; rec.contains(QString("Col%1").arg(c)); ++c)
+        texts << rec.value(QString("Col%1").arg(c));
+
+    // В строке с объединением покрытые ячейки повторяют текст главной
+    const bool merged = (rec.value("commontext") == "Y");
+    for (int c = 0; c < texts.size();) {
+        int span = 1;
+        if (merged && !texts[c].isEmpty())
+            while (c + span < texts.size() && texts[c + span] == texts[c])
+                ++span;
+
+        bool ok = cells.add({templateId, "content", row, c + 1, 1, span,
+                             cellHtml(rec, "Col", c + 1), DefaultColour});
+        for (int k = 1; ok && k < span; ++k)
+            ok = cells.add({templateId, "content", row, c + 1 + k, 0, 0, QString(), DefaultColour});
+        if (!ok)
+            return fail(QObject::tr("Couldn't write cells of %1").arg(rec.value("TabID")));
+        c += span;
+    }
+    return true;
+}
+
+bool XmlProjectReader::copyGraphImages() {
+    if (graphs.rowsWritten() == 0)
+        return true;
+    // Файл хранит только тип графика - изображение берём из библиотеки на сервере
+    QSqlQuery q(db);
+    q.prepare(R"(
+        UPDATE graph
+        SET name  = COALESCE((SELECT l.name FROM graph_library l WHERE l.graph_type = graph.graph_type), name),
+            image = (SELECT l.image FROM graph_library l WHERE l.graph_type = graph.graph_type)
+        WHERE image IS NULL
+          AND template_id IN (SELECT t.template_id FROM template t
+                              JOIN category c ON c.category_id = t.category_id
+                              WHERE c.project_id = ?)
+    )");
+    q.addBindValue(project);
+    if (!QUERY_EXEC(q))
+        return fail(QObject::tr("Couldn't copy graph images: %1").arg(q.lastError().text()));
+    return true;
+}
+
+// Строки таблицы из CSV/XLSX -> ячейки одного шаблона.
+//
+// Маркеры объединения: "<<" - ячейка входит в объединение ячейки слева,
+// "^^" - в объединение ячейки сверху. Главная ячейка записывается, когда
+// её область уже не может вырасти, поэтому в памяти держится только окно
+// строк с незакрытыми вертикальными объединениями, а не весь файл
+class GridWriter {
+public:
+    static constexpr int MaxWindowRows = 2000;
+
+    GridWriter(BulkInserter &cells, int templateId, int headerRows)
+        : cells(cells), templateId(templateId), headerRows(headerRows) {}
+
+    bool addRow(const QStringList &values);
+    bool finish();
+
+    QString error;
+
+private:
+    struct Cell {
+        QString text;
+        int ownerRow;               // главная ячейка области (для главной - она сама)
+        int ownerCol;
+        int rowSpan = 1;
+        int colSpan = 1;
+    };
+
+    Cell *cellAt(int row, int col) {
+        const int i = row - firstRow;
+        if (i < 0 || i >= window.size() || col < 0 || col >= window[i].size())
+            return nullptr;
+        return &window[i][col];
+    }
+    bool flush(bool all);
+    bool fail(const QString &message) {
+        error = message;
+        return false;
+    }
+
+    BulkInserter &cells;
+    int templateId;
+    int headerRows;
+
+    QList<QVector<Cell>> window;    // строки с firstRow (с 1, как row_index)
+    int firstRow = 1;
+    int lastRow = 0;
+    QVector<int> widths;            // ширина каждой строки - для выравнивания в finish()
+    int maxWidth = 0;
+};
+
+bool GridWriter::addRow(const QStringList &values) {
+    const int r = ++lastRow;
+    window.append(QVector<Cell>(values.size()));
+    QVector<Cell> &row = window.last();
+    widths.append(values.size());
+    maxWidth = qMax(maxWidth, int(values.size()));
+
+    for (int c = 0; c < values.size(); ++c) {
+        Cell &cell = row[c];
+        const QString marker = values[c].trimmed();
+        const Cell *source = nullptr;
+        if (marker == QLatin1String("<<"))
+            source = c > 0 ? &row[c - 1] : nullptr;
+        else if (marker == QLatin1String("^^"))
+            source = cellAt(r - 1, c);
+        else {
+            cell.text = values[c];
+            cell.ownerRow = r;
+            cell.ownerCol = c;
+            continue;
+        }
+
+        if (!source)
+            return fail(QObject::tr("Row %1, column %2: span marker %3 has no cell to join")
+                            .arg(r).arg(c + 1).arg(marker));
+        cell.ownerRow = source->ownerRow;
+        cell.ownerCol = source->ownerCol;
+        if (cell.ownerRow <= headerRows && r > headerRows)
+            return fail(QObject::tr("Row %1, column %2: a span cannot cross from the header into the content")
+                            .arg(r).arg(c + 1));
+        Cell *owner = cellAt(cell.ownerRow, cell.ownerCol);
+        owner->rowSpan = qMax(owner->rowSpan, r - cell.ownerRow + 1);
+        owner->colSpan = qMax(owner->colSpan, c - cell.ownerCol + 1);
+    }
+
+    if (!flush(false))
+        return false;
+    if (window.size() > MaxWindowRows)
+        return fail(QObject::tr("Row %1: a vertical span is longer than %2 rows")
+                        .arg(firstRow).arg(MaxWindowRows));
+    return true;
+}
+
+bool GridWriter::flush(bool all) {
+    while (!window.isEmpty()) {
+        const QVector<Cell> &row = window.first();
+        const int r = firstRow;
+
+        // Область, доходящая до последней строки, ещё может вырасти
+        if (!all) {
+            for (int c = 0; c < row.size(); ++c)
+                if (row[c].ownerRow == r && row[c].ownerCol == c
+                    && r + row[c].rowSpan - 1 >= lastRow)
+                    return true;
+        }
+
+        const QString cellType = r <= headerRows ? QStringLiteral("header") : QStringLiteral("content");
+        for (int c = 0; c < row.size(); ++c) {
+            const Cell &cell = row[c];
+            bool ok;
+            if (cell.ownerRow == r && cell.ownerCol == c) {
+                // Маркеры должны заполнить прямоугольник целиком
+                for (int rr = r; rr < r + cell.rowSpan; ++rr)
+                    for (int cc = c; cc < c + cell.colSpan; ++cc) {
+                        const Cell *inner = cellAt(rr, cc);
+                        if (!inner || inner->ownerRow != r || inner->ownerCol != c)
+                            return fail(QObject::tr("Row %1, column %2: span markers do not form a rectangle")
+                                            .arg(r).arg(c + 1));
+                    }
+                QString html = cell.text.toHtmlEscaped();
+                html.replace('\n', "<br/>");
+                ok = cells.add({templateId, cellType, r, c + 1, cell.rowSpan, cell.colSpan,
+                                html, DefaultColour});
+            } else {
+                ok = cells.add({templateId, cellType, r, c + 1, 0, 0, QString(), DefaultColour});
+            }
+            if (!ok)
+                return fail(QObject::tr("Couldn't write row %1").arg(r));
+        }
+        window.removeFirst();
+        ++firstRow;
+    }
+    return true;
+}
+
+bool GridWriter::finish() {
+    if (!flush(true))
+        return false;
+    // Короткие строки дополняются пустыми ячейками до ширины таблицы
+    for (int i = 0; i < widths.size(); ++i) {
+        const int r = i + 1;
+        const QString cellType = r <= headerRows ? QStringLiteral("header") : QStringLiteral("content");
+        for (int c = widths[i]; c < maxWidth; ++c)
+            if (!cells.add({templateId, cellType, r, c + 1, 1, 1, QString(), DefaultColour}))
+                return fail(QObject::tr("Couldn't write row %1").arg(r));
+    }
+    return true;
+}
+
+bool isTemplateMarker(const QStringList &row) {
+    return row.value(0).trimmed().compare(QLatin1String("#template"), Qt::CaseInsensitive) == 0;
+}
+
+bool isBlank(const QStringList &row) {
+    for (const QString &v : row)
+        if (!v.trimmed().isEmpty())
+            return false;
+    return true;
+}
+
+} // namespace
+
+ImportManager::ImportManager(QSqlDatabase &db) : db(db) {}
+
+ImportManager::~ImportManager() {}
+
+int ImportManager::importProjectXml(const QString &filename, const QString &projectName) {
+    error.clear();
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = QObject::tr("Couldn't open %1: %2").arg(filename, file.errorString());
+        return -1;
+    }
+
+    if (!db.transaction()) {
+        error = db.lastError().text();
+        return -1;
+    }
+
+    XmlProjectReader reader(db, projectName);
+    if (!reader.read(&file)) {
+        error = reader.error;
+        qDebug() << "Ошибка импорта XML" << QFileInfo(filename).fileName() << ":" << error;
+        db.rollback();
+        return -1;
+    }
+    if (!db.commit()) {
+        error = db.lastError().text();
+        db.rollback();
+        return -1;
+    }
+    return reader.projectId();
+}
+
+bool ImportManager::importGridIntoTemplate(int templateId, const QString &filename,
+                                           const GridImportOptions &options) {
+    error.clear();
+    QSqlQuery type(db);
+    type.prepare("SELECT template_type FROM template WHERE template_id = ?");
+    type.addBindValue(templateId);
+    if (!QUERY_EXEC(type) || !type.next()) {
+        error = QObject::tr("Template %1 not found").arg(templateId);
+        return false;
+    }
+    if (type.value(0).toString() == QLatin1String("graph")) {
+        error = QObject::tr("Cells can only be imported into tables and listings");
+        return false;
+    }
+
+    std::unique_ptr<RowSource> source = RowSource::open(filename, &error);
+    if (!source)
+        return false;
+
+    if (!db.transaction()) {
+        error = db.lastError().text();
+        return false;
+    }
+    auto rollback = [this](const QString &message) {
+        error = message;
+        qDebug() << "Ошибка импорта ячеек:" << error;
+        db.rollback();
+        return false;
+    };
+
+    // Содержимое заменяется целиком; версия - чтобы открытые копии увидели конфликт
+    if (!TemplateManager::claimVersion(db, templateId))
+        return rollback(QObject::tr("Couldn't lock template %1").arg(templateId));
+    // Копии шаблона с общими ячейками сохраняют прежнее содержимое
+    if (!TemplateManager::materializeContent(db, templateId))
+        return rollback(QObject::tr("Couldn't detach shared cells of template %1").arg(templateId));
+    QSqlQuery del(db);
+    del.prepare("DELETE FROM grid_cells WHERE template_id = ?");
+    del.addBindValue(templateId);
+    if (!QUERY_EXEC(del))
+        return rollback(del.lastError().text());
+
+    BulkInserter cells(db, "grid_cells", GridColumns);
+    GridWriter writer(cells, templateId, options.headerRows);
+    QStringList row;
+    int blankRun = 0;                   // пустые строки в конце файла не нужны
+    while (source->next(row)) {
+        if (isTemplateMarker(row))
+            return rollback(QObject::tr("#template rows are only allowed when importing into a category"));
+        if (isBlank(row)) {
+            ++blankRun;
+            continue;
+        }
+        for (; blankRun > 0; --blankRun)
+            if (!writer.addRow(QStringList()))
+                return rollback(writer.error);
+        if (!writer.addRow(row))
+            return rollback(writer.error);
+    }
+    if (!source->errorString().isEmpty())
+        return rollback(source->errorString());
+    if (!writer.finish())
+        return rollback(writer.error);
+    if (!cells.flush())
+        return rollback(QObject::tr("Couldn't write cells"));
+    if (!db.commit())
+        return rollback(db.lastError().text());
+    return true;
+}
+
+int ImportManager::importGridIntoCategory(int categoryId, const QString &filename,
+                                          const GridImportOptions &options) {
+    error.clear();
+    std::unique_ptr<RowSource> source = RowSource::open(filename, &error);
+    if (!source)
+        return -1;
+
+    if (!db.transaction()) {
+        error = db.lastError().text();
+        return -1;
+    }
+    auto rollback = [this](const QString &message) {
+        error = message;
+        qDebug() << "Ошибка импорта шаблонов:" << error;
+        db.rollback();
+        return -1;
+    };
+
+    // Новые шаблоны - после всего, что уже лежит в категории
+    QSqlQuery pos(db);
+    pos.prepare("SELECT COALESCE(MAX(p), 0) FROM ("
+                "  SELECT position AS p FROM template WHERE category_id = ? "
+                "  UNION ALL SELECT position FROM category WHERE parent_id = ?) AS positions");
+    pos.addBindValue(categoryId);
+    pos.addBindValue(categoryId);
+    if (!QUERY_EXEC(pos) || !pos.next())
+        return rollback(pos.lastError().text());
+    int position = pos.value(0).toInt();
+
+    QSqlQuery ins(db);
+    ins.prepare("INSERT INTO template (name, category_id, subtitle, notes, programming_notes, "
+                "position, is_dynamic, template_type) VALUES (?, ?, '', '', '', ?, ?, ?)"
+                + SqlDialect::returningId("template_id"));
+
+    BulkInserter cells(db, "grid_cells", GridColumns);
+    std::unique_ptr<GridWriter> writer;
+    int created = 0;
+    QStringList row;
+    int blankRun = 0;
+    while (source->next(row)) {
+        if (isTemplateMarker(row)) {
+            // #template;<имя>;<table|listing> - начало следующего шаблона
+            if (writer && !writer->finish())
+                return rollback(writer->error);
+            QString type = row.value(2).trimmed().toLower();
+            if (type != QLatin1String("table") && type != QLatin1String("listing"))
+                type = options.templateType;
+            const QString name = row.value(1).trimmed().isEmpty()
+                                     ? QObject::tr("Imported %1").arg(created + 1)
+                                     : row.value(1).trimmed();
+            ins.bindValue(0, name);
+            ins.bindValue(1, categoryId);
+            ins.bindValue(2, ++position);
+            ins.bindValue(3, false);
+            ins.bindValue(4, type);
+            if (!QUERY_EXEC(ins))
+                return rollback(QObject::tr("Couldn't create template %1: %2")
+                                    .arg(name, ins.lastError().text()));
+            writer = std::make_unique<GridWriter>(cells, SqlDialect::insertedId(ins), options.headerRows);
+            ++created;
+            blankRun = 0;
+            continue;
+        }
+        if (isBlank(row)) {
+            ++blankRun;
+            continue;
+        }
+        if (!writer)
+            return rollback(QObject::tr("The file must start with a #template row"));
+        for (; blankRun > 0; --blankRun)
+            if (!writer->addRow(QStringList()))
+                return rollback(writer->error);
+        if (!writer->addRow(row))
+            return rollback(writer->error);
+    }
+    if (!source->errorString().isEmpty())
+        return rollback(source->errorString());
+    if (writer && !writer->finish())
+        return rollback(writer->error);
+    if (!cells.flush())
+        return rollback(QObject::tr("Couldn't write cells"));
+    if (!db.commit())
+        return rollback(db.lastError().text());
+    return created;
+}
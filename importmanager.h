@@ -0,0 +1,52 @@
+#ifndef IMPORTMANAGER_H
+#define IMPORTMANAGER_H
+
+#include <QSqlDatabase>
+#include <QString>
+
+// Параметры импорта ячеек из CSV/XLSX
+struct GridImportOptions {
+    int     headerRows = 1;                     // первые строки каждого шаблона - заголовок
+    QString templateType = QStringLiteral("listing");   // для шаблонов без типа в строке #template
+};
+
+// Загрузка проектов из внешних файлов.
+//
+// XML - формат ExportProjectAsXml (MAIN/PROJECT/TABLE/TABLE_SHELLS/GRATH).
+// Файл читается потоком, категории и шаблоны создаются по мере появления,
+// ячейки и графики пишутся пакетами (BulkInserter). Весь импорт - одна
+// транзакция: при ошибке база не меняется.
+//
+// Формат теряет часть данных: HTML сведён к тексту с флагами жирный/курсив/
+// подчёркнутый и выравниванием, объединения в заголовке не записаны (ячейки
+// повторяют текст), для строк содержимого известно только, что объединение
+// есть (commontext) - одинаковые соседние ячейки такой строки объединяются.
+//
+// CSV и XLSX (первый лист) - спецификации листингов из таблиц. Строки идут
+// в grid_cells потоком; "<<" и "^^" в ячейке объединяют её с ячейкой слева
+// или сверху. При импорте в категорию строка "#template;<имя>;<тип>"
+// начинает новый шаблон.
+class ImportManager {
+public:
+    ImportManager(QSqlDatabase &db);
+    ~ImportManager();
+
+    // Новый проект из XML; пустое имя - значение dtfolder из файла.
+    // Возвращает id проекта или -1 (причина - lastError())
+    int importProjectXml(const QString &filename, const QString &projectName = QString());
+
+    // Заменяет все ячейки шаблона содержимым файла
+    bool importGridIntoTemplate(int templateId, const QString &filename,
+                                const GridImportOptions &options);
+    // Новые шаблоны в конце категории; возвращает их число или -1
+    int importGridIntoCategory(int categoryId, const QString &filename,
+                               const GridImportOptions &options);
+
+    QString lastError() const { return error; }
+
+private:
+    QSqlDatabase &db;
+    QString error;
+};
+
+#endif // IMPORTMANAGER_H
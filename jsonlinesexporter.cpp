@@ -0,0 +1,173 @@
+#include "jsonlinesexporter.h"
+#include "htmlscanner.h"
+
+namespace {
+
+// Строка JSON в UTF-8 с экранированием по RFC 8259
+void appendString(QByteArray &out, QStringView s) {
+    static const char hex[] = "0123456789abcdef";
+    out += '"';
+    const QByteArray utf8 = s.toUtf8();
+    for (const char ch : utf8) {
+        const uchar c = uchar(ch);
+        switch (c) {
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n";  break;
+        case '\r': out += "\\r";  break;
+        case '\t': out += "\\t";  break;
+        default:
+            if (c < 0x20) {
+                out += "\\u00";
+                out += hex[c >> 4];
+                out += hex[c & 0xF];
+            } else {
+                out += ch;
+            }
+        }
+    }
+    out += '"';
+}
+
+void appendField(QByteArray &out, const char *key) {
+    if (out.size() > 1)
+        out += ',';
+    out += '"';
+    out += key;
+    out += "\":";
+}
+
+void appendField(QByteArray &out, const char *key, QStringView value) {
+    appendField(out, key);
+    appendString(out, value);
+}
+
+void appendField(QByteArray &out, const char *key, qint64 value) {
+    appendField(out, key);
+    out += QByteArray::number(value);
+}
+
+void appendField(QByteArray &out, const char *key, bool value) {
+    appendField(out, key);
+    out += value ? "true" : "false";
+}
+
+} // namespace
+
+bool JsonLinesExporter::write(const ProjectSnapshot &snapshot, QIODevice &out) {
+    line.clear();
+    writeProjectLine(snapshot);
+    if (out.write(line) != line.size())
+        return false;
+
+    for (int t : snapshot.templateOrder()) {
+        line.clear();
+        writeTemplateLine(snapshot, t);
+        if (out.write(line) != line.size())
+            return false;
+    }
+    return true;
+}
+
+void JsonLinesExporter::writeProjectLine(const ProjectSnapshot &snapshot) {
+    const ProjectDetails &d = snapshot.details();
+    line += '{';
+    appendField(line, "record", QStringLiteral("project"));
+    appendField(line, "id", qint64(snapshot.projectId()));
+    appendField(line, "name", snapshot.projectName());
+    appendField(line, "style", snapshot.templateStyle());
+    appendField(line, "study", d.study);
+    appendField(line, "sponsor", d.sponsor);
+    appendField(line, "version", d.version);
+    appendField(line, "cutDate", d.cutDate.isValid() ? d.cutDate.toString(Qt::ISODate) : QString());
+    appendField(line, "templates", qint64(snapshot.templateOrder().size()));
+    line += "}\n";
+}
+
+void JsonLinesExporter::writeTemplateLine(const ProjectSnapshot &snapshot, int templateIndex) {
+    const SnapshotTemplate &t = snapshot.templates()[templateIndex];
+    line += '{';
+    appendField(line, "record", QStringLiteral("template"));
+    appendField(line, "id", qint64(t.templateId));
+    appendField(line, "path", t.path);
+    appendField(line, "tabId", tabId(t));
+    appendField(line, "type", t.type);
+
+    appendField(line, "chapters");
+    line += '[';
+    const QStringList chapters = snapshot.chapterNames(templateIndex);
+    for (int i = 0; i < chapters.size(); ++i) {
+        if (i)
+            line += ',';
+        appendString(line, HtmlScanner::plainText(chapters[i]));
+    }
+    line += ']';
+
+    appendField(line, "name", HtmlScanner::plainText(t.name));
+    appendField(line, "subtitle", HtmlScanner::plainText(t.subtitle));
+    appendField(line, "notes", HtmlScanner::plainText(t.notes));
+    appendField(line, "progNotes", HtmlScanner::plainText(t.programmingNotes));
+    appendField(line, "dynamic", t.dynamic);
+    appendField(line, "approved", t.approved);
+    if (t.relatedTemplateId >= 0)
+        appendField(line, "related", qint64(t.relatedTemplateId));
+
+    if (t.type == "graph") {
+        appendField(line, "graphType", t.graphType);
+        line += "}\n";
+        return;
+    }
+
+    const GridStore &grid = t.grid;
+    appendField(line, "headerRows", qint64(t.headerRows));
+    appendField(line, "columns", qint64(grid.columnCount()));
+
+    // Строки целиком, заголовок первым; закрытые объединением ячейки пусты
+    QByteArray styles;
+    appendField(line, "rows");
+    line += '[';
+    for (int r = 0; r < grid.rowCount(); ++r) {
+        if (r)
+            line += ',';
+        line += '[';
+        for (int c = 0; c < grid.columnCount(); ++c) {
+            if (c)
+                line += ',';
+            if (grid.isCovered(r, c)) {
+                line += "\"\"";
+                continue;
+            }
+            const HtmlSummary cell = HtmlScanner::scan(grid.textView(r, c));
+            appendString(line, cell.text);
+            if (cell.bold || cell.italic || cell.underline || cell.align != 'l') {
+                if (!styles.isEmpty())
+                    styles += ',';
+                styles += '[' + QByteArray::number(r) + ',' + QByteArray::number(c) + ",\"";
+                if (cell.bold)      styles += 'b';
+                if (cell.italic)    styles += 'i';
+                if (cell.underline) styles += 'u';
+                styles += "\",\"";
+                styles += char(cell.align.unicode());
+                styles += "\"]";
+            }
+        }
+        line += ']';
+    }
+    line += ']';
+
+    appendField(line, "spans");
+    line += '[';
+    const auto &spans = grid.spans();
+    for (int i = 0; i < spans.size(); ++i) {
+        const SpanIndex::Area &a = spans[i];
+        if (i)
+            line += ',';
+        line += '[' + QByteArray::number(a.row) + ',' + QByteArray::number(a.col) + ','
+                + QByteArray::number(a.rowSpan) + ',' + QByteArray::number(a.colSpan) + ']';
+    }
+    line += ']';
+
+    appendField(line, "styles");
+    line += '[' + styles + ']';
+    line += "}\n";
+}
@@ -0,0 +1,27 @@
+#ifndef JSONLINESEXPORTER_H
+#define JSONLINESEXPORTER_H
+
+#include "projectexporter.h"
+#include <QByteArray>
+
+// JSON Lines: первая строка - данные проекта, дальше по строке на шаблон
+// в порядке дерева. Каждую строку можно разбирать независимо, поэтому
+// файл удобно делить между параллельными обработчиками.
+// Ячейки - простой текст (HtmlScanner); начертание и выравнивание
+// перечислены отдельно и только у ячеек, где они не по умолчанию
+class JsonLinesExporter : public ProjectExporter {
+public:
+    QString title() const override      { return QStringLiteral("Export as JSON Lines"); }
+    QString fileFilter() const override { return QStringLiteral("JSON Lines (*.jsonl)"); }
+    QString fileSuffix() const override { return QStringLiteral("jsonl"); }
+
+    bool write(const ProjectSnapshot &snapshot, QIODevice &out) override;
+
+private:
+    void writeProjectLine(const ProjectSnapshot &snapshot);
+    void writeTemplateLine(const ProjectSnapshot &snapshot, int templateIndex);
+
+    QByteArray line;           // буфер одной записи, переиспользуется
+};
+
+#endif // JSONLINESEXPORTER_H
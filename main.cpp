@@ -1,16 +1,22 @@
 #include "mainwindow.h"
+#include "application.h"
+#include "stallwatchdog.h"
 #include "dbconnectiondialog.h"
-#include <QApplication>
 #include <QFile>
 #include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <memory>
+#include <optional>
 
 int main(int argc, char *argv[])
 {
-    QApplication a(argc, argv);
+    Application a(argc, argv);
 
     QCoreApplication::setOrganizationName("MyAutoShell");
     QCoreApplication::setOrganizationDomain("AutoShell.com");
     QCoreApplication::setApplicationName("AutoShell");
+    QCoreApplication::setApplicationVersion(AUTOTLG_VERSION);
 
     // Настройка логгирования в файл
     QFile logFile("AutoTLG_log.txt");
@@ -25,24 +31,46 @@ int main(int argc, char *argv[])
         });
     }
 
+    // Порог зависания GUI в мс (0 - сторож выключен)
+    bool thresholdOk = false;
+    const int stallMs = qEnvironmentVariableIntValue("AUTOTLG_STALL_MS", &thresholdOk);
+    StallWatchdog::install(thresholdOk ? stallMs : 250);
+
     int exitCode = 0;
     do {
         DBConnectionDialog dlg;
         if (dlg.exec() != QDialog::Accepted)
             return 0;   // Отмена в диалоге — выходим совсем
 
-        DatabaseHandler dbh(
-            dlg.host(),
-            dlg.port().toInt(),
-            dlg.databaseName(),
-            dlg.userName(),
-            dlg.password()
-            );
+        std::unique_ptr<DatabaseHandler> dbh;
+        std::optional<RemoteParams> replicaOf;
+        if (dlg.backend() == DbBackend::Sqlite) {
+            // Каталог для нового файла базы может ещё не существовать
+            QDir().mkpath(QFileInfo(dlg.localFile()).absolutePath());
+            dbh = std::make_unique<DatabaseHandler>(dlg.localFile());
+        } else if (dlg.useLocalReplica()) {
+            // Правки идут в локальный файл, сервер догоняет в фоне
+            replicaOf = RemoteParams{dlg.host(), dlg.port().toInt(), dlg.databaseName(),
+                                     dlg.userName(), dlg.password()};
+            const QString file = DatabaseHandler::replicaFileFor(*replicaOf);
+            QDir().mkpath(QFileInfo(file).absolutePath());
+            dbh = std::make_unique<DatabaseHandler>(file);
+        } else {
+            dbh = std::make_unique<DatabaseHandler>(
+                dlg.host(),
+                dlg.port().toInt(),
+                dlg.databaseName(),
+                dlg.userName(),
+                dlg.password()
+                );
+        }
 
-        if (!dbh.connectToDatabase())
+        if (!dbh->connectToDatabase())
             continue;   // при ошибке — повторить ввод
+        if (replicaOf && !dbh->startReplicaSync(*replicaOf))
+            continue;
 
-        MainWindow w(&dbh);
+        MainWindow w(dbh.get());
         w.showMaximized();
         exitCode = a.exec();
 
@@ -1,4 +1,6 @@
 #include "mainwindow.h"
+#include "querystatsdialog.h"
+#include "findreplacedialog.h"
 #include <QToolBar>
 #include <QSplitter>
 #include <QVBoxLayout>
@@ -12,6 +14,9 @@
 #include <QDir>
 #include <QFileInfo>
 #include <QMessageBox>
+#include <QStatusBar>
+#include <QPushButton>
+#include <QTime>
 
 MainWindow::MainWindow(DatabaseHandler *dbHandler, QWidget *parent)
     : QMainWindow(parent), dbHandler(dbHandler)  {
@@ -25,6 +30,15 @@ MainWindow::MainWindow(DatabaseHandler *dbHandler, QWidget *parent)
     QAction *exitAct = fileMenu->addAction(tr("Exit"));
     connect(exitAct, &QAction::triggered, qApp, &QApplication::quit);
 
+    QMenu *debugMenu = menuBar()->addMenu(tr("Debug"));
+    QAction *queryStatsAct = debugMenu->addAction(tr("Query statistics..."));
+    connect(queryStatsAct, &QAction::triggered, this, [this](){
+        // Окно немодальное: статистику удобно смотреть, продолжая работу
+        QueryStatsDialog *dlg = new QueryStatsDialog(this);
+        dlg->setAttribute(Qt::WA_DeleteOnClose);
+        dlg->show();
+    });
+
     // Подключение к базе данных
     if (!dbHandler->connectToDatabase()) {
         qDebug() << "Не удалось подключиться к базе данных";
@@ -37,6 +51,8 @@ MainWindow::MainWindow(DatabaseHandler *dbHandler, QWidget *parent)
     templatePanel   = new TemplatePanel(dbHandler, formatToolBar,this);
     setupUI();
     setupConnections();
+    setupSync();
+    setupEditMenu();
 }
 
 MainWindow::~MainWindow() {}
@@ -71,6 +87,56 @@ void MainWindow::setupUI() {
     resize(1200, 800);
 }
 
+void MainWindow::setupEditMenu() {
+    projectUndoStack = new QUndoStack(this);
+
+    // Меню встаёт между File и Debug
+    QMenu *editMenu = new QMenu(tr("Edit"), this);
+    menuBar()->insertMenu(menuBar()->actions().value(1), editMenu);
+
+    // Перед отменой/повтором открытый шаблон сохраняется, после - перечитывается
+    QAction *undoAct = editMenu->addAction(tr("Undo replace"));
+    undoAct->setEnabled(false);
+    connect(projectUndoStack, &QUndoStack::canUndoChanged, undoAct, &QAction::setEnabled);
+    connect(undoAct, &QAction::triggered, this, [this](){
+        templatePanel->saveTableData();
+        projectUndoStack->undo();
+        templatePanel->reloadIfUnmodified();
+    });
+    QAction *redoAct = editMenu->addAction(tr("Redo replace"));
+    redoAct->setEnabled(false);
+    connect(projectUndoStack, &QUndoStack::canRedoChanged, redoAct, &QAction::setEnabled);
+    connect(redoAct, &QAction::triggered, this, [this](){
+        templatePanel->saveTableData();
+        projectUndoStack->redo();
+        templatePanel->reloadIfUnmodified();
+    });
+    editMenu->addSeparator();
+
+    QAction *replaceAct = editMenu->addAction(tr("Find and replace in project..."));
+    replaceAct->setShortcut(QKeySequence(Qt::CTRL | Qt::SHIFT | Qt::Key_H));
+    connect(replaceAct, &QAction::triggered, this, [this](){
+        const int projectId = treeCategoryPanel->currentProjectId();
+        if (projectId <= 0) {
+            QMessageBox::information(this, tr("Find and replace"), tr("Select a project first."));
+            return;
+        }
+        FindReplaceDialog *dlg = new FindReplaceDialog(dbHandler->getReplaceManager(), projectId,
+                                                       projectUndoStack, this);
+        dlg->setAttribute(Qt::WA_DeleteOnClose);
+        connect(dlg, &FindReplaceDialog::aboutToReplace, templatePanel,
+                &TemplatePanel::saveTableData);
+        connect(dlg, &FindReplaceDialog::templatesChanged, this, [this](const QSet<int> &ids){
+            if (ids.contains(templatePanel->currentTemplateId()))
+                templatePanel->reloadIfUnmodified();
+        });
+        dlg->show();
+    });
+
+    // Замены относятся к одному проекту
+    connect(projectPanel, &ProjectPanel::projectSelected, projectUndoStack, &QUndoStack::clear);
+}
+
 void MainWindow::setupConnections() {
 
     // Загрузка проекта по Id и правильное отображение стиля таблиц в проекте
@@ -114,6 +180,31 @@ void MainWindow::setupConnections() {
     connect(formatToolBar, &FormatToolBar::cellFillRequested,
             templatePanel,   &TemplatePanel::fillCellColor);
 
+    // Изменения других пользователей: точечно обновляем дерево и открытый шаблон
+    connect(dbHandler, &DatabaseHandler::remoteCategoryChanged,
+            this, [this](int projectId, int categoryId, bool removed) {
+                if (projectId > 0 && projectId != treeCategoryPanel->currentProjectId())
+                    return;
+                treeCategoryPanel->applyCategoryChange(categoryId, removed);
+            });
+    connect(dbHandler, &DatabaseHandler::remoteTemplateChanged,
+            this, [this](int projectId, int templateId, bool removed) {
+                if (projectId > 0 && projectId != treeCategoryPanel->currentProjectId())
+                    return;
+                treeCategoryPanel->applyTemplateChange(templateId, removed);
+                if (templateId != templatePanel->currentTemplateId())
+                    return;
+                if (removed)
+                    templatePanel->clearAll();
+                else
+                    templatePanel->reloadIfUnmodified();
+            });
+    connect(dbHandler, &DatabaseHandler::remoteCellsChanged,
+            this, [this](int templateId) {
+                if (templateId == templatePanel->currentTemplateId())
+                    templatePanel->reloadIfUnmodified();
+            });
+
     // Получение Id для обновления стиля таблицы
     connect(formatToolBar, &FormatToolBar::styleSelected,
             this, [this](const QString &styleName){
@@ -125,3 +216,76 @@ void MainWindow::setupConnections() {
 
 }
 
+
+void MainWindow::setupSync() {
+    SyncEngine *sync = dbHandler->syncEngine();
+    if (!sync)
+        return;
+
+    syncStatusLabel = new QLabel(tr("Local replica: connecting..."), this);
+    statusBar()->addPermanentWidget(syncStatusLabel);
+
+    QMenu *fileMenu = menuBar()->actions().first()->menu();
+    QAction *syncNowAct = new QAction(tr("Synchronize now"), this);
+    fileMenu->insertAction(fileMenu->actions().value(1), syncNowAct);
+    connect(syncNowAct, &QAction::triggered, sync, &SyncEngine::requestSync);
+
+    // Открытый проект держим в реплике и сразу догружаем с сервера
+    connect(projectPanel, &ProjectPanel::projectSelected, sync, &SyncEngine::trackProject);
+    const int current = treeCategoryPanel->currentProjectId();
+    if (current > 0)
+        QMetaObject::invokeMethod(sync, "trackProject", Q_ARG(int, current));
+
+    connect(sync, &SyncEngine::onlineChanged, this, [this](bool online){
+        syncStatusLabel->setText(online ? tr("Local replica: online")
+                                        : tr("Local replica: offline"));
+    });
+    connect(sync, &SyncEngine::syncFinished, this, [this](bool ok, const QString &message){
+        syncStatusLabel->setText(tr("Local replica: %1 (%2)")
+                                     .arg(message, QTime::currentTime().toString("HH:mm")));
+        syncStatusLabel->setToolTip(ok ? QString() : message);
+    });
+
+    connect(sync, &SyncEngine::projectsChanged, this, [this](){
+        projectPanel->reloadProjectsKeepingSelection(treeCategoryPanel->currentProjectId());
+    });
+    connect(sync, &SyncEngine::projectChanged, this, [this](int projectId){
+        if (projectId == treeCategoryPanel->currentProjectId())
+            treeCategoryPanel->loadCategoriesAndTemplates();
+    });
+    connect(sync, &SyncEngine::templateChanged, this, [this](int templateId){
+        if (templateId == templatePanel->currentTemplateId())
+            templatePanel->reloadIfUnmodified();
+    });
+
+    // Ключи созданных офлайн строк заменены серверными
+    connect(sync, &SyncEngine::idRemapped, this,
+            [this](const QString &entity, int oldId, int newId){
+        if (entity == "project") {
+            if (treeCategoryPanel->currentProjectId() == oldId)
+                treeCategoryPanel->setCurrentProjectId(newId);
+            projectPanel->reloadProjectsKeepingSelection(treeCategoryPanel->currentProjectId());
+            return;
+        }
+        if (entity == "template" && templatePanel->currentTemplateId() == oldId)
+            templatePanel->setCurrentTemplateId(newId);
+        treeCategoryPanel->loadCategoriesAndTemplates();
+    });
+
+    connect(sync, &SyncEngine::conflictDetected, this,
+            [this, sync](int templateId, const QString &name){
+        QMessageBox box(QMessageBox::Warning, tr("Synchronization conflict"),
+                        tr("Template \"%1\" was changed both locally and on the server.").arg(name),
+                        QMessageBox::NoButton, this);
+        QPushButton *keepLocal  = box.addButton(tr("Keep my version"), QMessageBox::AcceptRole);
+        QPushButton *takeServer = box.addButton(tr("Take server version"), QMessageBox::DestructiveRole);
+        box.addButton(tr("Decide later"), QMessageBox::RejectRole);
+        box.exec();
+
+        if (box.clickedButton() == keepLocal || box.clickedButton() == takeServer) {
+            const bool keep = (box.clickedButton() == keepLocal);
+            QMetaObject::invokeMethod(sync, "resolveConflict",
+                                      Q_ARG(int, templateId), Q_ARG(bool, keep));
+        }
+    });
+}
@@ -8,6 +8,8 @@
 #include "treecategorypanel.h"
 #include <QMainWindow>
 #include <QSqlDatabase>
+#include <QLabel>
+#include <QUndoStack>
 
 
 class MainWindow : public QMainWindow {
@@ -23,6 +25,8 @@ private:
 
     void setupUI();
     void setupConnections();
+    void setupSync();           // только в режиме локальной реплики
+    void setupEditMenu();       // операции над всем проектом
 
     //QSqlDatabase db;            // Объявляем объект базы данных
     DatabaseHandler *dbHandler; // Обработчик базы данных
@@ -32,6 +36,8 @@ private:
     ProjectPanel    *projectPanel;
     TreeCategoryPanel *treeCategoryPanel;
     TemplatePanel   *templatePanel;
+    QLabel          *syncStatusLabel = nullptr;
+    QUndoStack      *projectUndoStack = nullptr;   // замены по проекту
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,388 @@
+#include "projectdiff.h"
+#include "projectsnapshot.h"
+#include "htmlscanner.h"
+#include <QtConcurrent>
+#include <QHash>
+#include <algorithm>
+#include <functional>
+
+namespace {
+
+// Дальше Майерс не ищет: память трассы растёт как квадрат числа правок
+constexpr int kMaxEdits = 2000;
+
+quint64 mix(quint64 h, size_t v) {
+    return (h ^ quint64(v)) * 1099511628211ULL;
+}
+
+constexpr quint64 kHashSeed = 14695981039346656037ULL;
+
+// Кратчайший скрипт правок Майерса, O((N + M) * D)
+bool myers(const quint64 *a, int n, const quint64 *b, int m, QVector<QPair<int, int>> &out) {
+    const int limit = qMin(n + m, kMaxEdits);
+    const int offset = limit + 1;
+    QVector<int> v(2 * limit + 3, 0);
+    QVector<QVector<int>> trace;
+    int found = -1;
+    for (int d = 0; d <= limit && found < 0; ++d) {
+        for (int k = -d; k <= d; k += 2) {
+            int x = (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1]))
+                        ? v[offset + k + 1] : v[offset + k - 1] + 1;
+            int y = x - k;
+            while (x < n && y < m && a[x] == b[y]) {
+                ++x;
+                ++y;
+            }
+            v[offset + k] = x;
+            if (x >= n && y >= m) {
+                found = d;
+                break;
+            }
+        }
+        trace.append(v.mid(offset - d, 2 * d + 1));
+    }
+    if (found < 0)
+        return false;
+
+    // Обратный проход по трассе; пары собираются с конца
+    QVector<QPair<int, int>> rev;
+    int x = n, y = m;
+    for (int d = found; d > 0; --d) {
+        const QVector<int> &prev = trace[d - 1];
+        auto at = [&](int k) { return prev[k + d - 1]; };
+        const int k = x - y;
+        const bool down = k == -d || (k != d && at(k - 1) < at(k + 1));
+        const int prevK = down ? k + 1 : k - 1;
+        const int prevX = at(prevK);
+        const int prevY = prevX - prevK;
+        const int startX = down ? prevX : prevX + 1;
+        const int startY = down ? prevY + 1 : prevY;
+        while (x > startX && y > startY) {
+            rev.append({x - 1, y - 1});
+            --x;
+            --y;
+        }
+        if (down)
+            rev.append({-1, prevY});
+        else
+            rev.append({prevX, -1});
+        x = prevX;
+        y = prevY;
+    }
+    while (x > 0 && y > 0) {
+        rev.append({x - 1, y - 1});
+        --x;
+        --y;
+    }
+    std::reverse(rev.begin(), rev.end());
+    out += rev;
+    return true;
+}
+
+// Пара выравнивания; paired - удаление и вставка, сведённые в замену
+struct Aligned {
+    int  left;
+    int  right;
+    bool paired;
+};
+
+// Подряд идущие удаления и вставки между совпадениями сводятся попарно
+QVector<Aligned> pairRuns(const QVector<QPair<int, int>> &pairs) {
+    QVector<Aligned> out;
+    out.reserve(pairs.size());
+    QVector<int> dels, ins;
+    auto flush = [&]() {
+        const int common = qMin(dels.size(), ins.size());
+        for (int i = 0; i < common; ++i)
+            out.append({dels[i], ins[i], true});
+        for (int i = common; i < dels.size(); ++i)
+            out.append({dels[i], -1, false});
+        for (int i = common; i < ins.size(); ++i)
+            out.append({-1, ins[i], false});
+        dels.clear();
+        ins.clear();
+    };
+    for (const auto &p : pairs) {
+        if (p.first >= 0 && p.second >= 0) {
+            flush();
+            out.append({p.first, p.second, false});
+        } else if (p.first >= 0) {
+            dels.append(p.first);
+        } else {
+            ins.append(p.second);
+        }
+    }
+    flush();
+    return out;
+}
+
+// Текст ячейки; закрытая объединением берёт текст владельца
+QStringView ownerText(const GridStore &grid, int row, int col) {
+    if (grid.isCovered(row, col)) {
+        const QPoint o = grid.owner(row, col);
+        return grid.textView(o.y(), o.x());
+    }
+    return grid.textView(row, col);
+}
+
+// Подпись столбца - его заголовок; без заголовка - весь столбец
+QVector<quint64> columnKeys(const SnapshotTemplate &t) {
+    const GridStore &g = t.grid;
+    const int rows = (t.headerRows > 0 && t.headerRows <= g.rowCount()) ? t.headerRows : g.rowCount();
+    QVector<quint64> keys(g.columnCount());
+    for (int c = 0; c < g.columnCount(); ++c) {
+        quint64 h = kHashSeed;
+        for (int r = 0; r < rows; ++r)
+            h = mix(h, qHash(ownerText(g, r, c)));
+        keys[c] = h;
+    }
+    return keys;
+}
+
+QVector<quint64> rowKeys(const GridStore &g, const QVector<int> &cols) {
+    QVector<quint64> keys(g.rowCount());
+    for (int r = 0; r < g.rowCount(); ++r) {
+        quint64 h = kHashSeed;
+        for (int c : cols)
+            h = mix(h, qHash(g.textView(r, c)));
+        keys[r] = h;
+    }
+    return keys;
+}
+
+const SnapshotTemplate &emptyTemplate() {
+    static const SnapshotTemplate empty;
+    return empty;
+}
+
+} // namespace
+
+QVector<QPair<int, int>> ProjectDiff::align(const QVector<quint64> &a, const QVector<quint64> &b) {
+    const int n = a.size();
+    const int m = b.size();
+    int prefix = 0;
+    while (prefix < n && prefix < m && a[prefix] == b[prefix])
+        ++prefix;
+    int suffix = 0;
+    while (suffix < n - prefix && suffix < m - prefix && a[n - 1 - suffix] == b[m - 1 - suffix])
+        ++suffix;
+
+    QVector<QPair<int, int>> out;
+    out.reserve(qMax(n, m));
+    for (int i = 0; i < prefix; ++i)
+        out.append({i, i});
+
+    // Середина без общих краёв; индексы Майерса - от prefix
+    QVector<QPair<int, int>> middle;
+    const int midN = n - prefix - suffix;
+    const int midM = m - prefix - suffix;
+    if (!myers(a.constData() + prefix, midN, b.constData() + prefix, midM, middle)) {
+        // Слишком много правок: середина целиком заменена
+        middle.clear();
+        for (int i = 0; i < midN; ++i)
+            middle.append({i, -1});
+        for (int j = 0; j < midM; ++j)
+            middle.append({-1, j});
+    }
+    for (const auto &p : std::as_const(middle))
+        out.append({p.first < 0 ? -1 : p.first + prefix, p.second < 0 ? -1 : p.second + prefix});
+
+    for (int i = suffix; i > 0; --i)
+        out.append({n - i, m - i});
+    return out;
+}
+
+QString ProjectDiff::matchName(TemplateDiff::Match match) {
+    switch (match) {
+    case TemplateDiff::Unmatched:   return QStringLiteral("unmatched");
+    case TemplateDiff::SameId:      return QStringLiteral("same template");
+    case TemplateDiff::PathAndName: return QStringLiteral("path and name");
+    case TemplateDiff::Name:        return QStringLiteral("name");
+    case TemplateDiff::RelatedId:   return QStringLiteral("related template");
+    case TemplateDiff::Path:        return QStringLiteral("path");
+    }
+    return QString();
+}
+
+QVector<TemplateDiff> ProjectDiff::compare(const ProjectSnapshot &left, const ProjectSnapshot &right) {
+    QVector<TemplateDiff> diffs = matchTemplates(left, right);
+    QtConcurrent::blockingMap(diffs, [&left, &right](TemplateDiff &d) {
+        diffTemplate(d.left >= 0 ? &left.templates()[d.left] : nullptr,
+                     d.right >= 0 ? &right.templates()[d.right] : nullptr, d);
+    });
+    return diffs;
+}
+
+QVector<TemplateDiff> ProjectDiff::matchTemplates(const ProjectSnapshot &left,
+                                                  const ProjectSnapshot &right) {
+    const auto &lt = left.templates();
+    const auto &rt = right.templates();
+    QVector<int> l2r(lt.size(), -1), r2l(rt.size(), -1);
+    QVector<TemplateDiff::Match> how(rt.size(), TemplateDiff::Unmatched);
+
+    auto link = [&](int i, int j, TemplateDiff::Match match) {
+        if (i < 0 || j < 0 || l2r[i] >= 0 || r2l[j] >= 0)
+            return;
+        l2r[i] = j;
+        r2l[j] = i;
+        how[j] = match;
+    };
+
+    // 1. Версии одного проекта: template_id общий
+    for (int j = 0; j < rt.size(); ++j)
+        link(left.indexOfTemplate(rt[j].templateId), j, TemplateDiff::SameId);
+
+    QVector<QString> lNames(lt.size()), rNames(rt.size());
+    for (int i = 0; i < lt.size(); ++i)
+        lNames[i] = HtmlScanner::plainText(lt[i].name).simplified();
+    for (int j = 0; j < rt.size(); ++j)
+        rNames[j] = HtmlScanner::plainText(rt[j].name).simplified();
+
+    // Проход по ключу: пара только при ключе, единственном на обеих сторонах
+    using KeyOf = std::function<QString(bool, int)>;
+    auto byKey = [&](const KeyOf &keyOf, TemplateDiff::Match match) {
+        QHash<QString, int> lk, rk;
+        auto collect = [&](QHash<QString, int> &keys, const QVector<int> &partner, bool isLeft) {
+            for (int i = 0; i < partner.size(); ++i) {
+                if (partner[i] >= 0)
+                    continue;
+                const QString key = keyOf(isLeft, i);
+                if (key.isEmpty())
+                    continue;
+                auto it = keys.find(key);
+                if (it == keys.end())
+                    keys.insert(key, i);
+                else
+                    *it = -1;               // ключ не уникален
+            }
+        };
+        collect(lk, l2r, true);
+        collect(rk, r2l, false);
+        for (auto it = rk.cbegin(); it != rk.cend(); ++it)
+            if (*it >= 0)
+                link(lk.value(it.key(), -1), *it, match);
+    };
+
+    auto path = [&](bool isLeft, int i) { return isLeft ? lt[i].path : rt[i].path; };
+    auto name = [&](bool isLeft, int i) { return isLeft ? lNames[i] : rNames[i]; };
+    auto type = [&](bool isLeft, int i) { return isLeft ? lt[i].type : rt[i].type; };
+
+    // 2-3. Путь и имя, затем только имя
+    byKey([&](bool l, int i) { return path(l, i) + QChar(0x1f) + name(l, i); },
+          TemplateDiff::PathAndName);
+    byKey([&](bool l, int i) { return name(l, i).isEmpty() ? QString() : name(l, i) + QChar(0x1f) + type(l, i); },
+          TemplateDiff::Name);
+
+    // 4. Связь с уже сопоставленным шаблоном: ключ - пара связанного справа
+    byKey([&](bool l, int i) {
+        const SnapshotTemplate &t = l ? lt[i] : rt[i];
+        if (t.relatedTemplateId < 0)
+            return QString();
+        int partner = -1;
+        if (l) {
+            const int rel = left.indexOfTemplate(t.relatedTemplateId);
+            partner = rel >= 0 ? l2r[rel] : -1;
+        } else {
+            partner = right.indexOfTemplate(t.relatedTemplateId);
+        }
+        return partner < 0 ? QString() : QString::number(partner) + QChar(0x1f) + t.type;
+    }, TemplateDiff::RelatedId);
+
+    // 5. Только путь (переименованный шаблон на прежнем месте)
+    byKey([&](bool l, int i) { return path(l, i) + QChar(0x1f) + type(l, i); },
+          TemplateDiff::Path);
+
+    // Порядок - дерево правого снимка; удалённые - в конце, по дереву левого
+    QVector<TemplateDiff> diffs;
+    diffs.reserve(rt.size() + lt.size());
+    for (int j : right.templateOrder()) {
+        TemplateDiff d;
+        d.left  = r2l[j];
+        d.right = j;
+        d.match = how[j];
+        diffs.append(d);
+    }
+    for (int i : left.templateOrder()) {
+        if (l2r[i] >= 0)
+            continue;
+        TemplateDiff d;
+        d.left = i;
+        diffs.append(d);
+    }
+    return diffs;
+}
+
+void ProjectDiff::diffTemplate(const SnapshotTemplate *left, const SnapshotTemplate *right,
+                               TemplateDiff &diff) {
+    const SnapshotTemplate &l = left ? *left : emptyTemplate();
+    const SnapshotTemplate &r = right ? *right : emptyTemplate();
+
+    if (left && right) {
+        auto field = [&](const QString &name, bool same) {
+            if (!same)
+                diff.changedFields << name;
+        };
+        field("path",              l.path == r.path);
+        field("name",              l.name == r.name);
+        field("subtitle",          l.subtitle == r.subtitle);
+        field("notes",             l.notes == r.notes);
+        field("programming notes", l.programmingNotes == r.programmingNotes);
+        field("type",              l.type == r.type);
+        field("dynamic",           l.dynamic == r.dynamic);
+        field("approved",          l.approved == r.approved);
+        field("graph type",        l.graphType == r.graphType);
+    }
+
+    // Столбцы: по заголовку, переименованный заголовок сводится в пару
+    const QVector<Aligned> cols = pairRuns(align(columnKeys(l), columnKeys(r)));
+    QVector<int> lCols, rCols;
+    diff.columns.reserve(cols.size());
+    bool columnsChanged = false;
+    for (const Aligned &a : cols) {
+        diff.columns.append({a.left, a.right});
+        if (a.left >= 0 && a.right >= 0) {
+            lCols.append(a.left);
+            rCols.append(a.right);
+        } else {
+            columnsChanged = true;
+        }
+    }
+
+    // Строки: хеш по общим столбцам, новый столбец не ломает совпадение строк
+    const QVector<Aligned> rows = pairRuns(align(rowKeys(l.grid, lCols), rowKeys(r.grid, rCols)));
+    diff.rows.reserve(rows.size());
+    bool rowsChanged = false;
+    for (const Aligned &a : rows) {
+        DiffRow row;
+        row.left = a.left;
+        row.right = a.right;
+        if (a.left < 0) {
+            row.op = DiffRow::Added;
+            diff.changedCells += r.grid.columnCount();
+        } else if (a.right < 0) {
+            row.op = DiffRow::Removed;
+            diff.changedCells += l.grid.columnCount();
+        } else if (a.paired) {
+            for (int c = 0; c < diff.columns.size(); ++c) {
+                const auto &col = diff.columns[c];
+                const QStringView lt = col.first >= 0 ? l.grid.textView(a.left, col.first) : QStringView();
+                const QStringView rt = col.second >= 0 ? r.grid.textView(a.right, col.second) : QStringView();
+                if (lt != rt)
+                    row.changedColumns.append(c);
+            }
+            row.op = row.changedColumns.isEmpty() ? DiffRow::Same : DiffRow::Modified;
+            diff.changedCells += row.changedColumns.size();
+        }
+        rowsChanged = rowsChanged || row.op != DiffRow::Same;
+        diff.rows.append(row);
+    }
+
+    if (!left)
+        diff.status = TemplateDiff::Added;
+    else if (!right)
+        diff.status = TemplateDiff::Removed;
+    else if (!diff.changedFields.isEmpty() || columnsChanged || rowsChanged)
+        diff.status = TemplateDiff::Modified;
+    else
+        diff.status = TemplateDiff::Unchanged;
+}
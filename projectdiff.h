@@ -0,0 +1,62 @@
+#ifndef PROJECTDIFF_H
+#define PROJECTDIFF_H
+
+#include <QVector>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+
+class ProjectSnapshot;
+struct SnapshotTemplate;
+
+// Строка выровненной таблицы: индексы строк GridStore слева и справа
+struct DiffRow {
+    enum Op { Same, Added, Removed, Modified };
+
+    Op  op    = Same;
+    int left  = -1;                 // -1 - строки нет на этой стороне
+    int right = -1;
+    QVector<int> changedColumns;    // индексы в TemplateDiff::columns (у Modified)
+};
+
+struct TemplateDiff {
+    enum Status { Unchanged, Modified, Added, Removed };
+    // Как найдена пара; порядок - порядок проходов сопоставления
+    enum Match { Unmatched, SameId, PathAndName, Name, RelatedId, Path };
+
+    int    left  = -1;              // индекс в templates() левого снимка
+    int    right = -1;
+    Status status = Unchanged;
+    Match  match  = Unmatched;
+    QStringList changedFields;      // name, subtitle, path ...
+    QVector<QPair<int, int>> columns;   // выровненные столбцы (левый, правый), -1 - нет
+    QVector<DiffRow> rows;
+    int    changedCells = 0;
+};
+
+// Сравнение двух снимков проекта (проекты или замороженные версии).
+//
+// Шаблоны сопоставляются проходами: тот же template_id (версии одного
+// проекта), путь и имя, только имя, связь с уже сопоставленным шаблоном
+// (related_template_id), только путь - каждый проход берёт лишь
+// уникальные ключи среди ещё не сопоставленных.
+// Таблицы выравниваются по столбцам (LCS по заголовку столбца), затем по
+// строкам (Майерс по хешам строк в общих столбцах); соседние удаление и
+// вставка сводятся в изменённые строки. Пары сравниваются параллельно
+class ProjectDiff {
+public:
+    static QVector<TemplateDiff> compare(const ProjectSnapshot &left, const ProjectSnapshot &right);
+
+    static QString matchName(TemplateDiff::Match match);
+
+    // Выравнивание двух последовательностей: пары (i, j), -1 - нет пары
+    static QVector<QPair<int, int>> align(const QVector<quint64> &a, const QVector<quint64> &b);
+
+private:
+    static QVector<TemplateDiff> matchTemplates(const ProjectSnapshot &left,
+                                                const ProjectSnapshot &right);
+    static void diffTemplate(const SnapshotTemplate *left, const SnapshotTemplate *right,
+                             TemplateDiff &diff);
+};
+
+#endif // PROJECTDIFF_H
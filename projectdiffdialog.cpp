@@ -0,0 +1,257 @@
+#include "projectdiffdialog.h"
+#include "htmlscanner.h"
+#include <QAbstractTableModel>
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QSplitter>
+#include <QHeaderView>
+#include <QScrollBar>
+#include <QPushButton>
+#include <QColor>
+
+// Одна сторона сравнения поверх выровненных строк и столбцов TemplateDiff
+class DiffSideModel : public QAbstractTableModel {
+public:
+    DiffSideModel(bool leftSide, QObject *parent)
+        : QAbstractTableModel(parent), leftSide(leftSide) {}
+
+    void setDiff(const SnapshotTemplate *t, const TemplateDiff *d) {
+        beginResetModel();
+        tmpl = t;
+        diff = d;
+        endResetModel();
+    }
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override {
+        return parent.isValid() || !diff ? 0 : diff->rows.size();
+    }
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override {
+        return parent.isValid() || !diff ? 0 : diff->columns.size();
+    }
+
+    QVariant data(const QModelIndex &index, int role) const override {
+        if (!diff || !index.isValid())
+            return QVariant();
+        const DiffRow &row = diff->rows[index.row()];
+        const int r = sourceRow(index.row());
+        const int c = sourceColumn(index.column());
+
+        if (role == Qt::DisplayRole || role == Qt::ToolTipRole) {
+            if (!tmpl || r < 0 || c < 0 || tmpl->grid.isCovered(r, c))
+                return QVariant();
+            return HtmlScanner::plainText(tmpl->grid.textView(r, c));
+        }
+        if (role == Qt::BackgroundRole) {
+            if (r < 0 || c < 0)
+                return QColor(0xee, 0xee, 0xee);        // строки или столбца нет на этой стороне
+            if (row.op == DiffRow::Added || row.op == DiffRow::Removed)
+                return leftSide ? QColor(0xf9, 0xd6, 0xd5) : QColor(0xd4, 0xf7, 0xd4);
+            const auto &col = diff->columns[index.column()];
+            if (col.first < 0 || col.second < 0)
+                return leftSide ? QColor(0xf9, 0xd6, 0xd5) : QColor(0xd4, 0xf7, 0xd4);
+            if (row.op == DiffRow::Modified)
+                return row.changedColumns.contains(index.column()) ? QColor(0xff, 0xe0, 0x8a)
+                                                                   : QColor(0xff, 0xf6, 0xd0);
+        }
+        return QVariant();
+    }
+
+    QVariant headerData(int section, Qt::Orientation orientation, int role) const override {
+        if (role != Qt::DisplayRole || !diff)
+            return QVariant();
+        const int source = orientation == Qt::Vertical ? sourceRow(section) : sourceColumn(section);
+        return source < 0 ? QVariant() : QVariant(source + 1);
+    }
+
+private:
+    int sourceRow(int row) const {
+        const DiffRow &r = diff->rows[row];
+        return leftSide ? r.left : r.right;
+    }
+    int sourceColumn(int col) const {
+        const auto &c = diff->columns[col];
+        return leftSide ? c.first : c.second;
+    }
+
+    bool leftSide;
+    const SnapshotTemplate *tmpl = nullptr;
+    const TemplateDiff *diff = nullptr;
+};
+
+namespace {
+
+QString statusMark(TemplateDiff::Status status) {
+    switch (status) {
+    case TemplateDiff::Added:     return QStringLiteral("+");
+    case TemplateDiff::Removed:   return QStringLiteral("-");
+    case TemplateDiff::Modified:  return QStringLiteral("~");
+    case TemplateDiff::Unchanged: return QStringLiteral(" ");
+    }
+    return QString();
+}
+
+QTableView *makeView(QAbstractItemModel *model, QWidget *parent) {
+    QTableView *view = new QTableView(parent);
+    view->setModel(model);
+    view->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    view->setWordWrap(false);
+    // Высота строк одна на всю таблицу: без замеров каждой строки
+    view->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    view->verticalHeader()->setDefaultSectionSize(view->fontMetrics().height() + 6);
+    view->horizontalHeader()->setDefaultSectionSize(140);
+    return view;
+}
+
+} // namespace
+
+ProjectDiffDialog::ProjectDiffDialog(ProjectSnapshot left, ProjectSnapshot right,
+                                     QVector<TemplateDiff> diffs, QWidget *parent)
+    : QDialog(parent),
+      leftSnapshot(std::move(left)),
+      rightSnapshot(std::move(right)),
+      diffs(std::move(diffs)) {
+    setWindowTitle(tr("Compare: %1 / %2").arg(leftSnapshot.projectName(), rightSnapshot.projectName()));
+    resize(1300, 750);
+
+    unchangedCheck = new QCheckBox(tr("Show unchanged templates"), this);
+    list = new QListWidget(this);
+    summary = new QLabel(this);
+    fieldsLabel = new QLabel(this);
+    fieldsLabel->setWordWrap(true);
+
+    leftModel  = new DiffSideModel(true, this);
+    rightModel = new DiffSideModel(false, this);
+    leftView   = makeView(leftModel, this);
+    rightView  = makeView(rightModel, this);
+
+    QLabel *leftTitle  = new QLabel(leftSnapshot.projectName(), this);
+    QLabel *rightTitle = new QLabel(rightSnapshot.projectName(), this);
+
+    QWidget *leftPane = new QWidget(this);
+    QVBoxLayout *leftLayout = new QVBoxLayout(leftPane);
+    leftLayout->setContentsMargins(0, 0, 0, 0);
+    leftLayout->addWidget(leftTitle);
+    leftLayout->addWidget(leftView);
+
+    QWidget *rightPane = new QWidget(this);
+    QVBoxLayout *rightLayout = new QVBoxLayout(rightPane);
+    rightLayout->setContentsMargins(0, 0, 0, 0);
+    rightLayout->addWidget(rightTitle);
+    rightLayout->addWidget(rightView);
+
+    QSplitter *tables = new QSplitter(Qt::Horizontal, this);
+    tables->addWidget(leftPane);
+    tables->addWidget(rightPane);
+
+    QWidget *detail = new QWidget(this);
+    QVBoxLayout *detailLayout = new QVBoxLayout(detail);
+    detailLayout->setContentsMargins(0, 0, 0, 0);
+    detailLayout->addWidget(fieldsLabel);
+    detailLayout->addWidget(tables, 1);
+
+    QWidget *listPane = new QWidget(this);
+    QVBoxLayout *listLayout = new QVBoxLayout(listPane);
+    listLayout->setContentsMargins(0, 0, 0, 0);
+    listLayout->addWidget(unchangedCheck);
+    listLayout->addWidget(list, 1);
+
+    QSplitter *main = new QSplitter(Qt::Horizontal, this);
+    main->addWidget(listPane);
+    main->addWidget(detail);
+    main->setStretchFactor(1, 1);
+    main->setSizes({320, 980});
+
+    QPushButton *closeButton = new QPushButton(tr("Close"), this);
+    QHBoxLayout *buttons = new QHBoxLayout;
+    buttons->addWidget(summary);
+    buttons->addStretch();
+    buttons->addWidget(closeButton);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addWidget(main, 1);
+    layout->addLayout(buttons);
+
+    // Общая прокрутка: строки и столбцы сторон выровнены один к одному
+    auto sync = [](QScrollBar *a, QScrollBar *b) {
+        connect(a, &QScrollBar::valueChanged, b, &QScrollBar::setValue);
+        connect(b, &QScrollBar::valueChanged, a, &QScrollBar::setValue);
+    };
+    sync(leftView->verticalScrollBar(), rightView->verticalScrollBar());
+    sync(leftView->horizontalScrollBar(), rightView->horizontalScrollBar());
+    connect(leftView->horizontalHeader(), &QHeaderView::sectionResized, this,
+            [this](int section, int, int size) { rightView->horizontalHeader()->resizeSection(section, size); });
+    connect(rightView->horizontalHeader(), &QHeaderView::sectionResized, this,
+            [this](int section, int, int size) { leftView->horizontalHeader()->resizeSection(section, size); });
+
+    connect(unchangedCheck, &QCheckBox::toggled, this, &ProjectDiffDialog::fillList);
+    connect(list, &QListWidget::currentRowChanged, this, &ProjectDiffDialog::showTemplate);
+    connect(closeButton, &QPushButton::clicked, this, &QDialog::close);
+
+    int added = 0, removed = 0, modified = 0, unchanged = 0;
+    for (const TemplateDiff &d : std::as_const(this->diffs)) {
+        switch (d.status) {
+        case TemplateDiff::Added:     ++added;     break;
+        case TemplateDiff::Removed:   ++removed;   break;
+        case TemplateDiff::Modified:  ++modified;  break;
+        case TemplateDiff::Unchanged: ++unchanged; break;
+        }
+    }
+    summary->setText(tr("Added: %1, removed: %2, modified: %3, unchanged: %4")
+                         .arg(added).arg(removed).arg(modified).arg(unchanged));
+    fillList();
+}
+
+void ProjectDiffDialog::fillList() {
+    list->clear();
+    const bool all = unchangedCheck->isChecked();
+    for (int i = 0; i < diffs.size(); ++i) {
+        const TemplateDiff &d = diffs[i];
+        if (!all && d.status == TemplateDiff::Unchanged)
+            continue;
+        const SnapshotTemplate &t = d.right >= 0 ? rightSnapshot.templates()[d.right]
+                                                 : leftSnapshot.templates()[d.left];
+        QListWidgetItem *item = new QListWidgetItem(
+            QString("%1 %2 %3").arg(statusMark(d.status), t.path, HtmlScanner::plainText(t.name)), list);
+        item->setData(Qt::UserRole, i);
+        if (d.status == TemplateDiff::Added)
+            item->setForeground(QColor(0x1a, 0x7f, 0x37));
+        else if (d.status == TemplateDiff::Removed)
+            item->setForeground(QColor(0xb3, 0x1d, 0x28));
+    }
+    if (list->count() > 0)
+        list->setCurrentRow(0);
+    else
+        showTemplate(-1);
+}
+
+void ProjectDiffDialog::showTemplate(int row) {
+    QListWidgetItem *item = row >= 0 ? list->item(row) : nullptr;
+    if (!item) {
+        leftModel->setDiff(nullptr, nullptr);
+        rightModel->setDiff(nullptr, nullptr);
+        fieldsLabel->setText(tr("No differences."));
+        return;
+    }
+    const TemplateDiff &d = diffs[item->data(Qt::UserRole).toInt()];
+    const SnapshotTemplate *l = d.left >= 0 ? &leftSnapshot.templates()[d.left] : nullptr;
+    const SnapshotTemplate *r = d.right >= 0 ? &rightSnapshot.templates()[d.right] : nullptr;
+    leftModel->setDiff(l, &d);
+    rightModel->setDiff(r, &d);
+
+    QStringList lines;
+    if (d.status == TemplateDiff::Added)
+        lines << tr("New template");
+    else if (d.status == TemplateDiff::Removed)
+        lines << tr("Removed template");
+    else
+        lines << tr("Matched by %1").arg(ProjectDiff::matchName(d.match));
+    if (l && r && l->path != r->path)
+        lines << tr("Path: %1 → %2").arg(l->path, r->path);
+    if (l && r && l->graphType != r->graphType)
+        lines << tr("Graph type: %1 → %2").arg(l->graphType, r->graphType);
+    if (!d.changedFields.isEmpty())
+        lines << tr("Changed: %1").arg(d.changedFields.join(", "));
+    if (d.changedCells > 0)
+        lines << tr("Changed cells: %1").arg(d.changedCells);
+    fieldsLabel->setText(lines.join("   "));
+}
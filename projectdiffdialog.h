@@ -0,0 +1,42 @@
+#ifndef PROJECTDIFFDIALOG_H
+#define PROJECTDIFFDIALOG_H
+
+#include <QDialog>
+#include <QListWidget>
+#include <QTableView>
+#include <QCheckBox>
+#include <QLabel>
+#include "projectsnapshot.h"
+#include "projectdiff.h"
+
+class DiffSideModel;
+
+// Результат ProjectDiff: список шаблонов слева, таблицы двух снимков рядом.
+// Строки и столбцы выровнены, прокрутка общая; модели отдают только
+// видимые ячейки, так что большие листинги открываются сразу
+class ProjectDiffDialog : public QDialog {
+    Q_OBJECT
+public:
+    ProjectDiffDialog(ProjectSnapshot left, ProjectSnapshot right,
+                      QVector<TemplateDiff> diffs, QWidget *parent = nullptr);
+
+private slots:
+    void fillList();
+    void showTemplate(int row);
+
+private:
+    ProjectSnapshot leftSnapshot;
+    ProjectSnapshot rightSnapshot;
+    QVector<TemplateDiff> diffs;
+
+    QCheckBox     *unchangedCheck;
+    QListWidget   *list;
+    QLabel        *summary;
+    QLabel        *fieldsLabel;
+    QTableView    *leftView;
+    QTableView    *rightView;
+    DiffSideModel *leftModel;
+    DiffSideModel *rightModel;
+};
+
+#endif // PROJECTDIFFDIALOG_H
@@ -0,0 +1,17 @@
+#include "projectexporter.h"
+#include "jsonlinesexporter.h"
+#include "rtfshellsexporter.h"
+
+std::vector<std::unique_ptr<ProjectExporter>> ProjectExporter::createAll() {
+    std::vector<std::unique_ptr<ProjectExporter>> all;
+    all.push_back(std::make_unique<JsonLinesExporter>());
+    all.push_back(std::make_unique<RtfShellsExporter>());
+    return all;
+}
+
+QString ProjectExporter::tabId(const SnapshotTemplate &t) {
+    const QString prefix = t.type == "listing" ? "List" : (t.type == "table" ? "Tab" : "Fig");
+    QString underscored = t.path;
+    underscored.replace('.', '_');
+    return prefix + '_' + underscored;
+}
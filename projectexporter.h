@@ -0,0 +1,30 @@
+#ifndef PROJECTEXPORTER_H
+#define PROJECTEXPORTER_H
+
+#include <QString>
+#include <QIODevice>
+#include <memory>
+#include <vector>
+#include "projectsnapshot.h"
+
+// Формат выгрузки проекта. Писатель получает уже загруженный снимок
+// и пишет в поток по мере обхода - весь файл в памяти не собирается.
+// XML сюда не входит: у него свой инкрементальный путь (ExportProjectAsXml)
+class ProjectExporter {
+public:
+    virtual ~ProjectExporter() = default;
+
+    virtual QString title() const = 0;          // пункт меню
+    virtual QString fileFilter() const = 0;     // для QFileDialog
+    virtual QString fileSuffix() const = 0;     // без точки
+
+    virtual bool write(const ProjectSnapshot &snapshot, QIODevice &out) = 0;
+
+    // Все зарегистрированные форматы, в порядке меню
+    static std::vector<std::unique_ptr<ProjectExporter>> createAll();
+
+    // TabID как в экспорте XML: Tab_1_2_3 / List_... / Fig_...
+    static QString tabId(const SnapshotTemplate &t);
+};
+
+#endif // PROJECTEXPORTER_H
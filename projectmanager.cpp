@@ -1,4 +1,8 @@
 #include "projectmanager.h"
+#include "projectsnapshot.h"
+#include "querystats.h"
+#include "sqldialect.h"
+#include "templatemanager.h"
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QDebug>
@@ -8,13 +12,13 @@ ProjectManager::~ProjectManager() {}
 
 int ProjectManager::createProject(const QString &name) {
     QSqlQuery query(db);
-    query.prepare("INSERT INTO project (name) VALUES (:name)");
+    query.prepare("INSERT INTO project (name) VALUES (:name)" + SqlDialect::returningId("project_id"));
     query.bindValue(":name", name);
-    if (!query.exec()) {
+    if (!QUERY_EXEC(query)) {
         qDebug() << "Ошибка создания проекта:" << query.lastError().text();
         return -1;
     }
-    return query.lastInsertId().toInt();
+    return SqlDialect::insertedId(query);
 }
 
 bool ProjectManager::updateProject(int projectId, const QString &newName) {
@@ -23,7 +27,7 @@ bool ProjectManager::updateProject(int projectId, const QString &newName) {
     query.bindValue(":name", newName);
     query.bindValue(":projectId", projectId);
 
-    if (!query.exec()) {
+    if (!QUERY_EXEC(query)) {
         qDebug() << "Ошибка обновления проекта:" << query.lastError().text();
         return false;
     }
@@ -36,7 +40,7 @@ bool ProjectManager::deleteProject(int projectId) {
     query.prepare("DELETE FROM project WHERE project_id = :projectId");
     query.bindValue(":projectId", projectId);
 
-    if (!query.exec()) {
+    if (!QUERY_EXEC(query)) {
         qDebug() << "Ошибка удаления проекта:" << query.lastError().text();
         return false;
     }
@@ -46,7 +50,7 @@ bool ProjectManager::deleteProject(int projectId) {
 QVector<Project> ProjectManager::getProjects() const {
     QVector<Project> projects;
     QSqlQuery query(db);
-    query.exec("SELECT project_id, name FROM project");
+    QUERY_EXEC_SQL(query, "SELECT project_id, name FROM project");
 
     while (query.next()) {
         Project project;
@@ -70,7 +74,7 @@ int ProjectManager::copyProject(int oldProjectId, const QString &newProjectName)
         QSqlQuery q(db);
         q.prepare("SELECT name FROM project WHERE project_id = :pid");
         q.bindValue(":pid", oldProjectId);
-        if (!q.exec() || !q.next()) {
+        if (!QUERY_EXEC(q) || !q.next()) {
             qDebug() << "Ошибка: проект с id" << oldProjectId << "не найден.";
             db.rollback();
             return -1;
@@ -87,14 +91,14 @@ int ProjectManager::copyProject(int oldProjectId, const QString &newProjectName)
                                ? (originalName + " (copy)")
                                : newProjectName;
         QSqlQuery q(db);
-        q.prepare("INSERT INTO project (name) VALUES (:name)");
+        q.prepare("INSERT INTO project (name) VALUES (:name)" + SqlDialect::returningId("project_id"));
         q.bindValue(":name", copyName);
-        if (!q.exec()) {
+        if (!QUERY_EXEC(q)) {
             qDebug() << "Ошибка создания копии проекта:" << q.lastError().text();
             db.rollback();
             return -1;
         }
-        newProjectId = q.lastInsertId().toInt();
+        newProjectId = SqlDialect::insertedId(q);
     }
 
     // 4) Рекурсивно копируем категории и шаблоны
@@ -150,7 +154,7 @@ bool ProjectManager::copyCategoriesRecursively(int oldProjectId, int newProjectI
     if (!oldParentId.isNull()) {
         query.bindValue(":oldParent", oldParentId);
     }
-    if (!query.exec()) {
+    if (!QUERY_EXEC(query)) {
         qDebug() << "Ошибка чтения категорий:" << query.lastError().text();
         return false;
     }
@@ -166,7 +170,7 @@ bool ProjectManager::copyCategoriesRecursively(int oldProjectId, int newProjectI
         ins.prepare(R"(
             INSERT INTO category (name, parent_id, project_id, position, depth)
             VALUES (:name, :parentId, :projId, :pos, :depth)
-        )");
+        )" + SqlDialect::returningId("category_id"));
         ins.bindValue(":name", cName);
         if (newParentId.isNull()) {
             // корневой parent_id = NULL
@@ -179,11 +183,11 @@ bool ProjectManager::copyCategoriesRecursively(int oldProjectId, int newProjectI
         ins.bindValue(":pos", cPos);
         ins.bindValue(":depth", cDepth);
 
-        if (!ins.exec()) {
+        if (!QUERY_EXEC(ins)) {
             qDebug() << "Ошибка вставки категории:" << ins.lastError().text();
             return false;
         }
-        int newCatId = ins.lastInsertId().toInt();
+        int newCatId = SqlDialect::insertedId(ins);
 
         // Сохраняем сопоставление
         categoryIdMap.insert(oldCatId, newCatId);
@@ -216,7 +220,7 @@ bool ProjectManager::copyTemplatesForCategory(int oldCategoryId, int newCategory
     )");
     q.bindValue(":catId", oldCategoryId);
 
-    if (!q.exec()) {
+    if (!QUERY_EXEC(q)) {
         qDebug() << "Ошибка чтения шаблонов:" << q.lastError().text();
         return false;
     }
@@ -237,7 +241,7 @@ bool ProjectManager::copyTemplatesForCategory(int oldCategoryId, int newCategory
             INSERT INTO template (name, category_id, notes, programming_notes, subtitle,
                                   position, is_dynamic, template_type)
             VALUES (:name, :catId, :notes, :pNotes, :subtitle, :pos, :dyn, :tType)
-        )");
+        )" + SqlDialect::returningId("template_id"));
         ins.bindValue(":name", tName);
         ins.bindValue(":catId", newCategoryId);
         ins.bindValue(":notes", notes);
@@ -247,11 +251,11 @@ bool ProjectManager::copyTemplatesForCategory(int oldCategoryId, int newCategory
         ins.bindValue(":dyn", isDynamic);
         ins.bindValue(":tType", tmplType);
 
-        if (!ins.exec()) {
+        if (!QUERY_EXEC(ins)) {
             qDebug() << "Ошибка вставки шаблона:" << ins.lastError().text();
             return false;
         }
-        int newTmplId = ins.lastInsertId().toInt();
+        int newTmplId = SqlDialect::insertedId(ins);
 
         // Сохраняем соответствие
         templateIdMap.insert(oldTmplId, newTmplId);
@@ -286,10 +290,10 @@ bool ProjectManager::copyTableOrListing(int oldTemplateId, int newTemplateId) {
     sel.prepare(R"(
         SELECT cell_type, row_index, col_index, row_span, col_span, content, colour
         FROM grid_cells
-        WHERE template_id = :tid
+        WHERE template_id = )" + TemplateManager::cellOwnerSql(":tid") + R"(
     )");
     sel.bindValue(":tid", oldTemplateId);
-    if (!sel.exec()) {
+    if (!QUERY_EXEC(sel)) {
         qDebug() << "Ошибка чтения grid_cells:" << sel.lastError().text();
         return false;
     }
@@ -317,7 +321,7 @@ bool ProjectManager::copyTableOrListing(int oldTemplateId, int newTemplateId) {
         ins.bindValue(":colSpan", colSpan);
         ins.bindValue(":content", content);
         ins.bindValue(":colour", colour);
-        if (!ins.exec()) {
+        if (!QUERY_EXEC(ins)) {
             qDebug() << "Ошибка вставки grid_cells:" << ins.lastError().text();
             return false;
         }
@@ -326,43 +330,23 @@ bool ProjectManager::copyTableOrListing(int oldTemplateId, int newTemplateId) {
 }
 
 bool ProjectManager::copyGraph(int oldTemplateId, int newTemplateId) {
-    // 1) Считываем записи из таблицы graph, связанные с oldTemplateId
-    QSqlQuery sel(db);
-    sel.prepare(R"(
-        SELECT name, graph_type, image
+    // Записи graph копируются на сервере одним INSERT ... SELECT:
+    // изображения не передаются клиенту и обратно
+    QSqlQuery ins(db);
+    ins.prepare(R"(
+        INSERT INTO graph (template_id, name, graph_type, image)
+        SELECT :newTid, name, graph_type, image
         FROM graph
         WHERE template_id = :oldTid
     )");
-    sel.bindValue(":oldTid", oldTemplateId);
+    ins.bindValue(":newTid", newTemplateId);
+    ins.bindValue(":oldTid", oldTemplateId);
 
-    if (!sel.exec()) {
-        qDebug() << "Ошибка чтения из graph:" << sel.lastError().text();
+    if (!QUERY_EXEC(ins)) {
+        qDebug() << "Ошибка копирования graph:" << ins.lastError().text();
         return false;
     }
 
-    // 2) Для каждой найденной записи вставляем новую в ту же таблицу `graph`,
-    //    но уже с template_id = newTemplateId
-    while (sel.next()) {
-        QString gName    = sel.value("name").toString();
-        QString gType    = sel.value("graph_type").toString();
-        QByteArray gImage= sel.value("image").toByteArray();
-
-        QSqlQuery ins(db);
-        ins.prepare(R"(
-            INSERT INTO graph (template_id, name, graph_type, image)
-            VALUES (:newTid, :nm, :gtype, :img)
-        )");
-        ins.bindValue(":newTid", newTemplateId);
-        ins.bindValue(":nm",     gName);
-        ins.bindValue(":gtype",  gType);
-        ins.bindValue(":img",    gImage);
-
-        if (!ins.exec()) {
-            qDebug() << "Ошибка вставки в graph:" << ins.lastError().text();
-            return false;
-        }
-    }
-
     return true;
 }
 
@@ -370,7 +354,7 @@ QString ProjectManager::getProjectName(int projectId) const {
     QSqlQuery query(db);
     query.prepare("SELECT name FROM project WHERE project_id = :pid");
     query.bindValue(":pid", projectId);
-    if (query.exec() && query.next())
+    if (QUERY_EXEC(query) && query.next())
         return query.value(0).toString();
     return QString();
 }
@@ -382,7 +366,7 @@ QString ProjectManager::getProjectStyle(int projectId) const {
     query.prepare("SELECT template_style FROM project WHERE project_id = :id");
     query.bindValue(":id", projectId);
 
-    if (!query.exec()) {
+    if (!QUERY_EXEC(query)) {
         qDebug() << "Не удалось получить стиль проекта:" << query.lastError().text();
         return styleName;
     }
@@ -400,7 +384,7 @@ bool ProjectManager::updateProjectStyle(int projectId, const QString &styleName)
     query.bindValue(":style", styleName);
     query.bindValue(":id",    projectId);
 
-    if (!query.exec()) {
+    if (!QUERY_EXEC(query)) {
         qDebug() << "Ошибка при обновлении стиля проекта:" << query.lastError().text();
         return false;
     }
@@ -413,7 +397,7 @@ ProjectDetails ProjectManager::getProjectDetails(int projectId) const {
     QSqlQuery query(db);
     query.prepare("SELECT study, sponsor, cut_date, version FROM project WHERE project_id = :pid");
     query.bindValue(":pid", projectId);
-    if (query.exec() && query.next()) {
+    if (QUERY_EXEC(query) && query.next()) {
         details.study = query.value("study").toString();
         details.sponsor = query.value("sponsor").toString();
         details.cutDate = query.value("cut_date").toDate();
@@ -422,6 +406,10 @@ ProjectDetails ProjectManager::getProjectDetails(int projectId) const {
     return details;
 }
 
+bool ProjectManager::loadSnapshot(int projectId, ProjectSnapshot &snapshot) const {
+    return snapshot.load(db, projectId);
+}
+
 bool ProjectManager::updateProjectDetails(int projectId, const ProjectDetails &details) {
     QSqlQuery query(db);
     query.prepare("UPDATE project SET study = :study, sponsor = :sponsor, cut_date = :cut_date, version = :version WHERE project_id = :pid");
@@ -431,7 +419,7 @@ bool ProjectManager::updateProjectDetails(int projectId, const ProjectDetails &d
     query.bindValue(":version", details.version);
     query.bindValue(":pid", projectId);
 
-    if (!query.exec()) {
+    if (!QUERY_EXEC(query)) {
         qDebug() << "Ошибка обновления деталей проекта:" << query.lastError().text();
         return false;
     }
@@ -8,6 +8,8 @@
 #include <QMap>
 #include <QDate>
 
+class ProjectSnapshot;
+
 struct Project {
     int projectId;
     QString name;
@@ -41,6 +43,9 @@ public:
     ProjectDetails getProjectDetails(int projectId) const;
     bool updateProjectDetails(int projectId, const ProjectDetails &details);
 
+    // Весь проект в память (см. ProjectSnapshot) - для экспортёров и проверок
+    bool loadSnapshot(int projectId, ProjectSnapshot &snapshot) const;
+
 private:
     QSqlDatabase &db;
 
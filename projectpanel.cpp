@@ -1,5 +1,8 @@
 #include "projectpanel.h"
+#include "stallwatchdog.h"
 #include "exportprojectasxml.h"
+#include "consistencychecker.h"
+#include "projectdiffdialog.h"
 #include <QInputDialog>
 #include <QMenu>
 #include <QStandardItem>
@@ -19,6 +22,10 @@
 #include <QFileInfo>
 #include <QDateEdit>
 #include <qpushbutton.h>
+#include <QSignalBlocker>
+#include <QApplication>
+#include <QSaveFile>
+#include <QLocale>
 
 ProjectPanel::ProjectPanel(DatabaseHandler *dbHandler, QWidget *parent)
     : QWidget(parent)
@@ -81,6 +88,7 @@ ProjectPanel::ProjectPanel(DatabaseHandler *dbHandler, QWidget *parent)
 ProjectPanel::~ProjectPanel() {}
 
 void ProjectPanel::loadProjectsIntoModel() {
+    STALL_SCOPE();
     // Сначала очищаем модель и добавляем пустой элемент (если это нужно повторно)
     projectModel->clear();
     QStandardItem *emptyItem = new QStandardItem("");
@@ -100,6 +108,21 @@ void ProjectPanel::loadProjectsIntoModel() {
     projectProxyModel->sort(0);
 }
 
+void ProjectPanel::reloadProjectsKeepingSelection(int projectId) {
+    const QSignalBlocker blocker(projectComboBox);
+    loadProjectsIntoModel();
+
+    for (int row = 0; row < projectModel->rowCount(); ++row) {
+        if (projectModel->item(row)->data(Qt::UserRole).toInt() == projectId) {
+            const QModelIndex proxyIdx =
+                projectProxyModel->mapFromSource(projectModel->index(row, 0));
+            projectComboBox->setCurrentIndex(proxyIdx.row());
+            return;
+        }
+    }
+    projectComboBox->setCurrentIndex(-1);
+}
+
 void ProjectPanel::onProjectActivated(int index) {
     QModelIndex proxyIdx = projectComboBox->model()->index(index, 0);
     if (!proxyIdx.isValid())
@@ -137,23 +160,43 @@ void ProjectPanel::showProjectContextMenu(const QPoint &pos) {
     if (projectId == 0) {
         // Пустой элемент – только создание нового проекта
         QAction *createAction = menu.addAction("Create new project");
+        QAction *importXmlAction = menu.addAction("Import from XML");
         QAction *selectedAction = menu.exec(projectComboBox->view()->viewport()->mapToGlobal(pos));
         if (selectedAction == createAction) {
             createNewProject();
+        } else if (selectedAction == importXmlAction) {
+            onImportProjectFromXml();
         }
     } else {
         QAction *configuringDataAction = menu.addAction("Configuring data");
         QAction *configureGroupsAction = menu.addAction("Set up groups");
         QAction *renameAction = menu.addAction("Rename it");
         QAction *copyAction   = menu.addAction("Create copy");
+        QAction *freezeAction  = menu.addAction("Freeze version");
+        QAction *changesAction = menu.addAction("Changes since last version");
+        QAction *compareAction = menu.addAction("Compare with...");
         QAction *deleteAction = menu.addAction("Remove");
+        QAction *checkAction  = menu.addAction("Check consistency");
         QAction *exportXmlAction   = menu.addAction("Export to XML");
-
+        // Остальные форматы - по пункту на зарегистрированный экспортёр
+        const auto exporters = ProjectExporter::createAll();
+        QList<QAction*> exportActions;
+        for (const auto &exporter : exporters)
+            exportActions << menu.addAction(exporter->title());
+        QAction *importXmlAction   = menu.addAction("Import from XML");
 
         QAction *selectedAction = menu.exec(projectComboBox->view()->viewport()->mapToGlobal(pos));
         if (selectedAction == exportXmlAction) {
             onExportProjectAsXml(projectId);
             return;
+        } else if (exportActions.contains(selectedAction)) {
+            onExportProject(projectId, *exporters[exportActions.indexOf(selectedAction)]);
+            return;
+        } else if (selectedAction == checkAction) {
+            checkProjectConsistency(projectId, false);
+            return;
+        } else if (selectedAction == importXmlAction) {
+            onImportProjectFromXml();
         } else if (selectedAction == configureGroupsAction) {
             configureGroups(sourceIndex);
         } else if (selectedAction == renameAction) {
@@ -162,6 +205,12 @@ void ProjectPanel::showProjectContextMenu(const QPoint &pos) {
             deleteProject(sourceIndex);
         } else if (selectedAction == copyAction) {
             copyProject(sourceIndex);
+        } else if (selectedAction == freezeAction) {
+            freezeProjectVersion(projectId);
+        } else if (selectedAction == changesAction) {
+            showChangesSinceVersion(projectId);
+        } else if (selectedAction == compareAction) {
+            compareProject(projectId);
         } else if (selectedAction == configuringDataAction) {
             configureProjectData(sourceIndex);
         }
@@ -298,6 +347,8 @@ void ProjectPanel::deleteProject(const QModelIndex &index) {
         if (!dbHandler->getProjectManager()->deleteProject(projId)) {
             QMessageBox::warning(this, "Error", "Couldn't delete the project.");
         } else {
+            // версии ушли каскадом, их данные могут больше ни на что не ссылаться
+            dbHandler->getVersionManager()->purgeUnusedBlobs();
             loadProjectsIntoModel();
         }
     }
@@ -358,6 +409,7 @@ QVector<QString> ProjectPanel::askForGroupNames(int numGroups) {
 }
 
 void ProjectPanel::configureGroups(const QModelIndex &index) {
+    STALL_SCOPE();
     if (!index.isValid())
         return;
 
@@ -422,14 +474,9 @@ void ProjectPanel::configureProjectData(const QModelIndex &index) {
 }
 
 void ProjectPanel::onExportProjectAsXml(int projectId) {
-    if (QMessageBox::question(
-            this,
-            tr("Check numbering"),
-            tr("Before exporting to XML, please check that the numbering of categories and templates is correct.\n\nProceed with export?"),
-            QMessageBox::Yes | QMessageBox::No
-            ) != QMessageBox::Yes) {
-        return; // пользователь хочет проверить — останавливаем экспорт
-    }
+    // Нумерация и таблицы проверяются автоматически, вместо вопроса пользователю
+    if (!checkProjectConsistency(projectId, true))
+        return;
 
     if (!editProjectDataWithValidation(projectId)) {
         return;
@@ -449,19 +496,30 @@ void ProjectPanel::onExportProjectAsXml(int projectId) {
     QString defaultName = QString("project_%1.xml").arg(projectId);
     QString initialPath = QDir(lastDir).filePath(defaultName);
 
-    // 3) Вызываем диалог
+    // 3) Вызываем диалог: обычный, компактный или сжатый XML
+    const QString plainFilter      = tr("XML files (*.xml)");
+    const QString compactFilter    = tr("Compact XML without indentation (*.xml)");
+    const QString compressedFilter = tr("Compressed XML (*.xml.gz)");
+    QString selectedFilter = settings.value("export/xmlFilter", plainFilter).toString();
     QString filename = QFileDialog::getSaveFileName(
         this,
         tr("Save the project as XML"),
         initialPath,
-        tr("XML files (*.xml)")
+        QStringList{plainFilter, compactFilter, compressedFilter}.join(";;"),
+        &selectedFilter
         );
     if (filename.isEmpty())
         return; // пользователь отменил
 
-    // 4) Сохраняем новую папку в настройки
+    const bool compressed = selectedFilter == compressedFilter
+                            || filename.endsWith(".gz", Qt::CaseInsensitive);
+    if (compressed && !filename.endsWith(".gz", Qt::CaseInsensitive))
+        filename += ".gz";
+
+    // 4) Сохраняем новую папку и формат в настройки
     QString newDir = QFileInfo(filename).absolutePath();
     settings.setValue(KEY, newDir);
+    settings.setValue("export/xmlFilter", selectedFilter);
     settings.sync();
 
     // 5) Запускаем экспорт
@@ -471,6 +529,12 @@ void ProjectPanel::onExportProjectAsXml(int projectId) {
         dbHandler->getTemplateManager(),
         dbHandler->getTableManager()
         );
+    // неизменённые шаблоны берутся из кэша прошлого экспорта
+    exporter.setCacheDirectory(dbHandler->cacheDirectory());
+    // Отступы внутри gzip почти ничего не стоят, но и пользы от них нет
+    exporter.setCompact(compressed || selectedFilter == compactFilter);
+    exporter.setCompression(compressed ? ExportProjectAsXml::Compression::Gzip
+                                       : ExportProjectAsXml::Compression::None);
     if (!exporter.exportProject(projectId, filename)) {
         QMessageBox::warning(
             this,
@@ -480,6 +544,277 @@ void ProjectPanel::onExportProjectAsXml(int projectId) {
     }
 }
 
+bool ProjectPanel::checkProjectConsistency(int projectId, bool beforeExport) {
+    ConsistencyChecker *checker = dbHandler->getConsistencyChecker();
+    ConsistencyReport report;
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    const bool loaded = checker->check(projectId, report);
+    QApplication::restoreOverrideCursor();
+    if (!loaded) {
+        QMessageBox::warning(this, tr("Error"), tr("Couldn't load the project for checking."));
+        return false;
+    }
+
+    if (report.isClean()) {
+        if (!beforeExport)
+            QMessageBox::information(this, tr("Check consistency"),
+                                     tr("No problems found."));
+        return true;
+    }
+
+    QStringList lines;
+    for (const ConsistencyIssue &issue : report.issues)
+        lines << QString("[%1]%2 %3")
+                     .arg(ConsistencyChecker::kindName(issue.kind),
+                          issue.repairable ? QString() : tr(" (manual)"),
+                          issue.description);
+
+    const int repairable = report.repairableCount();
+    QMessageBox box(QMessageBox::Warning, tr("Check consistency"),
+                    tr("Found %1 problem(s), %2 can be repaired automatically.")
+                        .arg(report.issues.size()).arg(repairable),
+                    QMessageBox::NoButton, this);
+    box.setDetailedText(lines.join('\n'));
+    QPushButton *repairButton = repairable > 0
+        ? box.addButton(tr("Repair"), QMessageBox::AcceptRole) : nullptr;
+    QPushButton *continueButton = beforeExport
+        ? box.addButton(tr("Export anyway"), QMessageBox::DestructiveRole) : nullptr;
+    box.addButton(beforeExport ? QMessageBox::Cancel : QMessageBox::Close);
+    box.exec();
+
+    if (continueButton && box.clickedButton() == continueButton)
+        return true;
+    if (!repairButton || box.clickedButton() != repairButton)
+        return false;
+
+    const int fixed = checker->repair(report);
+    if (fixed < 0) {
+        QMessageBox::warning(this, tr("Error"), tr("Couldn't repair the project.\n"
+                                                   "If it was changed since the check, check it again."));
+        return false;
+    }
+    // Номера и порядок в дереве могли поменяться
+    emit projectListChanged();
+    if (!beforeExport)
+        QMessageBox::information(this, tr("Check consistency"),
+                                 tr("Repaired %1 problem(s).").arg(fixed));
+    return true;
+}
+
+void ProjectPanel::freezeProjectVersion(int projectId) {
+    // По умолчанию - версия из данных проекта, иначе дата
+    QString label = dbHandler->getProjectManager()->getProjectDetails(projectId).version;
+    if (label.isEmpty())
+        label = QDate::currentDate().toString(Qt::ISODate);
+    bool ok;
+    label = QInputDialog::getText(this, tr("Freeze version"), tr("Version label:"),
+                                  QLineEdit::Normal, label, &ok).trimmed();
+    if (!ok || label.isEmpty())
+        return;
+
+    VersionManager *versions = dbHandler->getVersionManager();
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    const int versionId = versions->freezeVersion(projectId, label);
+    QApplication::restoreOverrideCursor();
+    if (versionId < 0) {
+        QMessageBox::warning(this, tr("Error"), tr("Couldn't freeze the project version."));
+        return;
+    }
+    const QVector<ProjectVersion> list = versions->getVersions(projectId);
+    if (list.isEmpty())
+        return;
+    const ProjectVersion &v = list.last();
+    QMessageBox::information(this, tr("Freeze version"),
+                             tr("Version \"%1\" saved: %2 of %3 templates stored, "
+                                "the rest are shared with earlier versions.")
+                                 .arg(v.label).arg(v.storedCount).arg(v.templateCount));
+}
+
+void ProjectPanel::showChangesSinceVersion(int projectId) {
+    VersionManager *versions = dbHandler->getVersionManager();
+    const QVector<ProjectVersion> list = versions->getVersions(projectId);
+    if (list.isEmpty()) {
+        QMessageBox::information(this, tr("Changes since last version"),
+                                 tr("The project has no frozen versions yet."));
+        return;
+    }
+
+    const ProjectVersion &last = list.last();
+    VersionDiff diff;
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    const bool ok = versions->diffWithProject(last.versionId, diff);
+    QApplication::restoreOverrideCursor();
+    if (!ok) {
+        QMessageBox::warning(this, tr("Error"), tr("Couldn't compare the project with the version."));
+        return;
+    }
+    if (diff.isEmpty()) {
+        QMessageBox::information(this, tr("Changes since last version"),
+                                 tr("No changes since version \"%1\".").arg(last.label));
+        return;
+    }
+    QString text = tr("Since version \"%1\" (%2):\n\n"
+                      "Added templates: %3\nRemoved templates: %4\n"
+                      "Modified templates: %5\nMoved templates: %6")
+                       .arg(last.label, QLocale().toString(last.createdAt, QLocale::ShortFormat))
+                       .arg(diff.added.size()).arg(diff.removed.size())
+                       .arg(diff.modified.size()).arg(diff.moved.size());
+    if (diff.treeChanged)
+        text += tr("\nCategories have changed.");
+    QMessageBox::information(this, tr("Changes since last version"), text);
+}
+
+void ProjectPanel::compareProject(int projectId) {
+    // Слева - выбранная версия или проект, справа - текущее состояние
+    struct Source {
+        int     versionId;      // -1 - живой проект
+        int     projectId;
+        QString label;
+    };
+    QVector<Source> sources;
+    QStringList items;
+    const QVector<ProjectVersion> versions = dbHandler->getVersionManager()->getVersions(projectId);
+    for (auto it = versions.crbegin(); it != versions.crend(); ++it) {
+        sources.append({it->versionId, projectId, it->label});
+        items << tr("Version: %1 (%2) #%3")
+                     .arg(it->label, QLocale().toString(it->createdAt, QLocale::ShortFormat),
+                          QString::number(it->versionId));
+    }
+    for (const Project &p : dbHandler->getProjectManager()->getProjects()) {
+        if (p.projectId == projectId)
+            continue;
+        sources.append({-1, p.projectId, p.name});
+        items << tr("Project: %1 #%2").arg(p.name, QString::number(p.projectId));
+    }
+    if (items.isEmpty()) {
+        QMessageBox::information(this, tr("Compare"),
+                                 tr("There are no versions or other projects to compare with."));
+        return;
+    }
+
+    // Имена проектов и метки версий могут совпадать - строки различает id,
+    // иначе indexOf() нашёл бы первую одноимённую
+    bool ok;
+    const QString choice = QInputDialog::getItem(this, tr("Compare"), tr("Compare the project with:"),
+                                                 items, 0, false, &ok);
+    if (!ok)
+        return;
+    const Source &source = sources[items.indexOf(choice)];
+
+    ProjectSnapshot left, right;
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    bool loaded = source.versionId > 0
+                      ? left.loadVersion(*dbHandler->getVersionManager(), source.versionId, source.label)
+                      : dbHandler->getProjectManager()->loadSnapshot(source.projectId, left);
+    loaded = loaded && dbHandler->getProjectManager()->loadSnapshot(projectId, right);
+    QVector<TemplateDiff> diffs;
+    if (loaded)
+        diffs = ProjectDiff::compare(left, right);
+    QApplication::restoreOverrideCursor();
+    if (!loaded) {
+        QMessageBox::warning(this, tr("Error"), tr("Couldn't load the projects for comparison."));
+        return;
+    }
+
+    ProjectDiffDialog *dialog = new ProjectDiffDialog(std::move(left), std::move(right),
+                                                      std::move(diffs), this);
+    dialog->setAttribute(Qt::WA_DeleteOnClose);
+    dialog->show();
+}
+
+void ProjectPanel::onExportProject(int projectId, ProjectExporter &exporter) {
+    const QString KEY = "export/lastDir";
+    QSettings settings;
+    QString lastDir = settings.value(
+                                  KEY,
+                                  QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation)
+                                  ).toString();
+    if (!QDir(lastDir).exists())
+        lastDir = QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation);
+
+    const QString defaultName = QString("project_%1.%2").arg(projectId).arg(exporter.fileSuffix());
+    QString filename = QFileDialog::getSaveFileName(
+        this,
+        exporter.title(),
+        QDir(lastDir).filePath(defaultName),
+        exporter.fileFilter()
+        );
+    if (filename.isEmpty())
+        return;
+    settings.setValue(KEY, QFileInfo(filename).absolutePath());
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    ProjectSnapshot snapshot;
+    bool ok = dbHandler->getProjectManager()->loadSnapshot(projectId, snapshot);
+    if (ok) {
+        // Файл заменяется целиком только после успешной записи
+        QSaveFile file(filename);
+        ok = file.open(QIODevice::WriteOnly) && exporter.write(snapshot, file) && file.commit();
+    }
+    QApplication::restoreOverrideCursor();
+    if (!ok) {
+        QMessageBox::warning(
+            this,
+            tr("Error"),
+            tr("Couldn't save file:\n%1").arg(filename)
+            );
+    }
+}
+
+void ProjectPanel::onImportProjectFromXml() {
+    // Каталог общий с экспортом: файл обычно берут оттуда, куда его сохранили
+    const QString KEY = "export/lastDir";
+    QSettings settings;
+    QString lastDir = settings.value(
+                                  KEY,
+                                  QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation)
+                                  ).toString();
+    if (!QDir(lastDir).exists())
+        lastDir = QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation);
+
+    QString filename = QFileDialog::getOpenFileName(
+        this,
+        tr("Import a project from XML"),
+        lastDir,
+        tr("XML files (*.xml)")
+        );
+    if (filename.isEmpty())
+        return;
+    settings.setValue(KEY, QFileInfo(filename).absolutePath());
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    ImportManager *importer = dbHandler->getImportManager();
+    const int newProjectId = importer->importProjectXml(filename);
+    QApplication::restoreOverrideCursor();
+    if (newProjectId < 0) {
+        QMessageBox::warning(
+            this,
+            tr("Error"),
+            tr("Couldn't import %1:\n%2").arg(filename, importer->lastError())
+            );
+        return;
+    }
+
+    const QString newProjectName = dbHandler->getProjectManager()->getProjectName(newProjectId);
+    QStandardItem *item = new QStandardItem(newProjectName);
+    item->setData(newProjectId, Qt::UserRole);
+    item->setFlags(item->flags() | Qt::ItemIsEditable);
+    projectModel->appendRow(item);
+    projectProxyModel->sort(0);
+
+    for (int i = 0; i < projectModel->rowCount(); ++i) {
+        if (projectModel->item(i)->data(Qt::UserRole).toInt() == newProjectId) {
+            QModelIndex proxyIdx = projectProxyModel->mapFromSource(projectModel->index(i, 0));
+            projectComboBox->setCurrentIndex(proxyIdx.row());
+            projectComboBox->setCurrentText(newProjectName);
+            emit projectSelected(newProjectId);
+            break;
+        }
+    }
+
+    emit projectListChanged();
+}
+
 bool ProjectPanel::editProjectDataWithValidation(int projectId) {
     while (true) {
         ProjectDetails current = dbHandler->getProjectManager()->getProjectDetails(projectId);
@@ -2,6 +2,7 @@
 #define PROJECTPANEL_H
 
 #include "databasehandler.h"
+#include "projectexporter.h"
 #include <QWidget>
 #include <QComboBox>
 #include <QStandardItemModel>
@@ -20,6 +21,8 @@ public:
 
 
     void loadProjectsIntoModel();
+    // Перезагрузить список, не меняя выбранный проект и не посылая projectSelected
+    void reloadProjectsKeepingSelection(int projectId);
     void onProjectActivated(int index);
 
     void showProjectContextMenu(const QPoint &pos);
@@ -32,6 +35,14 @@ public:
     QVector<QString> askForGroupNames(int numGroups);
 
     void onExportProjectAsXml(int projectId);
+    // Проверка целостности; перед экспортом - false, если пользователь отменил
+    bool checkProjectConsistency(int projectId, bool beforeExport);
+    void freezeProjectVersion(int projectId);
+    void showChangesSinceVersion(int projectId);
+    // Сравнение текущего проекта с его версией или другим проектом
+    void compareProject(int projectId);
+    void onExportProject(int projectId, ProjectExporter &exporter);
+    void onImportProjectFromXml();
 
     bool editProjectDataWithValidation(int projectId);
 
@@ -0,0 +1,320 @@
+#include "projectsnapshot.h"
+#include "querystats.h"
+#include "versionmanager.h"
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QColor>
+#include <QDebug>
+#include <algorithm>
+
+namespace {
+
+struct RawCell {
+    int     row;
+    int     col;
+    QString content;
+    QString colour;
+    int     rowSpan;
+    int     colSpan;
+};
+
+// То же уплотнение индексов, что DENSE_RANK в getTableData()
+void fillGrid(GridStore &grid, const QVector<RawCell> &cells, QHash<QString, QRgb> &colourCache) {
+    QVector<int> rows, cols;
+    rows.reserve(cells.size());
+    cols.reserve(cells.size());
+    qsizetype chars = 0;
+    for (const RawCell &c : cells) {
+        rows.append(c.row);
+        cols.append(c.col);
+        chars += c.content.size();
+    }
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+    std::sort(cols.begin(), cols.end());
+    cols.erase(std::unique(cols.begin(), cols.end()), cols.end());
+
+    grid.reset(rows.size(), cols.size());
+    grid.reserveText(chars);
+    for (const RawCell &c : cells) {
+        const int r = std::lower_bound(rows.cbegin(), rows.cend(), c.row) - rows.cbegin();
+        const int k = std::lower_bound(cols.cbegin(), cols.cend(), c.col) - cols.cbegin();
+        grid.setText(r, k, c.content);
+
+        auto it = colourCache.constFind(c.colour);
+        if (it == colourCache.cend()) {
+            const QColor parsed(c.colour);
+            it = colourCache.insert(c.colour, parsed.isValid() ? parsed.rgba()
+                                                               : GridStore::DefaultColour);
+        }
+        grid.setColour(r, k, *it);
+
+        if (c.rowSpan > 1 || c.colSpan > 1)
+            grid.setSpan(r, k, c.rowSpan, c.colSpan);
+    }
+}
+
+} // namespace
+
+bool ProjectSnapshot::load(QSqlDatabase &db, int projectId, LoadOption option) {
+    *this = ProjectSnapshot();
+    id = projectId;
+    keepRawCells = option == RawCells;
+    if (!loadProject(db) || !loadCategories(db) || !loadTemplates(db) || !loadCells(db)) {
+        *this = ProjectSnapshot();
+        return false;
+    }
+    buildPaths();
+    return true;
+}
+
+bool ProjectSnapshot::loadVersion(const VersionManager &versions, int versionId,
+                                  const QString &label, LoadOption option) {
+    *this = ProjectSnapshot();
+    QVector<FrozenCategory> frozenCats;
+    QVector<FrozenTemplate> frozenTmpls;
+    if (!versions.loadTree(versionId, frozenCats) || !versions.loadTemplates(versionId, frozenTmpls)) {
+        qDebug() << "ProjectSnapshot: не удалось загрузить версию" << versionId;
+        return false;
+    }
+    name = label;
+    keepRawCells = option == RawCells;
+
+    // Тот же порядок, что у запросов load()
+    std::sort(frozenCats.begin(), frozenCats.end(), [](const FrozenCategory &a, const FrozenCategory &b) {
+        return a.position != b.position ? a.position < b.position : a.categoryId < b.categoryId;
+    });
+    for (const FrozenCategory &f : std::as_const(frozenCats)) {
+        SnapshotCategory c;
+        c.categoryId = f.categoryId;
+        c.parentId   = f.parentId;
+        c.name       = f.name;
+        c.position   = f.position;
+        c.depth      = f.depth;
+        catIndex.insert(c.categoryId, cats.size());
+        cats.append(c);
+    }
+    linkCategories();
+
+    std::sort(frozenTmpls.begin(), frozenTmpls.end(), [](const FrozenTemplate &a, const FrozenTemplate &b) {
+        return a.position != b.position ? a.position < b.position : a.templateId < b.templateId;
+    });
+    QHash<QString, QRgb> colourCache;
+    QVector<RawCell> cells;
+    for (FrozenTemplate &f : frozenTmpls) {
+        SnapshotTemplate t;
+        t.templateId        = f.templateId;
+        t.categoryId        = f.categoryId;
+        t.name              = f.name;
+        t.subtitle          = f.subtitle;
+        t.notes             = f.notes;
+        t.programmingNotes  = f.programmingNotes;
+        t.position          = f.position;
+        t.type              = f.type;
+        t.dynamic           = f.dynamic;
+        t.approved          = f.approved;
+        t.relatedTemplateId = f.relatedTemplateId;
+        t.graphRows         = f.graphs.size();
+        if (!f.graphs.isEmpty())
+            t.graphType = f.graphs.first().graphType.trimmed();
+
+        cells.clear();
+        cells.reserve(f.cells.size());
+        for (const FrozenCell &c : std::as_const(f.cells)) {
+            if (c.header)
+                t.headerRows = std::max(t.headerRows, c.row);
+            cells.append({c.row, c.col, c.content, c.colour, c.rowSpan, c.colSpan});
+            if (keepRawCells)
+                t.cells.append({c.row, c.col, c.rowSpan, c.colSpan, c.header});
+        }
+        if (!cells.isEmpty())
+            fillGrid(t.grid, cells, colourCache);
+        f = FrozenTemplate();           // ячейки версии больше не нужны
+        addTemplate(std::move(t));
+    }
+    buildPaths();
+    return true;
+}
+
+QStringList ProjectSnapshot::chapterNames(int templateIndex) const {
+    QStringList names;
+    for (int c = tmpls[templateIndex].category; c >= 0;
+         c = catIndex.value(cats[c].parentId, -1))
+        names.prepend(cats[c].name);
+    return names;
+}
+
+bool ProjectSnapshot::loadProject(QSqlDatabase &db) {
+    QSqlQuery q(db);
+    q.prepare("SELECT name, template_style, study, sponsor, cut_date, version "
+              "FROM project WHERE project_id = ?");
+    q.addBindValue(id);
+    if (!QUERY_EXEC(q) || !q.next()) {
+        qDebug() << "ProjectSnapshot: проект не найден" << id << q.lastError().text();
+        return false;
+    }
+    name  = q.value(0).toString();
+    style = q.value(1).toString();
+    projectDetails.study   = q.value(2).toString();
+    projectDetails.sponsor = q.value(3).toString();
+    projectDetails.cutDate = q.value(4).toDate();
+    projectDetails.version = q.value(5).toString();
+    return true;
+}
+
+bool ProjectSnapshot::loadCategories(QSqlDatabase &db) {
+    QSqlQuery q(db);
+    q.setForwardOnly(true);
+    q.prepare("SELECT category_id, name, parent_id, position, depth "
+              "FROM category WHERE project_id = ? ORDER BY position, category_id");
+    q.addBindValue(id);
+    if (!QUERY_EXEC(q)) {
+        qDebug() << "ProjectSnapshot: ошибка загрузки категорий" << q.lastError().text();
+        return false;
+    }
+    while (q.next()) {
+        SnapshotCategory c;
+        c.categoryId = q.value(0).toInt();
+        c.name       = q.value(1).toString();
+        c.parentId   = q.value(2).isNull() ? -1 : q.value(2).toInt();
+        c.position   = q.value(3).toInt();
+        c.depth      = q.value(4).toInt();
+        catIndex.insert(c.categoryId, cats.size());
+        cats.append(c);
+    }
+
+    linkCategories();
+    return true;
+}
+
+void ProjectSnapshot::linkCategories() {
+    // Порядок position сохраняется: категории уже отсортированы
+    for (int i = 0; i < cats.size(); ++i) {
+        const int parent = catIndex.value(cats[i].parentId, -1);
+        if (parent < 0)
+            rootCats.append(i);
+        else
+            cats[parent].children.append(i);
+    }
+}
+
+void ProjectSnapshot::addTemplate(SnapshotTemplate &&t) {
+    t.category = catIndex.value(t.categoryId, -1);
+    const int idx = tmpls.size();
+    tmplIndex.insert(t.templateId, idx);
+    if (t.category >= 0)
+        cats[t.category].templates.append(idx);
+    tmpls.append(std::move(t));
+}
+
+bool ProjectSnapshot::loadTemplates(QSqlDatabase &db) {
+    QSqlQuery q(db);
+    q.setForwardOnly(true);
+    q.prepare(
+        "SELECT t.template_id, t.category_id, t.name, t.subtitle, t.notes, "
+        "t.programming_notes, t.position, t.template_type, t.is_dynamic, t.approved, "
+        "t.related_template_id, "
+        "(SELECT gr.graph_type FROM graph gr WHERE gr.template_id = t.template_id LIMIT 1), "
+        "(SELECT COUNT(*) FROM graph gr WHERE gr.template_id = t.template_id) "
+        "FROM template t "
+        "JOIN category c ON t.category_id = c.category_id "
+        "WHERE c.project_id = ? "
+        "ORDER BY t.position, t.template_id");
+    q.addBindValue(id);
+    if (!QUERY_EXEC(q)) {
+        qDebug() << "ProjectSnapshot: ошибка загрузки шаблонов" << q.lastError().text();
+        return false;
+    }
+    while (q.next()) {
+        SnapshotTemplate t;
+        t.templateId       = q.value(0).toInt();
+        t.categoryId       = q.value(1).toInt();
+        t.name             = q.value(2).toString();
+        t.subtitle         = q.value(3).toString();
+        t.notes            = q.value(4).toString();
+        t.programmingNotes = q.value(5).toString();
+        t.position         = q.value(6).toInt();
+        t.type             = q.value(7).toString();
+        t.dynamic          = q.value(8).toBool();
+        t.approved         = q.value(9).toBool();
+        t.relatedTemplateId = q.value(10).isNull() ? -1 : q.value(10).toInt();
+        t.graphType        = q.value(11).toString().trimmed();
+        t.graphRows        = q.value(12).toInt();
+        addTemplate(std::move(t));
+    }
+    return true;
+}
+
+bool ProjectSnapshot::loadCells(QSqlDatabase &db) {
+    // Все ячейки проекта одним запросом; по шаблону они идут подряд.
+    // Копия с общими ячейками получает ячейки владельца (миграция 008)
+    QSqlQuery q(db);
+    q.setForwardOnly(true);
+    q.prepare(
+        "SELECT t.template_id, g.cell_type, g.row_index, g.col_index, g.content, g.colour, "
+        "COALESCE(g.row_span, 1), COALESCE(g.col_span, 1) "
+        "FROM template t "
+        "JOIN category c ON t.category_id = c.category_id "
+        "JOIN grid_cells g ON g.template_id = COALESCE(t.content_source_id, t.template_id) "
+        "WHERE c.project_id = ? "
+        "ORDER BY t.template_id");
+    q.addBindValue(id);
+    if (!QUERY_EXEC(q)) {
+        qDebug() << "ProjectSnapshot: ошибка загрузки ячеек" << q.lastError().text();
+        return false;
+    }
+
+    QHash<QString, QRgb> colourCache;
+    QVector<RawCell> cells;
+    int current = -1;
+    auto flush = [&]() {
+        if (current >= 0 && !cells.isEmpty())
+            fillGrid(tmpls[current].grid, cells, colourCache);
+        cells.clear();
+    };
+
+    int currentId = -1;
+    while (q.next()) {
+        const int templateId = q.value(0).toInt();
+        if (templateId != currentId) {
+            flush();
+            currentId = templateId;
+            current = tmplIndex.value(templateId, -1);
+        }
+        if (current < 0)
+            continue;
+
+        const int row = q.value(2).toInt();
+        const int col = q.value(3).toInt();
+        const bool header = q.value(1).toString() == QLatin1String("header");
+        // число строк заголовка - как TableManager::getRowCountForHeader()
+        if (header)
+            tmpls[current].headerRows = std::max(tmpls[current].headerRows, row);
+        cells.append({row, col, q.value(4).toString(), q.value(5).toString(),
+                      q.value(6).toInt(), q.value(7).toInt()});
+        if (keepRawCells)
+            tmpls[current].cells.append({row, col, q.value(6).toInt(), q.value(7).toInt(), header});
+    }
+    flush();
+    return true;
+}
+
+void ProjectSnapshot::buildPaths() {
+    for (int root : std::as_const(rootCats)) {
+        cats[root].path = QString::number(cats[root].position);
+        buildOrder(root);
+    }
+}
+
+void ProjectSnapshot::buildOrder(int categoryIndex) {
+    const SnapshotCategory &cat = cats[categoryIndex];
+    for (int i = 0; i < cat.templates.size(); ++i) {
+        const int t = cat.templates[i];
+        tmpls[t].path = cat.path + '.' + QString::number(i + 1);
+        order.append(t);
+    }
+    for (int child : cat.children) {
+        cats[child].path = cat.path + '.' + QString::number(cats[child].position);
+        buildOrder(child);
+    }
+}
@@ -0,0 +1,106 @@
+#ifndef PROJECTSNAPSHOT_H
+#define PROJECTSNAPSHOT_H
+
+#include <QVector>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QSqlDatabase>
+#include "projectmanager.h"
+#include "gridstore.h"
+
+class VersionManager;
+
+struct SnapshotCategory {
+    int     categoryId = 0;
+    int     parentId   = -1;       // -1 у корневых
+    QString name;
+    int     position   = 0;
+    int     depth      = 0;
+    QString path;                  // "1.2" - номера position от корня
+    QVector<int> children;         // индексы в categories(), по position
+    QVector<int> templates;        // индексы в templates(), по position
+};
+
+// Ячейка с индексами как в базе (1-based, возможны пропуски) - для
+// проверки целостности; заполняется только при загрузке с RawCells
+struct SnapshotCell {
+    int  row;
+    int  col;
+    int  rowSpan;
+    int  colSpan;
+    bool header;
+};
+
+struct SnapshotTemplate {
+    int     templateId = 0;
+    int     categoryId = 0;
+    int     category   = -1;       // индекс в categories()
+    QString name;
+    QString subtitle;
+    QString notes;
+    QString programmingNotes;
+    int     position   = 0;
+    QString type;                  // table / listing / graph
+    bool    dynamic    = false;
+    bool    approved   = false;
+    int     relatedTemplateId = -1;
+    QString graphType;             // только у графиков
+    int     graphRows  = 0;        // строк в graph (у графика должна быть одна)
+    int     headerRows = 0;
+    GridStore grid;                // как getTableData(); у графиков пуст
+    QVector<SnapshotCell> cells;   // только с RawCells
+    QString path;                  // "1.2.3", как в экспорте
+};
+
+// Весь проект в памяти: дерево категорий, шаблоны и их таблицы.
+// Загружается четырьмя запросами независимо от размера проекта;
+// экспортёры и проверки дальше работают без базы
+class ProjectSnapshot {
+public:
+    enum LoadOption { GridsOnly, RawCells };
+    bool load(QSqlDatabase &db, int projectId, LoadOption option = GridsOnly);
+    // Замороженная версия (VersionManager); имя проекта - метка версии
+    bool loadVersion(const VersionManager &versions, int versionId, const QString &label,
+                     LoadOption option = GridsOnly);
+
+    int projectId() const                      { return id; }
+    const QString &projectName() const         { return name; }
+    const QString &templateStyle() const       { return style; }
+    const ProjectDetails &details() const      { return projectDetails; }
+
+    const QVector<SnapshotCategory> &categories() const { return cats; }
+    const QVector<SnapshotTemplate> &templates() const  { return tmpls; }
+    const QVector<int> &roots() const                   { return rootCats; }
+
+    // Шаблоны в порядке обхода дерева - том же, что у экспорта XML
+    const QVector<int> &templateOrder() const { return order; }
+    // Имена категорий от корня до категории шаблона (HTML как в базе)
+    QStringList chapterNames(int templateIndex) const;
+    int indexOfTemplate(int templateId) const { return tmplIndex.value(templateId, -1); }
+
+private:
+    bool loadProject(QSqlDatabase &db);
+    bool loadCategories(QSqlDatabase &db);
+    bool loadTemplates(QSqlDatabase &db);
+    bool loadCells(QSqlDatabase &db);
+    void linkCategories();
+    void addTemplate(SnapshotTemplate &&t);
+    void buildPaths();
+    void buildOrder(int categoryIndex);
+
+    int id = -1;
+    bool keepRawCells = false;
+    QString name;
+    QString style;
+    ProjectDetails projectDetails;
+
+    QVector<SnapshotCategory> cats;
+    QVector<SnapshotTemplate> tmpls;
+    QVector<int> rootCats;
+    QVector<int> order;
+    QHash<int, int> catIndex;      // category_id -> индекс
+    QHash<int, int> tmplIndex;     // template_id -> индекс
+};
+
+#endif // PROJECTSNAPSHOT_H
@@ -0,0 +1,155 @@
+#include "querystats.h"
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QDateTime>
+#include <QDebug>
+#include <algorithm>
+
+std::atomic_bool QueryStats::enabled{qEnvironmentVariableIsSet("AUTOTLG_QUERY_STATS")};
+
+namespace {
+
+// Для перцентилей храним последние MaxSamples замеров места вызова
+constexpr int MaxSamples = 2048;
+
+struct SiteStats {
+    const char *file     = nullptr;
+    int         line     = 0;
+    const char *function = nullptr;
+    qint64 count   = 0;
+    qint64 totalNs = 0;
+    qint64 maxNs   = 0;
+    qint64 rows    = -1;
+    QVector<qint64> samples;
+    int nextSample = 0;
+};
+
+// __FILE__ и Q_FUNC_INFO - литералы, поэтому ключ - указатель и номер строки
+using SiteKey = QPair<const char *, int>;
+
+QMutex &statsMutex() {
+    static QMutex m;
+    return m;
+}
+
+QHash<SiteKey, SiteStats> &statsTable() {
+    static QHash<SiteKey, SiteStats> t;
+    return t;
+}
+
+double percentileMs(QVector<qint64> v, double p) {
+    if (v.isEmpty())
+        return 0;
+    const qsizetype k = qMin(v.size() - 1, qsizetype(p * v.size()));
+    std::nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k] / 1e6;
+}
+
+} // namespace
+
+bool QueryStats::timedExec(QSqlQuery &q, const QString *sql,
+                           const char *file, int line, const char *function) {
+    QElapsedTimer t;
+    t.start();
+    const bool ok = sql ? q.exec(*sql) : q.exec();
+    const qint64 ns = t.nsecsElapsed();
+
+    StallWatchdog::noteQuery(ns);
+    if (!isEnabled())
+        return ok;
+
+    // Для SELECT размер известен только драйверам с QuerySize (PostgreSQL),
+    // у SQLite - лишь число изменённых строк
+    qint64 rows = -1;
+    if (ok)
+        rows = q.isSelect() ? q.size() : q.numRowsAffected();
+
+    QMutexLocker lock(&statsMutex());
+    SiteStats &s = statsTable()[SiteKey(file, line)];
+    if (!s.file) {
+        s.file = file;
+        s.line = line;
+        s.function = function;
+        s.samples.reserve(64);
+    }
+    ++s.count;
+    s.totalNs += ns;
+    s.maxNs = qMax(s.maxNs, ns);
+    if (rows >= 0)
+        s.rows = qMax<qint64>(s.rows, 0) + rows;
+    if (s.samples.size() < MaxSamples) {
+        s.samples.append(ns);
+    } else {
+        s.samples[s.nextSample] = ns;
+        s.nextSample = (s.nextSample + 1) % MaxSamples;
+    }
+    return ok;
+}
+
+QVector<QueryStats::Summary> QueryStats::snapshot() {
+    QVector<Summary> out;
+    {
+        QMutexLocker lock(&statsMutex());
+        out.reserve(statsTable().size());
+        for (const SiteStats &s : std::as_const(statsTable())) {
+            Summary sum;
+            sum.site     = QString("%1:%2").arg(QFileInfo(QString::fromUtf8(s.file)).fileName())
+                                            .arg(s.line);
+            sum.function = QString::fromUtf8(s.function);
+            sum.count    = s.count;
+            sum.totalMs  = s.totalNs / 1e6;
+            sum.maxMs    = s.maxNs / 1e6;
+            sum.p50Ms    = percentileMs(s.samples, 0.50);
+            sum.p95Ms    = percentileMs(s.samples, 0.95);
+            sum.p99Ms    = percentileMs(s.samples, 0.99);
+            sum.rows     = s.rows;
+            out.append(sum);
+        }
+    }
+    std::sort(out.begin(), out.end(), [](const Summary &a, const Summary &b) {
+        return a.totalMs > b.totalMs;
+    });
+    return out;
+}
+
+void QueryStats::reset() {
+    QMutexLocker lock(&statsMutex());
+    statsTable().clear();
+}
+
+QJsonDocument QueryStats::toJson() {
+    QJsonArray sites;
+    for (const Summary &s : snapshot()) {
+        QJsonObject o;
+        o["site"]     = s.site;
+        o["function"] = s.function;
+        o["count"]    = s.count;
+        o["total_ms"] = s.totalMs;
+        o["p50_ms"]   = s.p50Ms;
+        o["p95_ms"]   = s.p95Ms;
+        o["p99_ms"]   = s.p99Ms;
+        o["max_ms"]   = s.maxMs;
+        if (s.rows >= 0)
+            o["rows"] = s.rows;
+        sites.append(o);
+    }
+    QJsonObject root;
+    root["captured_at"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+    root["sites"] = sites;
+    return QJsonDocument(root);
+}
+
+bool QueryStats::dumpToFile(const QString &path) {
+    QFile f(path);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qDebug() << "QueryStats::dumpToFile():" << path << f.errorString();
+        return false;
+    }
+    return f.write(toJson().toJson(QJsonDocument::Indented)) >= 0;
+}
@@ -0,0 +1,61 @@
+#ifndef QUERYSTATS_H
+#define QUERYSTATS_H
+
+#include <QSqlQuery>
+#include <QString>
+#include <QVector>
+#include <QJsonDocument>
+#include <atomic>
+#include "stallwatchdog.h"
+
+// Статистика выполнения SQL-запросов по местам вызова (файл:строка).
+//
+// Менеджеры выполняют запросы через QUERY_EXEC(q) вместо q.exec(). Пока сбор
+// выключен, это обычный q.exec() плюс проверка двух флагов. Включается из
+// окна Debug > Query statistics или переменной окружения AUTOTLG_QUERY_STATS.
+// Время запросов в GUI-потоке также передаётся StallWatchdog.
+class QueryStats {
+public:
+    struct Summary {
+        QString site;               // file.cpp:123
+        QString function;
+        qint64  count   = 0;
+        double  totalMs = 0;
+        double  p50Ms   = 0;
+        double  p95Ms   = 0;
+        double  p99Ms   = 0;
+        double  maxMs   = 0;
+        qint64  rows    = -1;       // -1: драйвер не сообщает число строк
+    };
+
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+    static void setEnabled(bool on) { enabled.store(on, std::memory_order_relaxed); }
+
+    static bool exec(QSqlQuery &q, const char *file, int line, const char *function) {
+        if (!isEnabled() && !StallWatchdog::isActive())
+            return q.exec();
+        return timedExec(q, nullptr, file, line, function);
+    }
+    static bool exec(QSqlQuery &q, const QString &sql,
+                     const char *file, int line, const char *function) {
+        if (!isEnabled() && !StallWatchdog::isActive())
+            return q.exec(sql);
+        return timedExec(q, &sql, file, line, function);
+    }
+
+    static QVector<Summary> snapshot();     // по убыванию суммарного времени
+    static void reset();
+    static QJsonDocument toJson();
+    static bool dumpToFile(const QString &path);
+
+private:
+    static bool timedExec(QSqlQuery &q, const QString *sql,
+                          const char *file, int line, const char *function);
+
+    static std::atomic_bool enabled;
+};
+
+#define QUERY_EXEC(q)          QueryStats::exec((q), __FILE__, __LINE__, Q_FUNC_INFO)
+#define QUERY_EXEC_SQL(q, sql) QueryStats::exec((q), (sql), __FILE__, __LINE__, Q_FUNC_INFO)
+
+#endif // QUERYSTATS_H
@@ -0,0 +1,96 @@
+#include "querystatsdialog.h"
+#include "querystats.h"
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QPushButton>
+#include <QHeaderView>
+#include <QFileDialog>
+#include <QMessageBox>
+
+QueryStatsDialog::QueryStatsDialog(QWidget *parent)
+    : QDialog(parent) {
+    setWindowTitle(tr("Query statistics"));
+    resize(900, 500);
+
+    enabledCheck = new QCheckBox(tr("Collect statistics"), this);
+    enabledCheck->setChecked(QueryStats::isEnabled());
+
+    table = new QTableWidget(0, 9, this);
+    table->setHorizontalHeaderLabels({tr("Site"), tr("Function"), tr("Count"), tr("Total, ms"),
+                                      tr("p50, ms"), tr("p95, ms"), tr("p99, ms"), tr("Max, ms"),
+                                      tr("Rows")});
+    table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    table->setSelectionBehavior(QAbstractItemView::SelectRows);
+    table->horizontalHeader()->setSectionResizeMode(1, QHeaderView::Stretch);
+    table->verticalHeader()->hide();
+
+    QPushButton *refreshButton = new QPushButton(tr("Refresh"), this);
+    QPushButton *resetButton   = new QPushButton(tr("Reset"), this);
+    QPushButton *saveButton    = new QPushButton(tr("Save as JSON..."), this);
+    QPushButton *closeButton   = new QPushButton(tr("Close"), this);
+
+    QHBoxLayout *buttons = new QHBoxLayout;
+    buttons->addWidget(enabledCheck);
+    buttons->addStretch();
+    buttons->addWidget(refreshButton);
+    buttons->addWidget(resetButton);
+    buttons->addWidget(saveButton);
+    buttons->addWidget(closeButton);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addWidget(table);
+    layout->addLayout(buttons);
+
+    // Пока окно открыто, таблица обновляется сама
+    refreshTimer = new QTimer(this);
+    refreshTimer->setInterval(2000);
+
+    connect(enabledCheck, &QCheckBox::toggled, this, [](bool on){ QueryStats::setEnabled(on); });
+    connect(refreshButton, &QPushButton::clicked, this, &QueryStatsDialog::refresh);
+    connect(resetButton, &QPushButton::clicked, this, [this](){
+        QueryStats::reset();
+        refresh();
+    });
+    connect(saveButton, &QPushButton::clicked, this, &QueryStatsDialog::saveJson);
+    connect(closeButton, &QPushButton::clicked, this, &QDialog::close);
+    connect(refreshTimer, &QTimer::timeout, this, &QueryStatsDialog::refresh);
+    refreshTimer->start();
+
+    refresh();
+}
+
+void QueryStatsDialog::refresh() {
+    const QVector<QueryStats::Summary> stats = QueryStats::snapshot();
+
+    table->setSortingEnabled(false);
+    table->setRowCount(stats.size());
+    auto number = [](double v) {
+        QTableWidgetItem *item = new QTableWidgetItem;
+        item->setData(Qt::DisplayRole, v);
+        item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+        return item;
+    };
+    for (int i = 0; i < stats.size(); ++i) {
+        const QueryStats::Summary &s = stats[i];
+        table->setItem(i, 0, new QTableWidgetItem(s.site));
+        table->setItem(i, 1, new QTableWidgetItem(s.function));
+        table->setItem(i, 2, number(double(s.count)));
+        table->setItem(i, 3, number(qRound(s.totalMs * 100) / 100.0));
+        table->setItem(i, 4, number(qRound(s.p50Ms * 100) / 100.0));
+        table->setItem(i, 5, number(qRound(s.p95Ms * 100) / 100.0));
+        table->setItem(i, 6, number(qRound(s.p99Ms * 100) / 100.0));
+        table->setItem(i, 7, number(qRound(s.maxMs * 100) / 100.0));
+        table->setItem(i, 8, s.rows >= 0 ? number(double(s.rows)) : new QTableWidgetItem);
+    }
+    table->setSortingEnabled(true);
+}
+
+void QueryStatsDialog::saveJson() {
+    const QString path = QFileDialog::getSaveFileName(this, tr("Save query statistics"),
+                                                      "query_stats.json",
+                                                      tr("JSON files (*.json)"));
+    if (path.isEmpty())
+        return;
+    if (!QueryStats::dumpToFile(path))
+        QMessageBox::warning(this, tr("Error"), tr("Could not write file %1").arg(path));
+}
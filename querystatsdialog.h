@@ -0,0 +1,25 @@
+#ifndef QUERYSTATSDIALOG_H
+#define QUERYSTATSDIALOG_H
+
+#include <QDialog>
+#include <QCheckBox>
+#include <QTableWidget>
+#include <QTimer>
+
+// Отладочное окно со статистикой запросов (см. QueryStats)
+class QueryStatsDialog : public QDialog {
+    Q_OBJECT
+public:
+    explicit QueryStatsDialog(QWidget *parent = nullptr);
+
+private slots:
+    void refresh();
+    void saveJson();
+
+private:
+    QCheckBox    *enabledCheck;
+    QTableWidget *table;
+    QTimer       *refreshTimer;
+};
+
+#endif // QUERYSTATSDIALOG_H
@@ -0,0 +1,402 @@
+#include "replacemanager.h"
+#include "querystats.h"
+#include "sqldialect.h"
+#include "templatemanager.h"
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QRegularExpression>
+#include <QHash>
+#include <QDebug>
+#include <algorithm>
+
+namespace {
+
+struct FieldColumn {
+    ReplaceField field;
+    const char  *column;
+};
+
+// Поля шаблона, в которых идёт замена (кроме ячеек)
+const FieldColumn kTemplateFields[] = {
+    {ReplaceField::Subtitle,         "subtitle"},
+    {ReplaceField::Notes,            "notes"},
+    {ReplaceField::ProgrammingNotes, "programming_notes"},
+};
+
+const char *columnOf(ReplaceField field) {
+    for (const FieldColumn &f : kTemplateFields)
+        if (f.field == field)
+            return f.column;
+    return nullptr;
+}
+
+QString idList(const QSet<int> &ids) {
+    QStringList parts;
+    parts.reserve(ids.size());
+    for (int id : ids)
+        parts << QString::number(id);
+    return parts.join(',');
+}
+
+bool isAscii(const QString &s) {
+    for (QChar ch : s)
+        if (ch.unicode() > 0x7F)
+            return false;
+    return true;
+}
+
+} // namespace
+
+ReplaceManager::ReplaceManager(QSqlDatabase &db) : db(db) {}
+ReplaceManager::~ReplaceManager() {}
+
+QString ReplaceManager::textPattern(const QString &find) {
+    // Ищем в HTML, поэтому сам текст экранируется как в toHtml(). Обратная
+    // косая перед не буквой означает литерал и в PCRE, и в ARE PostgreSQL.
+    // Заглядывание вперёд отсекает совпадения внутри тегов и атрибутов.
+    QString pattern;
+    for (QChar ch : find.toHtmlEscaped()) {
+        if (!ch.isLetterOrNumber() && ch != '_')
+            pattern += '\\';
+        pattern += ch;
+    }
+    return pattern + "(?![^<]*>)";
+}
+
+QString ReplaceManager::replacementText(const QString &replacement) {
+    // В regexp_replace() '\' в замене - начало ссылки на группу
+    return replacement.toHtmlEscaped().replace("\\", "\\\\");
+}
+
+QSet<int> ReplaceManager::templatesOf(const QVector<ReplaceChange> &changes) {
+    QSet<int> ids;
+    for (const ReplaceChange &c : changes)
+        ids.insert(c.templateId);
+    return ids;
+}
+
+QVector<ReplacePreview> ReplaceManager::preview(int projectId, const QString &find,
+                                                bool caseSensitive) {
+    QVector<ReplacePreview> out;
+    if (find.isEmpty())
+        return out;
+
+    if (SqlDialect::isSqlite(db)) {
+        // Без regexp в SQLite: те же вычисления, что и при замене, без записи
+        QHash<int, ReplacePreview> byTemplate;
+        QHash<int, QString> names;
+        const auto changes = collectLocal(projectId, find, find, caseSensitive, &names);
+        if (!changes)
+            return out;
+        for (const ReplaceChange &c : *changes) {
+            ReplacePreview &p = byTemplate[c.templateId];
+            p.templateId = c.templateId;
+            p.templateName = names.value(c.templateId);
+            switch (c.field) {
+            case ReplaceField::Cell:             ++p.cells; break;
+            case ReplaceField::Subtitle:         p.subtitle = true; break;
+            case ReplaceField::Notes:            p.notes = true; break;
+            case ReplaceField::ProgrammingNotes: p.programmingNotes = true; break;
+            }
+        }
+        out = byTemplate.values();
+        std::sort(out.begin(), out.end(), [](const ReplacePreview &a, const ReplacePreview &b) {
+            return a.templateName < b.templateName;
+        });
+        return out;
+    }
+
+    const QString op = caseSensitive ? "~" : "~*";
+    const QString pattern = textPattern(find);
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    query.prepare(QString(R"(
+        SELECT t.template_id, t.name,
+               (SELECT COUNT(*) FROM grid_cells g
+                 WHERE g.template_id = COALESCE(t.content_source_id, t.template_id)
+                   AND g.content %1 ?),
+               COALESCE(t.subtitle %1 ?, FALSE),
+               COALESCE(t.notes %1 ?, FALSE),
+               COALESCE(t.programming_notes %1 ?, FALSE)
+        FROM   template t
+        JOIN   category c ON c.category_id = t.category_id
+        WHERE  c.project_id = ?
+        ORDER  BY t.name)").arg(op));
+    for (int i = 0; i < 4; ++i)
+        query.addBindValue(pattern);
+    query.addBindValue(projectId);
+    if (!QUERY_EXEC(query)) {
+        qDebug() << "Ошибка предпросмотра замены:" << query.lastError();
+        return out;
+    }
+    while (query.next()) {
+        ReplacePreview p;
+        p.templateId       = query.value(0).toInt();
+        p.templateName     = query.value(1).toString();
+        p.cells            = query.value(2).toInt();
+        p.subtitle         = query.value(3).toBool();
+        p.notes            = query.value(4).toBool();
+        p.programmingNotes = query.value(5).toBool();
+        if (p.cells > 0 || p.subtitle || p.notes || p.programmingNotes)
+            out.append(p);
+    }
+    return out;
+}
+
+std::optional<QVector<ReplaceChange>> ReplaceManager::replaceAll(int projectId, const QString &find,
+                                                                 const QString &replacement,
+                                                                 bool caseSensitive) {
+    if (find.isEmpty())
+        return QVector<ReplaceChange>{};
+
+    if (!db.transaction()) {
+        qDebug() << "Не удалось начать транзакцию:" << db.lastError();
+        return std::nullopt;
+    }
+    // Копии с общими ячейками (duplicateTemplate) сначала получают свои:
+    // замена идёт по ячейкам каждого шаблона, и у каждого - своя отмена
+    bool ok = TemplateManager::materializeProjectContent(db, projectId);
+
+    QVector<ReplaceChange> changes;
+    if (ok && SqlDialect::isSqlite(db)) {
+        const auto local = collectLocal(projectId, find, replacement, caseSensitive);
+        ok = local.has_value();
+        if (ok)
+            changes = *local;
+    }
+    ok = ok && (SqlDialect::isSqlite(db)
+                    ? writeValues(changes, false)
+                    : replaceOnServer(projectId, find, replacement, caseSensitive, changes));
+    if (!ok || !bumpVersions(templatesOf(changes)) || !db.commit()) {
+        db.rollback();
+        return std::nullopt;
+    }
+    return changes;
+}
+
+bool ReplaceManager::apply(const QVector<ReplaceChange> &changes, bool undo) {
+    if (changes.isEmpty())
+        return true;
+    if (!db.transaction()) {
+        qDebug() << "Не удалось начать транзакцию:" << db.lastError();
+        return false;
+    }
+    // С момента замены шаблон мог стать источником новой копии - она сохраняет свои ячейки
+    const QSet<int> touched = templatesOf(changes);
+    bool ok = true;
+    for (int tid : touched)
+        ok = ok && TemplateManager::materializeContent(db, tid);
+    if (!ok || !writeValues(changes, undo) || !bumpVersions(touched) || !db.commit()) {
+        db.rollback();
+        return false;
+    }
+    return true;
+}
+
+std::optional<QVector<ReplaceChange>> ReplaceManager::collectLocal(int projectId,
+                                                                   const QString &find,
+                                                                   const QString &replacement,
+                                                                   bool caseSensitive,
+                                                                   QHash<int, QString> *names) {
+    const QRegularExpression re(textPattern(find),
+                                caseSensitive ? QRegularExpression::NoPatternOption
+                                              : QRegularExpression::CaseInsensitiveOption);
+    const QString after = replacement.toHtmlEscaped();
+
+    // Замена буквальная: в QString::replace() '\1' в замене - ссылка на группу
+    auto replaceIn = [&](const QString &text, QString &out) {
+        qsizetype last = 0;
+        bool found = false;
+        out.clear();
+        for (auto it = re.globalMatch(text); it.hasNext();) {
+            const QRegularExpressionMatch m = it.next();
+            out += QStringView(text).mid(last, m.capturedStart() - last);
+            out += after;
+            last = m.capturedEnd();
+            found = true;
+        }
+        if (found)
+            out += QStringView(text).mid(last);
+        return found;
+    };
+
+    QVector<ReplaceChange> changes;
+    QString replaced;
+
+    // Грубый отбор на стороне SQLite; LIKE без учёта регистра только для ASCII
+    const QString needle = find.toHtmlEscaped();
+    QString filter;
+    if (caseSensitive)
+        filter = "AND instr(g.content, :needle) > 0";
+    else if (isAscii(needle))
+        filter = "AND g.content LIKE :needle ESCAPE '\\'";
+
+    // Копия шаблона читает ячейки владельца - как и в ветке PostgreSQL; перед
+    // заменой replace() уже отдал каждому шаблону собственные
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    query.prepare(QString(R"(
+        SELECT t.template_id, g.cell_type, g.row_index, g.col_index, g.content
+        FROM   grid_cells g
+        JOIN   template t ON g.template_id = COALESCE(t.content_source_id, t.template_id)
+        JOIN   category c ON c.category_id = t.category_id
+        WHERE  c.project_id = :pid
+          %1)").arg(filter));
+    query.bindValue(":pid", projectId);
+    if (caseSensitive) {
+        query.bindValue(":needle", needle);
+    } else if (!filter.isEmpty()) {
+        QString like = needle;
+        like.replace("\\", "\\\\").replace("%", "\\%").replace("_", "\\_");
+        query.bindValue(":needle", "%" + like + "%");
+    }
+    if (!QUERY_EXEC(query)) {
+        qDebug() << "Ошибка чтения ячеек для замены:" << query.lastError();
+        return std::nullopt;
+    }
+    while (query.next()) {
+        const QString before = query.value(4).toString();
+        if (!replaceIn(before, replaced))
+            continue;
+        changes.append({ReplaceField::Cell, query.value(0).toInt(), query.value(1).toString(),
+                        query.value(2).toInt(), query.value(3).toInt(), before, replaced});
+    }
+
+    query.prepare(R"(
+        SELECT t.template_id, t.name, t.subtitle, t.notes, t.programming_notes
+        FROM   template t
+        JOIN   category c ON c.category_id = t.category_id
+        WHERE  c.project_id = :pid)");
+    query.bindValue(":pid", projectId);
+    if (!QUERY_EXEC(query)) {
+        qDebug() << "Ошибка чтения шаблонов для замены:" << query.lastError();
+        return std::nullopt;
+    }
+    while (query.next()) {
+        const int tid = query.value(0).toInt();
+        if (names)
+            names->insert(tid, query.value(1).toString());
+        for (int i = 0; i < 3; ++i) {
+            const QString before = query.value(2 + i).toString();
+            if (replaceIn(before, replaced))
+                changes.append({kTemplateFields[i].field, tid, QString(), 0, 0, before, replaced});
+        }
+    }
+    return changes;
+}
+
+bool ReplaceManager::replaceOnServer(int projectId, const QString &find,
+                                     const QString &replacement, bool caseSensitive,
+                                     QVector<ReplaceChange> &out) {
+    const QString op      = caseSensitive ? "~" : "~*";
+    const QString flags   = caseSensitive ? "g" : "gi";
+    const QString pattern = textPattern(find);
+    const QString after   = replacementText(replacement);
+
+    // Соединение таблицы с самой собой: o - строка до UPDATE, так RETURNING
+    // отдаёт и старое значение для отмены
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    query.prepare(QString(R"(
+        UPDATE grid_cells g
+           SET content = regexp_replace(g.content, ?, ?, ?)
+          FROM grid_cells o, template t, category c
+         WHERE o.template_id = g.template_id AND o.cell_type = g.cell_type
+           AND o.row_index = g.row_index AND o.col_index = g.col_index
+           AND t.template_id = g.template_id
+           AND c.category_id = t.category_id
+           AND c.project_id = ?
+           AND g.content %1 ?
+        RETURNING g.template_id, g.cell_type, g.row_index, g.col_index, o.content, g.content)")
+                      .arg(op));
+    query.addBindValue(pattern);
+    query.addBindValue(after);
+    query.addBindValue(flags);
+    query.addBindValue(projectId);
+    query.addBindValue(pattern);
+    if (!QUERY_EXEC(query)) {
+        qDebug() << "Ошибка замены в ячейках:" << query.lastError();
+        return false;
+    }
+    while (query.next())
+        out.append({ReplaceField::Cell, query.value(0).toInt(), query.value(1).toString(),
+                    query.value(2).toInt(), query.value(3).toInt(),
+                    query.value(4).toString(), query.value(5).toString()});
+
+    for (const FieldColumn &f : kTemplateFields) {
+        query.prepare(QString(R"(
+            UPDATE template t
+               SET %1 = regexp_replace(t.%1, ?, ?, ?)
+              FROM template o, category c
+             WHERE o.template_id = t.template_id
+               AND c.category_id = t.category_id
+               AND c.project_id = ?
+               AND t.%1 %2 ?
+            RETURNING t.template_id, o.%1, t.%1)").arg(f.column, op));
+        query.addBindValue(pattern);
+        query.addBindValue(after);
+        query.addBindValue(flags);
+        query.addBindValue(projectId);
+        query.addBindValue(pattern);
+        if (!QUERY_EXEC(query)) {
+            qDebug() << "Ошибка замены в поле" << f.column << ":" << query.lastError();
+            return false;
+        }
+        while (query.next())
+            out.append({f.field, query.value(0).toInt(), QString(), 0, 0,
+                        query.value(1).toString(), query.value(2).toString()});
+    }
+    return true;
+}
+
+bool ReplaceManager::writeValues(const QVector<ReplaceChange> &changes, bool undo) {
+    QSqlQuery cell(db);
+    cell.prepare(R"(
+        UPDATE grid_cells SET content = ?
+         WHERE template_id = ? AND cell_type = ? AND row_index = ? AND col_index = ?
+           AND content = ?)");
+
+    int skipped = 0;
+    for (const ReplaceChange &c : changes) {
+        const QString &value    = undo ? c.before : c.after;
+        const QString &expected = undo ? c.after : c.before;
+        QSqlQuery field(db);
+        QSqlQuery &q = c.field == ReplaceField::Cell ? cell : field;
+        if (c.field == ReplaceField::Cell) {
+            q.addBindValue(value);
+            q.addBindValue(c.templateId);
+            q.addBindValue(c.cellType);
+            q.addBindValue(c.row);
+            q.addBindValue(c.col);
+            q.addBindValue(expected);
+        } else {
+            q.prepare(QString("UPDATE template SET %1 = ? WHERE template_id = ? AND %1 = ?")
+                          .arg(columnOf(c.field)));
+            q.addBindValue(value);
+            q.addBindValue(c.templateId);
+            q.addBindValue(expected);
+        }
+        if (!QUERY_EXEC(q)) {
+            qDebug() << "Ошибка записи замены:" << q.lastError();
+            return false;
+        }
+        // Значение уже изменил кто-то другой - его правку не затираем
+        if (q.numRowsAffected() == 0)
+            ++skipped;
+    }
+    if (skipped > 0)
+        qDebug() << "Замена: пропущено значений, изменённых с тех пор:" << skipped;
+    return true;
+}
+
+bool ReplaceManager::bumpVersions(const QSet<int> &templateIds) {
+    if (templateIds.isEmpty())
+        return true;
+    QSqlQuery query(db);
+    if (!QUERY_EXEC_SQL(query, QString("UPDATE template SET version = version + 1 "
+                                       "WHERE template_id IN (%1)").arg(idList(templateIds)))) {
+        qDebug() << "Ошибка обновления версий шаблонов:" << query.lastError();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,77 @@
+#ifndef REPLACEMANAGER_H
+#define REPLACEMANAGER_H
+
+#include <QVector>
+#include <QString>
+#include <QSet>
+#include <QHash>
+#include <QSqlDatabase>
+#include <optional>
+
+enum class ReplaceField { Cell, Subtitle, Notes, ProgrammingNotes };
+
+// Одно изменённое значение: ячейка (cellType/row/col) или поле шаблона
+struct ReplaceChange {
+    ReplaceField field;
+    int     templateId;
+    QString cellType;
+    int     row = 0;
+    int     col = 0;
+    QString before;
+    QString after;
+};
+
+// Совпадения в одном шаблоне (предпросмотр)
+struct ReplacePreview {
+    int     templateId;
+    QString templateName;
+    int     cells = 0;
+    bool    subtitle = false;
+    bool    notes = false;
+    bool    programmingNotes = false;
+};
+
+// Поиск и замена текста во всех шаблонах проекта: ячейки, подзаголовки
+// и примечания.
+//
+// Содержимое хранится как HTML QTextEdit; заменяется только текст между
+// тегами, разметка не трогается. Текст, разбитый форматированием
+// ("Pla<b>cebo</b>"), не находится. На PostgreSQL замена - несколько
+// UPDATE ... regexp_replace() на весь проект, на SQLite - проход в C++
+// с пакетной записью. Возвращаемые изменения позволяют отменить операцию.
+class ReplaceManager {
+public:
+    ReplaceManager(QSqlDatabase &db);
+    ~ReplaceManager();
+
+    QVector<ReplacePreview> preview(int projectId, const QString &find, bool caseSensitive);
+
+    // nullopt - ошибка (ничего не изменено)
+    std::optional<QVector<ReplaceChange>> replaceAll(int projectId, const QString &find,
+                                                     const QString &replacement,
+                                                     bool caseSensitive);
+
+    // Повтор (after) или отмена (before) записанных изменений. Значение,
+    // которое с тех пор изменил кто-то другой, не перезаписывается
+    bool apply(const QVector<ReplaceChange> &changes, bool undo);
+
+    static QSet<int> templatesOf(const QVector<ReplaceChange> &changes);
+
+private:
+    static QString textPattern(const QString &find);
+    static QString replacementText(const QString &replacement);
+
+    // names - имена шаблонов проекта (для предпросмотра)
+    std::optional<QVector<ReplaceChange>> collectLocal(int projectId, const QString &find,
+                                                       const QString &replacement,
+                                                       bool caseSensitive,
+                                                       QHash<int, QString> *names = nullptr);
+    bool replaceOnServer(int projectId, const QString &find, const QString &replacement,
+                         bool caseSensitive, QVector<ReplaceChange> &out);
+    bool writeValues(const QVector<ReplaceChange> &changes, bool undo);
+    bool bumpVersions(const QSet<int> &templateIds);
+
+    QSqlDatabase &db;
+};
+
+#endif // REPLACEMANAGER_H
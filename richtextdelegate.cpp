@@ -109,11 +109,14 @@ void RichTextDelegate::paint(QPainter *painter,
 
 QSize RichTextDelegate::sizeHint(const QStyleOptionViewItem &option,
                                  const QModelIndex &index) const {
-    QString html = index.data(Qt::DisplayRole).toString();
+    return documentSize(index.data(Qt::DisplayRole).toString(), option.rect.width());
+}
+
+QSize RichTextDelegate::documentSize(const QString &html, int width) {
     QTextDocument doc;
     doc.setHtml(html);
     // Задаём ширину для правильного вычисления высоты
-    doc.setTextWidth(option.rect.width());
+    doc.setTextWidth(width);
 
     return QSize(doc.idealWidth(), int(doc.size().height()));
 }
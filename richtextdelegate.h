@@ -27,6 +27,10 @@ public:
                                      const QModelIndex &index) const override;
 
     bool eventFilter(QObject *obj, QEvent *event) override;
+
+    // Размер HTML ячейки при ширине width - тот же расчёт, что в sizeHint,
+    // но без индекса модели (оценки размеров до создания строк, TableSizer)
+    static QSize documentSize(const QString &html, int width);
 };
 
 #endif // RICHTEXTDELEGATE_H
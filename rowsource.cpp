@@ -0,0 +1,305 @@
+#include "rowsource.h"
+#include "ziparchive.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QXmlStreamReader>
+#include <QVector>
+
+namespace {
+
+// CSV в духе RFC 4180: поля в кавычках могут содержать разделитель и
+// переводы строк, "" внутри кавычек - одна кавычка. Разделитель (',', ';'
+// или табуляция) определяется по первой строке: Excel в русской локали
+// сохраняет через ';'
+class CsvRowSource : public RowSource {
+public:
+    explicit CsvRowSource(const QString &filename) : file(filename) {}
+
+    bool open() {
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            error = file.errorString();
+            return false;
+        }
+        stream.setDevice(&file);
+        stream.setEncoding(QStringConverter::Utf8);     // BOM распознаётся сам
+        havePending = stream.readLineInto(&pending);
+        delimiter = detectDelimiter(pending);
+        return true;
+    }
+
+    bool next(QStringList &row) override {
+        row.clear();
+        QString line;
+        if (havePending) {
+            line = std::move(pending);
+            havePending = false;
+        } else if (!stream.readLineInto(&line)) {
+            return false;
+        }
+
+        QString field;
+        bool quoted = false;
+        for (;;) {
+            for (int i = 0; i < line.size(); ++i) {
+                const QChar ch = line.at(i);
+                if (quoted) {
+                    if (ch != '"') {
+                        field += ch;
+                    } else if (i + 1 < line.size() && line.at(i + 1) == '"') {
+                        field += '"';
+                        ++i;
+                    } else {
+                        quoted = false;
+                    }
+                } else if (ch == '"') {
+                    quoted = true;
+                } else if (ch == delimiter) {
+                    row << field;
+                    field.clear();
+                } else {
+                    field += ch;
+                }
+            }
+            if (!quoted)
+                break;
+            // Перевод строки внутри кавычек - часть значения
+            if (!stream.readLineInto(&line)) {
+                error = QStringLiteral("unterminated quoted field");
+                return false;
+            }
+            field += '\n';
+        }
+        row << field;
+        return true;
+    }
+
+private:
+    static QChar detectDelimiter(const QString &line) {
+        int counts[3] = {0, 0, 0};
+        const QChar candidates[3] = {',', ';', '\t'};
+        bool quoted = false;
+        for (const QChar ch : line) {
+            if (ch == '"')
+                quoted = !quoted;
+            for (int k = 0; !quoted && k < 3; ++k)
+                counts[k] += (ch == candidates[k]);
+        }
+        int best = 0;
+        for (int k = 1; k < 3; ++k)
+            if (counts[k] > counts[best])
+                best = k;
+        return candidates[best];
+    }
+
+    QFile       file;
+    QTextStream stream;
+    QString     pending;            // первая строка, прочитанная ради разделителя
+    bool        havePending = false;
+    QChar       delimiter = ',';
+};
+
+// Первый лист книги: workbook.xml -> r:id листа -> workbook.xml.rels -> путь.
+// Лист читается потоком из архива, общие строки загружаются заранее
+class XlsxRowSource : public RowSource {
+public:
+    explicit XlsxRowSource(const QString &filename) : archive(filename) {}
+
+    bool open() {
+        if (!archive.open())
+            return fail(archive.errorString());
+
+        const QString sheet = firstSheetPath();
+        if (sheet.isEmpty())
+            return false;
+        if (archive.contains("xl/sharedStrings.xml") && !loadSharedStrings())
+            return false;
+
+        sheetDevice = archive.openEntry(sheet);
+        if (!sheetDevice)
+            return fail(archive.errorString());
+        xml.setDevice(sheetDevice.get());
+        return true;
+    }
+
+    bool next(QStringList &row) override {
+        row.clear();
+        // Пропущенные в файле строки (у пустых строк нет <row>) отдаём пустыми
+        if (emptyRowsPending > 0) {
+            --emptyRowsPending;
+            return true;
+        }
+        if (haveBuffered) {
+            row = std::move(buffered);
+            haveBuffered = false;
+            return true;
+        }
+
+        while (!xml.atEnd()) {
+            xml.readNext();
+            if (!xml.isStartElement() || xml.name() != QLatin1String("row"))
+                continue;
+            const int r = xml.attributes().value("r").toInt();
+            if (!readRow(row))
+                break;
+            if (r > lastRow + 1) {
+                emptyRowsPending = r - lastRow - 2;
+                buffered = std::move(row);
+                haveBuffered = true;
+                row.clear();
+            }
+            lastRow = r > 0 ? r : lastRow + 1;
+            return true;
+        }
+        if (xml.hasError())
+            error = QStringLiteral("sheet XML line %1: %2").arg(xml.lineNumber()).arg(xml.errorString());
+        return false;
+    }
+
+private:
+    bool fail(const QString &message) {
+        error = message;
+        return false;
+    }
+
+    QString firstSheetPath() {
+        QString relId;
+        QXmlStreamReader wb(archive.readEntry("xl/workbook.xml"));
+        while (!wb.atEnd()) {
+            wb.readNext();
+            if (wb.isStartElement() && wb.name() == QLatin1String("sheet")) {
+                // r:id - атрибут в пространстве имён relationships
+                for (const QXmlStreamAttribute &a : wb.attributes())
+                    if (a.name() == QLatin1String("id"))
+                        relId = a.value().toString();
+                break;
+            }
+        }
+        if (relId.isEmpty()) {
+            fail(QStringLiteral("workbook has no sheets"));
+            return QString();
+        }
+
+        QXmlStreamReader rels(archive.readEntry("xl/_rels/workbook.xml.rels"));
+        while (!rels.atEnd()) {
+            rels.readNext();
+            if (rels.isStartElement() && rels.name() == QLatin1String("Relationship")
+                && rels.attributes().value("Id") == relId) {
+                const QString target = rels.attributes().value("Target").toString();
+                // Путь относительно xl/ или абсолютный от корня архива
+                return target.startsWith('/') ? target.mid(1) : "xl/" + target;
+            }
+        }
+        fail(QStringLiteral("sheet %1 is missing in workbook relationships").arg(relId));
+        return QString();
+    }
+
+    bool loadSharedStrings() {
+        std::unique_ptr<QIODevice> device = archive.openEntry("xl/sharedStrings.xml");
+        if (!device)
+            return fail(archive.errorString());
+        QXmlStreamReader ss(device.get());
+        QString current;
+        bool inPhonetic = false;
+        while (!ss.atEnd()) {
+            ss.readNext();
+            if (ss.isStartElement()) {
+                if (ss.name() == QLatin1String("si"))
+                    current.clear();
+                else if (ss.name() == QLatin1String("rPh"))
+                    inPhonetic = true;          // фонетическая подсказка, не текст ячейки
+                else if (ss.name() == QLatin1String("t") && !inPhonetic)
+                    current += ss.readElementText();
+            } else if (ss.isEndElement()) {
+                if (ss.name() == QLatin1String("si"))
+                    sharedStrings << current;
+                else if (ss.name() == QLatin1String("rPh"))
+                    inPhonetic = false;
+            }
+        }
+        if (ss.hasError())
+            return fail(QStringLiteral("sharedStrings.xml: %1").arg(ss.errorString()));
+        return true;
+    }
+
+    // "AB12" -> 27 (с нуля)
+    static int columnOf(QStringView ref) {
+        int col = 0;
+        for (const QChar ch : ref) {
+            if (!ch.isLetter())
+                break;
+            col = col * 26 + (ch.toUpper().unicode() - 'A' + 1);
+        }
+        return col - 1;
+    }
+
+    // Текст <is> или фрагмента <r>: <t> напрямую или внутри <r><t>..</t></r>
+    void appendInlineText(QString &value) {
+        while (xml.readNextStartElement()) {
+            if (xml.name() == QLatin1String("t"))
+                value += xml.readElementText();
+            else if (xml.name() == QLatin1String("r"))
+                appendInlineText(value);
+            else
+                xml.skipCurrentElement();   // rPr, rPh
+        }
+    }
+
+    bool readRow(QStringList &row) {
+        while (xml.readNextStartElement()) {
+            if (xml.name() != QLatin1String("c")) {
+                xml.skipCurrentElement();
+                continue;
+            }
+            const int col = columnOf(xml.attributes().value("r"));
+            const QString type = xml.attributes().value("t").toString();
+            QString value;
+            while (xml.readNextStartElement()) {
+                if (xml.name() == QLatin1String("v")) {
+                    value = xml.readElementText();
+                } else if (xml.name() == QLatin1String("is")) {
+                    appendInlineText(value);    // строка прямо в ячейке
+                } else {
+                    xml.skipCurrentElement();   // формулы <f> и прочее
+                }
+            }
+            if (type == QLatin1String("s"))
+                value = sharedStrings.value(value.toInt());
+            else if (type == QLatin1String("b"))
+                value = (value == QLatin1String("1")) ? QStringLiteral("TRUE") : QStringLiteral("FALSE");
+
+            while (col > row.size())
+                row << QString();
+            row << value;
+        }
+        return !xml.hasError();
+    }
+
+    ZipArchive archive;
+    std::unique_ptr<QIODevice> sheetDevice;
+    QXmlStreamReader xml;
+    QStringList sharedStrings;
+    int         lastRow = 0;
+    int         emptyRowsPending = 0;
+    QStringList buffered;
+    bool        haveBuffered = false;
+};
+
+} // namespace
+
+std::unique_ptr<RowSource> RowSource::open(const QString &filename, QString *errorOut) {
+    if (QFileInfo(filename).suffix().compare("xlsx", Qt::CaseInsensitive) == 0) {
+        auto source = std::make_unique<XlsxRowSource>(filename);
+        if (source->open())
+            return source;
+        if (errorOut)
+            *errorOut = source->errorString();
+        return nullptr;
+    }
+    auto source = std::make_unique<CsvRowSource>(filename);
+    if (source->open())
+        return source;
+    if (errorOut)
+        *errorOut = source->errorString();
+    return nullptr;
+}
@@ -0,0 +1,25 @@
+#ifndef ROWSOURCE_H
+#define ROWSOURCE_H
+
+#include <QString>
+#include <QStringList>
+#include <memory>
+
+// Построчное чтение табличного файла: CSV или первый лист книги XLSX.
+// В памяти только текущая строка (для XLSX ещё таблица общих строк книги)
+class RowSource {
+public:
+    virtual ~RowSource() = default;
+
+    // false - строки кончились; при ошибке errorString() не пуст
+    virtual bool next(QStringList &row) = 0;
+    QString errorString() const { return error; }
+
+    // Формат по расширению (.xlsx, иначе CSV); nullptr - файл не открыт
+    static std::unique_ptr<RowSource> open(const QString &filename, QString *errorOut);
+
+protected:
+    QString error;
+};
+
+#endif // ROWSOURCE_H
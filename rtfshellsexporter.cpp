@@ -0,0 +1,157 @@
+#include "rtfshellsexporter.h"
+#include "htmlscanner.h"
+
+namespace {
+
+// Альбомный Letter с полями 0.75" (в твипах)
+constexpr int PageWidth  = 15840;
+constexpr int PageHeight = 12240;
+constexpr int Margin     = 1080;
+constexpr int TextWidth  = PageWidth - 2 * Margin;
+
+// Текст в RTF: управляющие символы экранируются, не-ASCII - \uN? (\uc1)
+void appendText(QByteArray &out, QStringView s) {
+    for (const QChar ch : s) {
+        const char16_t u = ch.unicode();
+        if (u == '\\' || u == '{' || u == '}') {
+            out += '\\';
+            out += char(u);
+        } else if (u == '\n') {
+            out += "\\line ";
+        } else if (u == '\t') {
+            out += "\\tab ";
+        } else if (u < 0x80) {
+            out += char(u);
+        } else {
+            out += "\\u";
+            out += QByteArray::number(qint16(u));
+            out += '?';
+        }
+    }
+}
+
+void appendParagraph(QByteArray &out, const char *format, QStringView text) {
+    out += "{\\pard";
+    out += format;
+    out += ' ';
+    appendText(out, text);
+    out += "\\par}\n";
+}
+
+QString headingLabel(const QString &type) {
+    if (type == "listing")
+        return QStringLiteral("Listing");
+    if (type == "table")
+        return QStringLiteral("Table");
+    return QStringLiteral("Figure");
+}
+
+} // namespace
+
+bool RtfShellsExporter::write(const ProjectSnapshot &snapshot, QIODevice &out) {
+    chunk.clear();
+    writeDocumentStart(snapshot);
+    if (out.write(chunk) != chunk.size())
+        return false;
+
+    bool first = true;
+    for (int t : snapshot.templateOrder()) {
+        chunk.clear();
+        if (!first)
+            chunk += "\\pard\\page\n";
+        first = false;
+        writeTemplate(snapshot.templates()[t]);
+        if (out.write(chunk) != chunk.size())
+            return false;
+    }
+    return out.write("}\n") == 2;
+}
+
+void RtfShellsExporter::writeDocumentStart(const ProjectSnapshot &snapshot) {
+    const ProjectDetails &d = snapshot.details();
+    chunk += "{\\rtf1\\ansi\\ansicpg1252\\deff0\\uc1\n"
+             "{\\fonttbl{\\f0\\fmodern\\fcharset0 Courier New;}}\n";
+    chunk += "{\\info{\\title ";
+    appendText(chunk, snapshot.projectName());
+    chunk += "}}\n";
+    chunk += "\\paperw" + QByteArray::number(PageWidth) + "\\paperh" + QByteArray::number(PageHeight)
+             + "\\margl" + QByteArray::number(Margin) + "\\margr" + QByteArray::number(Margin)
+             + "\\margt" + QByteArray::number(Margin) + "\\margb" + QByteArray::number(Margin)
+             + "\\landscape\\f0\\fs16\n";
+
+    // Расположение как у блока PROJECT в XML: спонсор слева, исследование справа
+    chunk += "{\\header\\pard\\tqr\\tx" + QByteArray::number(TextWidth) + ' ';
+    appendText(chunk, d.sponsor);
+    chunk += "\\tab ";
+    appendText(chunk, d.study);
+    chunk += "\\par}\n";
+    chunk += "{\\footer\\pard\\qc ";
+    appendText(chunk, d.version);
+    chunk += "\\par}\n";
+}
+
+void RtfShellsExporter::writeTemplate(const SnapshotTemplate &t) {
+    appendParagraph(chunk, "\\keepn\\sb240\\b",
+                    headingLabel(t.type) + ' ' + t.path + ' ' + HtmlScanner::plainText(t.name));
+    const QString subtitle = HtmlScanner::plainText(t.subtitle);
+    if (!subtitle.isEmpty())
+        appendParagraph(chunk, "\\keepn\\qc", subtitle);
+
+    if (t.type == "graph")
+        appendParagraph(chunk, "\\sb240\\sa240\\qc\\i",
+                        '[' + (t.graphType.isEmpty() ? QStringLiteral("Figure") : t.graphType) + ']');
+    else if (!t.grid.isEmpty())
+        writeGrid(t);
+
+    const QString notes = HtmlScanner::plainText(t.notes);
+    if (!notes.isEmpty())
+        appendParagraph(chunk, "\\sb120\\fs14", notes);
+}
+
+void RtfShellsExporter::writeGrid(const SnapshotTemplate &t) {
+    const GridStore &grid = t.grid;
+    const int cols = grid.columnCount();
+    const int lastRow = grid.rowCount() - 1;
+    const int cellWidth = TextWidth / cols;
+
+    for (int r = 0; r <= lastRow; ++r) {
+        // Определение строки: объединения и рамки по ячейкам
+        chunk += "\\trowd\\trgaph70\\trleft0";
+        if (r < t.headerRows)
+            chunk += "\\trhdr";             // шапка повторяется на каждой странице
+        for (int c = 0; c < cols; ++c) {
+            const QPoint own = grid.owner(r, c);                 // x - столбец, y - строка
+            const int rs = grid.rowSpan(own.y(), own.x());
+            const int cs = grid.colSpan(own.y(), own.x());
+            if (rs > 1)
+                chunk += own.y() == r ? "\\clvmgf" : "\\clvmrg";
+            if (cs > 1)
+                chunk += own.x() == c ? "\\clmgf" : "\\clmrg";
+            if (r == 0)
+                chunk += "\\clbrdrt\\brdrs\\brdrw10";
+            if (r == t.headerRows - 1 || r == lastRow)
+                chunk += "\\clbrdrb\\brdrs\\brdrw10";
+            chunk += "\\cellx" + QByteArray::number(cellWidth * (c + 1));
+        }
+        chunk += '\n';
+
+        for (int c = 0; c < cols; ++c) {
+            if (grid.isCovered(r, c)) {
+                chunk += "\\pard\\intbl\\cell\n";
+                continue;
+            }
+            const HtmlSummary cell = HtmlScanner::scan(grid.textView(r, c));
+            chunk += "\\pard\\intbl\\q";
+            chunk += char(cell.align.unicode());
+            chunk += '{';
+            if (cell.bold)      chunk += "\\b";
+            if (cell.italic)    chunk += "\\i";
+            if (cell.underline) chunk += "\\ul";
+            chunk += ' ';
+            appendText(chunk, cell.text);
+            chunk += "}\\cell\n";
+        }
+        chunk += "\\row\n";
+    }
+    chunk += "\\pard\n";
+}
@@ -0,0 +1,27 @@
+#ifndef RTFSHELLSEXPORTER_H
+#define RTFSHELLSEXPORTER_H
+
+#include "projectexporter.h"
+#include <QByteArray>
+
+// Макеты таблиц (mock shells) в RTF: шаблон на страницу, заголовок с путём
+// и именем, подзаголовок, таблица с повторяемой шапкой и объединениями,
+// примечания мелким шрифтом. В колонтитулах - спонсор, исследование и версия
+// из данных проекта. Графики - только заголовок и заглушка с типом графика
+class RtfShellsExporter : public ProjectExporter {
+public:
+    QString title() const override      { return QStringLiteral("Export RTF shells"); }
+    QString fileFilter() const override { return QStringLiteral("RTF documents (*.rtf)"); }
+    QString fileSuffix() const override { return QStringLiteral("rtf"); }
+
+    bool write(const ProjectSnapshot &snapshot, QIODevice &out) override;
+
+private:
+    void writeDocumentStart(const ProjectSnapshot &snapshot);
+    void writeTemplate(const SnapshotTemplate &t);
+    void writeGrid(const SnapshotTemplate &t);
+
+    QByteArray chunk;          // буфер одного шаблона, переиспользуется
+};
+
+#endif // RTFSHELLSEXPORTER_H
@@ -0,0 +1,215 @@
+#include "schemamigrator.h"
+#include "sqldialect.h"
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QRegularExpression>
+#include <QDir>
+#include <QFile>
+#include <QMap>
+#include <QDebug>
+
+namespace {
+
+// Частые запросы менеджеров с подставленными константами: EXPLAIN не
+// принимает параметры подготовленного запроса
+struct HotQuery {
+    const char *table;
+    const char *sql;
+};
+
+const HotQuery kHotQueries[] = {
+    {"category",   "SELECT category_id, name, parent_id, position, depth, project_id "
+                   "FROM category WHERE project_id = 1 ORDER BY position"},
+    {"category",   "SELECT COALESCE(MAX(position), 0) + 1 FROM category "
+                   "WHERE parent_id IS NULL AND project_id = 1"},
+    {"category",   "SELECT position FROM category WHERE parent_id = 1"},
+    {"template",   "SELECT template_id, name, position FROM template "
+                   "WHERE category_id = 1 ORDER BY position"},
+    {"template",   "SELECT template_id FROM template WHERE related_template_id = 1"},
+    {"grid_cells", "SELECT row_index, col_index, content, colour FROM grid_cells "
+                   "WHERE template_id = 1"},
+    {"grid_cells", "SELECT MAX(row_index) FROM grid_cells "
+                   "WHERE template_id = 1 AND cell_type = 'header'"},
+    {"graph",      "SELECT image FROM graph WHERE template_id = 1"},
+};
+
+} // namespace
+
+SchemaMigrator::SchemaMigrator(QSqlDatabase &db) : db(db) {}
+
+QVector<SchemaMigrator::Migration> SchemaMigrator::availableMigrations() const {
+    static const QRegularExpression nameRx(R"(^(\d+)_(\w+?)(?:\.(pg|sqlite))?\.sql$)");
+    const QString ownSuffix = SqlDialect::isSqlite(db) ? "sqlite" : "pg";
+
+    QMap<int, Migration> byVersion;
+    QMap<int, bool>      specific;      // выбран вариант для своего бэкенда
+
+    const QDir dir(":/db/migrations");
+    for (const QString &file : dir.entryList({"*.sql"}, QDir::Files, QDir::Name)) {
+        const auto m = nameRx.match(file);
+        if (!m.hasMatch()) {
+            qDebug() << "SchemaMigrator: пропущен файл" << file;
+            continue;
+        }
+        const QString suffix = m.captured(3);
+        if (!suffix.isEmpty() && suffix != ownSuffix)
+            continue;                   // скрипт другого бэкенда
+        const int version = m.captured(1).toInt();
+        if (specific.value(version) && suffix.isEmpty())
+            continue;
+        byVersion[version] = {version, m.captured(2), dir.filePath(file)};
+        specific[version]  = !suffix.isEmpty();
+    }
+    return byVersion.values();
+}
+
+int SchemaMigrator::currentVersion() const {
+    if (!SqlDialect::tableExists(db, "schema_version"))
+        return 0;
+    QSqlQuery q(db);
+    if (!q.exec("SELECT COALESCE(MAX(version), 0) FROM schema_version") || !q.next()) {
+        qDebug() << "SchemaMigrator: cannot read schema_version" << q.lastError();
+        return -1;
+    }
+    return q.value(0).toInt();
+}
+
+bool SchemaMigrator::ensureVersionTable() {
+    QSqlQuery q(db);
+    if (!q.exec("CREATE TABLE IF NOT EXISTS schema_version ("
+                "  version INTEGER PRIMARY KEY,"
+                "  name TEXT NOT NULL,"
+                "  applied_at TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP)")) {
+        qDebug() << "SchemaMigrator: cannot create schema_version" << q.lastError();
+        return false;
+    }
+    return true;
+}
+
+bool SchemaMigrator::migrate() {
+    if (!ensureVersionTable())
+        return false;
+    const int current = currentVersion();
+    if (current < 0)
+        return false;
+
+    for (const Migration &m : availableMigrations()) {
+        if (m.version <= current)
+            continue;
+        if (!apply(m))
+            return false;
+    }
+    return true;
+}
+
+bool SchemaMigrator::apply(const Migration &m) {
+    QFile f(m.resource);
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qDebug() << "SchemaMigrator: cannot open" << m.resource;
+        return false;
+    }
+    const QString script = QString::fromUtf8(f.readAll());
+
+    if (!db.transaction()) {
+        qDebug() << "SchemaMigrator: cannot start tx" << db.lastError();
+        return false;
+    }
+
+    // Несколько клиентов могут подключиться к новому серверу одновременно:
+    // миграцию применяет первый, остальные ждут его и видят готовую версию
+    QSqlQuery q(db);
+    if (!SqlDialect::isSqlite(db) && !q.exec("LOCK TABLE schema_version IN EXCLUSIVE MODE")) {
+        qDebug() << "SchemaMigrator: cannot lock schema_version" << q.lastError();
+        db.rollback();
+        return false;
+    }
+    q.prepare("SELECT 1 FROM schema_version WHERE version = :v");
+    q.bindValue(":v", m.version);
+    if (!q.exec()) {
+        db.rollback();
+        return false;
+    }
+    if (q.next())
+        return db.commit();
+
+    for (const QString &stmt : SqlDialect::splitStatements(script)) {
+        if (!executeStatement(stmt)) {
+            qDebug() << "SchemaMigrator: migration" << m.version << m.name << "failed";
+            db.rollback();
+            return false;
+        }
+    }
+
+    QSqlQuery ins(db);
+    ins.prepare("INSERT INTO schema_version (version, name) VALUES (:v, :n)");
+    ins.bindValue(":v", m.version);
+    ins.bindValue(":n", m.name);
+    if (!ins.exec() || !db.commit()) {
+        qDebug() << "SchemaMigrator: cannot record migration" << m.version << ins.lastError();
+        db.rollback();
+        return false;
+    }
+    qDebug() << "SchemaMigrator: применена миграция" << m.version << m.name;
+    return true;
+}
+
+bool SchemaMigrator::executeStatement(const QString &statement) {
+    // ADD COLUMN IF NOT EXISTS в SQLite нет, поэтому существующий столбец
+    // пропускаем сами: базы бывают созданы разными версиями схемы
+    static const QRegularExpression addColumnRx(
+        R"(^ALTER\s+TABLE\s+(\w+)\s+ADD\s+COLUMN\s+(?:IF\s+NOT\s+EXISTS\s+)?(\w+))",
+        QRegularExpression::CaseInsensitiveOption);
+    const auto m = addColumnRx.match(statement);
+    if (m.hasMatch() && SqlDialect::columnExists(db, m.captured(1), m.captured(2)))
+        return true;
+
+    QSqlQuery q(db);
+    if (!q.exec(statement)) {
+        qDebug() << "SchemaMigrator:" << q.lastError() << "\n" << statement;
+        return false;
+    }
+    return true;
+}
+
+QStringList SchemaMigrator::unindexedHotQueries() {
+    QStringList out;
+    for (const HotQuery &h : kHotQueries) {
+        if (!usesIndex(h.table, h.sql))
+            out << QString::fromLatin1(h.sql);
+    }
+    return out;
+}
+
+bool SchemaMigrator::usesIndex(const QString &table, const QString &sql) {
+    QSqlQuery q(db);
+
+    if (SqlDialect::isSqlite(db)) {
+        // Строки плана: "SEARCH t USING INDEX ..." или "SCAN t" (полный проход)
+        const QRegularExpression fullScan(
+            QString(R"(^SCAN (TABLE )?%1\b)").arg(QRegularExpression::escape(table)));
+        if (!q.exec("EXPLAIN QUERY PLAN " + sql)) {
+            qDebug() << "usesIndex():" << q.lastError();
+            return false;
+        }
+        while (q.next()) {
+            const QString detail = q.value(3).toString();
+            if (fullScan.match(detail).hasMatch() && !detail.contains("USING"))
+                return false;
+        }
+        return true;
+    }
+
+    // На маленьких таблицах планировщик PostgreSQL выбирает Seq Scan даже при
+    // наличии индекса, поэтому последовательное чтение запрещаем: если оно
+    // всё равно в плане, подходящего индекса нет
+    if (!db.transaction())
+        return false;
+    bool ok = q.exec("SET LOCAL enable_seqscan = off") && q.exec("EXPLAIN " + sql);
+    QString plan;
+    while (ok && q.next())
+        plan += q.value(0).toString() + '\n';
+    if (!ok)
+        qDebug() << "usesIndex():" << q.lastError();
+    db.rollback();
+    return ok && !plan.contains("Seq Scan on " + table);
+}
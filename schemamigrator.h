@@ -0,0 +1,44 @@
+#ifndef SCHEMAMIGRATOR_H
+#define SCHEMAMIGRATOR_H
+
+#include <QSqlDatabase>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Версионные миграции схемы, выполняются при подключении.
+//
+// Скрипты лежат в ресурсах :/db/migrations и называются NNN_описание.sql;
+// вариант NNN_описание.sqlite.sql / NNN_описание.pg.sql заменяет общий
+// скрипт для своего бэкенда (если общего нет, миграция только для этого
+// бэкенда). Номер последней применённой миграции хранится
+// в таблице schema_version, каждая миграция выполняется в своей транзакции.
+class SchemaMigrator {
+public:
+    explicit SchemaMigrator(QSqlDatabase &db);
+
+    // Применяет все миграции новее текущей версии
+    bool migrate();
+    int currentVersion() const;
+
+    // EXPLAIN для частых запросов менеджеров: возвращает те, что читают
+    // таблицу целиком, а не по индексу (пустой список - всё в порядке)
+    QStringList unindexedHotQueries();
+
+private:
+    struct Migration {
+        int     version;
+        QString name;
+        QString resource;
+    };
+
+    QVector<Migration> availableMigrations() const;
+    bool ensureVersionTable();
+    bool apply(const Migration &m);
+    bool executeStatement(const QString &statement);
+    bool usesIndex(const QString &table, const QString &sql);
+
+    QSqlDatabase &db;
+};
+
+#endif // SCHEMAMIGRATOR_H
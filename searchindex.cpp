@@ -0,0 +1,99 @@
+#include "searchindex.h"
+#include <QRegularExpression>
+#include <algorithm>
+
+QStringList SearchIndex::tokenize(const QString &text) {
+    static const QRegularExpression separators("[^\\p{L}\\p{N}]+");
+    return text.toLower().split(separators, Qt::SkipEmptyParts);
+}
+
+QString SearchIndex::plainText(const QString &html) {
+    static const QRegularExpression headOrStyle("<(head|style)[^>]*>.*?</\\1>",
+                                                QRegularExpression::CaseInsensitiveOption
+                                                    | QRegularExpression::DotMatchesEverythingOption);
+    static const QRegularExpression tags("<[^>]*>");
+    QString plain = html;
+    plain.remove(headOrStyle);
+    plain.replace(tags, " ");
+    plain.replace("&nbsp;", " ");
+    plain.replace(QChar(0x00A0), ' ');
+    plain.replace("&lt;", "<");
+    plain.replace("&gt;", ">");
+    plain.replace("&amp;", "&");
+    return plain;
+}
+
+void SearchIndex::addText(int docId, const QString &text, int weight) {
+    QSet<QString> &mine = docTokens[docId];
+    for (const QString &token : tokenize(text)) {
+        postings[token][docId] += weight;
+        mine.insert(token);
+    }
+}
+
+void SearchIndex::removeDocument(int docId) {
+    const auto it = docTokens.constFind(docId);
+    if (it == docTokens.cend())
+        return;
+    for (const QString &token : *it) {
+        auto p = postings.find(token);
+        if (p == postings.end())
+            continue;
+        p->remove(docId);
+        if (p->isEmpty())
+            postings.erase(p);
+    }
+    docTokens.erase(it);
+}
+
+void SearchIndex::clear() {
+    postings.clear();
+    docTokens.clear();
+}
+
+QVector<SearchIndex::Hit> SearchIndex::search(const QStringList &terms, int limit) const {
+    if (terms.isEmpty())
+        return {};
+
+    QHash<int, double> scores;
+    for (int i = 0; i < terms.size(); ++i) {
+        // Все слова словаря с этим префиксом
+        QHash<int, double> matched;
+        for (auto p = postings.lowerBound(terms[i]);
+             p != postings.cend() && p.key().startsWith(terms[i]); ++p) {
+            for (auto d = p->cbegin(); d != p->cend(); ++d)
+                matched[d.key()] += d.value();
+        }
+
+        if (i == 0) {
+            scores = matched;
+        } else {
+            for (auto s = scores.begin(); s != scores.end();) {
+                const auto m = matched.constFind(s.key());
+                if (m == matched.cend()) {
+                    s = scores.erase(s);
+                } else {
+                    *s += *m;
+                    ++s;
+                }
+            }
+        }
+        if (scores.isEmpty())
+            return {};
+    }
+
+    QVector<Hit> hits;
+    hits.reserve(scores.size());
+    for (auto s = scores.cbegin(); s != scores.cend(); ++s)
+        hits.append({s.key(), s.value()});
+    auto better = [](const Hit &a, const Hit &b) {
+        return a.score != b.score ? a.score > b.score : a.docId < b.docId;
+    };
+    if (limit > 0 && hits.size() > limit) {
+        std::partial_sort(hits.begin(), hits.begin() + limit, hits.end(), better);
+        hits.resize(limit);
+    } else {
+        std::sort(hits.begin(), hits.end(), better);
+    }
+    return hits;
+}
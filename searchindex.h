@@ -0,0 +1,41 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <QMap>
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Обратный индекс в памяти для поиска шаблонов там, где нет полнотекстового
+// поиска сервера (SQLite).
+//
+// Словарь отсортирован, поэтому каждое слово запроса ищется как префикс
+// (ввод ещё не закончен); документ должен содержать все слова запроса.
+// Оценка - сумма весов полей, в которых встретилось слово.
+class SearchIndex {
+public:
+    struct Hit {
+        int    docId;
+        double score;
+    };
+
+    // Слова в нижнем регистре; HTML лучше убрать заранее (plainText)
+    static QStringList tokenize(const QString &text);
+    static QString plainText(const QString &html);
+
+    void addText(int docId, const QString &text, int weight);
+    void removeDocument(int docId);
+    void clear();
+    bool contains(int docId) const { return docTokens.contains(docId); }
+
+    // Лучшие limit документов по убыванию оценки
+    QVector<Hit> search(const QStringList &terms, int limit) const;
+
+private:
+    QMap<QString, QHash<int, int>> postings;    // слово -> документ -> вес
+    QHash<int, QSet<QString>>      docTokens;   // для удаления документа
+};
+
+#endif // SEARCHINDEX_H
@@ -0,0 +1,158 @@
+#include "searchmanager.h"
+#include "querystats.h"
+#include "sqldialect.h"
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QDebug>
+
+namespace {
+
+// Веса полей как у setweight() в db/migrations/005: A, B, C, D
+constexpr int NameWeight     = 8;
+constexpr int SubtitleWeight = 4;
+constexpr int NotesWeight    = 2;
+constexpr int CellWeight     = 1;
+
+// id - целые из базы, подставлять их в текст запроса безопасно
+QString idList(const QVector<int> &ids) {
+    QStringList parts;
+    parts.reserve(ids.size());
+    for (int id : ids)
+        parts << QString::number(id);
+    return parts.join(',');
+}
+
+} // namespace
+
+SearchManager::SearchManager(QSqlDatabase &db) : db(db) {}
+SearchManager::~SearchManager() {}
+
+QVector<SearchHit> SearchManager::search(int projectId, const QString &text, int limit) {
+    const QStringList terms = SearchIndex::tokenize(text);
+    if (terms.isEmpty() || projectId <= 0)
+        return {};
+    return SqlDialect::isSqlite(db) ? searchLocal(projectId, terms, limit)
+                                    : searchServer(projectId, terms, limit);
+}
+
+QVector<SearchHit> SearchManager::searchServer(int projectId, const QStringList &terms, int limit) {
+    // Слова - только буквы и цифры (tokenize), синтаксис tsquery в них не попадёт
+    QStringList parts;
+    for (const QString &term : terms)
+        parts << term + ":*";
+
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    query.prepare(R"(
+        SELECT t.template_id, t.name, ts_rank(s.document, q.query) AS rank
+        FROM   template_search s
+        JOIN   template t ON t.template_id = s.template_id
+        JOIN   category c ON c.category_id = t.category_id
+        CROSS  JOIN to_tsquery('simple', ?) AS q(query)
+        WHERE  c.project_id = ?
+          AND  s.document @@ q.query
+        ORDER  BY rank DESC, t.name
+        LIMIT  ?)");
+    query.addBindValue(parts.join(" & "));
+    query.addBindValue(projectId);
+    query.addBindValue(limit);
+    if (!QUERY_EXEC(query)) {
+        qDebug() << "Ошибка поиска шаблонов:" << query.lastError();
+        return {};
+    }
+
+    QVector<SearchHit> hits;
+    while (query.next())
+        hits.append({query.value(0).toInt(), query.value(1).toString(), query.value(2).toDouble()});
+    return hits;
+}
+
+QVector<SearchHit> SearchManager::searchLocal(int projectId, const QStringList &terms, int limit) {
+    if (!syncLocalIndex(projectId))
+        return {};
+
+    QVector<SearchHit> hits;
+    for (const SearchIndex::Hit &h : index.search(terms, limit))
+        hits.append({h.docId, indexed.value(h.docId).name, h.score});
+    return hits;
+}
+
+bool SearchManager::syncLocalIndex(int projectId) {
+    if (projectId != indexedProject) {
+        index.clear();
+        indexed.clear();
+        indexedProject = projectId;
+    }
+
+    // Версия растёт при любой правке шаблона и его таблицы; переименование
+    // версию не трогает, поэтому сравнивается и имя
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    query.prepare(R"(
+        SELECT t.template_id, t.version, t.name
+        FROM   template t
+        JOIN   category c ON c.category_id = t.category_id
+        WHERE  c.project_id = :pid)");
+    query.bindValue(":pid", projectId);
+    if (!QUERY_EXEC(query)) {
+        qDebug() << "Ошибка чтения версий шаблонов:" << query.lastError();
+        return false;
+    }
+
+    QHash<int, Indexed> current;
+    QVector<int> stale;
+    while (query.next()) {
+        const int tid = query.value(0).toInt();
+        const Indexed now{query.value(1).toInt(), query.value(2).toString()};
+        const auto it = indexed.constFind(tid);
+        if (it == indexed.cend() || it->version != now.version || it->name != now.name)
+            stale << tid;
+        current.insert(tid, now);
+    }
+    for (auto it = indexed.cbegin(); it != indexed.cend(); ++it)
+        if (!current.contains(it.key()))
+            index.removeDocument(it.key());
+
+    if (!indexTemplates(stale))
+        return false;
+    indexed = current;
+    return true;
+}
+
+bool SearchManager::indexTemplates(const QVector<int> &templateIds) {
+    if (templateIds.isEmpty())
+        return true;
+    const QString ids = idList(templateIds);
+
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if (!QUERY_EXEC_SQL(query, QString(R"(
+        SELECT template_id, name, subtitle, notes, programming_notes
+        FROM   template
+        WHERE  template_id IN (%1))").arg(ids))) {
+        qDebug() << "Ошибка чтения шаблонов для индекса:" << query.lastError();
+        return false;
+    }
+    while (query.next()) {
+        const int tid = query.value(0).toInt();
+        index.removeDocument(tid);
+        index.addText(tid, SearchIndex::plainText(query.value(1).toString()), NameWeight);
+        index.addText(tid, SearchIndex::plainText(query.value(2).toString()), SubtitleWeight);
+        index.addText(tid, SearchIndex::plainText(query.value(3).toString()), NotesWeight);
+        index.addText(tid, SearchIndex::plainText(query.value(4).toString()), NotesWeight);
+    }
+
+    if (!QUERY_EXEC_SQL(query, QString(R"(
+        SELECT t.template_id, g.content
+        FROM   template t
+        JOIN   grid_cells g ON g.template_id = COALESCE(t.content_source_id, t.template_id)
+        WHERE  t.template_id IN (%1)
+          AND  g.content IS NOT NULL AND g.content <> '')").arg(ids))) {
+        qDebug() << "Ошибка чтения ячеек для индекса:" << query.lastError();
+        return false;
+    }
+    while (query.next())
+        index.addText(query.value(0).toInt(), SearchIndex::plainText(query.value(1).toString()),
+                      CellWeight);
+    return true;
+}
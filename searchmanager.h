@@ -0,0 +1,44 @@
+#ifndef SEARCHMANAGER_H
+#define SEARCHMANAGER_H
+
+#include <QVector>
+#include <QString>
+#include <QHash>
+#include <QSqlDatabase>
+#include "searchindex.h"
+
+struct SearchHit {
+    int     templateId;
+    QString name;
+    double  rank;
+};
+
+// Поиск шаблонов проекта по имени, подзаголовку, примечаниям и ячейкам.
+// PostgreSQL - индекс template_search (db/migrations/005), SQLite - индекс
+// в памяти, который догоняет базу по template.version перед каждым поиском.
+class SearchManager {
+public:
+    SearchManager(QSqlDatabase &db);
+    ~SearchManager();
+
+    // Каждое слово запроса - префикс; нужны все слова
+    QVector<SearchHit> search(int projectId, const QString &text, int limit = 50);
+
+private:
+    QVector<SearchHit> searchServer(int projectId, const QStringList &terms, int limit);
+    QVector<SearchHit> searchLocal(int projectId, const QStringList &terms, int limit);
+    bool syncLocalIndex(int projectId);
+    bool indexTemplates(const QVector<int> &templateIds);
+
+    struct Indexed {
+        int     version;
+        QString name;
+    };
+
+    QSqlDatabase &db;
+    SearchIndex         index;
+    int                 indexedProject = -1;
+    QHash<int, Indexed> indexed;        // что сейчас лежит в index
+};
+
+#endif // SEARCHMANAGER_H
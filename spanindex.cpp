@@ -0,0 +1,88 @@
+#include "spanindex.h"
+#include <QSet>
+
+void SpanIndex::clear() {
+    list.clear();
+    areaOf.clear();
+}
+
+bool SpanIndex::addSpan(int row, int col, int rowSpan, int colSpan) {
+    if (rowSpan < 1 || colSpan < 1 || (rowSpan == 1 && colSpan == 1))
+        return true;
+
+    for (int dr = 0; dr < rowSpan; ++dr)
+        for (int dc = 0; dc < colSpan; ++dc)
+            if (areaOf.contains(key(row + dr, col + dc)))
+                return false;
+
+    const int idx = list.size();
+    list.append({row, col, rowSpan, colSpan});
+    for (int dr = 0; dr < rowSpan; ++dr)
+        for (int dc = 0; dc < colSpan; ++dc)
+            areaOf.insert(key(row + dr, col + dc), idx);
+    return true;
+}
+
+std::optional<SpanIndex::Area> SpanIndex::areaAt(int row, int col) const {
+    const auto it = areaOf.constFind(key(row, col));
+    if (it == areaOf.cend())
+        return std::nullopt;
+    return list[*it];
+}
+
+QPoint SpanIndex::owner(int row, int col) const {
+    // QPoint(x, y): x - столбец, y - строка
+    const auto it = areaOf.constFind(key(row, col));
+    if (it == areaOf.cend())
+        return QPoint(col, row);
+    const Area &a = list[*it];
+    return QPoint(a.col, a.row);
+}
+
+bool SpanIndex::isOwner(int row, int col) const {
+    const auto it = areaOf.constFind(key(row, col));
+    return it != areaOf.cend() && list[*it].row == row && list[*it].col == col;
+}
+
+bool SpanIndex::isCovered(int row, int col) const {
+    const auto it = areaOf.constFind(key(row, col));
+    return it != areaOf.cend() && (list[*it].row != row || list[*it].col != col);
+}
+
+int SpanIndex::rowSpan(int row, int col) const {
+    const auto it = areaOf.constFind(key(row, col));
+    if (it == areaOf.cend())
+        return 1;
+    const Area &a = list[*it];
+    return (a.row == row && a.col == col) ? a.rowSpan : 0;
+}
+
+int SpanIndex::colSpan(int row, int col) const {
+    const auto it = areaOf.constFind(key(row, col));
+    if (it == areaOf.cend())
+        return 1;
+    const Area &a = list[*it];
+    return (a.row == row && a.col == col) ? a.colSpan : 0;
+}
+
+QVector<SpanIndex::Area> SpanIndex::areasIntersecting(const Area &rect, bool *partial) const {
+    QVector<Area> out;
+    QSet<int> seen;
+    bool cut = false;
+    for (int r = rect.row; r < rect.row + rect.rowSpan; ++r) {
+        for (int c = rect.col; c < rect.col + rect.colSpan; ++c) {
+            const auto it = areaOf.constFind(key(r, c));
+            if (it == areaOf.cend() || seen.contains(*it))
+                continue;
+            seen.insert(*it);
+            const Area &a = list[*it];
+            out.append(a);
+            if (!rect.contains(a.row, a.col)
+                || !rect.contains(a.row + a.rowSpan - 1, a.col + a.colSpan - 1))
+                cut = true;
+        }
+    }
+    if (partial)
+        *partial = cut;
+    return out;
+}
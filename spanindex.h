@@ -0,0 +1,58 @@
+#ifndef SPANINDEX_H
+#define SPANINDEX_H
+
+#include <QVector>
+#include <QHash>
+#include <QPoint>
+#include <optional>
+
+// Индекс объединённых ячеек: для любой (строка, столбец) за O(1) находит
+// объединение, в которое она входит, и его ячейку-владельца.
+//
+// Строится один раз на таблицу. Координаты не привязаны к началу отсчёта:
+// в базе они 1-based, в GridStore и виджете 0-based. Хранятся только
+// ячейки внутри объединений, обычные ячейки места не занимают.
+class SpanIndex {
+public:
+    struct Area {
+        int row;
+        int col;
+        int rowSpan;
+        int colSpan;
+
+        bool contains(int r, int c) const {
+            return r >= row && r < row + rowSpan && c >= col && c < col + colSpan;
+        }
+    };
+
+    void clear();
+    bool isEmpty() const { return list.isEmpty(); }
+
+    // Регистрирует объединение с владельцем (row, col); 1x1 игнорируется.
+    // false, если область пересекается с уже добавленной
+    bool addSpan(int row, int col, int rowSpan, int colSpan);
+
+    std::optional<Area> areaAt(int row, int col) const;
+    QPoint owner(int row, int col) const;       // сама ячейка, если не в объединении
+    bool isOwner(int row, int col) const;
+    bool isCovered(int row, int col) const;     // внутри объединения, но не владелец
+
+    // Как в grid_cells: 1 - обычная ячейка, 0 - закрытая объединением
+    int rowSpan(int row, int col) const;
+    int colSpan(int row, int col) const;
+
+    // Объединения, задетые прямоугольником; partial = задетые не целиком
+    QVector<Area> areasIntersecting(const Area &rect, bool *partial = nullptr) const;
+
+    const QVector<Area> &areas() const { return list; }
+
+private:
+    static quint64 key(int row, int col) {
+        return (quint64(quint32(row)) << 32) | quint32(col);
+    }
+
+    QVector<Area>       list;
+    QHash<quint64, int> areaOf;     // каждая ячейка объединения -> индекс в list
+};
+
+#endif // SPANINDEX_H
@@ -0,0 +1,204 @@
+#include "sqldialect.h"
+#include <QRegularExpression>
+#include <QSqlError>
+#include <QSqlDriver>
+#include <QSqlRecord>
+#include <QFile>
+#include <QDebug>
+
+DbBackend SqlDialect::backend(const QSqlDatabase &db) {
+    return db.driverName() == QLatin1String("QSQLITE") ? DbBackend::Sqlite
+                                                        : DbBackend::Postgres;
+}
+
+bool SqlDialect::isSqlite(const QSqlDatabase &db) {
+    return backend(db) == DbBackend::Sqlite;
+}
+
+QString SqlDialect::driverName(DbBackend backend) {
+    return backend == DbBackend::Sqlite ? QStringLiteral("QSQLITE")
+                                        : QStringLiteral("QPSQL");
+}
+
+QString SqlDialect::schemaResource(DbBackend backend) {
+    return backend == DbBackend::Sqlite ? QStringLiteral(":/db/schema_sqlite.sql")
+                                        : QStringLiteral(":/db/schema.sql");
+}
+
+QString SqlDialect::returningId(const QString &column) {
+    // PostgreSQL и SQLite >= 3.35 понимают RETURNING одинаково;
+    // это избавляет QPSQL от лишнего SELECT lastval() внутри lastInsertId()
+    return QStringLiteral(" RETURNING ") + column;
+}
+
+int SqlDialect::insertedId(QSqlQuery &query) {
+    if (query.isSelect() && query.next())
+        return query.value(0).toInt();
+    return query.lastInsertId().toInt();
+}
+
+QString SqlDialect::blobLength(const QSqlDatabase &db, const QString &column) {
+    return isSqlite(db) ? QString("length(%1)").arg(column)
+                        : QString("octet_length(%1)").arg(column);
+}
+
+QString SqlDialect::blobSlice(const QSqlDatabase &db, const QString &column) {
+    return isSqlite(db) ? QString("substr(%1, ?, ?)").arg(column)
+                        : QString("substring(%1 FROM ? FOR ?)").arg(column);
+}
+
+bool SqlDialect::configureConnection(QSqlDatabase &db) {
+    if (!isSqlite(db))
+        return true;
+
+    // WAL: читатели не блокируют писателя, fsync только на контрольных точках.
+    // foreign_keys: без него не срабатывают ON DELETE CASCADE из схемы.
+    const QStringList pragmas = {
+        "PRAGMA journal_mode = WAL",
+        "PRAGMA synchronous = NORMAL",
+        "PRAGMA foreign_keys = ON",
+        "PRAGMA temp_store = MEMORY"
+    };
+    for (const QString &sql : pragmas) {
+        QSqlQuery q(db);
+        if (!q.exec(sql)) {
+            qDebug() << "configureConnection():" << sql << "failed:" << q.lastError();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SqlDialect::tableExists(const QSqlDatabase &db, const QString &table) {
+    return db.tables(QSql::Tables).contains(table, Qt::CaseInsensitive);
+}
+
+bool SqlDialect::columnExists(const QSqlDatabase &db, const QString &table, const QString &column) {
+    return db.record(table).contains(column);
+}
+
+bool SqlDialect::ensureSchema(QSqlDatabase &db) {
+    if (tableExists(db, "project"))
+        return true;                                  // схема уже есть, дальше - миграции
+
+    QFile f(schemaResource(backend(db)));
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qDebug() << "ensureSchema(): cannot open" << f.fileName();
+        return false;
+    }
+    const QString script = QString::fromUtf8(f.readAll());
+
+    if (!db.transaction()) {
+        qDebug() << "ensureSchema(): cannot start tx" << db.lastError();
+        return false;
+    }
+    if (!executeScript(db, script)) {
+        db.rollback();
+        return false;
+    }
+    return db.commit();
+}
+
+QStringList SqlDialect::splitStatements(const QString &script) {
+    QStringList out;
+    QString current;
+    QString dollarTag;                 // открытая строка $tag$ ... $tag$ (PL/pgSQL)
+    bool inString  = false;            // '...'
+    bool inComment = false;            // -- до конца строки
+
+    auto flush = [&]() {
+        const QString stmt = current.trimmed();
+        if (!stmt.isEmpty())
+            out << stmt;
+        current.clear();
+    };
+    // Тело триггера SQLite (BEGIN ... END;) содержит ';' внутри
+    auto insideTriggerBody = [&]() {
+        const QString head = current.trimmed().left(40).toUpper().simplified();
+        if (!head.startsWith("CREATE TRIGGER") && !head.startsWith("CREATE TEMP TRIGGER"))
+            return false;
+        // У PostgreSQL триггер без тела (EXECUTE FUNCTION ...;)
+        static const QRegularExpression beginWord("\\bBEGIN\\b",
+                                                  QRegularExpression::CaseInsensitiveOption);
+        if (!current.contains(beginWord))
+            return false;
+        return !current.trimmed().endsWith("END", Qt::CaseInsensitive);
+    };
+
+    for (int i = 0; i < script.size(); ++i) {
+        const QChar ch = script.at(i);
+
+        if (inComment) {
+            if (ch == '\n') {
+                inComment = false;
+                current += ch;
+            }
+            continue;
+        }
+        if (!dollarTag.isEmpty()) {
+            if (ch == '$' && script.mid(i, dollarTag.size()) == dollarTag) {
+                current += dollarTag;
+                i += dollarTag.size() - 1;
+                dollarTag.clear();
+            } else {
+                current += ch;
+            }
+            continue;
+        }
+        if (inString) {
+            current += ch;
+            if (ch == '\'')
+                inString = false;      // '' внутри строки обработается как две границы
+            continue;
+        }
+
+        if (ch == '-' && i + 1 < script.size() && script.at(i + 1) == '-') {
+            inComment = true;
+            continue;
+        }
+        if (ch == '\'') {
+            inString = true;
+            current += ch;
+            continue;
+        }
+        if (ch == '$') {
+            const int end = script.indexOf('$', i + 1);
+            if (end > i) {
+                const QString tag = script.mid(i, end - i + 1);   // "$$" или "$body$"
+                bool ident = true;
+                for (int k = 1; k < tag.size() - 1; ++k)
+                    if (!tag.at(k).isLetterOrNumber() && tag.at(k) != '_') { ident = false; break; }
+                if (ident) {
+                    dollarTag = tag;
+                    current += tag;
+                    i = end;
+                    continue;
+                }
+            }
+        }
+        if (ch == ';') {
+            if (insideTriggerBody()) {
+                current += ch;
+                continue;
+            }
+            flush();
+            continue;
+        }
+        current += ch;
+    }
+    flush();
+    return out;
+}
+
+bool SqlDialect::executeScript(QSqlDatabase &db, const QString &script) {
+    const QStringList statements = splitStatements(script);
+    for (const QString &sql : statements) {
+        QSqlQuery q(db);
+        if (!q.exec(sql)) {
+            qDebug() << "executeScript(): statement failed:" << q.lastError().text()
+                     << "\n" << sql.left(200);
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,48 @@
+#ifndef SQLDIALECT_H
+#define SQLDIALECT_H
+
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QString>
+#include <QStringList>
+
+// Поддерживаемые бэкенды хранения
+enum class DbBackend {
+    Postgres,   // центральный сервер (QPSQL)
+    Sqlite      // локальный файл (QSQLITE, режим WAL)
+};
+
+// Все различия диалектов SQL собраны здесь, менеджеры не проверяют драйвер сами
+class SqlDialect {
+public:
+    static DbBackend backend(const QSqlDatabase &db);
+    static bool isSqlite(const QSqlDatabase &db);
+    static QString driverName(DbBackend backend);
+
+    // Ресурс со скриптом начальной схемы для бэкенда
+    static QString schemaResource(DbBackend backend);
+
+    // Суффикс INSERT, возвращающий сгенерированный ключ (SERIAL / INTEGER PRIMARY KEY)
+    static QString returningId(const QString &column);
+    // Ключ только что вставленной строки: из RETURNING, иначе через lastInsertId()
+    static int insertedId(QSqlQuery &query);
+
+    // Длина BLOB в байтах и фрагмент BLOB (смещение с 1, два позиционных параметра ?)
+    static QString blobLength(const QSqlDatabase &db, const QString &column);
+    static QString blobSlice(const QSqlDatabase &db, const QString &column);
+
+    // Настройка соединения сразу после открытия (PRAGMA для SQLite)
+    static bool configureConnection(QSqlDatabase &db);
+
+    // Создаёт начальную схему в пустой базе; дальнейшие изменения - SchemaMigrator
+    static bool ensureSchema(QSqlDatabase &db);
+
+    // Разбиение SQL-скрипта на отдельные операторы (QSqlQuery выполняет по одному)
+    static QStringList splitStatements(const QString &script);
+    static bool executeScript(QSqlDatabase &db, const QString &script);
+
+    static bool tableExists(const QSqlDatabase &db, const QString &table);
+    static bool columnExists(const QSqlDatabase &db, const QString &table, const QString &column);
+};
+
+#endif // SQLDIALECT_H
@@ -0,0 +1,250 @@
+#include "stallwatchdog.h"
+#include <QCoreApplication>
+#include <QAbstractEventDispatcher>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QEvent>
+#include <QMetaEnum>
+#include <QVector>
+#include <QFile>
+#include <QDateTime>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QDebug>
+#include <algorithm>
+
+std::atomic_bool StallWatchdog::active{false};
+
+namespace {
+
+// Участок (событие или STALL_SCOPE), попавший в разбивку
+struct Frame {
+    QString what;
+    qint64  ns;
+    int     depth;
+};
+
+// Всё, кроме атомиков, трогает только GUI-поток
+struct WatchState {
+    qint64 thresholdNs = 0;
+    QElapsedTimer clock;                // общие монотонные часы, только чтение
+    QThread *guiThread = nullptr;
+
+    qint64 busySince = -1;              // начало текущей итерации цикла
+    qint64 blockedAt = -1;
+    qint64 idleNs    = 0;               // суммарное время ожидания в циклах
+    int    depth     = 0;
+
+    QVector<Frame> frames;              // участки дольше порога / 4
+    qint64 sqlNs    = 0;
+    int    sqlCount = 0;
+
+    // Для фонового потока: что выполняется прямо сейчас
+    std::atomic<qint64>       busySinceNs{-1};
+    std::atomic<const char *> currentClass{nullptr};
+    std::atomic<int>          currentEvent{0};
+    std::atomic<const char *> currentScope{nullptr};
+    std::atomic_bool          liveReported{false};
+};
+
+WatchState &state() {
+    static WatchState s;
+    return s;
+}
+
+bool onGuiThread() {
+    return StallWatchdog::isActive() && QThread::currentThread() == state().guiThread;
+}
+
+QString eventName(int type) {
+    const char *key = QMetaEnum::fromType<QEvent::Type>().valueToKey(type);
+    return key ? QString::fromLatin1(key) : QString::number(type);
+}
+
+double toMs(qint64 ns) {
+    return qRound(ns / 1e4) / 100.0;
+}
+
+// Собственное время участка без ожидания во вложенных циклах; короткие
+// участки в разбивку не попадают (и строка для них не собирается)
+qint64 frameNs(qint64 start, qint64 idleAtStart) {
+    WatchState &s = state();
+    const qint64 ns = s.clock.nsecsElapsed() - start - (s.idleNs - idleAtStart);
+    return ns >= s.thresholdNs / 4 ? ns : -1;
+}
+
+void reportStall(qint64 busyNs) {
+    WatchState &s = state();
+    std::stable_sort(s.frames.begin(), s.frames.end(), [](const Frame &a, const Frame &b) {
+        return a.depth < b.depth;
+    });
+
+    qWarning().noquote() << QString("UI stall: %1 ms, SQL %2 ms in %3 queries")
+                                .arg(toMs(busyNs)).arg(toMs(s.sqlNs)).arg(s.sqlCount);
+    QJsonArray frames;
+    for (const Frame &f : std::as_const(s.frames)) {
+        qWarning().noquote() << QString("  %1%2: %3 ms")
+                                    .arg(QString(f.depth * 2, ' '), f.what).arg(toMs(f.ns));
+        frames.append(QJsonObject{{"what", f.what}, {"ms", toMs(f.ns)}, {"depth", f.depth}});
+    }
+
+    QFile file("AutoTLG_stalls.jsonl");
+    if (file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        QJsonObject o;
+        o["time"]      = QDateTime::currentDateTime().toString(Qt::ISODate);
+        o["version"]   = QCoreApplication::applicationVersion();
+        o["ms"]        = toMs(busyNs);
+        o["sql_ms"]    = toMs(s.sqlNs);
+        o["sql_count"] = s.sqlCount;
+        o["frames"]    = frames;
+        file.write(QJsonDocument(o).toJson(QJsonDocument::Compact) + '\n');
+    }
+}
+
+void onAwake() {
+    WatchState &s = state();
+    const qint64 now = s.clock.nsecsElapsed();
+    if (s.blockedAt >= 0) {
+        s.idleNs += now - s.blockedAt;
+        s.blockedAt = -1;
+    }
+    if (s.busySince < 0) {
+        s.busySince = now;
+        s.frames.clear();
+        s.sqlNs = 0;
+        s.sqlCount = 0;
+        s.liveReported.store(false);
+        s.busySinceNs.store(now);
+    }
+}
+
+void onAboutToBlock() {
+    WatchState &s = state();
+    const qint64 now = s.clock.nsecsElapsed();
+    if (s.busySince >= 0) {
+        const qint64 busy = now - s.busySince;
+        s.busySince = -1;
+        s.busySinceNs.store(-1);
+        if (busy >= s.thresholdNs)
+            reportStall(busy);
+    }
+    s.blockedAt = now;
+}
+
+// Фоновый поток: сообщает о цикле, который не вернулся за 4 порога
+void monitorLoop() {
+    WatchState &s = state();
+    const qint64 limitNs = s.thresholdNs * 4;
+    while (!QThread::currentThread()->isInterruptionRequested()) {
+        QThread::msleep(100);
+        const qint64 since = s.busySinceNs.load();
+        if (since < 0 || s.liveReported.load())
+            continue;
+        const qint64 blocked = s.clock.nsecsElapsed() - since;
+        if (blocked < limitNs)
+            continue;
+        s.liveReported.store(true);
+        const char *cls   = s.currentClass.load();
+        const char *scope = s.currentScope.load();
+        qWarning().noquote() << QString("UI blocked for %1 ms, handling %2 %3%4")
+                                    .arg(toMs(blocked))
+                                    .arg(QString::fromLatin1(cls ? cls : "?"),
+                                         eventName(s.currentEvent.load()),
+                                         scope ? " in " + QString::fromUtf8(scope) : QString());
+    }
+}
+
+} // namespace
+
+void StallWatchdog::install(int thresholdMs) {
+    if (thresholdMs <= 0 || isActive())
+        return;
+    WatchState &s = state();
+    s.thresholdNs = qint64(thresholdMs) * 1000000;
+    s.clock.start();
+    s.guiThread = QCoreApplication::instance()->thread();
+
+    QAbstractEventDispatcher *dispatcher = QAbstractEventDispatcher::instance(s.guiThread);
+    if (!dispatcher) {
+        qDebug() << "StallWatchdog::install(): нет диспетчера событий";
+        return;
+    }
+    QObject::connect(dispatcher, &QAbstractEventDispatcher::awake, dispatcher, onAwake,
+                     Qt::DirectConnection);
+    QObject::connect(dispatcher, &QAbstractEventDispatcher::aboutToBlock, dispatcher,
+                     onAboutToBlock, Qt::DirectConnection);
+
+    QThread *monitor = QThread::create(monitorLoop);
+    monitor->setObjectName("StallWatchdog");
+    // aboutToQuit не подходит: после «Сменить БД» цикл событий запускается снова
+    QObject::connect(QCoreApplication::instance(), &QObject::destroyed, [monitor]() {
+        monitor->requestInterruption();
+        monitor->wait();
+        delete monitor;
+    });
+    monitor->start(QThread::LowPriority);
+
+    active.store(true);
+}
+
+void StallWatchdog::noteQuery(qint64 nsecs) {
+    if (!onGuiThread())
+        return;
+    state().sqlNs += nsecs;
+    ++state().sqlCount;
+}
+
+StallWatchdog::Dispatch::Dispatch(QObject *receiver, QEvent *event) {
+    if (!onGuiThread())
+        return;
+    WatchState &s = state();
+    className   = receiver->metaObject()->className();
+    eventType   = event->type();
+    start       = s.clock.nsecsElapsed();
+    idleAtStart = s.idleNs;
+    ++s.depth;
+    if (!s.currentClass.load(std::memory_order_relaxed)) {
+        outermost = true;
+        s.currentClass.store(className);
+        s.currentEvent.store(eventType);
+    }
+}
+
+StallWatchdog::Dispatch::~Dispatch() {
+    if (start < 0)
+        return;
+    WatchState &s = state();
+    --s.depth;
+    const qint64 ns = frameNs(start, idleAtStart);
+    if (ns >= 0)
+        s.frames.append({QString::fromLatin1(className) + ' ' + eventName(eventType), ns, s.depth});
+    if (outermost)
+        s.currentClass.store(nullptr);
+}
+
+StallWatchdog::Scope::Scope(const char *name)
+    : name(name) {
+    if (!onGuiThread())
+        return;
+    WatchState &s = state();
+    start       = s.clock.nsecsElapsed();
+    idleAtStart = s.idleNs;
+    ++s.depth;
+    if (!s.currentScope.load(std::memory_order_relaxed)) {
+        outermost = true;
+        s.currentScope.store(name);
+    }
+}
+
+StallWatchdog::Scope::~Scope() {
+    if (start < 0)
+        return;
+    WatchState &s = state();
+    --s.depth;
+    const qint64 ns = frameNs(start, idleAtStart);
+    if (ns >= 0)
+        s.frames.append({QString::fromUtf8(name), ns, s.depth});
+    if (outermost)
+        s.currentScope.store(nullptr);
+}
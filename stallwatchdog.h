@@ -0,0 +1,66 @@
+#ifndef STALLWATCHDOG_H
+#define STALLWATCHDOG_H
+
+#include <QtGlobal>
+#include <atomic>
+
+class QObject;
+class QEvent;
+
+// Сторож зависаний GUI-потока.
+//
+// Итерация цикла событий - от пробуждения (awake) до ухода в ожидание
+// (aboutToBlock). Если она длится дольше порога, в лог пишется, какие
+// события и помеченные STALL_SCOPE участки кода выполнялись и сколько из
+// этого времени ушло на SQL. Та же запись добавляется строкой JSON в
+// AutoTLG_stalls.jsonl вместе с версией программы - для сравнения релизов.
+// Если цикл не возвращается совсем, фоновый поток пишет, где он застрял.
+//
+// Время, проведённое во вложенных циклах (модальные диалоги) в ожидании
+// пользователя, не считается.
+class StallWatchdog {
+public:
+    // Вызывать из GUI-потока после создания QApplication; thresholdMs <= 0 - выключено
+    static void install(int thresholdMs);
+    static bool isActive() { return active.load(std::memory_order_relaxed); }
+
+    // Время SQL-запроса (QueryStats); учитывается только в GUI-потоке
+    static void noteQuery(qint64 nsecs);
+
+    // Обработка одного события (Application::notify)
+    class Dispatch {
+    public:
+        Dispatch(QObject *receiver, QEvent *event);
+        ~Dispatch();
+        Dispatch(const Dispatch &) = delete;
+        Dispatch &operator=(const Dispatch &) = delete;
+    private:
+        // Получатель может быть удалён обработчиком: запоминаем только имя класса
+        const char *className = nullptr;
+        int         eventType = 0;
+        qint64      start = -1;     // -1: сторож выключен или не GUI-поток
+        qint64      idleAtStart = 0;
+        bool        outermost = false;
+    };
+
+    // Именованный участок кода в разбивке времени
+    class Scope {
+    public:
+        explicit Scope(const char *name);
+        ~Scope();
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+    private:
+        const char *name;
+        qint64 start = -1;
+        qint64 idleAtStart = 0;
+        bool   outermost = false;
+    };
+
+private:
+    static std::atomic_bool active;
+};
+
+#define STALL_SCOPE() StallWatchdog::Scope stallScope_(Q_FUNC_INFO)
+
+#endif // STALLWATCHDOG_H
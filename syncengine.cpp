@@ -0,0 +1,1005 @@
+#include "syncengine.h"
+#include "sqldialect.h"
+#include "schemamigrator.h"
+#include "templatemanager.h"
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QSqlRecord>
+#include <QCryptographicHash>
+#include <QFile>
+#include <QHash>
+#include <QDebug>
+
+namespace {
+
+// Отпечаток шаблона на сервере: одна строка md5 на шаблон, по сети идут только хэши
+const char *kRemoteFingerprintSql = R"(
+    SELECT t.template_id,
+           md5(concat_ws('|', t.name, t.subtitle, t.category_id, t.notes,
+                         t.programming_notes, t.position, t.is_dynamic, t.approved,
+                         t.related_template_id, t.template_type,
+               (SELECT string_agg(concat_ws(',', c.cell_type, c.row_index, c.col_index,
+                                            c.row_span, c.col_span,
+                                            md5(COALESCE(c.content, '')), c.colour),
+                                  ';' ORDER BY c.cell_type, c.row_index, c.col_index)
+                  FROM grid_cells c
+                 WHERE c.template_id = COALESCE(t.content_source_id, t.template_id)),
+               (SELECT string_agg(concat_ws(',', g.name, g.graph_type,
+                                            md5(COALESCE(g.image, ''::bytea))),
+                                  ';' ORDER BY g.name, g.graph_type)
+                  FROM graph g WHERE g.template_id = t.template_id)))
+      FROM template t
+)";
+
+const char *kCellColumns  = "cell_type, row_index, col_index, row_span, col_span, content, colour";
+const char *kGraphColumns = "name, graph_type, image";
+
+// Многострочный INSERT пачками: по сети один запрос на сотню строк, а не на каждую
+bool insertRows(QSqlDatabase &dst, const QString &table, const QString &columns,
+                int templateId, const QVector<QVariantList> &rows) {
+    if (rows.isEmpty())
+        return true;
+    const int width = rows.first().size() + 1;     // + template_id
+    const int chunk = 100;                         // 100 * 8 < 999 (лимит SQLite)
+
+    QString tuple = "(" + QString("?,").repeated(width);
+    tuple.chop(1);
+    tuple += ")";
+
+    for (int from = 0; from < rows.size(); from += chunk) {
+        const int n = qMin(chunk, int(rows.size()) - from);
+        QStringList tuples;
+        for (int i = 0; i < n; ++i)
+            tuples << tuple;
+
+        QSqlQuery q(dst);
+        q.prepare(QString("INSERT INTO %1 (template_id, %2) VALUES %3")
+                      .arg(table, columns, tuples.join(',')));
+        for (int i = 0; i < n; ++i) {
+            q.addBindValue(templateId);
+            for (const QVariant &v : rows[from + i])
+                q.addBindValue(v);
+        }
+        if (!q.exec()) {
+            qDebug() << "SyncEngine: insert into" << table << "failed:" << q.lastError();
+            return false;
+        }
+    }
+    return true;
+}
+
+QString fingerprintOf(const QVariantList &row,
+                      const QVector<QVariantList> &cells,
+                      const QVector<QVariantList> &graphs) {
+    QCryptographicHash h(QCryptographicHash::Sha1);
+    auto add = [&h](const QVariant &v) {
+        if (v.isNull())
+            h.addData(QByteArrayView("\x01", 1));
+        else if (v.typeId() == QMetaType::QByteArray)
+            h.addData(v.toByteArray());
+        else
+            h.addData(v.toString().toUtf8());
+        h.addData(QByteArrayView("\x1f", 1));
+    };
+    // template_id не входит: после замены локального ключа содержимое то же
+    for (int i = 1; i < row.size(); ++i)
+        add(row[i]);
+    for (const QVariantList &r : cells) {
+        for (const QVariant &v : r) add(v);
+        h.addData(QByteArrayView("\x1e", 1));
+    }
+    for (const QVariantList &r : graphs) {
+        for (const QVariant &v : r) add(v);
+        h.addData(QByteArrayView("\x1e", 1));
+    }
+    return QString::fromLatin1(h.result().toHex());
+}
+
+// Значения из QSQLITE и QPSQL приходят разными типами (bool/int, QDate/строка)
+bool sameValue(const QVariant &a, const QVariant &b) {
+    return a.isNull() == b.isNull() && a.toString() == b.toString();
+}
+
+} // namespace
+
+SyncEngine::SyncEngine(const QString &replicaFile, const RemoteParams &remote, QObject *parent)
+    : QObject(parent), replicaFile(replicaFile), remote(remote) {
+    localName  = QString("sync_local_%1").arg(quintptr(this));
+    remoteName = QString("sync_remote_%1").arg(quintptr(this));
+}
+
+SyncEngine::~SyncEngine() {
+    stop();
+}
+
+QString SyncEngine::templateColumns() {
+    return "template_id, name, subtitle, category_id, notes, programming_notes, "
+           "position, is_dynamic, approved, related_template_id, template_type";
+}
+
+bool SyncEngine::prepareReplica(QSqlDatabase &db) {
+    QFile f(":/db/replica_sqlite.sql");
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qDebug() << "prepareReplica(): cannot open" << f.fileName();
+        return false;
+    }
+    if (!db.transaction()) {
+        qDebug() << "prepareReplica(): cannot start tx" << db.lastError();
+        return false;
+    }
+    if (!SqlDialect::executeScript(db, QString::fromUtf8(f.readAll()))) {
+        db.rollback();
+        return false;
+    }
+    QSqlQuery q(db);
+    q.exec("INSERT OR REPLACE INTO sync_meta (key, value) VALUES ('applying', '0')");
+    return db.commit();
+}
+
+//  Управление циклом
+
+void SyncEngine::start() {
+    if (running)
+        return;
+    running = true;
+
+    timer = new QTimer(this);
+    timer->setInterval(15000);
+    connect(timer, &QTimer::timeout, this, &SyncEngine::runCycle);
+    timer->start();
+
+    notifyDelay = new QTimer(this);
+    notifyDelay->setSingleShot(true);
+    notifyDelay->setInterval(500);
+    connect(notifyDelay, &QTimer::timeout, this, &SyncEngine::runCycle);
+
+    QTimer::singleShot(0, this, &SyncEngine::runCycle);
+}
+
+void SyncEngine::stop() {
+    if (!running)
+        return;
+    running = false;
+    if (timer)
+        timer->stop();
+    if (notifyDelay)
+        notifyDelay->stop();
+
+    local.close();
+    server.close();
+    local  = QSqlDatabase();
+    server = QSqlDatabase();
+    QSqlDatabase::removeDatabase(localName);
+    QSqlDatabase::removeDatabase(remoteName);
+}
+
+void SyncEngine::requestSync() {
+    if (running)
+        QTimer::singleShot(0, this, &SyncEngine::runCycle);
+}
+
+void SyncEngine::trackProject(int projectId) {
+    if (projectId <= 0 || !openLocal())
+        return;
+    QSqlQuery q(local);
+    q.prepare("INSERT OR IGNORE INTO sync_project (project_id) VALUES (?)");
+    q.addBindValue(projectId);
+    if (!q.exec())
+        qDebug() << "trackProject():" << q.lastError();
+    requestSync();
+}
+
+bool SyncEngine::openConnections() {
+    return openLocal() && openServer();
+}
+
+bool SyncEngine::openLocal() {
+    if (!local.isValid()) {
+        local = QSqlDatabase::addDatabase("QSQLITE", localName);
+        local.setDatabaseName(replicaFile);
+        local.setConnectOptions("QSQLITE_BUSY_TIMEOUT=5000");
+    }
+    if (!local.isOpen()) {
+        if (!local.open() || !SqlDialect::configureConnection(local)) {
+            qDebug() << "SyncEngine: cannot open replica" << local.lastError().text();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SyncEngine::openServer() {
+    if (!server.isValid()) {
+        server = QSqlDatabase::addDatabase("QPSQL", remoteName);
+        server.setHostName(remote.host);
+        server.setPort(remote.port);
+        server.setDatabaseName(remote.dbName);
+        server.setUserName(remote.user);
+        server.setPassword(remote.password);
+        server.setConnectOptions("connect_timeout=10");
+    }
+    if (!server.isOpen()) {
+        if (!server.open()) {
+            qDebug() << "SyncEngine: server unavailable" << server.lastError().text();
+            return false;
+        }
+        // Сервер мог быть создан старой версией программы
+        if (!SqlDialect::ensureSchema(server) || !SchemaMigrator(server).migrate()) {
+            server.close();
+            return false;
+        }
+        QSqlDriver *driver = server.driver();
+        if (driver->hasFeature(QSqlDriver::EventNotifications)) {
+            connect(driver, &QSqlDriver::notification,
+                    this, &SyncEngine::onServerNotification, Qt::UniqueConnection);
+            driver->subscribeToNotification("autotlg_changes");
+        }
+    }
+    return true;
+}
+
+void SyncEngine::onServerNotification(const QString &name, QSqlDriver::NotificationSource source,
+                                      const QVariant &payload) {
+    Q_UNUSED(payload);
+    // Собственные отправки приходят как SelfSource
+    if (name == "autotlg_changes" && source == QSqlDriver::OtherSource
+        && running && !notifyDelay->isActive())
+        notifyDelay->start();
+}
+
+void SyncEngine::runCycle() {
+    if (!running)
+        return;
+    emit syncStarted();
+
+    const bool connected = openConnections();
+    if (connected != online) {
+        online = connected;
+        emit onlineChanged(online);
+    }
+    if (!connected) {
+        emit syncFinished(false, tr("Server is unavailable, working offline"));
+        return;
+    }
+
+    bool ok = pushChanges() && pullProjects();
+    if (ok) {
+        QVector<int> tracked;
+        QSqlQuery q(local);
+        q.exec("SELECT project_id FROM sync_project");
+        while (q.next())
+            tracked << q.value(0).toInt();
+        for (int projectId : tracked)
+            ok = pullProject(projectId) && ok;
+    }
+
+    if (!ok) {
+        // Разорванное соединение переоткроется в следующем цикле
+        QSqlQuery ping(server);
+        if (!ping.exec("SELECT 1")) {
+            server.close();
+            online = false;
+            emit onlineChanged(false);
+        }
+    }
+    emit syncFinished(ok, ok ? tr("Synchronized") : tr("Synchronization failed"));
+}
+
+//  Журнал изменений
+
+QVector<SyncEngine::DirtyEntry> SyncEngine::dirtyEntries(const QString &entity, bool deleted) const {
+    QVector<DirtyEntry> out;
+    QSqlQuery q(local);
+    if (entity == "category" && !deleted) {
+        // Родительские категории раньше дочерних: parent_id должен уже быть серверным
+        q.prepare("SELECT d.id, d.entity_id FROM sync_dirty d "
+                  "JOIN category c ON c.category_id = d.entity_id "
+                  "WHERE d.entity = 'category' AND d.deleted = 0 ORDER BY c.depth, d.id");
+    } else if (entity == "template" && !deleted) {
+        q.prepare("SELECT id, entity_id FROM sync_dirty "
+                  "WHERE entity = 'template' AND deleted = 0 "
+                  "AND entity_id NOT IN (SELECT template_id FROM sync_conflict) ORDER BY id");
+    } else {
+        q.prepare("SELECT id, entity_id FROM sync_dirty WHERE entity = ? AND deleted = ? ORDER BY id");
+        q.addBindValue(entity);
+        q.addBindValue(deleted ? 1 : 0);
+    }
+    if (!q.exec()) {
+        qDebug() << "dirtyEntries():" << q.lastError();
+        return out;
+    }
+    while (q.next())
+        out.append({q.value(0).toLongLong(), q.value(1).toInt(), deleted});
+    return out;
+}
+
+bool SyncEngine::isDirty(const QString &entity, int id) const {
+    QSqlQuery q(local);
+    q.prepare("SELECT 1 FROM sync_dirty WHERE entity = ? AND entity_id = ?");
+    q.addBindValue(entity);
+    q.addBindValue(id);
+    return q.exec() && q.next();
+}
+
+bool SyncEngine::clearDirty(qint64 markId) {
+    // Если объект изменили во время отправки, у отметки уже другой id и она останется
+    QSqlQuery q(local);
+    q.prepare("DELETE FROM sync_dirty WHERE id = ?");
+    q.addBindValue(markId);
+    if (!q.exec()) {
+        qDebug() << "clearDirty():" << q.lastError();
+        return false;
+    }
+    return true;
+}
+
+bool SyncEngine::setApplying(bool on) {
+    QSqlQuery q(local);
+    q.prepare("INSERT OR REPLACE INTO sync_meta (key, value) VALUES ('applying', ?)");
+    q.addBindValue(on ? "1" : "0");
+    return q.exec();
+}
+
+bool SyncEngine::remapId(const QString &entity, int oldId, int newId) {
+    if (!local.transaction())
+        return false;
+
+    QStringList sql;
+    if (entity == "project") {
+        sql << "UPDATE category SET project_id = :new WHERE project_id = :old"
+            << "UPDATE sync_project SET project_id = :new WHERE project_id = :old"
+            << "UPDATE project SET project_id = :new WHERE project_id = :old";
+    } else if (entity == "category") {
+        sql << "UPDATE category SET parent_id = :new WHERE parent_id = :old"
+            << "UPDATE template SET category_id = :new WHERE category_id = :old"
+            << "UPDATE category SET category_id = :new WHERE category_id = :old";
+    } else {
+        sql << "UPDATE grid_cells SET template_id = :new WHERE template_id = :old"
+            << "UPDATE graph SET template_id = :new WHERE template_id = :old"
+            << "UPDATE template SET related_template_id = :new WHERE related_template_id = :old"
+            << "UPDATE template SET content_source_id = :new WHERE content_source_id = :old"
+            << "UPDATE sync_base SET template_id = :new WHERE template_id = :old"
+            << "UPDATE sync_conflict SET template_id = :new WHERE template_id = :old"
+            << "UPDATE template SET template_id = :new WHERE template_id = :old"
+            // ссылки на шаблон уходили на сервер как NULL - отправить ещё раз
+            << "INSERT OR REPLACE INTO sync_dirty (entity, entity_id, deleted) "
+               "SELECT 'template', template_id, 0 FROM template WHERE related_template_id = :new";
+    }
+    sql << "UPDATE sync_dirty SET entity_id = :new WHERE entity = :entity AND entity_id = :old";
+
+    bool ok = setApplying(true);
+    QSqlQuery q(local);
+    ok = ok && q.exec("PRAGMA defer_foreign_keys = ON");
+    for (const QString &s : std::as_const(sql)) {
+        if (!ok) break;
+        q.prepare(s);
+        q.bindValue(":new", newId);
+        q.bindValue(":old", oldId);
+        if (s.contains(":entity"))
+            q.bindValue(":entity", entity);
+        ok = q.exec();
+        if (!ok)
+            qDebug() << "remapId():" << q.lastError() << s;
+    }
+    ok = ok && setApplying(false);
+    if (!ok || !local.commit()) {
+        local.rollback();
+        return false;
+    }
+    emit idRemapped(entity, oldId, newId);
+    return true;
+}
+
+//  Отпечатки и конфликты
+
+bool SyncEngine::readTemplate(QSqlDatabase &src, int templateId, TemplateData &out) const {
+    QSqlQuery q(src);
+    q.prepare("SELECT " + templateColumns() + " FROM template WHERE template_id = ?");
+    q.addBindValue(templateId);
+    if (!q.exec() || !q.next())
+        return false;
+    out.row.clear();
+    for (int i = 0; i < q.record().count(); ++i)
+        out.row << q.value(i);
+
+    out.cells.clear();
+    // Копия с общими ячейками уходит на другую сторону с ячейками владельца
+    q.prepare(QString("SELECT %1 FROM grid_cells WHERE template_id = %2 "
+                      "ORDER BY cell_type, row_index, col_index")
+                  .arg(kCellColumns, TemplateManager::cellOwnerSql("?")));
+    q.addBindValue(templateId);
+    if (!q.exec())
+        return false;
+    while (q.next()) {
+        QVariantList r;
+        for (int i = 0; i < 7; ++i) r << q.value(i);
+        out.cells << r;
+    }
+
+    out.graphs.clear();
+    q.prepare(QString("SELECT %1 FROM graph WHERE template_id = ? "
+                      "ORDER BY name, graph_type").arg(kGraphColumns));
+    q.addBindValue(templateId);
+    if (!q.exec())
+        return false;
+    while (q.next())
+        out.graphs << QVariantList{q.value(0), q.value(1), q.value(2)};
+    return true;
+}
+
+bool SyncEngine::writeTemplateContent(QSqlDatabase &dst, int templateId, const TemplateData &data) {
+    if (!TemplateManager::materializeContent(dst, templateId))
+        return false;
+    QSqlQuery q(dst);
+    q.prepare("DELETE FROM grid_cells WHERE template_id = ?");
+    q.addBindValue(templateId);
+    if (!q.exec()) return false;
+    q.prepare("DELETE FROM graph WHERE template_id = ?");
+    q.addBindValue(templateId);
+    if (!q.exec()) return false;
+
+    return insertRows(dst, "grid_cells", kCellColumns, templateId, data.cells)
+        && insertRows(dst, "graph", kGraphColumns, templateId, data.graphs);
+}
+
+QString SyncEngine::remoteFingerprint(int templateId) {
+    QSqlQuery q(server);
+    q.prepare(QString(kRemoteFingerprintSql) + " WHERE t.template_id = ?");
+    q.addBindValue(templateId);
+    if (!q.exec() || !q.next())
+        return QString();           // шаблона на сервере нет
+    return q.value(1).toString();
+}
+
+QString SyncEngine::localFingerprint(int templateId) const {
+    TemplateData data;
+    if (!readTemplate(const_cast<QSqlDatabase &>(local), templateId, data))
+        return QString();
+    return fingerprintOf(data.row, data.cells, data.graphs);
+}
+
+QVariant SyncEngine::storedRemoteFp(int templateId) const {
+    QSqlQuery q(local);
+    q.prepare("SELECT remote_fp FROM sync_base WHERE template_id = ?");
+    q.addBindValue(templateId);
+    if (q.exec() && q.next())
+        return q.value(0);
+    return QVariant();
+}
+
+QString SyncEngine::storedLocalFp(int templateId) const {
+    QSqlQuery q(local);
+    q.prepare("SELECT local_fp FROM sync_base WHERE template_id = ?");
+    q.addBindValue(templateId);
+    if (q.exec() && q.next())
+        return q.value(0).toString();
+    return QString();
+}
+
+bool SyncEngine::storeBase(int templateId, const QString &remoteFp, const QString &localFp) {
+    QSqlQuery q(local);
+    q.prepare("INSERT OR REPLACE INTO sync_base (template_id, remote_fp, local_fp) VALUES (?, ?, ?)");
+    q.addBindValue(templateId);
+    q.addBindValue(remoteFp);
+    q.addBindValue(localFp);
+    return q.exec();
+}
+
+bool SyncEngine::hasRealLocalChanges(int templateId) const {
+    // Панель сохраняет шаблон целиком даже без правок; сравниваем содержимое
+    if (isLocalId(templateId))
+        return true;
+    return localFingerprint(templateId) != storedLocalFp(templateId);
+}
+
+bool SyncEngine::recordConflict(int templateId, const QString &remoteFp) {
+    QSqlQuery q(local);
+    q.prepare("INSERT OR REPLACE INTO sync_conflict (template_id, remote_fp) VALUES (?, ?)");
+    q.addBindValue(templateId);
+    q.addBindValue(remoteFp);
+    if (!q.exec()) {
+        qDebug() << "recordConflict():" << q.lastError();
+        return false;
+    }
+    if (!announcedConflicts.contains(templateId)) {
+        announcedConflicts.insert(templateId);
+        QSqlQuery n(local);
+        n.prepare("SELECT name FROM template WHERE template_id = ?");
+        n.addBindValue(templateId);
+        emit conflictDetected(templateId, n.exec() && n.next() ? n.value(0).toString() : QString());
+    }
+    return true;
+}
+
+void SyncEngine::resolveConflict(int templateId, bool keepLocal) {
+    if (!openConnections()) {
+        emit syncFinished(false, tr("Server is unavailable, conflict stays unresolved"));
+        return;
+    }
+    QSqlQuery q(local);
+    if (keepLocal) {
+        // Текущая версия сервера становится базой - следующая отправка перезапишет её
+        QSqlQuery upd(local);
+        upd.prepare("INSERT OR REPLACE INTO sync_base (template_id, remote_fp, local_fp) "
+                    "VALUES (?, ?, (SELECT local_fp FROM sync_base WHERE template_id = ?))");
+        upd.addBindValue(templateId);
+        upd.addBindValue(remoteFingerprint(templateId));
+        upd.addBindValue(templateId);
+        upd.exec();
+        q.prepare("INSERT OR REPLACE INTO sync_dirty (entity, entity_id, deleted) VALUES ('template', ?, 0)");
+    } else {
+        // Сбрасываем базу - следующий цикл заберёт шаблон с сервера
+        QSqlQuery upd(local);
+        upd.prepare("UPDATE sync_base SET remote_fp = NULL WHERE template_id = ?");
+        upd.addBindValue(templateId);
+        upd.exec();
+        q.prepare("DELETE FROM sync_dirty WHERE entity = 'template' AND entity_id = ?");
+    }
+    q.addBindValue(templateId);
+    q.exec();
+
+    QSqlQuery del(local);
+    del.prepare("DELETE FROM sync_conflict WHERE template_id = ?");
+    del.addBindValue(templateId);
+    del.exec();
+    announcedConflicts.remove(templateId);
+
+    requestSync();
+}
+
+//  Отправка локальных изменений
+
+bool SyncEngine::pushChanges() {
+    return pushProjects() && pushCategories() && pushTemplates() && pushDeletions();
+}
+
+bool SyncEngine::pushProjects() {
+    for (const DirtyEntry &e : dirtyEntries("project", false)) {
+        QSqlQuery sel(local);
+        sel.prepare("SELECT name, template_style, study, sponsor, cut_date, version "
+                    "FROM project WHERE project_id = ?");
+        sel.addBindValue(e.entityId);
+        if (!sel.exec())
+            return false;
+        if (!sel.next()) { clearDirty(e.markId); continue; }
+
+        QSqlQuery q(server);
+        if (isLocalId(e.entityId)) {
+            q.prepare("INSERT INTO project (name, template_style, study, sponsor, cut_date, version) "
+                      "VALUES (?, ?, ?, ?, ?, ?)" + SqlDialect::returningId("project_id"));
+        } else {
+            q.prepare("UPDATE project SET name = ?, template_style = ?, study = ?, sponsor = ?, "
+                      "cut_date = ?, version = ? WHERE project_id = ?");
+        }
+        for (int i = 0; i < 6; ++i)
+            q.addBindValue(sel.value(i));
+        if (!isLocalId(e.entityId))
+            q.addBindValue(e.entityId);
+        if (!q.exec()) {
+            qDebug() << "pushProjects():" << q.lastError();
+            return false;
+        }
+        if (isLocalId(e.entityId) && !remapId("project", e.entityId, SqlDialect::insertedId(q)))
+            return false;
+        clearDirty(e.markId);
+    }
+    return true;
+}
+
+bool SyncEngine::pushCategories() {
+    for (const DirtyEntry &e : dirtyEntries("category", false)) {
+        QSqlQuery sel(local);
+        sel.prepare("SELECT name, parent_id, position, depth, project_id "
+                    "FROM category WHERE category_id = ?");
+        sel.addBindValue(e.entityId);
+        if (!sel.exec())
+            return false;
+        if (!sel.next()) { clearDirty(e.markId); continue; }
+
+        QSqlQuery q(server);
+        if (isLocalId(e.entityId)) {
+            q.prepare("INSERT INTO category (name, parent_id, position, depth, project_id) "
+                      "VALUES (?, ?, ?, ?, ?)" + SqlDialect::returningId("category_id"));
+        } else {
+            q.prepare("UPDATE category SET name = ?, parent_id = ?, position = ?, depth = ?, "
+                      "project_id = ? WHERE category_id = ?");
+        }
+        for (int i = 0; i < 5; ++i)
+            q.addBindValue(sel.value(i));
+        if (!isLocalId(e.entityId))
+            q.addBindValue(e.entityId);
+        if (!q.exec()) {
+            qDebug() << "pushCategories():" << q.lastError();
+            return false;
+        }
+        if (isLocalId(e.entityId) && !remapId("category", e.entityId, SqlDialect::insertedId(q)))
+            return false;
+        clearDirty(e.markId);
+    }
+    return true;
+}
+
+bool SyncEngine::pushTemplates() {
+    for (const DirtyEntry &e : dirtyEntries("template", false)) {
+        if (!pushTemplate(e.entityId, e.markId))
+            return false;
+    }
+    return true;
+}
+
+bool SyncEngine::pushTemplate(int templateId, qint64 markId) {
+    const bool isNew = isLocalId(templateId);
+    if (!isNew && !hasRealLocalChanges(templateId))
+        return clearDirty(markId);              // сохранение без правок
+
+    TemplateData data;
+    if (!local.transaction())                   // снимок: шаблон и ячейки согласованы
+        return false;
+    const bool found = readTemplate(local, templateId, data);
+    local.commit();
+    if (!found)
+        return true;                            // удалён, отправит pushDeletions()
+
+    const QString localFp = fingerprintOf(data.row, data.cells, data.graphs);
+
+    // Ссылки на ещё не отправленные шаблоны уйдут после их отправки (см. remapId)
+    QVariant related = data.row.value(9);
+    if (!related.isNull() && isLocalId(related.toInt()))
+        related = QVariant(QMetaType::fromType<int>());
+
+    if (!server.transaction())
+        return false;
+
+    bool insert = isNew;
+    if (!isNew) {
+        // Блокируем строку, чтобы отпечаток не изменился до нашей записи
+        QSqlQuery lock(server);
+        lock.prepare("SELECT 1 FROM template WHERE template_id = ? FOR UPDATE");
+        lock.addBindValue(templateId);
+        if (!lock.exec()) {
+            qDebug() << "pushTemplate(): lock failed" << lock.lastError();
+            server.rollback();
+            return false;
+        }
+
+        const QString remoteFp = remoteFingerprint(templateId);
+        const QVariant baseFp = storedRemoteFp(templateId);
+        if (baseFp.isNull() || baseFp.toString() != remoteFp) {
+            server.rollback();
+            return recordConflict(templateId, remoteFp);
+        }
+        insert = remoteFp.isEmpty();            // удалён на сервере, но оставлен локально
+    }
+
+    QSqlQuery q(server);
+    if (insert) {
+        q.prepare("INSERT INTO template (name, subtitle, category_id, notes, programming_notes, "
+                  "position, is_dynamic, approved, related_template_id, template_type) "
+                  "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?)" + SqlDialect::returningId("template_id"));
+    } else {
+        q.prepare("UPDATE template SET name = ?, subtitle = ?, category_id = ?, notes = ?, "
+                  "programming_notes = ?, position = ?, is_dynamic = ?, approved = ?, "
+                  "related_template_id = ?, template_type = ?, version = version + 1 "
+                  "WHERE template_id = ?");
+    }
+    for (int i = 1; i <= 10; ++i)
+        q.addBindValue(i == 9 ? related : data.row.value(i));
+    if (!insert)
+        q.addBindValue(templateId);
+
+    if (!q.exec()) {
+        qDebug() << "pushTemplate():" << q.lastError();
+        server.rollback();
+        return false;
+    }
+    const int remoteId = insert ? SqlDialect::insertedId(q) : templateId;
+
+    if (!writeTemplateContent(server, remoteId, data)) {
+        server.rollback();
+        return false;
+    }
+    // База - отпечаток нашей записи, снятый под блокировкой: правка, пришедшая
+    // на сервер после commit, останется отличием от базы и даст конфликт
+    const QString baseFp = remoteFingerprint(remoteId);
+    if (baseFp.isEmpty() || !server.commit()) {
+        server.rollback();
+        return false;
+    }
+
+    if (remoteId != templateId && !remapId("template", templateId, remoteId))
+        return false;
+    storeBase(remoteId, baseFp, localFp);
+    return clearDirty(markId);
+}
+
+bool SyncEngine::pushDeletions() {
+    // Удаление побеждает: шаблоны, категории и проекты удаляются на сервере
+    // даже если их успели изменить (каскад на сервере уберёт вложенное)
+    static const QList<QPair<QString, QString>> order = {
+        {"template", "DELETE FROM template WHERE template_id = ?"},
+        {"category", "DELETE FROM category WHERE category_id = ?"},
+        {"project",  "DELETE FROM project WHERE project_id = ?"}
+    };
+    for (const auto &step : order) {
+        for (const DirtyEntry &e : dirtyEntries(step.first, true)) {
+            if (!isLocalId(e.entityId)) {
+                QSqlQuery q(server);
+                q.prepare(step.second);
+                q.addBindValue(e.entityId);
+                if (!q.exec()) {
+                    qDebug() << "pushDeletions():" << q.lastError();
+                    return false;
+                }
+            }
+            if (step.first == "template") {
+                QSqlQuery q(local);
+                q.prepare("DELETE FROM sync_base WHERE template_id = ?");
+                q.addBindValue(e.entityId);
+                q.exec();
+                q.prepare("DELETE FROM sync_conflict WHERE template_id = ?");
+                q.addBindValue(e.entityId);
+                q.exec();
+            }
+            clearDirty(e.markId);
+        }
+    }
+    return true;
+}
+
+//  Получение изменений с сервера
+
+bool SyncEngine::pullProjects() {
+    QSqlQuery q(server);
+    if (!q.exec("SELECT project_id, name, template_style, study, sponsor, cut_date, version FROM project")) {
+        qDebug() << "pullProjects():" << q.lastError();
+        return false;
+    }
+    QHash<int, QVariantList> remoteRows;
+    while (q.next()) {
+        QVariantList r;
+        for (int i = 1; i < 7; ++i) r << q.value(i);
+        remoteRows.insert(q.value(0).toInt(), r);
+    }
+
+    QHash<int, QVariantList> localRows;
+    QSqlQuery l(local);
+    l.prepare("SELECT project_id, name, template_style, study, sponsor, cut_date, version "
+              "FROM project WHERE project_id < ?");
+    l.addBindValue(LocalIdBase);
+    if (!l.exec())
+        return false;
+    while (l.next()) {
+        QVariantList r;
+        for (int i = 1; i < 7; ++i) r << l.value(i);
+        localRows.insert(l.value(0).toInt(), r);
+    }
+
+    if (!local.transaction())
+        return false;
+    bool ok = setApplying(true);
+    bool changed = false;
+
+    for (auto it = remoteRows.cbegin(); ok && it != remoteRows.cend(); ++it) {
+        const auto lit = localRows.constFind(it.key());
+        if (isDirty("project", it.key()))
+            continue;
+        if (lit != localRows.cend()) {
+            bool same = true;
+            for (int i = 0; i < it->size(); ++i)
+                same = same && sameValue(lit->value(i), it->value(i));
+            if (same)
+                continue;
+        }
+
+        QSqlQuery up(local);
+        up.prepare("INSERT INTO project (project_id, name, template_style, study, sponsor, cut_date, version) "
+                   "VALUES (?, ?, ?, ?, ?, ?, ?) "
+                   "ON CONFLICT(project_id) DO UPDATE SET name = excluded.name, "
+                   "template_style = excluded.template_style, study = excluded.study, "
+                   "sponsor = excluded.sponsor, cut_date = excluded.cut_date, version = excluded.version");
+        up.addBindValue(it.key());
+        for (const QVariant &v : *it)
+            up.addBindValue(v);
+        ok = up.exec();
+        changed = true;
+    }
+
+    for (auto it = localRows.cbegin(); ok && it != localRows.cend(); ++it) {
+        if (remoteRows.contains(it.key()) || isDirty("project", it.key()))
+            continue;
+        QSqlQuery del(local);
+        del.prepare("DELETE FROM project WHERE project_id = ?");
+        del.addBindValue(it.key());
+        ok = del.exec();
+        del.prepare("DELETE FROM sync_project WHERE project_id = ?");
+        del.addBindValue(it.key());
+        ok = ok && del.exec();
+        changed = true;
+    }
+
+    ok = ok && setApplying(false);
+    if (!ok || !local.commit()) {
+        qDebug() << "pullProjects(): local apply failed" << local.lastError();
+        local.rollback();
+        return false;
+    }
+    if (changed)
+        emit projectsChanged();
+    return true;
+}
+
+bool SyncEngine::pullProject(int projectId) {
+    if (isLocalId(projectId))
+        return true;                            // ещё не отправлен
+
+    // 1. Сеть: категории целиком и только отпечатки шаблонов
+    QSqlQuery q(server);
+    q.prepare("SELECT category_id, name, parent_id, position, depth, project_id "
+              "FROM category WHERE project_id = ? ORDER BY depth");
+    q.addBindValue(projectId);
+    if (!q.exec()) {
+        qDebug() << "pullProject():" << q.lastError();
+        return false;
+    }
+    QVector<QVariantList> remoteCats;
+    QSet<int> remoteCatIds;
+    while (q.next()) {
+        QVariantList r;
+        for (int i = 0; i < 6; ++i) r << q.value(i);
+        remoteCats << r;
+        remoteCatIds.insert(q.value(0).toInt());
+    }
+
+    q.prepare(QString(kRemoteFingerprintSql)
+              + " JOIN category k ON k.category_id = t.category_id WHERE k.project_id = ?");
+    q.addBindValue(projectId);
+    if (!q.exec()) {
+        qDebug() << "pullProject():" << q.lastError();
+        return false;
+    }
+    QHash<int, QString> remoteFps;
+    while (q.next())
+        remoteFps.insert(q.value(0).toInt(), q.value(1).toString());
+
+    // 2. Сеть: полное содержимое только изменившихся на сервере шаблонов
+    QSet<int> conflicted;
+    {
+        QSqlQuery c(local);
+        c.exec("SELECT template_id FROM sync_conflict");
+        while (c.next())
+            conflicted.insert(c.value(0).toInt());
+    }
+    QHash<int, TemplateData> fetched;
+    for (auto it = remoteFps.cbegin(); it != remoteFps.cend(); ++it) {
+        const QVariant base = storedRemoteFp(it.key());
+        if ((!base.isNull() && base.toString() == *it) || conflicted.contains(it.key()))
+            continue;
+        TemplateData data;
+        if (!readTemplate(server, it.key(), data))
+            return false;
+        fetched.insert(it.key(), data);
+    }
+
+    // 3. Локально, одной транзакцией; решения о конфликтах принимаются
+    //    под блокировкой записи, чтобы не разойтись с правками из интерфейса
+    if (!local.transaction())
+        return false;
+    bool ok = setApplying(true);
+    QSqlQuery lq(local);
+    ok = ok && lq.exec("PRAGMA defer_foreign_keys = ON");
+    bool treeChanged = false;
+    QVector<int> changedTemplates;
+
+    for (const QVariantList &c : std::as_const(remoteCats)) {
+        if (!ok) break;
+        if (isDirty("category", c[0].toInt()))
+            continue;
+        QSqlQuery cur(local);
+        cur.prepare("SELECT name, parent_id, position, depth FROM category WHERE category_id = ?");
+        cur.addBindValue(c[0]);
+        if (cur.exec() && cur.next()
+            && sameValue(cur.value(0), c[1]) && sameValue(cur.value(1), c[2])
+            && sameValue(cur.value(2), c[3]) && sameValue(cur.value(3), c[4]))
+            continue;
+
+        QSqlQuery up(local);
+        up.prepare("INSERT INTO category (category_id, name, parent_id, position, depth, project_id) "
+                   "VALUES (?, ?, ?, ?, ?, ?) "
+                   "ON CONFLICT(category_id) DO UPDATE SET name = excluded.name, "
+                   "parent_id = excluded.parent_id, position = excluded.position, "
+                   "depth = excluded.depth, project_id = excluded.project_id");
+        for (const QVariant &v : c)
+            up.addBindValue(v);
+        ok = up.exec();
+        treeChanged = true;
+    }
+
+    for (auto it = fetched.cbegin(); ok && it != fetched.cend(); ++it) {
+        const int tid = it.key();
+        if (isDirty("template", tid) && hasRealLocalChanges(tid)) {
+            ok = recordConflict(tid, remoteFps.value(tid));
+            continue;
+        }
+        QSqlQuery up(local);
+        up.prepare("INSERT INTO template (" + templateColumns() + ") "
+                   "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?) "
+                   "ON CONFLICT(template_id) DO UPDATE SET name = excluded.name, "
+                   "subtitle = excluded.subtitle, category_id = excluded.category_id, "
+                   "notes = excluded.notes, programming_notes = excluded.programming_notes, "
+                   "position = excluded.position, is_dynamic = excluded.is_dynamic, "
+                   "approved = excluded.approved, related_template_id = excluded.related_template_id, "
+                   "template_type = excluded.template_type, version = template.version + 1");
+        for (const QVariant &v : it->row)
+            up.addBindValue(v);
+        ok = up.exec() && writeTemplateContent(local, tid, *it);
+        ok = ok && storeBase(tid, remoteFps.value(tid), localFingerprint(tid));
+
+        QSqlQuery clr(local);
+        clr.prepare("DELETE FROM sync_dirty WHERE entity = 'template' AND entity_id = ?");
+        clr.addBindValue(tid);
+        ok = ok && clr.exec();
+        changedTemplates << tid;
+    }
+
+    // Удалённые на сервере шаблоны и категории (кроме изменённых локально)
+    if (ok) {
+        QSqlQuery sel(local);
+        sel.prepare("SELECT t.template_id FROM template t "
+                    "JOIN category k ON k.category_id = t.category_id "
+                    "WHERE k.project_id = ? AND t.template_id < ?");
+        sel.addBindValue(projectId);
+        sel.addBindValue(LocalIdBase);
+        ok = sel.exec();
+        QVector<int> gone;
+        while (ok && sel.next()) {
+            const int tid = sel.value(0).toInt();
+            if (!remoteFps.contains(tid) && !isDirty("template", tid))
+                gone << tid;
+        }
+        for (int tid : std::as_const(gone)) {
+            QSqlQuery del(local);
+            del.prepare("DELETE FROM template WHERE template_id = ?");
+            del.addBindValue(tid);
+            ok = ok && del.exec();
+            del.prepare("DELETE FROM sync_base WHERE template_id = ?");
+            del.addBindValue(tid);
+            ok = ok && del.exec();
+            treeChanged = true;
+        }
+
+        sel.prepare("SELECT category_id FROM category WHERE project_id = ? AND category_id < ?");
+        sel.addBindValue(projectId);
+        sel.addBindValue(LocalIdBase);
+        ok = ok && sel.exec();
+        QVector<int> goneCats;
+        while (ok && sel.next()) {
+            const int cid = sel.value(0).toInt();
+            if (!remoteCatIds.contains(cid) && !isDirty("category", cid))
+                goneCats << cid;
+        }
+        for (int cid : std::as_const(goneCats)) {
+            QSqlQuery del(local);
+            del.prepare("DELETE FROM category WHERE category_id = ?");
+            del.addBindValue(cid);
+            ok = ok && del.exec();
+            treeChanged = true;
+        }
+    }
+
+    // Ссылка на шаблон вне реплики нарушила бы внешний ключ при фиксации
+    ok = ok && lq.exec("UPDATE template SET related_template_id = NULL "
+                       "WHERE related_template_id IS NOT NULL "
+                       "AND related_template_id NOT IN (SELECT template_id FROM template)");
+    ok = ok && setApplying(false);
+    if (!ok || !local.commit()) {
+        qDebug() << "pullProject(): local apply failed" << local.lastError();
+        local.rollback();
+        return false;
+    }
+
+    if (treeChanged || !changedTemplates.isEmpty())
+        emit projectChanged(projectId);
+    for (int tid : std::as_const(changedTemplates))
+        emit templateChanged(tid);
+    return true;
+}
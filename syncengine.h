@@ -0,0 +1,133 @@
+#ifndef SYNCENGINE_H
+#define SYNCENGINE_H
+
+#include <QObject>
+#include <QSqlDatabase>
+#include <QSqlDriver>
+#include <QString>
+#include <QVariant>
+#include <QVector>
+#include <QSet>
+#include <QTimer>
+
+// Параметры центрального сервера PostgreSQL
+struct RemoteParams {
+    QString host;
+    int     port = 5432;
+    QString dbName;
+    QString user;
+    QString password;
+};
+
+// Фоновая синхронизация локальной реплики (SQLite) с центральным PostgreSQL.
+//
+// Менеджеры работают только с репликой, поэтому правки из интерфейса
+// никогда не ждут сети. Триггеры реплики (db/replica_sqlite.sql) записывают
+// изменённые объекты в sync_dirty; SyncEngine в своём потоке и на своих
+// соединениях отправляет их на сервер и забирает чужие изменения.
+//
+// Конфликты определяются по шаблонам: для каждого шаблона хранится отпечаток
+// серверной версии на момент последней синхронизации. Если шаблон изменён
+// локально и при этом отпечаток на сервере уже другой, шаблон не
+// перезаписывается ни в одну сторону до решения пользователя.
+class SyncEngine : public QObject {
+    Q_OBJECT
+public:
+    // Ключи локально созданных строк (до отправки на сервер)
+    static constexpr int LocalIdBase = 1000000000;
+    static bool isLocalId(int id) { return id >= LocalIdBase; }
+
+    SyncEngine(const QString &replicaFile, const RemoteParams &remote,
+               QObject *parent = nullptr);
+    ~SyncEngine();
+
+    // Служебные таблицы и триггеры реплики; вызывается на основном соединении
+    static bool prepareReplica(QSqlDatabase &db);
+
+public slots:
+    void start();                       // в рабочем потоке: соединения и таймер
+    void stop();
+    void requestSync();                 // внеочередной цикл синхронизации
+    void trackProject(int projectId);   // держать проект в реплике
+    void resolveConflict(int templateId, bool keepLocal);
+
+signals:
+    void syncStarted();
+    void syncFinished(bool ok, const QString &message);
+    void onlineChanged(bool online);
+
+    void projectsChanged();                 // изменился список проектов
+    void projectChanged(int projectId);     // дерево проекта обновлено с сервера
+    void templateChanged(int templateId);   // содержимое шаблона обновлено с сервера
+    void idRemapped(const QString &entity, int oldId, int newId);
+    void conflictDetected(int templateId, const QString &templateName);
+
+private slots:
+    // Сервер сообщил о чужих изменениях (LISTEN) - забрать их, не дожидаясь таймера
+    void onServerNotification(const QString &name, QSqlDriver::NotificationSource source,
+                              const QVariant &payload);
+
+private:
+    struct DirtyEntry {
+        qint64 markId;
+        int    entityId;
+        bool   deleted;
+    };
+
+    struct TemplateData {
+        QVariantList row;                   // поля template в порядке templateColumns()
+        QVector<QVariantList> cells;        // строки grid_cells без template_id
+        QVector<QVariantList> graphs;       // строки graph без template_id
+    };
+
+    bool openConnections();
+    bool openLocal();
+    bool openServer();
+    void runCycle();
+
+    // Отправка
+    bool pushChanges();
+    bool pushProjects();
+    bool pushCategories();
+    bool pushTemplates();
+    bool pushDeletions();
+    bool pushTemplate(int templateId, qint64 markId);
+
+    // Получение
+    bool pullProjects();
+    bool pullProject(int projectId);
+
+    // Служебное
+    QVector<DirtyEntry> dirtyEntries(const QString &entity, bool deleted) const;
+    bool isDirty(const QString &entity, int id) const;
+    bool clearDirty(qint64 markId);
+    bool remapId(const QString &entity, int oldId, int newId);
+    bool setApplying(bool on);
+
+    QString remoteFingerprint(int templateId);
+    QString localFingerprint(int templateId) const;
+    QVariant storedRemoteFp(int templateId) const;
+    QString storedLocalFp(int templateId) const;
+    bool storeBase(int templateId, const QString &remoteFp, const QString &localFp);
+    bool recordConflict(int templateId, const QString &remoteFp);
+    bool hasRealLocalChanges(int templateId) const;
+
+    bool readTemplate(QSqlDatabase &src, int templateId, TemplateData &out) const;
+    bool writeTemplateContent(QSqlDatabase &dst, int templateId, const TemplateData &data);
+
+    static QString templateColumns();
+
+    QString      replicaFile;
+    RemoteParams remote;
+    QString      localName;                 // имена соединений этого потока
+    QString      remoteName;
+    QSqlDatabase local;
+    QSqlDatabase server;
+    QTimer      *timer = nullptr;
+    QTimer      *notifyDelay = nullptr;
+    bool         online = false;
+    bool         running = false;
+    QSet<int>    announcedConflicts;
+};
+
+#endif // SYNCENGINE_H
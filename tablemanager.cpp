@@ -1,7 +1,64 @@
 #include "tablemanager.h"
+#include "querystats.h"
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QRegularExpression>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include "sqldialect.h"
+
+namespace {
+
+// Структурная правка - одна транзакция: собственные ячейки копии
+// (materializeContent), сама правка и новая версия шаблона фиксируются
+// вместе. Без commit() деструктор откатывает всё
+class EditTransaction {
+public:
+    EditTransaction(QSqlDatabase &db, int templateId) : db(db), templateId(templateId) {
+        if (!db.transaction()) {
+            qDebug() << "EditTransaction: cannot start tx" << db.lastError();
+            return;
+        }
+        open = true;
+        if (!TemplateManager::materializeContent(db, templateId))
+            rollback();
+    }
+    ~EditTransaction() { rollback(); }
+
+    explicit operator bool() const { return open; }
+
+    // touch = false: функция из db/migrations/004 уже подняла версию сама
+    bool commit(bool touch = true) {
+        if (!open)
+            return false;
+        // Структурные правки применяются к текущему состоянию базы без сверки
+        // версии, но другие редакторы должны увидеть, что шаблон изменился
+        if (touch && !TemplateManager::claimVersion(db, templateId)) {
+            rollback();
+            return false;
+        }
+        open = false;
+        if (!db.commit()) {
+            qDebug() << "EditTransaction: commit fail" << db.lastError();
+            db.rollback();
+            return false;
+        }
+        return true;
+    }
+
+private:
+    void rollback() {
+        if (open)
+            db.rollback();
+        open = false;
+    }
+
+    QSqlDatabase &db;
+    int  templateId;
+    bool open = false;
+};
+
+} // namespace
 
 TableManager::TableManager(QSqlDatabase &db)
     : db(db) {}
@@ -9,12 +66,15 @@ TableManager::TableManager(QSqlDatabase &db)
 TableManager::~TableManager() {}
 
 bool TableManager::addRow(int templateId, bool addToHeader, const QString &headerContent) {
+    EditTransaction tx(db, templateId);
+    if (!tx)
+        return false;
     QSqlQuery q(db);
 
     // Если шаблон пустой – создаём единственную ячейку (1,1) header
     q.prepare(QLatin1String("SELECT COUNT(*) FROM grid_cells WHERE template_id = :tid"));
     q.bindValue(":tid", templateId);
-    if (!q.exec() || !q.next())
+    if (!QUERY_EXEC(q) || !q.next())
         return false;
 
     if (q.value(0).toInt() == 0) {
@@ -27,10 +87,10 @@ bool TableManager::addRow(int templateId, bool addToHeader, const QString &heade
         )");
         ins.bindValue(":tid",     templateId);
         ins.bindValue(":content", headerContent);
-        if (!ins.exec())
+        if (!QUERY_EXEC(ins))
             return false;
 
-        return true;
+        return tx.commit();
     }
 
     // Шаблон не пустой
@@ -42,7 +102,7 @@ bool TableManager::addRow(int templateId, bool addToHeader, const QString &heade
             WHERE template_id = :tid AND cell_type = 'header'
         )");
         q.bindValue(":tid", templateId);
-        if (!q.exec() || !q.next())
+        if (!QUERY_EXEC(q) || !q.next())
             return false;
 
         newRow = q.value(0).toInt() + 1;
@@ -60,7 +120,7 @@ bool TableManager::addRow(int templateId, bool addToHeader, const QString &heade
         list.bindValue(":tid",    templateId);
         list.bindValue(":newRow", newRow);
 
-        if (!list.exec()) {
+        if (!QUERY_EXEC(list)) {
             qDebug() << "addRow(): cannot fetch rows to shift:" << list.lastError();
             return false;
         }
@@ -81,7 +141,7 @@ bool TableManager::addRow(int templateId, bool addToHeader, const QString &heade
             upd.bindValue(":tid",    templateId);
             upd.bindValue(":oldRow", oldRow);
 
-            if (!upd.exec()) {
+            if (!QUERY_EXEC(upd)) {
                 qDebug() << "addRow(): shift row" << oldRow
                          << "->" << newIdx << "failed:" << upd.lastError();
                 return false;          // прерываем, чтобы не оставить БД в мусорном состоянии
@@ -95,7 +155,7 @@ bool TableManager::addRow(int templateId, bool addToHeader, const QString &heade
             WHERE template_id = :tid AND cell_type = 'content'
         )");
         q.bindValue(":tid", templateId);
-        if (!q.exec() || !q.next()) {
+        if (!QUERY_EXEC(q) || !q.next()) {
             qDebug() << "addRow(): content MAX(row_index) failed:" << q.lastError();
             return false;
         }
@@ -118,7 +178,7 @@ bool TableManager::addRow(int templateId, bool addToHeader, const QString &heade
         ORDER BY col_index
     )");
     colQ.bindValue(":tid", templateId);
-    if (!colQ.exec()) {
+    if (!QUERY_EXEC(colQ)) {
         qDebug() << "addRow(): fetch cols failed:" << colQ.lastError();
         return false;
     }
@@ -139,22 +199,25 @@ bool TableManager::addRow(int templateId, bool addToHeader, const QString &heade
         ins.bindValue(":col",   col);
         ins.bindValue(":cnt",   (addToHeader && col == columns.first())
                                   ? headerContent : QString());
-        if (!ins.exec()) {
+        if (!QUERY_EXEC(ins)) {
             qDebug() << "addRow(): INSERT failed for col" << col
                      << ins.lastError();
             return false;
         }
     }
-    return true;
+    return tx.commit();
 }
 
 bool TableManager::addColumn(int templateId, const QString &headerContent) {
+    EditTransaction tx(db, templateId);
+    if (!tx)
+        return false;
     QSqlQuery q(db);
 
     // Пустая таблица
     q.prepare("SELECT COUNT(*) FROM grid_cells WHERE template_id = :tid");
     q.bindValue(":tid", templateId);
-    if (!q.exec() || !q.next())
+    if (!QUERY_EXEC(q) || !q.next())
         return false;
 
     if (q.value(0).toInt() == 0) {
@@ -167,13 +230,13 @@ bool TableManager::addColumn(int templateId, const QString &headerContent) {
         )");
         ins.bindValue(":tid", templateId);
         ins.bindValue(":cnt", headerContent);
-        return ins.exec();
+        return QUERY_EXEC(ins) && tx.commit();
     }
 
     // Определяем новый номер столбца
     q.prepare("SELECT MAX(col_index) FROM grid_cells WHERE template_id = :tid");
     q.bindValue(":tid", templateId);
-    if (!q.exec() || !q.next())
+    if (!QUERY_EXEC(q) || !q.next())
         return false;
 
     const int newCol      = q.value(0).toInt() + 1;
@@ -191,7 +254,7 @@ bool TableManager::addColumn(int templateId, const QString &headerContent) {
     )");
     refQ.bindValue(":tid", templateId);
     refQ.bindValue(":ref", refCol);
-    if (!refQ.exec())
+    if (!QUERY_EXEC(refQ))
         return false;
 
     while (refQ.next())
@@ -215,14 +278,17 @@ bool TableManager::addColumn(int templateId, const QString &headerContent) {
         // только в самой верхней header‑ячейке ставим текст, если передан
         const bool firstHeader = (type == "header" && row == rowType.firstKey());
         ins.bindValue(":cnt", firstHeader ? headerContent : QString());
-        if (!ins.exec())
+        if (!QUERY_EXEC(ins))
             return false;
     }
 
-    return true;
+    return tx.commit();
 }
 
 bool TableManager::deleteRow(int templateId, int row) {
+    EditTransaction tx(db, templateId);
+    if (!tx)
+        return false;
     QSqlQuery q(db);
 
     // Удаляем ячейки строки любого типа
@@ -233,7 +299,7 @@ bool TableManager::deleteRow(int templateId, int row) {
     )");
     q.bindValue(":tid", templateId);
     q.bindValue(":row", row);
-    if (!q.exec())
+    if (!QUERY_EXEC(q))
         return false;
 
 
@@ -249,7 +315,7 @@ bool TableManager::deleteRow(int templateId, int row) {
     list.bindValue(":tid",     templateId);
     list.bindValue(":deleted", row);     // row — та, что мы только что стерли
 
-    if (!list.exec())
+    if (!QUERY_EXEC(list))
         return false;
 
 
@@ -268,16 +334,19 @@ bool TableManager::deleteRow(int templateId, int row) {
         upd.bindValue(":tid",    templateId);
         upd.bindValue(":oldRow", oldRow);
 
-        if (!upd.exec()) {
+        if (!QUERY_EXEC(upd)) {
             qDebug() << "deleteRow(): shift row" << oldRow
                      << "→" << newRow << "failed:" << upd.lastError();
             return false;           // прекращаем во избежание разрыва данных
         }
     }
-    return true;
+    return tx.commit();
 }
 
 bool TableManager::deleteColumn(int templateId, int col) {
+    EditTransaction tx(db, templateId);
+    if (!tx)
+        return false;
     QSqlQuery q(db);
 
     // Удаляем ячейки столбца (и header, и content)
@@ -288,7 +357,7 @@ bool TableManager::deleteColumn(int templateId, int col) {
     )");
     q.bindValue(":tid", templateId);
     q.bindValue(":col", col);
-    if (!q.exec())
+    if (!QUERY_EXEC(q))
         return false;
 
 
@@ -304,7 +373,7 @@ bool TableManager::deleteColumn(int templateId, int col) {
     list.bindValue(":tid",     templateId);
     list.bindValue(":deleted", col);
 
-    if (!list.exec())
+    if (!QUERY_EXEC(list))
         return false;
 
 
@@ -323,19 +392,19 @@ bool TableManager::deleteColumn(int templateId, int col) {
         upd.bindValue(":tid",    templateId);
         upd.bindValue(":oldCol", oldCol);
 
-        if (!upd.exec()) {
+        if (!QUERY_EXEC(upd)) {
             qDebug() << "deleteColumn(): shift col" << oldCol << "→" << newCol << "failed:" << upd.lastError();
             return false;
         }
     }
-    return true;
+    return tx.commit();
 }
 
 int TableManager::getRowCountForHeader(int templateId) {
     QSqlQuery q(db);
-    q.prepare("SELECT MAX(row_index) FROM grid_cells WHERE template_id=:tid AND cell_type='header'");
+    q.prepare("SELECT MAX(row_index) FROM grid_cells WHERE template_id=" + TemplateManager::cellOwnerSql(":tid") + " AND cell_type='header'");
     q.bindValue(":tid", templateId);
-    if(q.exec() && q.next()){
+    if(QUERY_EXEC(q) && q.next()){
         return q.value(0).toInt();
     }
     return 0;
@@ -343,69 +412,101 @@ int TableManager::getRowCountForHeader(int templateId) {
 
 int TableManager::getColCountForHeader(int templateId) {
     QSqlQuery q(db);
-    q.prepare("SELECT MAX(col_index) FROM grid_cells WHERE template_id=:tid AND cell_type='header'");
+    q.prepare("SELECT MAX(col_index) FROM grid_cells WHERE template_id=" + TemplateManager::cellOwnerSql(":tid") + " AND cell_type='header'");
     q.bindValue(":tid", templateId);
-    if(q.exec() && q.next()){
+    if(QUERY_EXEC(q) && q.next()){
         return q.value(0).toInt();
     }
     return 0;
 }
 
 bool TableManager::updateCellColour(int templateId, int rowIndex, int colIndex, const QString &colour) {
+    EditTransaction tx(db, templateId);
+    if (!tx)
+        return false;
     QSqlQuery query(db);
     query.prepare("UPDATE grid_cells SET colour = :colour WHERE template_id = :templateId AND cell_type = 'content' AND row_index = :rowIndex AND col_index = :colIndex");
     query.bindValue(":colour", colour);
     query.bindValue(":templateId", templateId);
     query.bindValue(":rowIndex", rowIndex);
     query.bindValue(":colIndex", colIndex);
-    if (!query.exec()) {
+    if (!QUERY_EXEC(query)) {
         qDebug() << "Ошибка обновления цвета ячейки:" << query.lastError();
         return false;
     }
-    return true;
+    return tx.commit();
 }
 
-bool TableManager::saveDataTableTemplate(int templateId,
-                                         const std::optional<QVector<QString>>& headers,
-                                         const std::optional<QVector<QVector<QString>>>& cellData,
-                                         const std::optional<QVector<QVector<QString>>>& cellColours) {
+WriteResult TableManager::updateCellColours(int templateId, const QVector<QPair<int, int>> &cells,
+                                            const QString &colour, std::optional<int> expectedVersion) {
     if (!db.transaction()) {
-        qDebug() << "saveDataTableTemplate(): cannot start tx" << db.lastError();
-        return false;
+        qDebug() << "updateCellColours(): cannot start tx" << db.lastError();
+        return {};
     }
+    const WriteResult claimed = TemplateManager::claimVersion(db, templateId, expectedVersion);
+    if (!claimed) {
+        db.rollback();
+        return claimed;
+    }
+    if (!TemplateManager::materializeContent(db, templateId)) { db.rollback(); return {}; }
 
-    // сохраняем span-ы существующей таблицы
-    QMap<QPair<int,int>, QPair<int,int>> spanMap;
-    QSet<QPair<int,int>>                  inner;
-    {
-        QSqlQuery q(db);
-        q.prepare(u8R"(
-            SELECT row_index, col_index,
-                   COALESCE(row_span,1), COALESCE(col_span,1)
-            FROM   grid_cells
-            WHERE  template_id = :tid)");
+    QSqlQuery q(db);
+    q.prepare(R"(
+        UPDATE grid_cells SET colour = :clr
+        WHERE  template_id = :tid AND row_index = :r AND col_index = :c)");
+    for (const auto &cell : cells) {
+        q.bindValue(":clr", colour);
         q.bindValue(":tid", templateId);
-        if (!q.exec()) { db.rollback(); return false; }
-
-        while (q.next()) {
-            int r = q.value(0).toInt(), c = q.value(1).toInt();
-            int rs = q.value(2).toInt(), cs = q.value(3).toInt();
-            spanMap[{r,c}] = {rs,cs};
-            for (int dr = 0; dr < rs; ++dr)
-                for (int dc = 0; dc < cs; ++dc)
-                    if (dr || dc) inner.insert({r+dr,c+dc});
+        q.bindValue(":r",   cell.first);
+        q.bindValue(":c",   cell.second);
+        if (!QUERY_EXEC(q)) {
+            qDebug() << "updateCellColours(): update failed at" << cell << q.lastError();
+            db.rollback();
+            return {};
         }
     }
 
+    if (!db.commit()) {
+        qDebug() << "updateCellColours(): commit fail" << db.lastError();
+        db.rollback();
+        return {};
+    }
+    return claimed;
+}
+
+WriteResult TableManager::saveDataTableTemplate(int templateId,
+                                                const std::optional<QVector<QString>>& headers,
+                                                const std::optional<QVector<QVector<QString>>>& cellData,
+                                                const std::optional<QVector<QVector<QString>>>& cellColours,
+                                                std::optional<int> expectedVersion) {
+    if (!db.transaction()) {
+        qDebug() << "saveDataTableTemplate(): cannot start tx" << db.lastError();
+        return {};
+    }
+
+    // Сначала версия: при конфликте ячейки не трогаем, а параллельное
+    // сохранение того же шаблона дождётся конца этой транзакции
+    const WriteResult claimed = TemplateManager::claimVersion(db, templateId, expectedVersion);
+    if (!claimed) {
+        db.rollback();
+        return claimed;
+    }
+    if (!TemplateManager::materializeContent(db, templateId)) { db.rollback(); return {}; }
+
+    // сохраняем span-ы существующей таблицы
+    SpanIndex spans;
+    if (!loadSpanIndex(templateId, spans)) { db.rollback(); return {}; }
+
     // полностью чистим старые ячейки
     {
         QSqlQuery del(db);
         del.prepare(u8"DELETE FROM grid_cells WHERE template_id = :tid");
         del.bindValue(":tid", templateId);
-        if (!del.exec()) { db.rollback(); return false; }
+        if (!QUERY_EXEC(del)) { db.rollback(); return {}; }
     }
 
-    if (!cellData) { db.commit(); return true; }    // нечего вставлять
+    if (!cellData)                                  // нечего вставлять
+        return db.commit() ? claimed : WriteResult{};
 
     // Готовим INSERT
     QSqlQuery ins(db);
@@ -425,9 +526,8 @@ bool TableManager::saveDataTableTemplate(int templateId,
         const QString ctype = isHeader ? "header" : "content";
         for (int c = 0; c < tbl[r].size(); ++c) {
 
-            if (inner.contains({r+1,c+1})) continue;      // «внутренняя»
+            if (spans.isCovered(r+1, c+1)) continue;      // «внутренняя»
 
-            auto span = spanMap.value({r+1,c+1}, {1,1});
             QString colour = "#FFFFFF";
             if (cellColours && r < cellColours->size()
                 && c < (*cellColours)[r].size())
@@ -439,13 +539,13 @@ bool TableManager::saveDataTableTemplate(int templateId,
             ins.bindValue(":c"    , c+1);
             ins.bindValue(":cnt"  , tbl[r][c]);
             ins.bindValue(":clr"  , colour);
-            ins.bindValue(":rs"   , span.first);
-            ins.bindValue(":cs"   , span.second);
+            ins.bindValue(":rs"   , spans.rowSpan(r+1, c+1));
+            ins.bindValue(":cs"   , spans.colSpan(r+1, c+1));
 
-            if (!ins.exec()) {
+            if (!QUERY_EXEC(ins)) {
                 qDebug() << "insert failed at" << r+1 << c+1 << ins.lastError();
                 db.rollback();
-                return false;
+                return {};
             }
         }
     }
@@ -454,20 +554,27 @@ bool TableManager::saveDataTableTemplate(int templateId,
     if (!db.commit()) {
         qDebug() << "saveDataTableTemplate(): commit fail" << db.lastError();
         db.rollback();
-        return false;
+        return {};
     }
-    return true;
+    return claimed;
 }
 
 bool TableManager::generateColumnsForDynamicTemplate(int templateId, const QVector<QString>& groupNames) {
+    EditTransaction tx(db, templateId);
+    if (!tx)
+        return false;
     int numGroups = groupNames.size();
     if (numGroups < 1) {
         qDebug() << "Число групп не может быть меньше 1.";
         return false;
     }
-    if (!db.transaction()) {
-        qDebug() << "Не удалось начать транзакцию:" << db.lastError();
-        return false;
+    if (!SqlDialect::isSqlite(db)) {
+        // Имена передаются JSON-массивом: литерал text[] пришлось бы экранировать вручную
+        return callEditFunction(
+            "autotlg_generate_group_columns(?, ARRAY(SELECT e FROM json_array_elements_text(CAST(? AS json))"
+            " WITH ORDINALITY AS t(e, n) ORDER BY n))",
+            {templateId, QString::fromUtf8(QJsonDocument(QJsonArray::fromStringList(groupNames))
+                                               .toJson(QJsonDocument::Compact))}) && tx.commit(false);
     }
 
     // Лямбда: удаляем HTML-теги, заменяем &nbsp;, берём последнюю непустую строку, сжимаем пробелы
@@ -492,9 +599,8 @@ bool TableManager::generateColumnsForDynamicTemplate(int templateId, const QVect
         ORDER BY col_index
     )");
     selectHeaders.bindValue(":tid", templateId);
-    if (!selectHeaders.exec()) {
+    if (!QUERY_EXEC(selectHeaders)) {
         qDebug() << "Ошибка получения столбцов:" << selectHeaders.lastError();
-        db.rollback();
         return false;
     }
 
@@ -519,7 +625,6 @@ bool TableManager::generateColumnsForDynamicTemplate(int templateId, const QVect
 
     if (group1Order < 0) {
         qDebug() << "Не найдена ни одна колонка с префиксом 'group'.";
-        db.rollback();
         return false;
     }
 
@@ -536,9 +641,8 @@ bool TableManager::generateColumnsForDynamicTemplate(int templateId, const QVect
         q.bindValue(":newHeader", groupNames[0]);
         q.bindValue(":tid", templateId);
         q.bindValue(":col", group1Order);
-        if (!q.exec()) {
+        if (!QUERY_EXEC(q)) {
             qDebug() << "Ошибка при переименовании первой группы:" << q.lastError();
-            db.rollback();
             return false;
         }
     }
@@ -553,9 +657,8 @@ bool TableManager::generateColumnsForDynamicTemplate(int templateId, const QVect
         )");
         q.bindValue(":tid", templateId);
         q.bindValue(":col", col);
-        if (!q.exec()) {
+        if (!QUERY_EXEC(q)) {
             qDebug() << "Ошибка удаления колонки" << col << ":" << q.lastError();
-            db.rollback();
             return false;
         }
     }
@@ -573,9 +676,8 @@ bool TableManager::generateColumnsForDynamicTemplate(int templateId, const QVect
         )");
         sel.bindValue(":tid", templateId);
         sel.bindValue(":base", group1Order);
-        if (!sel.exec()) {
+        if (!QUERY_EXEC(sel)) {
             qDebug() << "Ошибка выбора колонок для сдвига:" << sel.lastError();
-            db.rollback();
             return false;
         }
 
@@ -594,9 +696,8 @@ bool TableManager::generateColumnsForDynamicTemplate(int templateId, const QVect
             upd.bindValue(":newCol", oldCol + shift);
             upd.bindValue(":tid", templateId);
             upd.bindValue(":oldCol", oldCol);
-            if (!upd.exec()) {
+            if (!QUERY_EXEC(upd)) {
                 qDebug() << "Ошибка сдвига колонки" << oldCol << ":" << upd.lastError();
-                db.rollback();
                 return false;
             }
         }
@@ -616,9 +717,8 @@ bool TableManager::generateColumnsForDynamicTemplate(int templateId, const QVect
         )");
         readG1.bindValue(":tid", templateId);
         readG1.bindValue(":col", group1Order);
-        if (!readG1.exec()) {
+        if (!QUERY_EXEC(readG1)) {
             qDebug() << "Ошибка чтения содержимого первой группы:" << readG1.lastError();
-            db.rollback();
             return false;
         }
         while (readG1.next())
@@ -642,9 +742,8 @@ bool TableManager::generateColumnsForDynamicTemplate(int templateId, const QVect
             insH.bindValue(":tid", templateId);
             insH.bindValue(":col", newCol);
             insH.bindValue(":hdr", hdr);
-            if (!insH.exec()) {
+            if (!QUERY_EXEC(insH)) {
                 qDebug() << "Ошибка вставки header группы" << i << ":" << insH.lastError();
-                db.rollback();
                 return false;
             }
         }
@@ -662,16 +761,15 @@ bool TableManager::generateColumnsForDynamicTemplate(int templateId, const QVect
             insC.bindValue(":row", it.key());
             insC.bindValue(":col", newCol);
             insC.bindValue(":cont", it.value());
-            if (!insC.exec()) {
+            if (!QUERY_EXEC(insC)) {
                 qDebug() << "Ошибка вставки content группы" << i << ":" << insC.lastError();
-                db.rollback();
                 return false;
             }
         }
     }
 
-    // коммитим транзакцию
-    if (!db.commit()) {
+    // коммитим транзакцию вместе с версией шаблона
+    if (!tx.commit()) {
         qDebug() << "Ошибка коммита:" << db.lastError();
         return false;
     }
@@ -684,6 +782,25 @@ bool TableManager::generateColumnsForDynamicTemplate(int templateId, const QVect
 bool TableManager::mergeCells(int templateId, const QString &cellType,
                               int startRow, int startCol,
                               int rowSpan, int colSpan) {
+    EditTransaction tx(db, templateId);
+    if (!tx)
+        return false;
+    if (!SqlDialect::isSqlite(db))
+        return callEditFunction("autotlg_merge_cells(?, ?, ?, ?, ?, ?)",
+                                {templateId, cellType, startRow, startCol, rowSpan, colSpan}) && tx.commit(false);
+
+    //  Прежние объединения внутри области поглощаются новым; задетые
+    //  частично дали бы перекрывающиеся области
+    SpanIndex spans;
+    if (!loadSpanIndex(templateId, spans))
+        return false;
+    bool partial = false;
+    spans.areasIntersecting({startRow, startCol, rowSpan, colSpan}, &partial);
+    if (partial) {
+        qDebug() << "mergeCells(): область частично пересекает другое объединение";
+        return false;
+    }
+
     //  Обновляем главную ячейку (startRow, startCol):
     QSqlQuery q(db);
     q.prepare(R"(
@@ -700,7 +817,7 @@ bool TableManager::mergeCells(int templateId, const QString &cellType,
     q.bindValue(":ctype", cellType);
     q.bindValue(":r", startRow);
     q.bindValue(":c", startCol);
-    if(!q.exec()){
+    if(!QUERY_EXEC(q)){
         qDebug() << "mergeCells() error upd main cell:" << q.lastError();
         return false;
     }
@@ -724,40 +841,35 @@ bool TableManager::mergeCells(int templateId, const QString &cellType,
     upd.bindValue(":c2",    startCol + colSpan  - 1);
     upd.bindValue(":r",     startRow);
     upd.bindValue(":c",     startCol);
-    if (!upd.exec()) {
+    if (!QUERY_EXEC(upd)) {
         qDebug() << "mergeCells() error marking inner cells:" << upd.lastError();
         return false;
     }
 
-    return true;
+    return tx.commit();
 }
 
 bool TableManager::unmergeCells(int templateId, const QString &cellType, int rowIndex1, int colIndex1) {
-    //  Считываем текущий span основной ячейки
-    QSqlQuery sel(db);
-    sel.prepare(R"(
-        SELECT COALESCE(row_span,1) AS rs,
-               COALESCE(col_span,1) AS cs
-        FROM   grid_cells
-        WHERE  template_id = :tid
-          AND  cell_type   = :ctype
-          AND  row_index   = :r
-          AND  col_index   = :c
-    )");
-    sel.bindValue(":tid",   templateId);
-    sel.bindValue(":ctype", cellType);
-    sel.bindValue(":r",     rowIndex1);
-    sel.bindValue(":c",     colIndex1);
-    if (!sel.exec() || !sel.next()) {
-        qDebug() << "unmergeCells(): main cell not found or query failed:" << sel.lastError();
+    EditTransaction tx(db, templateId);
+    if (!tx)
         return false;
-    }
-    int rs = qMax(1, sel.value("rs").toInt());
-    int cs = qMax(1, sel.value("cs").toInt());
+    if (!SqlDialect::isSqlite(db))
+        return callEditFunction("autotlg_unmerge_cells(?, ?, ?, ?)",
+                                {templateId, cellType, rowIndex1, colIndex1}) && tx.commit(false);
+
+    //  Находим объединение, в которое входит ячейка (она может быть и «внутренней»)
+    SpanIndex spans;
+    if (!loadSpanIndex(templateId, spans))
+        return false;
+    const auto area = spans.areaAt(rowIndex1, colIndex1);
 
     // если спанов нет — ничего не делаем
-    if (rs == 1 && cs == 1)
+    if (!area)
         return true;
+    rowIndex1 = area->row;
+    colIndex1 = area->col;
+    const int rs = area->rowSpan;
+    const int cs = area->colSpan;
 
     //  Сбрасываем span у главной ячейки
     QSqlQuery updMain(db);
@@ -774,7 +886,7 @@ bool TableManager::unmergeCells(int templateId, const QString &cellType, int row
     updMain.bindValue(":ctype", cellType);
     updMain.bindValue(":r",     rowIndex1);
     updMain.bindValue(":c",     colIndex1);
-    if (!updMain.exec()) {
+    if (!QUERY_EXEC(updMain)) {
         qDebug() << "unmergeCells(): failed to reset span on main cell:" << updMain.lastError();
         return false;
     }
@@ -796,12 +908,12 @@ bool TableManager::unmergeCells(int templateId, const QString &cellType, int row
     updInner.bindValue(":r2",    rowIndex1 + rs - 1);
     updInner.bindValue(":c1",    colIndex1);
     updInner.bindValue(":c2",    colIndex1 + cs - 1);
-    if (!updInner.exec()) {
+    if (!QUERY_EXEC(updInner)) {
         qDebug() << "unmergeCells(): failed to restore inner cells:" << updInner.lastError();
         return false;
     }
 
-    return true;
+    return tx.commit();
 }
 
 bool TableManager::cellExists(int templateId, const QString &cellType,
@@ -810,7 +922,7 @@ bool TableManager::cellExists(int templateId, const QString &cellType,
     q.prepare(R"(
         SELECT 1
         FROM   grid_cells
-        WHERE  template_id = :tid
+        WHERE  template_id = )" + TemplateManager::cellOwnerSql(":tid") + R"(
           AND  cell_type   = :ctype
           AND  row_index   = :r
           AND  col_index   = :c
@@ -820,14 +932,56 @@ bool TableManager::cellExists(int templateId, const QString &cellType,
     q.bindValue(":ctype",  cellType);
     q.bindValue(":r",      rowIndex);
     q.bindValue(":c",      colIndex);
-    if (!q.exec()) {
+    if (!QUERY_EXEC(q)) {
         qDebug() << "cellExists(): exec failed:" << q.lastError();
         return false;
     }
     return q.next();
 }
 
+bool TableManager::loadSpanIndex(int templateId, SpanIndex &out) const {
+    out.clear();
+    QSqlQuery q(db);
+    q.setForwardOnly(true);
+    q.prepare(R"(
+        SELECT row_index, col_index, row_span, col_span
+        FROM   grid_cells
+        WHERE  template_id = )" + TemplateManager::cellOwnerSql(":tid") + R"(
+          AND  (row_span > 1 OR col_span > 1))");
+    q.bindValue(":tid", templateId);
+    if (!QUERY_EXEC(q)) {
+        qDebug() << "loadSpanIndex():" << q.lastError();
+        return false;
+    }
+    while (q.next())
+        out.addSpan(q.value(0).toInt(), q.value(1).toInt(),
+                    q.value(2).toInt(), q.value(3).toInt());
+    return true;
+}
+
+bool TableManager::callEditFunction(const QString &call, const QVariantList &args) {
+    // Функции из db/migrations/004: вся правка - один запрос внутри
+    // EditTransaction; false от функции - отказ без изменений (например,
+    // частичное пересечение объединений)
+    QSqlQuery q(db);
+    q.prepare("SELECT " + call);
+    for (const QVariant &v : args)
+        q.addBindValue(v);
+    if (!QUERY_EXEC(q) || !q.next()) {
+        qDebug() << "callEditFunction():" << call << q.lastError();
+        return false;
+    }
+    return q.value(0).toBool();
+}
+
 bool TableManager::insertRow(int templateId, int beforeRow, bool addToHeader, const QString &headerContent) {
+    EditTransaction tx(db, templateId);
+    if (!tx)
+        return false;
+    if (!SqlDialect::isSqlite(db))
+        return callEditFunction("autotlg_insert_row(?, ?, ?, ?)",
+                                {templateId, beforeRow, addToHeader, headerContent}) && tx.commit(false);
+
     QSqlQuery shift(db);
     // 1) Сдвигаем все строки с row_index >= beforeRow вниз
     shift.prepare(R"(
@@ -839,7 +993,7 @@ bool TableManager::insertRow(int templateId, int beforeRow, bool addToHeader, co
     )");
     shift.bindValue(":tid", templateId);
     shift.bindValue(":pos", beforeRow);
-    if (!shift.exec()) return false;
+    if (!QUERY_EXEC(shift)) return false;
 
     while (shift.next()) {
         int oldRow = shift.value(0).toInt();
@@ -853,7 +1007,7 @@ bool TableManager::insertRow(int templateId, int beforeRow, bool addToHeader, co
         upd.bindValue(":newIdx", oldRow + 1);
         upd.bindValue(":tid",    templateId);
         upd.bindValue(":oldRow", oldRow);
-        if (!upd.exec()) return false;
+        if (!QUERY_EXEC(upd)) return false;
     }
 
     // 2) Собираем все существующие колонки
@@ -866,7 +1020,7 @@ bool TableManager::insertRow(int templateId, int beforeRow, bool addToHeader, co
         ORDER BY col_index
     )");
     colQ.bindValue(":tid", templateId);
-    if (!colQ.exec()) return false;
+    if (!QUERY_EXEC(colQ)) return false;
     while (colQ.next()) cols << colQ.value(0).toInt();
 
     // 3) Вставляем новую строку
@@ -884,12 +1038,19 @@ bool TableManager::insertRow(int templateId, int beforeRow, bool addToHeader, co
         // Для header-строки только в первом столбце вставляем текст
         QString cnt = (addToHeader && col == cols.first()) ? headerContent : QString();
         ins.bindValue(":cnt", cnt);
-        if (!ins.exec()) return false;
+        if (!QUERY_EXEC(ins)) return false;
     }
-    return true;
+    return tx.commit();
 }
 
 bool TableManager::insertColumn(int templateId, int beforeCol, const QString &headerContent) {
+    EditTransaction tx(db, templateId);
+    if (!tx)
+        return false;
+    if (!SqlDialect::isSqlite(db))
+        return callEditFunction("autotlg_insert_column(?, ?, ?)",
+                                {templateId, beforeCol, headerContent}) && tx.commit(false);
+
     QSqlQuery shift(db);
     // 1) Сдвигаем все колонки с col_index >= beforeCol вправо
     shift.prepare(R"(
@@ -901,7 +1062,7 @@ bool TableManager::insertColumn(int templateId, int beforeCol, const QString &he
     )");
     shift.bindValue(":tid", templateId);
     shift.bindValue(":pos", beforeCol);
-    if (!shift.exec()) return false;
+    if (!QUERY_EXEC(shift)) return false;
 
     while (shift.next()) {
         int oldCol = shift.value(0).toInt();
@@ -915,7 +1076,7 @@ bool TableManager::insertColumn(int templateId, int beforeCol, const QString &he
         upd.bindValue(":newIdx", oldCol + 1);
         upd.bindValue(":tid",    templateId);
         upd.bindValue(":oldCol", oldCol);
-        if (!upd.exec()) return false;
+        if (!QUERY_EXEC(upd)) return false;
     }
 
     // 2) Собираем все строки, чтобы вставить в каждую новую ячейку
@@ -929,7 +1090,7 @@ bool TableManager::insertColumn(int templateId, int beforeCol, const QString &he
         ORDER BY row_index
     )");
     refQ.bindValue(":tid", templateId);
-    if (!refQ.exec()) return false;
+    if (!QUERY_EXEC(refQ)) return false;
     while (refQ.next())
         rowType[refQ.value(0).toInt()] = refQ.value(1).toString();
 
@@ -950,7 +1111,7 @@ bool TableManager::insertColumn(int templateId, int beforeCol, const QString &he
         // Если это первая header-ячейка, ставим текст
         bool firstHdr = (type == "header" && row == rowType.firstKey());
         ins.bindValue(":cnt", firstHdr ? headerContent : QString());
-        if (!ins.exec()) return false;
+        if (!QUERY_EXEC(ins)) return false;
     }
-    return true;
+    return tx.commit();
 }
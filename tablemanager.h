@@ -3,6 +3,9 @@
 
 #include <optional>
 #include <QSqlDatabase>
+#include <QPair>
+#include "templatemanager.h"
+#include "spanindex.h"
 
 class TableManager {
 public:
@@ -18,11 +21,18 @@ public:
     int getColCountForHeader(int templateId);
 
     bool updateCellColour(int templateId, int rowIndex, int colIndex, const QString &colour);
-
-    bool saveDataTableTemplate(int templateId,
-                               const std::optional<QVector<QString>>& headers,
-                               const std::optional<QVector<QVector<QString>>> &cellData,
-                               const std::optional<QVector<QVector<QString>>> &cellColours);
+    // Цвет ячеек (row_index, col_index) одной транзакцией, без перезаписи
+    // таблицы; expectedVersion - как у saveDataTableTemplate
+    WriteResult updateCellColours(int templateId, const QVector<QPair<int, int>> &cells,
+                                  const QString &colour, std::optional<int> expectedVersion = std::nullopt);
+
+    // Полная перезапись ячеек шаблона. С expectedVersion запись выполняется,
+    // только если шаблон не менялся с этой версии, иначе WriteStatus::Conflict
+    WriteResult saveDataTableTemplate(int templateId,
+                                      const std::optional<QVector<QString>>& headers,
+                                      const std::optional<QVector<QVector<QString>>> &cellData,
+                                      const std::optional<QVector<QVector<QString>>> &cellColours,
+                                      std::optional<int> expectedVersion = std::nullopt);
 
     bool generateColumnsForDynamicTemplate(int templateId, const QVector<QString>& groupNames);
 
@@ -38,6 +48,11 @@ public:
     bool insertColumn(int templateId, int beforeCol, const QString &headerContent = "");
 
 private:
+    // Структурная правка хранимой функцией PostgreSQL; SQLite идёт по C++ пути
+    bool callEditFunction(const QString &call, const QVariantList &args);
+    // Объединения шаблона из grid_cells (координаты базы, 1-based)
+    bool loadSpanIndex(int templateId, SpanIndex &out) const;
+
     QSqlDatabase &db;
 };
 
@@ -0,0 +1,224 @@
+#include "tablesizer.h"
+#include "gridstore.h"
+#include "htmlscanner.h"
+#include "richtextdelegate.h"
+#include <QTableView>
+#include <QHeaderView>
+#include <QScrollBar>
+#include <QEvent>
+#include <QSet>
+#include <QPair>
+
+namespace {
+
+// Строк содержимого, по которым решается, одинаковы ли строки таблицы
+constexpr int kUniformSampleRows = 32;
+// Строк под заголовком, по которым подбирается ширина столбца
+constexpr int kColumnSampleRows = 200;
+
+} // namespace
+
+TableSizer::TableSizer(QTableView *view)
+    : QObject(view), view(view) {
+    measureTimer.setSingleShot(true);
+    measureTimer.setInterval(0);
+    connect(&measureTimer, &QTimer::timeout, this, &TableSizer::measureVisible);
+
+    connect(view->verticalScrollBar(), &QScrollBar::valueChanged, this, &TableSizer::scheduleMeasure);
+    connect(view->verticalScrollBar(), &QScrollBar::rangeChanged, this, &TableSizer::scheduleMeasure);
+    view->viewport()->installEventFilter(this);
+
+    // Строку, которую пользователь растянул сам, больше не меряем и не оцениваем
+    connect(view->verticalHeader(), &QHeaderView::sectionResized, this, [this](int row, int, int) {
+        if (sizing || row < 0 || row >= fixed.size())
+            return;
+        fixed[row] = true;
+        if (pending[row]) {
+            pending[row] = false;
+            --pendingCount;
+        }
+    });
+}
+
+int TableSizer::estimateLines(QStringView html) {
+    if (html.isEmpty())
+        return 1;
+    return int(HtmlScanner::plainText(html).count(QLatin1Char('\n'))) + 1;
+}
+
+int TableSizer::lineHeight() const {
+    // Ширина как у делегата без переноса по словам: вся таблица (см. sizeHint)
+    return RichTextDelegate::documentSize(QStringLiteral("Xg"), view->width()).height()
+           + (view->showGrid() ? 1 : 0);
+}
+
+bool TableSizer::estimateRange(int firstRow, const GridStore &rows) {
+    const int nC = rows.columnCount();
+    const int end = qMin(int(lines.size()), firstRow + rows.rowCount());
+
+    // Текст объединения по вертикали делится между строками - в оценку не идёт
+    QSet<QPair<int, int>> tall;
+    for (const SpanIndex::Area &a : rows.spans())
+        if (a.rowSpan > 1)
+            tall.insert({a.row, a.col});
+
+    bool singleLine = true;
+    for (int r = qMax(0, firstRow); r < end; ++r) {
+        const int local = r - firstRow;
+        int n = 1;
+        for (int c = 0; c < nC; ++c) {
+            if (rows.isCovered(local, c) || tall.contains({local, c}))
+                continue;
+            n = qMax(n, estimateLines(rows.textView(local, c)));
+        }
+        lines[r] = n;
+        if (r >= headerRows && n > 1)
+            singleLine = false;
+    }
+    return singleLine;
+}
+
+void TableSizer::prepare(const GridStore &grid, int rowCount, int headerRows) {
+    const int nR = qMin(grid.rowCount(), rowCount);
+    const int nC = grid.columnCount();
+    this->headerRows = qMax(0, headerRows);
+    lines = QVector<int>(rowCount, 1);
+    pending.clear();
+    fixed.clear();
+    pendingCount = 0;
+
+    uniform = estimateRange(0, grid);
+
+    // Быстрый путь: первые строки содержимого одной высоты - её и берём для всех
+    const int gridLine = view->showGrid() ? 1 : 0;
+    const int width = view->width();
+    int sampleHeight = -1;
+    const int sampleEnd = qMin(nR, this->headerRows + kUniformSampleRows);
+    for (int r = this->headerRows; r < sampleEnd && uniform; ++r) {
+        int h = 0;
+        for (int c = 0; c < nC; ++c) {
+            if (!grid.isCovered(r, c))
+                h = qMax(h, RichTextDelegate::documentSize(grid.text(r, c), width).height());
+        }
+        if (sampleHeight < 0)
+            sampleHeight = h;
+        else if (h != sampleHeight)
+            uniform = false;
+    }
+    uniform = uniform && sampleHeight > 0;
+    rowHeight = uniform ? sampleHeight + gridLine : lineHeight();
+
+    // Строк ещё нет: setDefaultSectionSize не проходит по 20 тысячам секций
+    QHeaderView *vh = view->verticalHeader();
+    sizing = true;
+    vh->setDefaultSectionSize(qMax(rowHeight, vh->minimumSectionSize()));
+    sizing = false;
+}
+
+void TableSizer::apply(const QVector<int> &fixedHeights) {
+    const int nR = qMin(int(lines.size()), view->model() ? view->model()->rowCount() : 0);
+    const int line = uniform ? lineHeight() : rowHeight;
+    pending = QVector<bool>(nR, false);
+    fixed = QVector<bool>(nR, false);
+    pendingCount = 0;
+
+    sizing = true;
+    for (int r = 0; r < nR; ++r) {
+        if (r < fixedHeights.size() && fixedHeights[r] > 0) {
+            view->setRowHeight(r, fixedHeights[r]);
+            fixed[r] = true;
+            continue;
+        }
+        if (uniform && r >= headerRows)
+            continue;                               // высота по умолчанию уже точная
+        if (lines[r] > 1)
+            view->setRowHeight(r, line * lines[r]);
+        pending[r] = true;
+        ++pendingCount;
+    }
+    sizing = false;
+    scheduleMeasure();
+}
+
+void TableSizer::estimateRows(int firstRow, const GridStore &rows) {
+    estimateRange(firstRow, rows);
+
+    // Однострочные строки однородной таблицы остаются с высотой по умолчанию,
+    // прочие получают оценку и ждут замера
+    const int line = uniform ? lineHeight() : rowHeight;
+    const int end = qMin(int(pending.size()), firstRow + rows.rowCount());
+    sizing = true;
+    for (int r = qMax(0, firstRow); r < end; ++r) {
+        if (fixed[r] || (uniform && r >= headerRows && lines[r] == 1))
+            continue;
+        if (lines[r] > 1)
+            view->setRowHeight(r, line * lines[r]);
+        if (!pending[r]) {
+            pending[r] = true;
+            ++pendingCount;
+        }
+    }
+    sizing = false;
+    scheduleMeasure();
+}
+
+int TableSizer::fitColumn(int col) const {
+    const QAbstractItemModel *model = view->model();
+    if (!model)
+        return 0;
+    const int end = qMin(model->rowCount(), headerRows + kColumnSampleRows);
+    const int width = view->width();
+    int w = 0;
+    for (int r = 0; r < end; ++r) {
+        if (view->columnSpan(r, col) > 1)       // текст объединения делится между столбцами
+            continue;
+        const QString html = model->index(r, col).data(Qt::DisplayRole).toString();
+        if (!html.isEmpty())
+            w = qMax(w, RichTextDelegate::documentSize(html, width).width());
+    }
+    return w + (view->showGrid() ? 1 : 0);
+}
+
+bool TableSizer::eventFilter(QObject *obj, QEvent *event) {
+    if (obj == view->viewport() && (event->type() == QEvent::Resize || event->type() == QEvent::Show))
+        scheduleMeasure();
+    return QObject::eventFilter(obj, event);
+}
+
+void TableSizer::scheduleMeasure() {
+    if (pendingCount > 0 && !measureTimer.isActive())
+        measureTimer.start();
+}
+
+void TableSizer::measureVisible() {
+    if (pendingCount == 0 || !view->isVisible() || !view->model())
+        return;
+    const int nR = qMin(int(pending.size()), view->model()->rowCount());
+    if (nR == 0)
+        return;
+
+    int top = view->rowAt(0);
+    if (top < 0)
+        top = 0;
+    int bottom = view->rowAt(view->viewport()->height() - 1);
+    if (bottom < 0)
+        bottom = nR - 1;
+    // Запас в полэкрана: следующие строки прокрутки уже измерены
+    bottom = qMin(nR - 1, bottom + (bottom - top + 1) / 2);
+
+    bool measured = false;
+    sizing = true;
+    for (int r = top; r <= bottom; ++r) {
+        if (!pending[r])
+            continue;
+        view->resizeRowToContents(r);
+        pending[r] = false;
+        --pendingCount;
+        measured = true;
+    }
+    sizing = false;
+
+    // Строки могли стать ниже оценки - в окно попали новые
+    if (measured)
+        scheduleMeasure();
+}
@@ -0,0 +1,65 @@
+#ifndef TABLESIZER_H
+#define TABLESIZER_H
+
+#include <QObject>
+#include <QVector>
+#include <QTimer>
+#include <QStringView>
+
+class QTableView;
+class GridStore;
+
+// Размеры строк и столбцов большой таблицы без замера всех ячеек при загрузке.
+//
+// Высота строки по умолчанию задаётся до создания строк, поэтому обычные
+// строки собственного размера не получают. Если все строки содержимого
+// однострочные и одинаковые по первым строкам (типичный листинг), замеров
+// дальше нет вовсе. Иначе многострочным строкам ставится оценка по числу
+// абзацев, а точная высота меряется делегатом, когда строка становится
+// видимой. Ширина столбца - по заголовку и первым строкам, а не по всем.
+// Высоты, заданные пользователем, не трогаются
+class TableSizer : public QObject {
+    Q_OBJECT
+public:
+    explicit TableSizer(QTableView *view);
+
+    // До создания строк (в таблице 0 строк): оценки по первым строкам rows
+    // таблицы из rowCount строк и высота по умолчанию
+    void prepare(const GridStore &rows, int rowCount, int headerRows);
+    // После заполнения: высоты пользователя (<= 0 - нет) и оценки, замер видимых строк
+    void apply(const QVector<int> &fixedHeights);
+    // Догруженные строки [firstRow, firstRow + rows.rowCount()): оценки и замер при показе
+    void estimateRows(int firstRow, const GridStore &rows);
+
+    // Ширина столбца по содержимому заголовка и первых строк
+    int fitColumn(int col) const;
+
+    // Размеры меняет сам sizer - это не правка пользователя
+    bool isSizing() const { return sizing; }
+
+    // Число строк текста в HTML ячейки - по абзацам и переносам, без разбора документа
+    static int estimateLines(QStringView html);
+
+protected:
+    bool eventFilter(QObject *obj, QEvent *event) override;
+
+private:
+    void scheduleMeasure();
+    void measureVisible();
+    int  lineHeight() const;
+    // Оценки строк rows с firstRow; false - среди строк содержимого есть многострочные
+    bool estimateRange(int firstRow, const GridStore &rows);
+
+    QTableView *view;
+    QVector<int>  lines;        // оценка строк текста по строкам таблицы
+    QVector<bool> pending;      // оценка ещё не заменена замером
+    QVector<bool> fixed;        // высота задана пользователем
+    int  pendingCount = 0;
+    int  headerRows = 0;
+    int  rowHeight = 0;         // высота по умолчанию
+    bool uniform = false;
+    bool sizing = false;
+    QTimer measureTimer;
+};
+
+#endif // TABLESIZER_H
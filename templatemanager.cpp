@@ -1,8 +1,32 @@
 #include "templatemanager.h"
+#include "querystats.h"
+#include "sqldialect.h"
+#include "blobreader.h"
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QColor>
 #include <optional>
+#include <algorithm>
+
+namespace {
+
+// Цвет ячейки из базы; разных цветов в таблице единицы - разбор кэшируется
+QRgb cachedColour(QHash<QString, QRgb> &cache, const QString &clr) {
+    auto it = cache.constFind(clr);
+    if (it == cache.cend()) {
+        const QColor parsed(clr);
+        it = cache.insert(clr, parsed.isValid() ? parsed.rgba() : GridStore::DefaultColour);
+    }
+    return *it;
+}
+
+// Плотный номер строки или столбца по индексу из базы; -1, если такого нет
+int denseIndex(const QVector<int> &indexes, int value) {
+    const auto it = std::lower_bound(indexes.cbegin(), indexes.cend(), value);
+    return (it != indexes.cend() && *it == value) ? int(it - indexes.cbegin()) : -1;
+}
+
+} // namespace
 
 TemplateManager::TemplateManager(QSqlDatabase &db) : db(db) {}
 TemplateManager::~TemplateManager() {}
@@ -14,7 +38,7 @@ bool TemplateManager::createTemplate(int categoryId, const QString &templateName
     query.prepare("SELECT 1 FROM category WHERE category_id = :categoryId");
     query.bindValue(":categoryId", categoryId);
 
-    if (!query.exec() || !query.next()) {
+    if (!QUERY_EXEC(query) || !query.next()) {
         qDebug() << "Ошибка: категория с ID" << categoryId << "не существует.";
         return false;
     }
@@ -26,7 +50,7 @@ bool TemplateManager::createTemplate(int categoryId, const QString &templateName
                   ") AS combined");
     query.bindValue(":categoryId", categoryId);
 
-    if (!query.exec() || !query.next()) {
+    if (!QUERY_EXEC(query) || !query.next()) {
         qDebug() << "Ошибка получения максимального position:" << query.lastError();
         return false;
     }
@@ -38,19 +62,19 @@ bool TemplateManager::createTemplate(int categoryId, const QString &templateName
     query.prepare(R"(
         INSERT INTO template (category_id, name, subtitle, position, notes, programming_notes, template_type, is_dynamic)
         VALUES (:categoryId, :name,  '', :position, '', '', :templateType, :isDynamic)
-    )");
+    )" + SqlDialect::returningId("template_id"));
     query.bindValue(":categoryId", categoryId);
     query.bindValue(":name",        templateName);
     query.bindValue(":position",    newPosition);
     query.bindValue(":templateType", templateType);
     query.bindValue(":isDynamic", isDynDefault);
 
-    if (!query.exec()) {
+    if (!QUERY_EXEC(query)) {
         qDebug() << "Ошибка добавления шаблона в базу данных:" << query.lastError();
         return false;
     }
 
-    lastCreatedTemplateId = query.lastInsertId().toInt();
+    lastCreatedTemplateId = SqlDialect::insertedId(query);
 
     qDebug() << "Шаблон" << templateName << "успешно создан с ID категории" << categoryId;
     return true;
@@ -72,12 +96,13 @@ bool TemplateManager::duplicateTemplate(int srcId, const QString &newName, int &
                subtitle,
                notes,
                programming_notes,
-               is_dynamic
+               is_dynamic,
+               COALESCE(content_source_id, template_id)
         FROM   template
         WHERE  template_id = ?
     )");
     q.addBindValue(srcId);
-    if (!q.exec() || !q.next()) {
+    if (!QUERY_EXEC(q) || !q.next()) {
         qDebug() << "duplicateTemplate: исходный шаблон не найден или ошибка:" << q.lastError();
         db.rollback();
         return false;
@@ -90,46 +115,32 @@ bool TemplateManager::duplicateTemplate(int srcId, const QString &newName, int &
     QString notes   = q.value(4).toString();
     QString progNt  = q.value(5).toString();
     bool    isDyn   = q.value(6).toBool();
-
-    //  сдвигаем все шаблоны с position > posSrc в этой категории (DESC!)
-    QSqlQuery sel(db);
-    sel.prepare(R"(
-        SELECT template_id, position
-        FROM   template
-        WHERE  category_id = ?
-          AND  position    > ?
-        ORDER  BY position DESC
-    )");
-    sel.addBindValue(catId);
-    sel.addBindValue(posSrc);
-    if (!sel.exec()) {
-        qDebug() << "duplicateTemplate: не удалось выбрать шаблоны для сдвига:" << sel.lastError();
+    int     owner   = q.value(7).toInt();       // чьи ячейки у источника
+    const bool grid = (tType == "table" || tType == "listing");
+
+    //  сдвигаем все шаблоны с position > posSrc в этой категории одним UPDATE
+    QSqlQuery shift(db);
+    shift.prepare("UPDATE template SET position = position + 1 "
+                  "WHERE category_id = ? AND position > ?");
+    shift.addBindValue(catId);
+    shift.addBindValue(posSrc);
+    if (!QUERY_EXEC(shift)) {
+        qDebug() << "duplicateTemplate: ошибка сдвига шаблонов:" << shift.lastError();
         db.rollback();
         return false;
     }
-    while (sel.next()) {
-        int id  = sel.value(0).toInt();
-        int pos = sel.value(1).toInt();
-        QSqlQuery upd(db);
-        upd.prepare("UPDATE template SET position = ? WHERE template_id = ?");
-        upd.addBindValue(pos + 1);
-        upd.addBindValue(id);
-        if (!upd.exec()) {
-            qDebug() << "duplicateTemplate: ошибка сдвига шаблона" << id << upd.lastError();
-            db.rollback();
-            return false;
-        }
-    }
 
-    //  вставляем копию «шапки» сразу после оригинала
+    //  вставляем копию «шапки» сразу после оригинала.
+    //  Ячейки не копируются: копия ссылается на их владельца (миграция 008)
+    //  и получит свои при первой записи - см. materializeContent
     QSqlQuery ins(db);
     ins.prepare(R"(
         INSERT INTO template
             (category_id, name, subtitle,
              position, notes, programming_notes,
-             template_type, is_dynamic)
-        VALUES(?,?,?,?,?,?,?,?)
-    )");
+             template_type, is_dynamic, content_source_id)
+        VALUES(?,?,?,?,?,?,?,?,?)
+    )" + SqlDialect::returningId("template_id"));
     ins.addBindValue(catId);
     ins.addBindValue(newName);
     ins.addBindValue(subT);
@@ -138,35 +149,16 @@ bool TemplateManager::duplicateTemplate(int srcId, const QString &newName, int &
     ins.addBindValue(progNt);
     ins.addBindValue(tType);
     ins.addBindValue(isDyn);
-    if (!ins.exec()) {
+    ins.addBindValue(grid ? QVariant(owner) : QVariant(QMetaType::fromType<int>()));
+    if (!QUERY_EXEC(ins)) {
         qDebug() << "duplicateTemplate: не удалось вставить новый шаблон:" << ins.lastError();
         db.rollback();
         return false;
     }
-    newId = ins.lastInsertId().toInt();
+    newId = SqlDialect::insertedId(ins);
 
-    //  копируем содержимое: либо grid_cells, либо graph
-    if (tType == "table" || tType == "listing") {
-        QSqlQuery cp(db);
-        cp.prepare(R"(
-            INSERT INTO grid_cells
-                (template_id, cell_type, row_index, col_index,
-                 content, colour, row_span, col_span)
-            SELECT
-                ?, cell_type, row_index, col_index,
-                content, colour, row_span, col_span
-            FROM grid_cells
-            WHERE template_id = ?
-        )");
-        cp.addBindValue(newId);
-        cp.addBindValue(srcId);
-        if (!cp.exec()) {
-            qDebug() << "duplicateTemplate: не удалось скопировать grid_cells:" << cp.lastError();
-            db.rollback();
-            return false;
-        }
-    }
-    else if (tType == "graph") {
+    //  график копируется сразу: это одна строка
+    if (tType == "graph") {
         QSqlQuery cp(db);
         cp.prepare(R"(
             INSERT INTO graph
@@ -178,7 +170,7 @@ bool TemplateManager::duplicateTemplate(int srcId, const QString &newName, int &
         )");
         cp.addBindValue(newId);
         cp.addBindValue(srcId);
-        if (!cp.exec()) {
+        if (!QUERY_EXEC(cp)) {
             qDebug() << "duplicateTemplate: не удалось скопировать graph:" << cp.lastError();
             db.rollback();
             return false;
@@ -232,7 +224,7 @@ bool TemplateManager::updateTemplate(int templateId,
     query.bindValue(":templateId", templateId);
 
     // Выполнение запроса
-    if (!query.exec()) {
+    if (!QUERY_EXEC(query)) {
         qDebug() << "Ошибка обновления шаблона:" << query.lastError();
         return false;
     }
@@ -240,132 +232,151 @@ bool TemplateManager::updateTemplate(int templateId,
     return true;
 }
 
+WriteResult TemplateManager::updateTemplate(int templateId, int expectedVersion,
+                                            const std::optional<QString> &subtitle,
+                                            const std::optional<QString> &notes,
+                                            const std::optional<QString> &programmingNotes) {
+    if (!db.transaction()) {
+        qDebug() << "updateTemplate(): cannot start tx" << db.lastError();
+        return {};
+    }
+
+    WriteResult res = claimVersion(db, templateId, expectedVersion);
+    if (!res) {
+        db.rollback();
+        return res;
+    }
+
+    if ((subtitle || notes || programmingNotes)
+        && !updateTemplate(templateId, std::nullopt, subtitle, notes, programmingNotes)) {
+        db.rollback();
+        return {};
+    }
+
+    if (!db.commit()) {
+        qDebug() << "updateTemplate(): commit fail" << db.lastError();
+        db.rollback();
+        return {};
+    }
+    return res;
+}
+
 bool TemplateManager::deleteTemplate(int templateId) {
+    //  Всё удаление - одна транзакция: ячейки не теряются и не остаются сиротами
+    if (!db.transaction()) {
+        qDebug() << "deleteTemplate(): cannot start tx" << db.lastError();
+        return false;
+    }
+    auto fail = [&]() {
+        db.rollback();
+        return false;
+    };
+
     //  Выясняем, какой это тип шаблона
     QSqlQuery typeQuery(db);
     typeQuery.prepare("SELECT template_type FROM template WHERE template_id = :templateId");
     typeQuery.bindValue(":templateId", templateId);
 
-    if (!typeQuery.exec() || !typeQuery.next()) {
+    if (!QUERY_EXEC(typeQuery) || !typeQuery.next()) {
         qDebug() << "Ошибка: шаблон с ID" << templateId << "не найден или нет поля template_type";
-        return false;
+        return fail();
     }
     QString tmplType = typeQuery.value(0).toString();
 
     // Удаляем связанные данные в зависимости от типа
     if (tmplType == "table" || tmplType == "listing") {
+        // Копии, читающие ячейки шаблона, забирают их себе. Сам шаблон чужие
+        // ячейки не копирует: у копии своих нет, удалять нечего
+        if (!releaseContent(db, templateId))
+            return fail();
         QSqlQuery query(db);
         query.prepare("DELETE FROM grid_cells WHERE template_id = :templateId");
         query.bindValue(":templateId", templateId);
-        if (!query.exec()) {
+        if (!QUERY_EXEC(query)) {
             qDebug() << "Ошибка удаления ячеек из grid_cells:" << query.lastError().text();
-            return false;
+            return fail();
         }
     } else if (tmplType == "graph") {
         QSqlQuery query(db);
         query.prepare("DELETE FROM graph WHERE template_id = :templateId");
         query.bindValue(":templateId", templateId);
-        if (!query.exec()) {
+        if (!QUERY_EXEC(query)) {
             qDebug() << "Ошибка удаления данных из graph:" << query.lastError();
-            return false;
+            return fail();
         }
     }
 
     QSqlQuery delTemplate(db);
     delTemplate.prepare("DELETE FROM template WHERE template_id = :templateId");
     delTemplate.bindValue(":templateId", templateId);
-    if (!delTemplate.exec()) {
+    if (!QUERY_EXEC(delTemplate)) {
         qDebug() << "Ошибка удаления шаблона (из template):" << delTemplate.lastError();
-        return false;
+        return fail();
     }
 
+    if (!db.commit()) {
+        qDebug() << "deleteTemplate(): commit fail" << db.lastError();
+        return fail();
+    }
     return true;
 }
 
 bool TemplateManager::copyGraphFromLibrary(const QString &graphTypeKey, int newTemplateId) {
-    // 1) Находим «эталонный» граф в graph_library,
-    //    где graph_type = :graphTypeKey (graph_type является PK)
-    QSqlQuery libQuery(db);
-    libQuery.prepare(R"(
-        SELECT name, graph_type, image
-        FROM graph_library
-        WHERE graph_type = :gType
-    )");
-    libQuery.bindValue(":gType", graphTypeKey);
-
-    if (!libQuery.exec() || !libQuery.next()) {
-        qDebug() << "Ошибка: не найден граф с graph_type =" << graphTypeKey
-                 << "в таблице graph_library, либо ошибка запроса:"
-                 << libQuery.lastError();
-        return false;
-    }
-
-    // Извлекаем данные из найденной записи
-    QString baseName    = libQuery.value("name").toString();
-    QString baseGType   = libQuery.value("graph_type").toString(); // совпадает с graphTypeKey
-    QByteArray baseBlob = libQuery.value("image").toByteArray();
-
-    // 2) Вставляем «копию» этого графика в таблицу graph,
-    //    привязывая её к существующему template_id
+    // Копия «эталонного» графика из graph_library (graph_type является PK)
+    // делается на сервере: изображение не проходит через клиента
     QSqlQuery insertQ(db);
     insertQ.prepare(R"(
         INSERT INTO graph (template_id, name, graph_type, image)
-        VALUES (:tid, :nm, :gt, :img)
+        SELECT :tid, name, graph_type, image
+        FROM graph_library
+        WHERE graph_type = :gType
     )");
-    insertQ.bindValue(":tid", newTemplateId);
-    insertQ.bindValue(":nm",  baseName);
-    insertQ.bindValue(":gt",  baseGType);
-    insertQ.bindValue(":img", baseBlob);
+    insertQ.bindValue(":tid",   newTemplateId);
+    insertQ.bindValue(":gType", graphTypeKey);
 
-    if (!insertQ.exec()) {
+    if (!QUERY_EXEC(insertQ)) {
         qDebug() << "Ошибка вставки копии графика в таблицу 'graph':"
                  << insertQ.lastError();
         return false;
     }
+    if (insertQ.numRowsAffected() == 0) {
+        qDebug() << "Ошибка: не найден граф с graph_type =" << graphTypeKey
+                 << "в таблице graph_library";
+        return false;
+    }
 
     return true;
 }
 
 bool TemplateManager::updateGraphFromLibrary(const QString &graphTypeKey, int templateId) {
-    //  Ищем нужный «эталон» в graph_library
-    QSqlQuery libQuery(db);
-    libQuery.prepare(R"(
-        SELECT name, graph_type, image
-        FROM graph_library
-        WHERE graph_type = :gType
-    )");
-    libQuery.bindValue(":gType", graphTypeKey);
-
-    if (!libQuery.exec() || !libQuery.next()) {
-        qDebug() << "Ошибка: не найдено graph_type =" << graphTypeKey
-                 << "в graph_library. Err:" << libQuery.lastError();
-        return false;
-    }
-
-    QString newName  = libQuery.value("name").toString();
-    QString newGType = libQuery.value("graph_type").toString();
-    QByteArray newImg= libQuery.value("image").toByteArray();
-
-    //  Обновляем текущую запись в graph
+    //  Обновляем текущую запись в graph из «эталона» в graph_library,
+    //  изображение копируется на сервере
     QSqlQuery updQ(db);
     updQ.prepare(R"(
         UPDATE graph
-        SET name = :nm,
-            graph_type = :gt,
-            image = :img
+        SET name       = (SELECT l.name  FROM graph_library l WHERE l.graph_type = :gt1),
+            graph_type = :gt2,
+            image      = (SELECT l.image FROM graph_library l WHERE l.graph_type = :gt3)
         WHERE template_id = :tid
+          AND EXISTS (SELECT 1 FROM graph_library l WHERE l.graph_type = :gt4)
     )");
-    updQ.bindValue(":nm", newName);
-    updQ.bindValue(":gt", newGType);
-    updQ.bindValue(":img", newImg);
+    updQ.bindValue(":gt1", graphTypeKey);
+    updQ.bindValue(":gt2", graphTypeKey);
+    updQ.bindValue(":gt3", graphTypeKey);
+    updQ.bindValue(":gt4", graphTypeKey);
     updQ.bindValue(":tid", templateId);
 
-    if (!updQ.exec()) {
+    if (!QUERY_EXEC(updQ)) {
         qDebug() << "Ошибка UPDATE graph:" << updQ.lastError();
         return false;
     }
+    if (updQ.numRowsAffected() == 0) {
+        qDebug() << "Ошибка: не найдено graph_type =" << graphTypeKey
+                 << "в graph_library или графика шаблона" << templateId;
+        return false;
+    }
 
-    return true;
+    return static_cast<bool>(claimVersion(db, templateId));
 }
 
 bool TemplateManager::setTemplateDynamic(int templateId, bool dynamic) {
@@ -374,7 +385,7 @@ bool TemplateManager::setTemplateDynamic(int templateId, bool dynamic) {
     query.bindValue(":dyn", dynamic);
     query.bindValue(":tid", templateId);
 
-    if (!query.exec()) {
+    if (!QUERY_EXEC(query)) {
         qDebug() << "Ошибка обновления is_dynamic:" << query.lastError().text();
         return false;
     }
@@ -386,7 +397,7 @@ bool TemplateManager::isTemplateDynamic(int templateId) const {
     query.prepare("SELECT is_dynamic FROM template WHERE template_id = :tid");
     query.bindValue(":tid", templateId);
 
-    if (!query.exec() || !query.next()) {
+    if (!QUERY_EXEC(query) || !query.next()) {
         qDebug() << "Ошибка чтения is_dynamic:" << query.lastError().text();
         return false; // по умолчанию
     }
@@ -398,7 +409,7 @@ bool TemplateManager::setTemplateApproved(int templateId, bool approved) {
     q.prepare("UPDATE template SET approved = :appr WHERE template_id = :tid");
     q.bindValue(":appr", approved);
     q.bindValue(":tid", templateId);
-    if (!q.exec()) {
+    if (!QUERY_EXEC(q)) {
         qDebug() << "Ошибка обновления approved:" << q.lastError().text();
         return false;
     }
@@ -409,7 +420,7 @@ bool TemplateManager::isTemplateApproved(int templateId) const {
     QSqlQuery q(db);
     q.prepare("SELECT approved FROM template WHERE template_id = :tid");
     q.bindValue(":tid", templateId);
-    if (!q.exec() || !q.next()) {
+    if (!QUERY_EXEC(q) || !q.next()) {
         qDebug() << "Ошибка чтения approved:" << q.lastError().text();
         return false; // по умолчанию
     }
@@ -424,7 +435,7 @@ bool TemplateManager::updateTemplateCategory(int templateId, int newCategoryId)
     else
         q.bindValue(":newCat", newCategoryId);
     q.bindValue(":tid", templateId);
-    if (!q.exec()) {
+    if (!QUERY_EXEC(q)) {
         qDebug() << "Ошибка обновления категории шаблона:" << q.lastError();
         return false;
     }
@@ -436,7 +447,7 @@ bool TemplateManager::updateTemplatePosition(int templateId, int position) {
     query.prepare("UPDATE template SET position = :position WHERE template_id = :id");
     query.bindValue(":position", position);
     query.bindValue(":id",       templateId);
-    if (!query.exec()) {
+    if (!QUERY_EXEC(query)) {
         qDebug() << "Ошибка обновления позиции шаблона:" << query.lastError();
         return false;
     }
@@ -455,7 +466,7 @@ QVector<int> TemplateManager::getDynamicTemplatesForProject(int projectId) {
         );
     query.addBindValue(projectId);
 
-    if (!query.exec()) {
+    if (!QUERY_EXEC(query)) {
         qDebug() << "Ошибка загрузки динамических шаблонов проекта:" << query.lastError();
         return templateIds;
     }
@@ -468,6 +479,37 @@ QVector<int> TemplateManager::getDynamicTemplatesForProject(int projectId) {
 
 }
 
+QVector<TemplateNode> TemplateManager::getTemplateNodesForProject(int projectId) const {
+    QVector<TemplateNode> nodes;
+    QSqlQuery query(db);
+    query.prepare(
+        "SELECT t.template_id, t.category_id, t.name, t.position, t.template_type, "
+        "t.is_dynamic, t.approved "
+        "FROM template t "
+        "JOIN category c ON t.category_id = c.category_id "
+        "WHERE c.project_id = ?"
+        );
+    query.addBindValue(projectId);
+
+    if (!QUERY_EXEC(query)) {
+        qDebug() << "Ошибка загрузки шаблонов проекта:" << query.lastError().text();
+        return nodes;
+    }
+
+    while (query.next()) {
+        TemplateNode n;
+        n.templateId   = query.value(0).toInt();
+        n.categoryId   = query.value(1).toInt();
+        n.name         = query.value(2).toString();
+        n.position     = query.value(3).toInt();
+        n.templateType = query.value(4).toString();
+        n.dynamic      = query.value(5).toBool();
+        n.approved     = query.value(6).toBool();
+        nodes.append(n);
+    }
+    return nodes;
+}
+
 QVector<Template> TemplateManager::getTemplatesForCategory(int categoryId) {
     QVector<Template> templates;
     QSqlQuery query(db);
@@ -475,7 +517,7 @@ QVector<Template> TemplateManager::getTemplatesForCategory(int categoryId) {
                   "FROM template WHERE category_id = :categoryId ORDER BY position");
     query.bindValue(":categoryId", categoryId);
 
-    if (!query.exec()) {
+    if (!QUERY_EXEC(query)) {
         qDebug() << "Ошибка получения шаблонов для категории:" << query.lastError();
         return templates;
     }
@@ -494,81 +536,399 @@ QVector<Template> TemplateManager::getTemplatesForCategory(int categoryId) {
     return templates;
 }
 
-TableMatrix TemplateManager::getTableData(int templateId) {
-    TableMatrix table;                              // результат
+std::optional<Template> TemplateManager::getTemplate(int templateId) const {
+    QSqlQuery query(db);
+    query.prepare("SELECT template_id, name, subtitle, notes, programming_notes, position, category_id "
+                  "FROM template WHERE template_id = :tid");
+    query.bindValue(":tid", templateId);
+    if (!QUERY_EXEC(query)) {
+        qDebug() << "Ошибка получения шаблона:" << query.lastError();
+        return std::nullopt;
+    }
+    if (!query.next())
+        return std::nullopt;
+
+    return Template{
+        query.value(0).toInt(),
+        query.value(1).toString(),
+        query.value(2).toString(),
+        query.value(3).toString(),
+        query.value(4).toString(),
+        query.value(5).toInt(),
+        query.value(6).toInt()
+    };
+}
 
-    /* ---------- 1. формируем списки уникальных строк/столбцов ------ */
-    QVector<int> rows, cols;
-    {
-        QSqlQuery q(db);
-        q.prepare("SELECT DISTINCT row_index FROM grid_cells "
-                  "WHERE template_id = :tid ORDER BY row_index");
-        q.bindValue(":tid", templateId);
-        if (q.exec())
-            while (q.next()) rows << q.value(0).toInt();
+GridStore TemplateManager::getTableData(int templateId) {
+    GridStore grid;
+
+    /* ---------- 1. размеры: число различных строк и столбцов ---------- */
+    QSqlQuery dims(db);
+    dims.prepare("SELECT COUNT(DISTINCT row_index), COUNT(DISTINCT col_index), "
+                 "COALESCE(SUM(LENGTH(content)), 0) "
+                 "FROM grid_cells WHERE template_id = " + cellOwnerSql(":tid"));
+    dims.bindValue(":tid", templateId);
+    if (!QUERY_EXEC(dims) || !dims.next()) {
+        qDebug() << "getTableData(): dims query failed" << dims.lastError();
+        return grid;
+    }
+    const int nR = dims.value(0).toInt();
+    const int nC = dims.value(1).toInt();
+    if (nR == 0 || nC == 0)
+        return grid;                                // шаблон пуст
+    grid.reset(nR, nC);
+    grid.reserveText(dims.value(2).toLongLong());
+
+    /* ---------- 2. все ячейки одним проходом ------------------------- */
+    // Индексы в базе могут идти с пропусками: плотные номера считает DENSE_RANK
+    QSqlQuery q(db);
+    q.setForwardOnly(true);
+    q.prepare(R"(
+        SELECT DENSE_RANK() OVER (ORDER BY row_index) - 1,
+               DENSE_RANK() OVER (ORDER BY col_index) - 1,
+               content, colour,
+               COALESCE(row_span,1) AS rs,
+               COALESCE(col_span,1) AS cs
+        FROM   grid_cells
+        WHERE  template_id = )" + cellOwnerSql(":tid"));
+    q.bindValue(":tid", templateId);
+    if (!QUERY_EXEC(q)) {
+        qDebug() << "getTableData(): query failed" << q.lastError();
+        return grid;
+    }
+
+    QHash<QString, QRgb> colourCache;               // цветов в таблице единицы
+    while (q.next()) {
+        const int r = q.value(0).toInt();
+        const int c = q.value(1).toInt();
+        if (r < 0 || r >= nR || c < 0 || c >= nC) continue;   // защита от мусора
+
+        grid.setText(r, c, q.value(2).toString());
+        grid.setColour(r, c, cachedColour(colourCache, q.value(3).toString()));
+
+        /* «теневые» ячейки внутри объединённой области отмечает setSpan */
+        const int rs = q.value(4).toInt();
+        const int cs = q.value(5).toInt();
+        if (rs > 1 || cs > 1)
+            grid.setSpan(r, c, rs, cs);
     }
-    {
-        QSqlQuery q(db);
-        q.prepare("SELECT DISTINCT col_index FROM grid_cells "
-                  "WHERE template_id = :tid ORDER BY col_index");
+    return grid;
+}
+
+bool TemplateManager::getTableLayout(int templateId, GridLayout &out) {
+    out = GridLayout();
+    const QString owner = cellOwnerSql(":tid");
+
+    /* ---------- номера строк и столбцов без текста ячеек ------------- */
+    QSqlQuery q(db);
+    q.setForwardOnly(true);
+    auto readIndexes = [&](const char *column, QVector<int> &to) {
+        q.prepare(QString("SELECT DISTINCT %1 FROM grid_cells WHERE template_id = %2 ORDER BY %1")
+                      .arg(QLatin1String(column), owner));
         q.bindValue(":tid", templateId);
-        if (q.exec())
-            while (q.next()) cols << q.value(0).toInt();
+        if (!QUERY_EXEC(q)) {
+            qDebug() << "getTableLayout():" << column << "query failed" << q.lastError();
+            return false;
+        }
+        while (q.next())
+            to.append(q.value(0).toInt());
+        return true;
+    };
+    if (!readIndexes("row_index", out.rowIndexes) || !readIndexes("col_index", out.colIndexes))
+        return false;
+    const int nR = out.rowCount();
+    const int nC = out.columnCount();
+
+    /* ---------- строки заголовка идут первыми ------------------------ */
+    q.prepare("SELECT MAX(row_index) FROM grid_cells WHERE template_id = " + owner
+              + " AND cell_type = 'header'");
+    q.bindValue(":tid", templateId);
+    if (!QUERY_EXEC(q)) {
+        qDebug() << "getTableLayout(): header query failed" << q.lastError();
+        return false;
     }
-    if (rows.isEmpty() || cols.isEmpty())
-        return table;                               // шаблон пуст
+    if (q.next() && !q.value(0).isNull())
+        out.headerRows = int(std::upper_bound(out.rowIndexes.cbegin(), out.rowIndexes.cend(),
+                                              q.value(0).toInt()) - out.rowIndexes.cbegin());
 
-    const int nR = rows.size();
-    const int nC = cols.size();
-    table.resize(nR);
-    for (int r = 0; r < nR; ++r)
-        table[r].resize(nC);                        // Cell() по‑умолчанию
+    /* ---------- объединения: их единицы на таблицу ------------------- */
+    q.prepare("SELECT row_index, col_index, row_span, col_span FROM grid_cells "
+              "WHERE template_id = " + owner + " AND (row_span > 1 OR col_span > 1)");
+    q.bindValue(":tid", templateId);
+    if (!QUERY_EXEC(q)) {
+        qDebug() << "getTableLayout(): spans query failed" << q.lastError();
+        return false;
+    }
+    while (q.next()) {
+        const int r = denseIndex(out.rowIndexes, q.value(0).toInt());
+        const int c = denseIndex(out.colIndexes, q.value(1).toInt());
+        if (r < 0 || c < 0)
+            continue;
+        const int rs = qBound(1, q.value(2).toInt(), nR - r);
+        const int cs = qBound(1, q.value(3).toInt(), nC - c);
+        if (rs > 1 || cs > 1)
+            out.spans.append({r, c, rs, cs});
+    }
+    return true;
+}
 
-    /* ---------- 2. выбираем все ячейки с span‑ами ------------------- */
+bool TemplateManager::getTableRows(int templateId, const GridLayout &layout,
+                                   int firstRow, int rowCount, GridStore &grid) {
+    grid = GridStore();
+    const int first = qMax(0, firstRow);
+    const int last  = qMin(layout.rowCount(), firstRow + rowCount) - 1;
+    if (first > last || layout.columnCount() == 0)
+        return true;
+    grid.reset(last - first + 1, layout.columnCount());
+
+    // Ключ страницы - (row_index, col_index) её первой строки: поиск по
+    // первичному ключу (template_id, cell_type, row_index, col_index)
     QSqlQuery q(db);
+    q.setForwardOnly(true);
     q.prepare(R"(
-        SELECT row_index, col_index, content, colour,
-               COALESCE(row_span,1) AS rs,
-               COALESCE(col_span,1) AS cs
+        SELECT row_index, col_index, content, colour
         FROM   grid_cells
-        WHERE  template_id = :tid
+        WHERE  template_id = )" + cellOwnerSql(":tid") + R"(
+          AND  cell_type = :ctype
+          AND  (row_index, col_index) >= (:r0, 0)
+          AND  row_index <= :r1
         ORDER  BY row_index, col_index)");
+
+    QHash<QString, QRgb> colourCache;
+    auto readPart = [&](const QString &cellType, int from, int to) {   // плотные номера строк
+        if (from > to)
+            return true;
+        q.bindValue(":tid",   templateId);
+        q.bindValue(":ctype", cellType);
+        q.bindValue(":r0",    layout.rowIndexes[from]);
+        q.bindValue(":r1",    layout.rowIndexes[to]);
+        if (!QUERY_EXEC(q)) {
+            qDebug() << "getTableRows(): query failed" << q.lastError();
+            return false;
+        }
+        while (q.next()) {
+            const int r = denseIndex(layout.rowIndexes, q.value(0).toInt()) - first;
+            const int c = denseIndex(layout.colIndexes, q.value(1).toInt());
+            if (r < 0 || r >= grid.rowCount() || c < 0)
+                continue;
+            grid.setText(r, c, q.value(2).toString());
+            grid.setColour(r, c, cachedColour(colourCache, q.value(3).toString()));
+        }
+        return true;
+    };
+    if (!readPart("header", first, qMin(last, layout.headerRows - 1))
+        || !readPart("content", qMax(first, layout.headerRows), last)) {
+        grid = GridStore();
+        return false;
+    }
+
+    // Объединения с владельцем в этих строках; обрезаются по границе страницы
+    for (const SpanIndex::Area &a : layout.spans)
+        if (a.row >= first && a.row <= last)
+            grid.setSpan(a.row - first, a.col, a.rowSpan, a.colSpan);
+    return true;
+}
+
+int TemplateManager::getTemplateVersion(int templateId) const {
+    QSqlQuery q(db);
+    q.prepare("SELECT version FROM template WHERE template_id = :tid");
     q.bindValue(":tid", templateId);
-    if (!q.exec()) {
-        qDebug() << "getTableData(): query failed" << q.lastError();
-        return table;
+    if (!QUERY_EXEC(q) || !q.next()) {
+        qDebug() << "Ошибка чтения версии шаблона:" << q.lastError().text();
+        return -1;
+    }
+    return q.value(0).toInt();
+}
+
+QHash<int, qint64> TemplateManager::getChangeSequences(int projectId) const {
+    QHash<int, qint64> seqs;
+    QSqlQuery q(db);
+    q.prepare("SELECT t.template_id, t.change_seq FROM template t "
+              "JOIN category c ON t.category_id = c.category_id "
+              "WHERE c.project_id = ?");
+    q.addBindValue(projectId);
+    if (!QUERY_EXEC(q)) {
+        qDebug() << "Ошибка чтения change_seq шаблонов:" << q.lastError().text();
+        return seqs;
     }
+    while (q.next())
+        seqs.insert(q.value(0).toInt(), q.value(1).toLongLong());
+    return seqs;
+}
 
-    while (q.next()) {
-        int dbRow  = q.value(0).toInt();
-        int dbCol  = q.value(1).toInt();
-        int r      = rows.indexOf(dbRow);
-        int c      = cols.indexOf(dbCol);
-        if (r < 0 || c < 0) continue;               // защита от мусора
-
-        Cell &cell   = table[r][c];
-        cell.text    = q.value(2).toString();
-        QString clr  = q.value(3).toString();
-        cell.colour  = (QColor(clr).isValid() ? clr : "#FFFFFF");
-        cell.rowSpan = q.value(4).toInt();
-        cell.colSpan = q.value(5).toInt();
-
-        /* помечаем «теневые» ячейки внутри объединённой области */
-        if (cell.rowSpan > 1 || cell.colSpan > 1) {
-            for (int dr = 0; dr < cell.rowSpan; ++dr)
-                for (int dc = 0; dc < cell.colSpan; ++dc)
-                    if (dr || dc)
-                        table[r+dr][c+dc].rowSpan = 0;   // ≤ 0 → нет ячейки
+qint64 TemplateManager::getChangeCounter() const {
+    QSqlQuery q(db);
+    if (!QUERY_EXEC_SQL(q, SqlDialect::isSqlite(db)
+                               ? "SELECT value FROM change_counter WHERE id = 1"
+                               : "SELECT last_value FROM autotlg_change_seq")
+        || !q.next()) {
+        qDebug() << "Ошибка чтения счётчика изменений:" << q.lastError().text();
+        return -1;
+    }
+    return q.value(0).toLongLong();
+}
+
+WriteResult TemplateManager::claimVersion(QSqlDatabase &db, int templateId,
+                                          std::optional<int> expectedVersion) {
+    // Условие на версию проверяется тем же UPDATE, что её увеличивает:
+    // конкурирующая запись ждёт блокировки строки и после неё уже не совпадёт
+    QSqlQuery upd(db);
+    upd.prepare(expectedVersion
+                    ? "UPDATE template SET version = version + 1 "
+                      "WHERE template_id = :tid AND version = :exp"
+                    : "UPDATE template SET version = version + 1 WHERE template_id = :tid");
+    upd.bindValue(":tid", templateId);
+    if (expectedVersion)
+        upd.bindValue(":exp", *expectedVersion);
+    if (!QUERY_EXEC(upd)) {
+        qDebug() << "claimVersion(): UPDATE failed" << upd.lastError();
+        return {};
+    }
+
+    QSqlQuery cur(db);
+    cur.prepare("SELECT version FROM template WHERE template_id = :tid");
+    cur.bindValue(":tid", templateId);
+    if (!QUERY_EXEC(cur) || !cur.next()) {
+        qDebug() << "claimVersion(): шаблон" << templateId << "не найден" << cur.lastError();
+        return {};
+    }
+
+    WriteResult res;
+    res.version = cur.value(0).toInt();
+    res.status  = upd.numRowsAffected() > 0 ? WriteStatus::Ok : WriteStatus::Conflict;
+    if (res.isConflict())
+        qDebug() << "claimVersion(): шаблон" << templateId << "изменён: ожидалась версия"
+                 << *expectedVersion << "в базе" << res.version;
+    return res;
+}
+
+QString TemplateManager::cellOwnerSql(const QString &param) {
+    return QString("(SELECT COALESCE(content_source_id, template_id) FROM template "
+                   "WHERE template_id = %1)").arg(param);
+}
+
+bool TemplateManager::materializeContent(QSqlDatabase &db, int templateId) {
+    QSqlQuery q(db);
+    q.prepare("SELECT content_source_id FROM template WHERE template_id = ?");
+    q.addBindValue(templateId);
+    if (!QUERY_EXEC(q)) {
+        qDebug() << "materializeContent(): SELECT failed" << q.lastError();
+        return false;
+    }
+    if (!q.next())
+        return true;                                // шаблона нет - и делить нечего
+    const QVariant source = q.value(0);
+
+    QSqlQuery cp(db);
+    if (!source.isNull()) {
+        cp.prepare("INSERT INTO grid_cells (template_id, cell_type, row_index, col_index, "
+                   "row_span, col_span, content, colour) "
+                   "SELECT ?, cell_type, row_index, col_index, row_span, col_span, content, colour "
+                   "FROM grid_cells WHERE template_id = ?");
+        cp.addBindValue(templateId);
+        cp.addBindValue(source);
+        if (!QUERY_EXEC(cp)) {
+            qDebug() << "materializeContent(): copy from" << source << "failed" << cp.lastError();
+            return false;
+        }
+        cp.prepare("UPDATE template SET content_source_id = NULL WHERE template_id = ?");
+        cp.addBindValue(templateId);
+        if (!QUERY_EXEC(cp)) {
+            qDebug() << "materializeContent(): UPDATE failed" << cp.lastError();
+            return false;
         }
     }
-    return table;
+    return releaseContent(db, templateId);
+}
+
+bool TemplateManager::releaseContent(QSqlDatabase &db, int templateId) {
+    QSqlQuery cp(db);
+    cp.prepare("SELECT 1 FROM template WHERE content_source_id = ? LIMIT 1");
+    cp.addBindValue(templateId);
+    if (!QUERY_EXEC(cp)) {
+        qDebug() << "releaseContent(): SELECT failed" << cp.lastError();
+        return false;
+    }
+    if (!cp.next())
+        return true;                                // копий нет
+
+    // Цепочек нет, поэтому копии шаблона читают именно его ячейки
+    cp.prepare("INSERT INTO grid_cells (template_id, cell_type, row_index, col_index, "
+               "row_span, col_span, content, colour) "
+               "SELECT d.template_id, g.cell_type, g.row_index, g.col_index, "
+               "g.row_span, g.col_span, g.content, g.colour "
+               "FROM template d JOIN grid_cells g ON g.template_id = d.content_source_id "
+               "WHERE d.content_source_id = ?");
+    cp.addBindValue(templateId);
+    if (!QUERY_EXEC(cp)) {
+        qDebug() << "releaseContent(): copy to duplicates failed" << cp.lastError();
+        return false;
+    }
+    cp.prepare("UPDATE template SET content_source_id = NULL WHERE content_source_id = ?");
+    cp.addBindValue(templateId);
+    if (!QUERY_EXEC(cp)) {
+        qDebug() << "releaseContent(): UPDATE of duplicates failed" << cp.lastError();
+        return false;
+    }
+    return true;
+}
+
+bool TemplateManager::materializeProjectContent(QSqlDatabase &db, int projectId) {
+    // Копии проекта забирают ячейки владельцев - владельцы могут быть и в других проектах
+    QSqlQuery cp(db);
+    cp.prepare("INSERT INTO grid_cells (template_id, cell_type, row_index, col_index, "
+               "row_span, col_span, content, colour) "
+               "SELECT d.template_id, g.cell_type, g.row_index, g.col_index, "
+               "g.row_span, g.col_span, g.content, g.colour "
+               "FROM template d "
+               "JOIN category c ON c.category_id = d.category_id "
+               "JOIN grid_cells g ON g.template_id = d.content_source_id "
+               "WHERE c.project_id = ?");
+    cp.addBindValue(projectId);
+    if (!QUERY_EXEC(cp)) {
+        qDebug() << "materializeProjectContent(): copy failed" << cp.lastError();
+        return false;
+    }
+    cp.prepare("UPDATE template SET content_source_id = NULL "
+               "WHERE content_source_id IS NOT NULL "
+               "AND category_id IN (SELECT category_id FROM category WHERE project_id = ?)");
+    cp.addBindValue(projectId);
+    if (!QUERY_EXEC(cp)) {
+        qDebug() << "materializeProjectContent(): UPDATE failed" << cp.lastError();
+        return false;
+    }
+
+    // Копии из других проектов, читающие ячейки этого
+    cp.prepare("INSERT INTO grid_cells (template_id, cell_type, row_index, col_index, "
+               "row_span, col_span, content, colour) "
+               "SELECT d.template_id, g.cell_type, g.row_index, g.col_index, "
+               "g.row_span, g.col_span, g.content, g.colour "
+               "FROM template d "
+               "JOIN template s ON s.template_id = d.content_source_id "
+               "JOIN category c ON c.category_id = s.category_id "
+               "JOIN grid_cells g ON g.template_id = s.template_id "
+               "WHERE c.project_id = ?");
+    cp.addBindValue(projectId);
+    if (!QUERY_EXEC(cp)) {
+        qDebug() << "materializeProjectContent(): copy to duplicates failed" << cp.lastError();
+        return false;
+    }
+    cp.prepare("UPDATE template SET content_source_id = NULL "
+               "WHERE content_source_id IN (SELECT t.template_id FROM template t "
+               "JOIN category c ON c.category_id = t.category_id WHERE c.project_id = ?)");
+    cp.addBindValue(projectId);
+    if (!QUERY_EXEC(cp)) {
+        qDebug() << "materializeProjectContent(): UPDATE of duplicates failed" << cp.lastError();
+        return false;
+    }
+    return true;
 }
 
 QString TemplateManager::getSubtitleForTemplate(int templateId) {
     QSqlQuery query(db);
     query.prepare("SELECT subtitle FROM template WHERE template_id = :tid");
     query.bindValue(":tid", templateId);
-    if (query.exec() && query.next()) {
+    if (QUERY_EXEC(query) && query.next()) {
         return query.value(0).toString();
     } else {
         qDebug() << "Ошибка загрузки подзаголовка:" << query.lastError().text();
@@ -581,7 +941,7 @@ QString TemplateManager::getNotesForTemplate(int templateId) {
     query.prepare("SELECT notes FROM template WHERE template_id = :templateId");
     query.bindValue(":templateId", templateId);
 
-    if (query.exec() && query.next()) {
+    if (QUERY_EXEC(query) && query.next()) {
         return query.value(0).toString();
     } else {
         qDebug() << "Ошибка загрузки заметок:" << query.lastError().text();
@@ -594,7 +954,7 @@ QString TemplateManager::getProgrammingNotesForTemplate(int templateId) {
     query.prepare("SELECT programming_notes FROM template WHERE template_id = :templateId");
     query.bindValue(":templateId", templateId);
 
-    if (query.exec() && query.next()) {
+    if (QUERY_EXEC(query) && query.next()) {
         return query.value(0).toString();
     } else {
         qDebug() << "Ошибка загрузки программных заметок:" << query.lastError().text();
@@ -606,20 +966,17 @@ QString TemplateManager::getTemplateType(int templateId) {
     QSqlQuery query(db);
     query.prepare("SELECT template_type FROM template WHERE template_id = :tid");
     query.bindValue(":tid", templateId);
-    if (query.exec() && query.next()) {
+    if (QUERY_EXEC(query) && query.next()) {
         return query.value(0).toString();
     }
     return "table"; // выкинуть предупреждение
 }
 
-QByteArray TemplateManager::getGraphImage(int templateId) {
-    QSqlQuery query(db);
-    query.prepare("SELECT image FROM graph WHERE template_id = :tid");
-    query.bindValue(":tid", templateId);
-    if (query.exec() && query.next()) {
-        return query.value(0).toByteArray();
-    }
-    return QByteArray();
+std::unique_ptr<QIODevice> TemplateManager::openGraphImage(int templateId) const {
+    auto dev = std::make_unique<BlobReader>(db, "graph", "image", "template_id", templateId);
+    if (!dev->open(QIODevice::ReadOnly))
+        return nullptr;                         // графика нет или изображение пустое
+    return dev;
 }
 
 QString TemplateManager::getGraphType(int templateId) {
@@ -627,7 +984,7 @@ QString TemplateManager::getGraphType(int templateId) {
     query.prepare("SELECT graph_type FROM graph WHERE template_id = :id");
     query.bindValue(":id", templateId);
 
-    if (!query.exec()) {
+    if (!QUERY_EXEC(query)) {
         qWarning() << query.lastError().text();
         return QString();
     }
@@ -644,7 +1001,7 @@ QStringList TemplateManager::getGraphTypesFromLibrary() {
     QSqlQuery query(db);
 
     query.prepare("SELECT graph_type FROM graph_library ORDER BY graph_type");
-    if (!query.exec()) {
+    if (!QUERY_EXEC(query)) {
         qDebug() << "Ошибка получения типов графиков:" << query.lastError();
         return types; // вернёт пустой список
     }
@@ -669,7 +1026,7 @@ int TemplateManager::getProjectIdByTemplate(int templateId) const {
         WHERE t.template_id = :tid
     )");
     q.bindValue(":tid", templateId);
-    if (q.exec() && q.next()) return q.value(0).toInt();
+    if (QUERY_EXEC(q) && q.next()) return q.value(0).toInt();
     return 0;
 }
 
@@ -685,7 +1042,7 @@ QVector<TemplateBrief> TemplateManager::getTemplatesByProjectAndType(int project
     )");
     q.bindValue(":pid", projectId);
     q.bindValue(":tt",  type);
-    if (!q.exec()) return out;
+    if (!QUERY_EXEC(q)) return out;
     while (q.next()) out.push_back({ q.value(0).toInt(), q.value(1).toString() });
     return out;
 }
@@ -694,7 +1051,7 @@ std::optional<int> TemplateManager::getRelatedTemplateId(int templateId) const {
     QSqlQuery q(db);
     q.prepare("SELECT related_template_id FROM template WHERE template_id = :tid");
     q.bindValue(":tid", templateId);
-    if (!q.exec() || !q.next()) return std::nullopt;
+    if (!QUERY_EXEC(q) || !q.next()) return std::nullopt;
     if (q.value(0).isNull())     return std::nullopt;
     return q.value(0).toInt();
 }
@@ -707,6 +1064,6 @@ bool TemplateManager::setRelatedTemplateId(int templateId, const std::optional<i
     else
         q.bindValue(":rid", QVariant()); // NULL
     q.bindValue(":tid", templateId);
-    return q.exec();
+    return QUERY_EXEC(q);
 }
 
@@ -2,9 +2,13 @@
 #define TEMPLATEMANAGER_H
 
 #include <QVector>
+#include <QHash>
 #include <QString>
 #include <optional>
+#include <memory>
+#include <QIODevice>
 #include <QSqlDatabase>
+#include "gridstore.h"
 
 struct Template {
     int templateId;
@@ -16,19 +20,47 @@ struct Template {
     int categoryId;
 };
 
-struct Cell {
-    QString text      = "";
-    QString colour    = "#FFFFFF";
-    int     rowSpan   = 1;
-    int     colSpan   = 1;
-};
-
 struct TemplateBrief {
     int id;
     QString name;
 };
 
-using TableMatrix = QVector<QVector<Cell>>;
+// Узел дерева проекта: всё, что нужно для отображения и фильтра, одним запросом
+struct TemplateNode {
+    int     templateId;
+    int     categoryId;
+    QString name;
+    int     position;
+    QString templateType;
+    bool    dynamic;
+    bool    approved;
+};
+
+// Индекс таблицы для постраничной загрузки (TemplatePanel): всё, кроме текста ячеек
+struct GridLayout {
+    QVector<int> rowIndexes;            // row_index строк по порядку (в базе возможны пропуски)
+    QVector<int> colIndexes;
+    int headerRows = 0;                 // первые строки таблицы - заголовок
+    QVector<SpanIndex::Area> spans;     // в плотных координатах, обрезаны по таблице
+
+    int rowCount() const    { return rowIndexes.size(); }
+    int columnCount() const { return colIndexes.size(); }
+};
+
+// Результат записи с проверкой версии шаблона (оптимистичная блокировка)
+enum class WriteStatus {
+    Ok,         // записано, version - новая версия шаблона
+    Conflict,   // шаблон успел изменить кто-то другой, version - текущая версия в базе
+    Error       // ошибка SQL или шаблон не найден
+};
+
+struct WriteResult {
+    WriteStatus status = WriteStatus::Error;
+    int version = -1;
+
+    bool isConflict() const { return status == WriteStatus::Conflict; }
+    explicit operator bool() const { return status == WriteStatus::Ok; }
+};
 
 class TemplateManager {
 public:
@@ -42,6 +74,11 @@ public:
                         const std::optional<QString> &subtitle,
                         const std::optional<QString> &notes,
                         const std::optional<QString> &programmingNotes);
+    // То же с проверкой версии: запись проходит, только если шаблон не менялся с expectedVersion
+    WriteResult updateTemplate(int templateId, int expectedVersion,
+                               const std::optional<QString> &subtitle,
+                               const std::optional<QString> &notes,
+                               const std::optional<QString> &programmingNotes);
     bool deleteTemplate(int templateId);
 
     bool copyGraphFromLibrary(const QString &graphTypeKey, int newTemplateId);
@@ -57,16 +94,52 @@ public:
     bool updateTemplatePosition(int templateId, int position);
 
     QVector<int> getDynamicTemplatesForProject(int projectId);
+    QVector<TemplateNode> getTemplateNodesForProject(int projectId) const;
     QVector<Template> getTemplatesForCategory(int categoryId);    // Получение шаблонов по категории
-
-    TableMatrix getTableData(int templateId);
+    std::optional<Template> getTemplate(int templateId) const;
+
+    // Версия шаблона растёт при каждом изменении содержимого; -1 если шаблона нет
+    int getTemplateVersion(int templateId) const;
+    // change_seq всех шаблонов проекта (миграция 006): сдвигается при любой
+    // правке шаблона, его ячеек или графика. Ключ - template_id
+    QHash<int, qint64> getChangeSequences(int projectId) const;
+    // Последний выданный change_seq базы; меньше прежнего - база восстановлена
+    // из копии или пересоздана. -1 при ошибке
+    qint64 getChangeCounter() const;
+    // Увеличивает версию (compare-and-swap, если задана expectedVersion).
+    // Вызывается внутри транзакции записи, блокировка строки держится до её конца
+    static WriteResult claimVersion(QSqlDatabase &db, int templateId,
+                                    std::optional<int> expectedVersion = std::nullopt);
+
+    // Копия из duplicateTemplate читает ячейки владельца (content_source_id,
+    // миграция 008). Подзапрос SQL: template_id, под которым лежат ячейки
+    // шаблона с id из параметра param (":tid", "?")
+    static QString cellOwnerSql(const QString &param);
+    // Перед записью ячеек шаблона: он получает собственные ячейки, если
+    // читал чужие, а копии, читавшие его, - свои. Вызывается внутри транзакции записи
+    static bool materializeContent(QSqlDatabase &db, int templateId);
+    // Только вторая половина: копии, читавшие ячейки шаблона, забирают их себе
+    // (перед удалением шаблона). Тоже внутри транзакции
+    static bool releaseContent(QSqlDatabase &db, int templateId);
+    // То же для всех шаблонов проекта (массовая замена)
+    static bool materializeProjectContent(QSqlDatabase &db, int projectId);
+
+    GridStore getTableData(int templateId);
+    // Постраничное чтение: индекс таблицы, затем строки [firstRow, firstRow + rowCount)
+    // в GridStore с нулевой строки. Страница ищется по первичному ключу от
+    // (row_index, col_index) своей первой строки, без OFFSET. false - ошибка
+    // чтения, out пуст: пустую страницу нельзя принять за прочитанную
+    bool getTableLayout(int templateId, GridLayout &out);
+    bool getTableRows(int templateId, const GridLayout &layout, int firstRow, int rowCount,
+                      GridStore &out);
 
     QString getSubtitleForTemplate(int templateId);               // Получение подзаголовков
     QString getNotesForTemplate(int templateId);                  // Получение заметок
     QString getProgrammingNotesForTemplate(int templateId);       // Получение программных заметок
 
     QString getTemplateType(int templateId);
-    QByteArray getGraphImage(int templateId);
+    // Изображение графика для чтения кусками (nullptr, если его нет)
+    std::unique_ptr<QIODevice> openGraphImage(int templateId) const;
     QString getGraphType(int templateId);
     QStringList getGraphTypesFromLibrary();
 
@@ -1,5 +1,7 @@
 #include "templatepanel.h"
+#include "stallwatchdog.h"
 #include "richtextdelegate.h"
+#include "tablesizer.h"
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QSplitter>
@@ -16,6 +18,10 @@
 #include <QMenu>
 #include <QtMath>
 #include <QIcon>
+#include <QCryptographicHash>
+#include <QTimer>
+#include <QImageReader>
+#include <QScrollBar>
 
 TemplatePanel::TemplatePanel(DatabaseHandler *dbHandler, FormatToolBar *formatToolBar, QWidget *parent)
     : QWidget(parent)
@@ -46,6 +52,17 @@ void TemplatePanel::setupUI() {
     templateTableWidget->setTextElideMode(Qt::ElideNone);
     templateTableWidget->horizontalHeader()->hide();
     templateTableWidget->verticalHeader()->hide();
+    tableSizer = new TableSizer(templateTableWidget);
+
+    // Страницы ячеек: видимые - сразу, следующие - по одной на тик таймера
+    prefetchTimer = new QTimer(this);
+    prefetchTimer->setSingleShot(true);
+    prefetchTimer->setInterval(30);
+    connect(prefetchTimer, &QTimer::timeout, this, &TemplatePanel::prefetchPages);
+    connect(templateTableWidget->verticalScrollBar(), &QScrollBar::valueChanged,
+            this, &TemplatePanel::loadVisiblePages);
+    connect(templateTableWidget->verticalScrollBar(), &QScrollBar::rangeChanged,
+            this, &TemplatePanel::loadVisiblePages);
 
     templateTableWidget->setContextMenuPolicy(Qt::CustomContextMenu);
     connect(templateTableWidget, &QTableWidget::customContextMenuRequested,
@@ -75,7 +92,7 @@ void TemplatePanel::setupUI() {
         lastSizedTemplateId = selectedTemplateId;
     });
     connect(templateTableWidget->verticalHeader(), &QHeaderView::sectionResized, this, [this](int idx, int /*oldSize*/, int newSize){
-        if (idx < 0) return;
+        if (idx < 0 || tableSizer->isSizing()) return;     // оценки и замеры - не правка пользователя
         if (savedRowHeights.size() < templateTableWidget->rowCount())
             savedRowHeights.resize(templateTableWidget->rowCount());
         savedRowHeights[idx] = newSize;
@@ -302,19 +319,16 @@ void TemplatePanel::clearAll() {
 
 //
 void TemplatePanel::loadTableTemplate(int templateId) {
-
+    STALL_SCOPE();
     selectedTemplateId = templateId;
     if (templateId == lastSizedTemplateId) {
         const int prevCols = templateTableWidget->columnCount();
-        const int prevRows = templateTableWidget->rowCount();
 
         savedColWidths.resize(prevCols);
         for (int c = 0; c < prevCols; ++c)
             savedColWidths[c] = templateTableWidget->columnWidth(c);
-
-        savedRowHeights.resize(prevRows);
-        for (int r = 0; r < prevRows; ++r)
-            savedRowHeights[r] = templateTableWidget->rowHeight(r);
+        // savedRowHeights - только высоты, заданные пользователем (см. sectionResized):
+        // остальные строки снова получат оценку и замер при показе
     } else {
         savedColWidths.clear();
         savedRowHeights.clear();
@@ -322,51 +336,40 @@ void TemplatePanel::loadTableTemplate(int templateId) {
     templateTableWidget->clear();
     templateTableWidget->clearSpans();
 
-    const QString ttype = dbHandler->getTemplateManager()->getTemplateType(templateId);
-    const bool isListing = (ttype == "listing");
-
-    TableMatrix cells = dbHandler->getTemplateManager()->getTableData(templateId);
-    const int nR = cells.size();
-    const int nC = nR ? cells[0].size() : 0;
-
+    TemplateManager *tm = dbHandler->getTemplateManager();
+    currentIsListing = (tm->getTemplateType(templateId) == "listing");
+
+    // Индекс таблицы целиком, текст ячеек - только первой страницы с заголовком
+    if (!tm->getTableLayout(templateId, gridLayout))
+        gridLayout = GridLayout();
+    const int nR = gridLayout.rowCount();
+    const int nC = gridLayout.columnCount();
+    const int headerRows = gridLayout.headerRows;
+    GridStore firstPage;
+    const bool firstPageRead = tm->getTableRows(templateId, gridLayout, 0, kPageRows, firstPage);
+
+    // Высота по умолчанию задаётся, пока строк нет: новые строки получают её сразу.
+    // Страниц нет, пока строки создаются: прокрутка ничего не дочитывает
+    loadedPages.clear();
+    templateTableWidget->setRowCount(0);
+    tableSizer->prepare(firstPage, nR, headerRows);
     templateTableWidget->setRowCount(nR);
     templateTableWidget->setColumnCount(nC);
-
-    // Получаем число строк-заголовков (т.е. максимальное значение row_index для ячеек типа header)
-    int headerRows = dbHandler->getTableManager()->getRowCountForHeader(templateId);
-
-    for (int r = 0; r < nR; ++r) {
-        for (int c = 0; c < nC; ++c) {
-
-            const Cell &cell = cells[r][c];
-            if (cell.rowSpan == 0)              // «теневая» – пропускаем
-                continue;
-
-            auto *item = new QTableWidgetItem(cell.text);
-
-            if (isListing) {
-                item->setTextAlignment(Qt::AlignLeft);
-            } else {
-                item->setTextAlignment((c == 0) ? Qt::AlignLeft :  Qt::AlignCenter);
-            }
-
-
-            item->setBackground(QColor(cell.colour));
-            if (r < headerRows)                 // серый фон заголовка
-                item->setBackground(Qt::lightGray);
-            templateTableWidget->setItem(r, c, item);
-
-            int rs = cell.rowSpan, cs = cell.colSpan;
-            if (rs < 1) rs = 1;
-            if (cs < 1) cs = 1;
-            if ((rs > 1 || cs > 1) && r + rs <= nR && c + cs <= nC) {
-                templateTableWidget->setSpan(r, c, rs, cs);
-            }
-
-        }
+    loadedPages = QVector<bool>((nR + kPageRows - 1) / kPageRows, false);
+
+    templateTableWidget->setUpdatesEnabled(false);
+    // Объединения известны для всей таблицы: ячейки под ними не создаются
+    gridSpans.clear();
+    for (const SpanIndex::Area &sp : std::as_const(gridLayout.spans)) {
+        if (gridSpans.addSpan(sp.row, sp.col, sp.rowSpan, sp.colSpan))
+            templateTableWidget->setSpan(sp.row, sp.col, sp.rowSpan, sp.colSpan);
     }
+    fillRows(firstPage, 0);
+    if (!loadedPages.isEmpty())
+        loadedPages[0] = firstPageRead;     // при ошибке страница перечитается при показе
 
     applySizingPreservingUserChanges(nR, nC);
+    templateTableWidget->setUpdatesEnabled(true);
 
     // Загружаем подзаголовок, заметки и программные заметки
     QString subtitle = dbHandler->getTemplateManager()->getSubtitleForTemplate(templateId);
@@ -403,37 +406,144 @@ void TemplatePanel::loadTableTemplate(int templateId) {
 
     templateTableWidget->setHorizontalScrollMode(QAbstractItemView::ScrollPerPixel);
 
+    markLoaded();
+    loadVisiblePages();
     qDebug() << "Шаблон таблицы с ID" << templateId << "загружен.";
 
 }
-void TemplatePanel::loadGraphTemplate(int templateId) {
 
-    // Получаем данные графика (байтовый массив)
-    QByteArray imageData = dbHandler->getTemplateManager()->getGraphImage(templateId);
-    if (imageData.isEmpty()) {
-        graphLabel->setText("No chart data available");
-        return;
+void TemplatePanel::fillRows(const GridStore &rows, int firstRow) {
+    const int nC = qMin(rows.columnCount(), templateTableWidget->columnCount());
+    const int end = qMin(templateTableWidget->rowCount(), firstRow + rows.rowCount());
+    for (int r = firstRow; r < end; ++r) {
+        for (int c = 0; c < nC; ++c) {
+
+            if (gridSpans.isCovered(r, c))      // «теневая» – пропускаем
+                continue;
+
+            auto *item = new QTableWidgetItem(rows.text(r - firstRow, c));
+
+            if (currentIsListing) {
+                item->setTextAlignment(Qt::AlignLeft);
+            } else {
+                item->setTextAlignment((c == 0) ? Qt::AlignLeft :  Qt::AlignCenter);
+            }
+
+
+            item->setBackground(rows.colour(r - firstRow, c));
+            if (r < gridLayout.headerRows)      // серый фон заголовка
+                item->setBackground(Qt::lightGray);
+            templateTableWidget->setItem(r, c, item);
+        }
     }
-    // Загружаем изображение в QPixmap
-    QPixmap pixmap;
-    if (!pixmap.loadFromData(imageData)) {
-        graphLabel->setText("Image upload error");
-        return;
+}
+
+bool TemplatePanel::loadPages(int firstPage, int lastPage) {
+    STALL_SCOPE();
+    const int firstRow = firstPage * kPageRows;
+    GridStore rows;
+    if (!dbHandler->getTemplateManager()->getTableRows(
+            selectedTemplateId, gridLayout, firstRow, (lastPage - firstPage + 1) * kPageRows, rows)) {
+        // Страницы остаются непрочитанными: пустые строки не уйдут в базу поверх настоящих
+        qDebug() << "Не удалось прочитать страницы" << firstPage << "-" << lastPage
+                 << "шаблона" << selectedTemplateId;
+        return false;
     }
-    graphLabel->setPixmap(pixmap.scaled(graphLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
-    graphLabel->show();
+    for (int p = firstPage; p <= lastPage; ++p)
+        loadedPages[p] = true;
+    if (rows.isEmpty())
+        return true;
+
+    templateTableWidget->setUpdatesEnabled(false);
+    fillRows(rows, firstRow);
+    tableSizer->estimateRows(firstRow, rows);
+    templateTableWidget->setUpdatesEnabled(true);
+
+    // Прочитанное из базы - не правка: хэш загрузки растёт вместе с таблицей
+    loadedTableHash += rowsHash(firstRow, qMin(templateTableWidget->rowCount(), firstRow + rows.rowCount()));
+    return true;
+}
+
+bool TemplatePanel::ensureRowsLoaded(int firstRow, int lastRow) {
+    const int last = qMin(lastRow / kPageRows, int(loadedPages.size()) - 1);
+    bool ok = true;
+    for (int p = qMax(0, firstRow / kPageRows); p <= last; ++p) {
+        if (loadedPages[p])
+            continue;
+        // Подряд идущие непрочитанные страницы - одним запросом
+        int end = p;
+        while (end < last && !loadedPages[end + 1])
+            ++end;
+        ok = loadPages(p, end) && ok;
+        p = end;
+    }
+    return ok;
+}
 
+bool TemplatePanel::loadRemainingPages() {
+    return ensureRowsLoaded(0, templateTableWidget->rowCount() - 1);
+}
+
+void TemplatePanel::loadVisiblePages() {
+    const int nR = templateTableWidget->rowCount();
+    if (nR == 0 || loadedPages.isEmpty())
+        return;
+    int top = templateTableWidget->rowAt(0);
+    if (top < 0)
+        top = 0;
+    int bottom = templateTableWidget->rowAt(templateTableWidget->viewport()->height() - 1);
+    if (bottom < 0)
+        bottom = nR - 1;
+    ensureRowsLoaded(top, bottom);
+
+    prefetchFrom = bottom / kPageRows + 1;
+    if (prefetchFrom < loadedPages.size())
+        prefetchTimer->start();
+}
+
+void TemplatePanel::prefetchPages() {
+    const int end = qMin(int(loadedPages.size()), prefetchFrom + kPrefetchPages);
+    for (int p = prefetchFrom; p < end; ++p) {
+        if (loadedPages[p])
+            continue;
+        if (loadPages(p, p))
+            prefetchTimer->start();     // следующая страница - на следующем тике
+        return;
+    }
+}
+void TemplatePanel::loadGraphTemplate(int templateId) {
+    STALL_SCOPE();
     QString subtitle = dbHandler->getTemplateManager()->getSubtitleForTemplate(templateId);
     QString notes = dbHandler->getTemplateManager()->getNotesForTemplate(templateId);
     QString programmingNotes = dbHandler->getTemplateManager()->getProgrammingNotesForTemplate(templateId);
     subtitleField->setHtml(subtitle);
     notesField->setHtml(notes);
     notesProgrammingField->setHtml(programmingNotes);
+    markLoaded();
 
+    // Изображение читается из базы кусками, без копии всего файла в памяти
+    std::unique_ptr<QIODevice> imageData = dbHandler->getTemplateManager()->openGraphImage(templateId);
+    if (!imageData) {
+        graphLabel->setText("No chart data available");
+        return;
+    }
+    // Декодируем сразу в размер виджета
+    QImageReader reader(imageData.get());
+    const QSize fullSize = reader.size();
+    if (fullSize.isValid() && !graphLabel->size().isEmpty())
+        reader.setScaledSize(fullSize.scaled(graphLabel->size(), Qt::KeepAspectRatio));
+    const QImage image = reader.read();
+    if (image.isNull()) {
+        graphLabel->setText("Image upload error");
+        return;
+    }
+    graphLabel->setPixmap(QPixmap::fromImage(image));
+    graphLabel->show();
 
     qDebug() << "График с ID" << templateId << "загружен.";
 }
 void TemplatePanel::loadTemplate(int templateId) {
+    STALL_SCOPE();
     if (selectedTemplateId > 0) {
         saveTableData();
     }
@@ -454,6 +564,86 @@ void TemplatePanel::loadTemplate(int templateId) {
     populateRelatedCombo(templateId);
 }
 
+void TemplatePanel::markLoaded() {
+    loadedVersion   = dbHandler->getTemplateManager()->getTemplateVersion(selectedTemplateId);
+    loadedTableHash = tableHash();
+    loadedNotesHash = notesHash();
+}
+
+bool TemplatePanel::isModified() const {
+    return tableHash() != loadedTableHash || notesHash() != loadedNotesHash;
+}
+
+size_t TemplatePanel::tableHash() const {
+    const int rows = templateTableWidget->rowCount();
+    size_t h = qHashMulti(0, rows, templateTableWidget->columnCount());
+    // Только прочитанные страницы; после удаления строк номера страниц
+    // сдвинуты, но к этому моменту прочитано всё (deleteRowOrColumn)
+    for (int p = 0; p * kPageRows < rows; ++p) {
+        if (p >= loadedPages.size() || loadedPages[p])
+            h += rowsHash(p * kPageRows, qMin(rows, (p + 1) * kPageRows));
+    }
+    return h;
+}
+
+size_t TemplatePanel::rowsHash(int firstRow, int endRow) const {
+    const int cols = templateTableWidget->columnCount();
+    size_t h = 0;
+    for (int r = firstRow; r < endRow; ++r) {
+        for (int c = 0; c < cols; ++c) {
+            const auto *it = templateTableWidget->item(r, c);
+            h += qHashMulti(0, r, c,
+                            it ? it->text() : QString(),
+                            it ? it->background().color().name() : QString(),
+                            templateTableWidget->rowSpan(r, c),
+                            templateTableWidget->columnSpan(r, c));
+        }
+    }
+    return h;
+}
+
+QByteArray TemplatePanel::notesHash() const {
+    QCryptographicHash h(QCryptographicHash::Sha1);
+    h.addData(subtitleField->toHtml().toUtf8());
+    h.addData(notesField->toHtml().toUtf8());
+    h.addData(notesProgrammingField->toHtml().toUtf8());
+    return h.result();
+}
+
+bool TemplatePanel::reloadIfUnmodified() {
+    if (selectedTemplateId <= 0 || isModified())
+        return false;           // правки пользователя важнее, они уйдут при сохранении
+    const int id = selectedTemplateId;
+    selectedTemplateId = -1;    // без сохранения текущего состояния
+    loadTemplate(id);
+    return true;
+}
+
+bool TemplatePanel::overwriteAfterConflict(int currentVersion) {
+    QMessageBox box(QMessageBox::Warning, tr("Template changed"),
+                    tr("This template has been changed by another user since you opened it."),
+                    QMessageBox::NoButton, this);
+    QPushButton *overwrite = box.addButton(tr("Overwrite with my changes"), QMessageBox::DestructiveRole);
+    box.addButton(tr("Discard my changes and reload"), QMessageBox::RejectRole);
+    box.exec();
+
+    if (box.clickedButton() == overwrite) {
+        loadedVersion = currentVersion;     // следующая попытка сверяется с текущей версией
+        return true;
+    }
+
+    // Перечитываем после выхода из обработчика: сохранение могло начаться
+    // из commitData делегата или при переключении на другой шаблон
+    const int id = selectedTemplateId;
+    QTimer::singleShot(0, this, [this, id]{
+        if (selectedTemplateId != id)
+            return;
+        selectedTemplateId = -1;
+        loadTemplate(id);
+    });
+    return false;
+}
+
 //
 QVector<CellData> TemplatePanel::collectRowBackup(int rowIndex) {
     QVector<CellData> backup;
@@ -542,6 +732,12 @@ void TemplatePanel::addRowOrColumn(const QString &type) {
 void TemplatePanel::deleteRowOrColumn(const QString &type) {
     // 1) Сначала убираем старую команду, если была
     undoStack->clear();
+    // Удаление сдвигает строки виджета: страницы дочитываются до него
+    if (!loadRemainingPages()) {
+        QMessageBox::warning(this, tr("Delete"),
+                             tr("Couldn't read the whole table from the database."));
+        return;
+    }
 
     // 2) Собираем backup и пушим новую команду как раньше
     if (type == "row") {
@@ -559,21 +755,45 @@ void TemplatePanel::deleteRowOrColumn(const QString &type) {
     }
 }
 void TemplatePanel::saveTableData() {
-    // Сохраняем заметки (как и раньше)
-    dbHandler->getTemplateManager()->updateTemplate(
-        selectedTemplateId,
-        std::nullopt,
-        subtitleField->toHtml(),
-        notesField->toHtml(),
-        notesProgrammingField->toHtml()
-        );
-
-    if (viewStack->currentIndex() != 0 || selectedTemplateId <= 0)
+    if (selectedTemplateId <= 0)
         return;
 
-    // Закрываем все открытые редакторы, чтобы данные попали в item-ы
-    templateTableWidget->closePersistentEditor(nullptr);
-    templateTableWidget->clearFocus();
+    const bool isTable = (viewStack->currentIndex() == 0);
+    if (isTable) {
+        // Закрываем все открытые редакторы, чтобы данные попали в item-ы
+        templateTableWidget->closePersistentEditor(nullptr);
+        templateTableWidget->clearFocus();
+    }
+
+    // Пишем только изменившееся; каждая запись сверяет версию шаблона,
+    // поэтому чужие правки, сделанные после загрузки, не затираются молча
+    if (notesHash() != loadedNotesHash) {
+        auto write = [this]{
+            return dbHandler->getTemplateManager()->updateTemplate(
+                selectedTemplateId, loadedVersion,
+                subtitleField->toHtml(),
+                notesField->toHtml(),
+                notesProgrammingField->toHtml()
+                );
+        };
+        WriteResult res = write();
+        while (res.isConflict() && overwriteAfterConflict(res.version))
+            res = write();
+        if (!res)
+            return;
+        loadedVersion   = res.version;
+        loadedNotesHash = notesHash();
+    }
+
+    if (!isTable || tableHash() == loadedTableHash)
+        return;
+    // Таблица записывается целиком - дочитываем непрочитанные страницы.
+    // Без них запись затёрла бы настоящие ячейки пустыми: правки остаются
+    // несохранёнными до следующей попытки
+    if (!loadRemainingPages()) {
+        qDebug() << "saveTableData(): таблица прочитана не целиком, запись отменена";
+        return;
+    }
 
     const int rows = templateTableWidget->rowCount();
     const int cols = templateTableWidget->columnCount();
@@ -601,13 +821,22 @@ void TemplatePanel::saveTableData() {
         dbHandler->getTableManager()->getRowCountForHeader(selectedTemplateId);
 
     QVector<QString> headers(headerRows);  // содержимое тут неважно – нужна длина
-    dbHandler->getTableManager()->saveDataTableTemplate(
-        selectedTemplateId,
-        headerRows ? std::optional{headers} : std::nullopt,
-        std::optional{cellData},
-        std::optional{cellColours}
-        );
-
+    auto write = [&]{
+        return dbHandler->getTableManager()->saveDataTableTemplate(
+            selectedTemplateId,
+            headerRows ? std::optional{headers} : std::nullopt,
+            std::optional{cellData},
+            std::optional{cellColours},
+            loadedVersion
+            );
+    };
+    WriteResult res = write();
+    while (res.isConflict() && overwriteAfterConflict(res.version))
+        res = write();
+    if (!res)
+        return;
+    loadedVersion   = res.version;
+    loadedTableHash = tableHash();
 }
 void TemplatePanel::onChangeGraphTypeClicked() {
     if (selectedTemplateId <= 0) {
@@ -842,14 +1071,28 @@ void TemplatePanel::unmergeSelectedCells() {
 
 //
 void TemplatePanel::fillCellColor(const QColor &color) {
+    // Несохранённые правки до заливки: после записи цвета они остаются правками
+    const size_t pending = tableHash() - loadedTableHash;
+    QVector<QPair<int, int>> cells;
     applyToSelection([&](QTableWidgetItem* item){
         item->setBackground(color);
-        dbHandler->getTableManager()->updateCellColour(
-            selectedTemplateId,
-            item->row(), item->column(),
-            color.name()
-            );
+        cells.append({item->row() + 1, item->column() + 1});
     });
+    if (selectedTemplateId <= 0 || cells.isEmpty())
+        return;
+
+    // В базу уходят только залитые ячейки, с проверкой версии шаблона
+    auto write = [&]{
+        return dbHandler->getTableManager()->updateCellColours(
+            selectedTemplateId, cells, color.name(), loadedVersion);
+    };
+    WriteResult res = write();
+    while (res.isConflict() && overwriteAfterConflict(res.version))
+        res = write();
+    if (!res)
+        return;
+    loadedVersion   = res.version;
+    loadedTableHash = tableHash() - pending;
 }
 void TemplatePanel::changeCellFontFamily(const QFont &font) {
     applyToSelection([&](QTableWidgetItem* item){
@@ -1041,28 +1284,13 @@ void TemplatePanel::applySizingPreservingUserChanges(int nR, int nC) {
         if (haveSaved) {
             templateTableWidget->setColumnWidth(c, savedColWidths[c]);
         } else {
-            // Автоподгон только этой колонки
-            hh->setSectionResizeMode(c, QHeaderView::ResizeToContents);
-            templateTableWidget->resizeColumnToContents(c);
-            int w = templateTableWidget->columnWidth(c);
-            templateTableWidget->setColumnWidth(c, w + 20); // небольшой запас
-            hh->setSectionResizeMode(c, QHeaderView::Interactive);
+            // Автоподгон только этой колонки - по заголовку и первым строкам
+            templateTableWidget->setColumnWidth(c, tableSizer->fitColumn(c) + 20); // небольшой запас
         }
     }
 
-    for (int r = 0; r < nR; ++r) {
-        bool haveSaved = (r < savedRowHeights.size() && savedRowHeights[r] > 0);
-
-        if (haveSaved) {
-            templateTableWidget->setRowHeight(r, savedRowHeights[r]);
-        } else {
-            vh->setSectionResizeMode(r, QHeaderView::ResizeToContents);
-            templateTableWidget->resizeRowToContents(r);
-            int h = templateTableWidget->rowHeight(r);
-            templateTableWidget->setRowHeight(r, h); // оставляем «как есть»
-            vh->setSectionResizeMode(r, QHeaderView::Interactive);
-        }
-    }
+    // Строки не меряются все сразу: сохранённые высоты, оценки, замер видимых
+    tableSizer->apply(savedRowHeights);
 
     lastSizedTemplateId = selectedTemplateId;
     if (savedColWidths.size() != nC) savedColWidths.resize(nC);
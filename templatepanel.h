@@ -18,10 +18,14 @@
 #include <QHBoxLayout>
 #include <QUndoStack>
 #include <QComboBox>
+#include <QTimer>
+#include <climits>
 #include "databasehandler.h"
 #include "formattoolbar.h"
 #include "commands.h"
 
+class TableSizer;
+
 class TemplatePanel : public QWidget
 {
     Q_OBJECT
@@ -63,6 +67,9 @@ public:
 
     void applySizingPreservingUserChanges(int nR, int nC);
 
+    // Перечитать открытый шаблон из базы, если в панели нет несохранённых правок
+    bool reloadIfUnmodified();
+
 signals:
     void textEditFocused(QTextEdit *editor);
     void checkButtonPressed();
@@ -112,6 +119,17 @@ private:
         if (idxs.isEmpty() && templateTableWidget->currentIndex().isValid())
             idxs.append(templateTableWidget->currentIndex());
 
+        // Выделение могло захватить ещё не прочитанные строки - дочитываем их
+        if (!idxs.isEmpty()) {
+            int minRow = INT_MAX, maxRow = -1;
+            for (const QModelIndex &idx : std::as_const(idxs)) {
+                minRow = qMin(minRow, idx.row());
+                maxRow = qMax(maxRow, idx.row());
+            }
+            if (!ensureRowsLoaded(minRow, maxRow))
+                return;
+        }
+
         // Чтобы не дублировать ячейки
         QSet<QPair<int,int>> seen;
         for (const QModelIndex &idx : idxs) {
@@ -127,13 +145,50 @@ private:
         }
     }
 
+    TableSizer *tableSizer = nullptr;   // размеры строк без замера всей таблицы
     int lastSizedTemplateId = -1;
     QVector<int> savedColWidths;
-    QVector<int> savedRowHeights;
+    QVector<int> savedRowHeights;       // заданные пользователем, 0 - нет
+
+    // Постраничная загрузка ячеек. Индекс таблицы (номера строк и столбцов,
+    // объединения) читается целиком, текст - страницами по kPageRows строк:
+    // первая с заголовком сразу, остальные по мере прокрутки и на kPrefetchPages
+    // вперёд на тиках таймера. Сохранение и удаление строк дочитывают всё
+    static constexpr int kPageRows = 200;
+    static constexpr int kPrefetchPages = 2;
+    GridLayout gridLayout;
+    SpanIndex gridSpans;                // объединения таблицы в координатах виджета
+    QVector<bool> loadedPages;
+    int prefetchFrom = 0;               // первая страница после видимых
+    bool currentIsListing = false;
+    QTimer *prefetchTimer = nullptr;
+    void fillRows(const GridStore &rows, int firstRow);
+    // false - страница не прочитана (ошибка базы) и остаётся непрочитанной
+    bool loadPages(int firstPage, int lastPage);
+    bool ensureRowsLoaded(int firstRow, int lastRow);
+    bool loadRemainingPages();
+    void loadVisiblePages();
+    void prefetchPages();
 
     QComboBox* relatedCombo = nullptr;
     void populateRelatedCombo(int templateId);
 
+    // Состояние шаблона на момент загрузки: версия в базе и хэши содержимого
+    // панели (ячейки с объединениями и поля заметок отдельно). Хэш таблицы -
+    // сумма хэшей прочитанных строк: догруженная страница прибавляется к обоим
+    void markLoaded();
+    bool isModified() const;
+    size_t tableHash() const;
+    size_t rowsHash(int firstRow, int endRow) const;
+    QByteArray notesHash() const;
+    int loadedVersion = -1;
+    size_t loadedTableHash = 0;
+    QByteArray loadedNotesHash;
+
+    // Шаблон изменён другим пользователем: true - перезаписать своими правками,
+    // false - отказаться от них (шаблон будет перечитан)
+    bool overwriteAfterConflict(int currentVersion);
+
 };
 
 #endif // TEMPLATEPANEL_H
@@ -1,5 +1,7 @@
 #include "treecategorypanel.h"
+#include "stallwatchdog.h"
 #include <QVBoxLayout>
+#include <QHBoxLayout>
 #include <QMessageBox>
 #include <QInputDialog>
 #include <QMenu>
@@ -7,6 +9,11 @@
 #include <QPushButton>
 #include <QTreeWidgetItem>
 #include <QHeaderView>
+#include <QTreeWidgetItemIterator>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QSettings>
+#include <QApplication>
 
 TreeCategoryPanel::TreeCategoryPanel(DatabaseHandler *dbHandler, QWidget *parent)
     : QWidget(parent)
@@ -37,8 +44,62 @@ TreeCategoryPanel::TreeCategoryPanel(DatabaseHandler *dbHandler, QWidget *parent
     connect(categoryTreeWidget, &QWidget::customContextMenuRequested,
             this, &TreeCategoryPanel::showTreeContextMenu);
 
+    // Поиск: результаты обновляются по мере набора
+    searchEdit = new QLineEdit(this);
+    searchEdit->setPlaceholderText(tr("Search templates..."));
+    searchEdit->setClearButtonEnabled(true);
+    searchResults = new QListWidget(this);
+    searchResults->setMaximumHeight(180);
+    searchResults->hide();
+    searchTimer = new QTimer(this);
+    searchTimer->setSingleShot(true);
+    searchTimer->setInterval(200);
+
+    connect(searchEdit, &QLineEdit::textChanged, searchTimer, qOverload<>(&QTimer::start));
+    connect(searchTimer, &QTimer::timeout, this, &TreeCategoryPanel::runSearch);
+    connect(searchEdit, &QLineEdit::returnPressed, this, [this](){
+        if (searchResults->count() > 0)
+            selectTemplateNode(searchResults->item(0)->data(Qt::UserRole).toInt());
+    });
+    connect(searchResults, &QListWidget::itemClicked, this, [this](QListWidgetItem *item){
+        selectTemplateNode(item->data(Qt::UserRole).toInt());
+    });
+
+    // Фильтр дерева: работает по снимку pathIndex, без запросов к базе
+    filterEdit = new QLineEdit(this);
+    filterEdit->setPlaceholderText(tr("Filter by name or number..."));
+    filterEdit->setClearButtonEnabled(true);
+    filterType = new QComboBox(this);
+    filterType->addItem(tr("All types"), QString());
+    filterType->addItem(tr("Categories"), QStringLiteral("category"));
+    filterType->addItem(tr("Tables"), QStringLiteral("table"));
+    filterType->addItem(tr("Listings"), QStringLiteral("listing"));
+    filterType->addItem(tr("Graphs"), QStringLiteral("graph"));
+    filterApproval = new QComboBox(this);
+    filterApproval->addItem(tr("Any state"), int(TreePathIndex::Approval::Any));
+    filterApproval->addItem(tr("Approved"), int(TreePathIndex::Approval::Approved));
+    filterApproval->addItem(tr("Not approved"), int(TreePathIndex::Approval::NotApproved));
+    filterTimer = new QTimer(this);
+    filterTimer->setSingleShot(true);
+    filterTimer->setInterval(0);
+
+    connect(filterEdit, &QLineEdit::textChanged, this, &TreeCategoryPanel::applyFilter);
+    connect(filterType, qOverload<int>(&QComboBox::currentIndexChanged),
+            this, &TreeCategoryPanel::applyFilter);
+    connect(filterApproval, qOverload<int>(&QComboBox::currentIndexChanged),
+            this, &TreeCategoryPanel::applyFilter);
+    connect(filterTimer, &QTimer::timeout, this, &TreeCategoryPanel::applyFilter);
+
+    QHBoxLayout *filterLayout = new QHBoxLayout;
+    filterLayout->addWidget(filterEdit, 1);
+    filterLayout->addWidget(filterType);
+    filterLayout->addWidget(filterApproval);
+
     // Размещаем виджет в layout
     QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addWidget(searchEdit);
+    layout->addWidget(searchResults);
+    layout->addLayout(filterLayout);
     layout->addWidget(categoryTreeWidget);
     setLayout(layout);
 }
@@ -47,12 +108,53 @@ TreeCategoryPanel::~TreeCategoryPanel() {}
 
 void TreeCategoryPanel::clearAll() {
     categoryTreeWidget->clear();
+    pathIndex.clear();
+    pathIndexDirty = true;
     selectedProjectId = 0;  // Или -1, если так принято
 }
 
 void TreeCategoryPanel::loadCategoriesAndTemplatesForProject(int projectId) {
+    STALL_SCOPE();
     selectedProjectId = projectId;    // обновляем поле
     loadCategoriesAndTemplates();     // вызываем ваш метод, который строит дерево
+    if (!searchEdit->text().isEmpty())
+        searchTimer->start();         // результаты другого проекта неактуальны
+}
+
+void TreeCategoryPanel::runSearch() {
+    STALL_SCOPE();
+    searchResults->clear();
+    const QString text = searchEdit->text();
+    if (text.trimmed().isEmpty() || selectedProjectId <= 0) {
+        searchResults->hide();
+        return;
+    }
+
+    const QVector<SearchHit> hits =
+        dbHandler->getSearchManager()->search(selectedProjectId, text);
+    for (const SearchHit &hit : hits) {
+        // Номер узла из дерева помогает различить одноимённые шаблоны
+        const QTreeWidgetItem *node = findNode(hit.templateId, false);
+        QListWidgetItem *item = new QListWidgetItem(
+            node ? node->text(0) + "  " + hit.name : hit.name, searchResults);
+        item->setData(Qt::UserRole, hit.templateId);
+    }
+    if (hits.isEmpty())
+        new QListWidgetItem(tr("Nothing found"), searchResults);
+    searchResults->show();
+}
+
+void TreeCategoryPanel::selectTemplateNode(int templateId) {
+    if (templateId <= 0)
+        return;
+    QTreeWidgetItem *node = findNode(templateId, false);
+    if (!node)
+        return;
+    for (QTreeWidgetItem *p = node->parent(); p; p = p->parent())
+        p->setExpanded(true);
+    categoryTreeWidget->setCurrentItem(node);
+    categoryTreeWidget->scrollToItem(node, QAbstractItemView::PositionAtCenter);
+    emit templateSelected(templateId);
 }
 
 //  Загрузки
@@ -61,10 +163,96 @@ void TreeCategoryPanel::loadCategoriesAndTemplates() {
     QSet<int> expandedIds = saveExpandedState();
     categoryTreeWidget->clear();
 
-    int projectId = selectedProjectId;
-
-    loadItemsForCategory(projectId, QVariant(), nullptr, QString());
+    // Два запроса на всё дерево вместо обхода по категориям
+    rebuildPathIndex();
+    for (int root : pathIndex.roots())
+        addIndexedNode(root, nullptr);
     restoreExpandedState(expandedIds);
+    applyFilter();
+}
+
+void TreeCategoryPanel::rebuildPathIndex() {
+    pathIndexDirty = false;
+    if (selectedProjectId <= 0) {
+        pathIndex.clear();
+        return;
+    }
+    const QVector<Category> categories =
+        dbHandler->getCategoryManager()->getCategoriesByProject(selectedProjectId);
+    const QVector<TemplateNode> templates =
+        dbHandler->getTemplateManager()->getTemplateNodesForProject(selectedProjectId);
+    pathIndex.build(categories, templates);
+}
+
+void TreeCategoryPanel::invalidatePathIndex() {
+    pathIndexDirty = true;
+    // Активный фильтр пересчитаем после того, как правка дойдёт до дерева
+    if (filtering)
+        filterTimer->start();
+}
+
+void TreeCategoryPanel::addIndexedNode(int index, QTreeWidgetItem *parentItem) {
+    const TreePathIndex::Node &n = pathIndex.node(index);
+    QTreeWidgetItem *item = parentItem ? new QTreeWidgetItem(parentItem)
+                                       : new QTreeWidgetItem(categoryTreeWidget);
+    item->setText(0, n.path);
+    item->setText(1, n.name);
+    item->setData(0, Qt::UserRole, n.id);
+    item->setData(0, Qt::UserRole + 1, n.isCategory);
+    if (n.isCategory) {
+        for (int child : n.children)
+            addIndexedNode(child, item);
+        return;
+    }
+    const QString tip = n.dynamic ? tr("Dynamic template") : tr("Static template");
+    item->setToolTip(0, tip);
+    item->setToolTip(1, tip);
+    item->setForeground(1, n.approved ? QBrush(Qt::darkGreen) : QBrush(Qt::red));
+}
+
+TreePathIndex::Filter TreeCategoryPanel::currentFilter() const {
+    TreePathIndex::Filter filter;
+    filter.text = filterEdit->text();
+    filter.type = filterType->currentData().toString();
+    filter.approval = TreePathIndex::Approval(filterApproval->currentData().toInt());
+    return filter;
+}
+
+void TreeCategoryPanel::applyFilter() {
+    STALL_SCOPE();
+    const TreePathIndex::Filter filter = currentFilter();
+
+    if (filter.isEmpty()) {
+        if (!filtering)
+            return;
+        filtering = false;
+        QTreeWidgetItemIterator it(categoryTreeWidget);
+        for (; *it; ++it)
+            (*it)->setHidden(false);
+        categoryTreeWidget->collapseAll();
+        restoreExpandedState(expandedBeforeFilter);
+        return;
+    }
+
+    if (!filtering) {
+        expandedBeforeFilter = saveExpandedState();
+        filtering = true;
+    }
+    // База читается, только если дерево менялось после последнего снимка
+    if (pathIndexDirty)
+        rebuildPathIndex();
+
+    const QVector<bool> visible = pathIndex.match(filter);
+    QTreeWidgetItemIterator it(categoryTreeWidget);
+    for (; *it; ++it) {
+        QTreeWidgetItem *item = *it;
+        const bool isCat = item->data(0, Qt::UserRole + 1).toBool();
+        const int index = pathIndex.indexOf(item->data(0, Qt::UserRole).toInt(), isCat);
+        const bool shown = index >= 0 && visible[index];
+        item->setHidden(!shown);
+        if (shown && isCat)
+            item->setExpanded(true);
+    }
 }
 void TreeCategoryPanel::extracted(QVector<CombinedItem> &items,
                                   QVector<Category> &categories) {
@@ -269,6 +457,7 @@ void TreeCategoryPanel::onCategoryOrTemplateDoubleClickedForEditing(QTreeWidgetI
                 int templateId = item->data(0, Qt::UserRole).toInt();
                 dbHandler->getTemplateManager()->updateTemplate(templateId, newName, std::nullopt, std::nullopt, std::nullopt);
             }
+            invalidatePathIndex();
         }
     }
 }
@@ -282,6 +471,7 @@ void TreeCategoryPanel::onCheckButtonClicked() {
     const int templateId = selectedItem->data(0, Qt::UserRole).toInt();
     bool approved = dbHandler->getTemplateManager()->isTemplateApproved(templateId);
     selectedItem->setForeground(1, approved ? QBrush(Qt::darkGreen) : QBrush(Qt::red));
+    invalidatePathIndex();
 }
 
 //  Нумерация
@@ -300,6 +490,7 @@ void TreeCategoryPanel::updateNumbering() {
             item->setText(0, QString::number(pos));
             renumberChildren(item);
     }
+    invalidatePathIndex();
 }
 void TreeCategoryPanel::renumberChildren(QTreeWidgetItem *parent) {
     QString prefix = parent->text(0);
@@ -367,12 +558,15 @@ void TreeCategoryPanel::changeItemPosition() {
     int current = newPos;
     for (int i = idx+1; i < siblings.size(); ++i)
         setNumber(siblings[i], ++current);
+    invalidatePathIndex();
 }
 void TreeCategoryPanel::updateHierarchy() {
+    STALL_SCOPE();
     // Пройтись по всем топ-левел категориям
     for (int i = 0; i < categoryTreeWidget->topLevelItemCount(); ++i) {
         updateItemHierarchy(categoryTreeWidget->topLevelItem(i), -1, 0);
     }
+    invalidatePathIndex();
 }
 void TreeCategoryPanel::updateItemHierarchy(QTreeWidgetItem* item, int newParentId, int depth) {
     bool isCat = item->data(0, Qt::UserRole + 1).toBool();
@@ -426,6 +620,10 @@ void TreeCategoryPanel::showTreeContextMenu(const QPoint &pos) {
                 createCategoryOrTemplate(false);
             });
             contextMenu.addAction("Delete category", this, &TreeCategoryPanel::deleteCategoryOrTemplate);
+            const int categoryId = selectedItem->data(0, Qt::UserRole).toInt();
+            contextMenu.addAction("Import templates from CSV/XLSX...", this, [this, categoryId]() {
+                importSpreadsheet(categoryId, true);
+            });
         } else {
             int templateId = selectedItem->data(0, Qt::UserRole).toInt();
 
@@ -441,6 +639,11 @@ void TreeCategoryPanel::showTreeContextMenu(const QPoint &pos) {
                 toggleDynamicState(templateId, !isDyn);
             });
             contextMenu.addAction("Delete template", this, &TreeCategoryPanel::deleteCategoryOrTemplate);
+            if (dbHandler->getTemplateManager()->getTemplateType(templateId) != "graph") {
+                contextMenu.addAction("Import cells from CSV/XLSX...", this, [this, templateId]() {
+                    importSpreadsheet(templateId, false);
+                });
+            }
         }
     } else {
         // Клик вне элементов - добавляем корневую категорию
@@ -679,6 +882,53 @@ void TreeCategoryPanel::duplicateTemplate(int srcId) {
     loadCategoriesAndTemplates();      // перерисовываем дерево
     emit templateSelected(newId);
 }
+void TreeCategoryPanel::importSpreadsheet(int id, bool intoCategory) {
+    const QString KEY = "import/lastSpreadsheetDir";
+    QSettings settings;
+    const QString filename = QFileDialog::getOpenFileName(
+        this,
+        intoCategory ? tr("Import templates") : tr("Import cells"),
+        settings.value(KEY).toString(),
+        tr("Spreadsheets (*.csv *.xlsx);;CSV files (*.csv);;Excel workbooks (*.xlsx)"));
+    if (filename.isEmpty())
+        return;
+    settings.setValue(KEY, QFileInfo(filename).absolutePath());
+
+    bool ok = false;
+    GridImportOptions options;
+    options.headerRows = QInputDialog::getInt(this, tr("Header rows"),
+                                              tr("Number of header rows in each template:"),
+                                              1, 0, 50, 1, &ok);
+    if (!ok)
+        return;
+
+    if (!intoCategory && QMessageBox::question(
+            this, tr("Import cells"),
+            tr("All cells of the template will be replaced with the file contents. Continue?"))
+        != QMessageBox::Yes)
+        return;
+
+    ImportManager *importer = dbHandler->getImportManager();
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    const int result = intoCategory
+                           ? importer->importGridIntoCategory(id, filename, options)
+                           : (importer->importGridIntoTemplate(id, filename, options) ? 1 : -1);
+    QApplication::restoreOverrideCursor();
+    if (result < 0) {
+        QMessageBox::warning(this, tr("Error"),
+                             tr("Import failed, nothing was changed:\n%1").arg(importer->lastError()));
+        return;
+    }
+
+    if (intoCategory) {
+        loadCategoriesAndTemplates();
+        if (QTreeWidgetItem *node = findNode(id, true))
+            node->setExpanded(true);
+        QMessageBox::information(this, tr("Import"), tr("%n template(s) imported.", "", result));
+    } else {
+        emit templateSelected(id);      // открыть с новым содержимым
+    }
+}
 void TreeCategoryPanel::toggleDynamicState(int templateId, bool makeDynamic) {
     bool ok = dbHandler->getTemplateManager()->setTemplateDynamic(templateId, makeDynamic);
     if (!ok) {
@@ -710,6 +960,142 @@ QTreeWidgetItem* TreeCategoryPanel::findItemById(QTreeWidgetItem* parent, int id
     return nullptr;
 }
 
+QTreeWidgetItem* TreeCategoryPanel::findNode(int id, bool isCategory) const {
+    QTreeWidgetItemIterator it(categoryTreeWidget);
+    for (; *it; ++it) {
+        if ((*it)->data(0, Qt::UserRole).toInt() == id
+            && (*it)->data(0, Qt::UserRole + 1).toBool() == isCategory)
+            return *it;
+    }
+    return nullptr;
+}
+
+//  Точечные обновления
+
+int TreeCategoryPanel::nodePosition(const QTreeWidgetItem *node) {
+    // Номер в дереве хранится только в тексте: "1.2.3" -> 3
+    const QString num = node->text(0);
+    return num.mid(num.lastIndexOf('.') + 1).toInt();
+}
+
+void TreeCategoryPanel::refreshNodeNumbers(QTreeWidgetItem *node) {
+    QTreeWidgetItem *parent = node->parent();
+    const QString own = QString::number(nodePosition(node));
+    node->setText(0, parent ? parent->text(0) + "." + own : own);
+    for (int i = 0; i < node->childCount(); ++i)
+        refreshNodeNumbers(node->child(i));
+}
+
+void TreeCategoryPanel::placeNode(QTreeWidgetItem *node, QTreeWidgetItem *parentNode, int position) {
+    QTreeWidgetItem *oldParent = node->parent();
+    const bool attached = oldParent || categoryTreeWidget->indexOfTopLevelItem(node) >= 0;
+    const bool expanded = node->isExpanded();
+
+    // Позиция в тексте нужна до поиска места среди соседей
+    node->setText(0, QString::number(position));
+
+    auto childCount = [&](){ return parentNode ? parentNode->childCount()
+                                               : categoryTreeWidget->topLevelItemCount(); };
+    auto childAt = [&](int i){ return parentNode ? parentNode->child(i)
+                                                 : categoryTreeWidget->topLevelItem(i); };
+
+    if (attached && oldParent == parentNode) {
+        const int idx = parentNode ? parentNode->indexOfChild(node)
+                                   : categoryTreeWidget->indexOfTopLevelItem(node);
+        const bool beforeOk = idx == 0 || nodePosition(childAt(idx - 1)) <= position;
+        const bool afterOk  = idx + 1 >= childCount() || nodePosition(childAt(idx + 1)) >= position;
+        if (beforeOk && afterOk) {
+            refreshNodeNumbers(node);
+            return;                     // порядок не изменился
+        }
+    }
+
+    if (attached) {
+        if (oldParent)
+            oldParent->removeChild(node);
+        else
+            categoryTreeWidget->takeTopLevelItem(categoryTreeWidget->indexOfTopLevelItem(node));
+    }
+
+    int insertAt = childCount();
+    for (int i = 0; i < childCount(); ++i) {
+        if (nodePosition(childAt(i)) > position) {
+            insertAt = i;
+            break;
+        }
+    }
+    if (parentNode)
+        parentNode->insertChild(insertAt, node);
+    else
+        categoryTreeWidget->insertTopLevelItem(insertAt, node);
+
+    node->setExpanded(expanded);
+    refreshNodeNumbers(node);
+}
+
+void TreeCategoryPanel::applyCategoryChange(int categoryId, bool removed) {
+    invalidatePathIndex();
+    QTreeWidgetItem *node = findNode(categoryId, true);
+    const auto category = removed ? std::nullopt
+                                  : dbHandler->getCategoryManager()->getCategory(categoryId);
+
+    if (!category || category->projectId != selectedProjectId) {
+        delete node;                    // удалена или ушла в другой проект
+        return;
+    }
+
+    QTreeWidgetItem *parentNode = nullptr;
+    if (category->parentId >= 0) {
+        parentNode = findNode(category->parentId, true);
+        if (!parentNode) {
+            // Родитель ещё не пришёл - его уведомление построит поддерево целиком
+            delete node;
+            return;
+        }
+    }
+
+    const bool isNew = (node == nullptr);
+    if (isNew) {
+        node = new QTreeWidgetItem;
+        node->setData(0, Qt::UserRole, categoryId);
+        node->setData(0, Qt::UserRole + 1, true);
+    }
+    node->setText(1, category->name);
+    placeNode(node, parentNode, category->position);
+
+    if (isNew)
+        loadItemsForCategory(selectedProjectId, categoryId, node, node->text(0));
+}
+
+void TreeCategoryPanel::applyTemplateChange(int templateId, bool removed) {
+    invalidatePathIndex();
+    QTreeWidgetItem *node = findNode(templateId, false);
+    const auto tmpl = removed ? std::nullopt
+                              : dbHandler->getTemplateManager()->getTemplate(templateId);
+
+    QTreeWidgetItem *parentNode = tmpl ? findNode(tmpl->categoryId, true) : nullptr;
+    if (!parentNode) {
+        delete node;                    // удалён или его категории нет в этом дереве
+        return;
+    }
+
+    if (!node) {
+        node = new QTreeWidgetItem;
+        node->setData(0, Qt::UserRole, templateId);
+        node->setData(0, Qt::UserRole + 1, false);
+    }
+    node->setText(1, tmpl->name);
+
+    const bool isDyn = dbHandler->getTemplateManager()->isTemplateDynamic(templateId);
+    const QString tip = isDyn ? tr("Dynamic template") : tr("Static template");
+    node->setToolTip(0, tip);
+    node->setToolTip(1, tip);
+    const bool approved = dbHandler->getTemplateManager()->isTemplateApproved(templateId);
+    node->setForeground(1, approved ? QBrush(Qt::darkGreen) : QBrush(Qt::red));
+
+    placeNode(node, parentNode, tmpl->position);
+}
+
 //  Сохранение / восстановление состояния
 
 QSet<int> TreeCategoryPanel::saveExpandedState() {
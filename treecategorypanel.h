@@ -8,8 +8,12 @@
 #include <QSqlDatabase>
 #include <QPointer>
 #include <QSet>
+#include <QLineEdit>
+#include <QListWidget>
+#include <QTimer>
 #include "databasehandler.h"
 #include "mytreewidget.h"
+#include "treepathindex.h"
 
 
 struct CombinedItem {
@@ -59,6 +63,8 @@ public:
     void deleteCategoryOrTemplate();
     void toggleDynamicState(int templateId, bool makeDynamic);
     QTreeWidgetItem* findItemById(QTreeWidgetItem* parent, int id);
+    // В отличие от findItemById учитывает тип узла: id категорий и шаблонов пересекаются
+    QTreeWidgetItem* findNode(int id, bool isCategory) const;
 
     // Сохранение/восстановление состояния дерева
     QSet<int> saveExpandedState();
@@ -66,6 +72,9 @@ public:
     void restoreExpandedState(const QSet<int> &expandedIds);
     void restoreExpandedRecursive(QTreeWidgetItem *item, const QSet<int> &expandedIds);
 
+    // Выделить шаблон в дереве (раскрыв категории) и открыть его
+    void selectTemplateNode(int templateId);
+
     void setCurrentProjectId(int projectId) { selectedProjectId = projectId; }
     int currentProjectId() const { return selectedProjectId; }
 
@@ -73,17 +82,47 @@ public:
 public slots:
     void loadCategoriesAndTemplatesForProject(int projectId);
 
+    // Точечное обновление узла по изменению из базы (без перезагрузки дерева
+    // и без записи позиций обратно в базу)
+    void applyCategoryChange(int categoryId, bool removed);
+    void applyTemplateChange(int templateId, bool removed);
+
 private slots:
     void changeItemPosition();
     void duplicateTemplate(int srcTemplateId);
+    void importSpreadsheet(int id, bool intoCategory);
+    void runSearch();
+    void applyFilter();
 
 signals:
     void templateSelected(int templateId);
 
 private:
+    void placeNode(QTreeWidgetItem *node, QTreeWidgetItem *parentNode, int position);
+    void refreshNodeNumbers(QTreeWidgetItem *node);
+    static int nodePosition(const QTreeWidgetItem *node);
+
+    // Снимок дерева для построения и фильтра
+    void rebuildPathIndex();
+    void invalidatePathIndex();
+    void addIndexedNode(int index, QTreeWidgetItem *parentItem);
+    TreePathIndex::Filter currentFilter() const;
+
     DatabaseHandler *dbHandler;
 
     MyTreeWidget *categoryTreeWidget;   // Иерархический вид категорий и шаблонов
+    QLineEdit    *searchEdit;           // поиск по содержимому шаблонов
+    QListWidget  *searchResults;
+    QTimer       *searchTimer;          // поиск после паузы в наборе
+    QLineEdit    *filterEdit;           // фильтр дерева по имени или номеру
+    QComboBox    *filterType;
+    QComboBox    *filterApproval;
+    QTimer       *filterTimer;          // повтор фильтра после правок дерева
+
+    TreePathIndex pathIndex;
+    bool          pathIndexDirty = true;
+    bool          filtering = false;
+    QSet<int>     expandedBeforeFilter;
     int selectedProjectId = -1;
 
 };
@@ -0,0 +1,112 @@
+#include "treepathindex.h"
+#include <QRegularExpression>
+#include <algorithm>
+#include <functional>
+
+void TreePathIndex::clear() {
+    nodes.clear();
+    rootNodes.clear();
+    lookup.clear();
+}
+
+void TreePathIndex::build(const QVector<Category> &categories,
+                          const QVector<TemplateNode> &templates) {
+    clear();
+    nodes.reserve(categories.size() + templates.size());
+
+    for (const Category &cat : categories) {
+        Node n;
+        n.id = cat.categoryId;
+        n.isCategory = true;
+        n.position = cat.position;
+        n.name = cat.name;
+        n.type = QStringLiteral("category");
+        lookup.insert(key(n.id, true), nodes.size());
+        nodes.append(n);
+    }
+    for (const Category &cat : categories) {
+        const int self = lookup.value(key(cat.categoryId, true));
+        // parent_id NULL читается как 0; потерянного родителя считаем корнем
+        const int parent = cat.parentId > 0 ? lookup.value(key(cat.parentId, true), -1) : -1;
+        nodes[self].parent = parent;
+        (parent < 0 ? rootNodes : nodes[parent].children).append(self);
+    }
+    // Шаблоны всегда лежат в категории
+    for (const TemplateNode &t : templates) {
+        const int parent = lookup.value(key(t.categoryId, true), -1);
+        if (parent < 0)
+            continue;
+        Node n;
+        n.id = t.templateId;
+        n.isCategory = false;
+        n.parent = parent;
+        n.position = t.position;
+        n.name = t.name;
+        n.type = t.templateType;
+        n.dynamic = t.dynamic;
+        n.approved = t.approved;
+        lookup.insert(key(n.id, false), nodes.size());
+        nodes[parent].children.append(nodes.size());
+        nodes.append(n);
+    }
+
+    // При равных позициях категории идут раньше шаблонов (порядок добавления)
+    auto byPosition = [this](int a, int b) { return nodes[a].position < nodes[b].position; };
+    std::stable_sort(rootNodes.begin(), rootNodes.end(), byPosition);
+    for (Node &n : nodes)
+        std::stable_sort(n.children.begin(), n.children.end(), byPosition);
+
+    for (int root : rootNodes)
+        assignPaths(root, QString());
+}
+
+void TreePathIndex::assignPaths(int index, const QString &parentPath) {
+    Node &n = nodes[index];
+    const QString number = QString::number(n.position);
+    n.path = parentPath.isEmpty() ? number : parentPath + '.' + number;
+    for (int child : n.children)
+        assignPaths(child, n.path);
+}
+
+QVector<bool> TreePathIndex::match(const Filter &filter) const {
+    QVector<bool> visible(nodes.size(), filter.isEmpty());
+    if (filter.isEmpty())
+        return visible;
+
+    static const QRegularExpression numberPrefix("^\\d+(\\.\\d+)*\\.?$");
+    const QString text = filter.text.trimmed();
+    const bool byNumber = numberPrefix.match(text).hasMatch();
+    // "2.3" - сам узел 2.3 и всё внутри него, но не 2.30
+    const QString number = text.endsWith('.') ? text.chopped(1) : text;
+    const QString numberChildren = number + '.';
+
+    auto textMatches = [&](const Node &n) {
+        if (text.isEmpty())
+            return true;
+        if (byNumber)
+            return n.path == number || n.path.startsWith(numberChildren);
+        return n.name.contains(text, Qt::CaseInsensitive);
+    };
+    auto attributesMatch = [&](const Node &n) {
+        if (!filter.type.isEmpty() && n.type != filter.type)
+            return false;
+        if (filter.approval == Approval::Any)
+            return true;
+        if (n.isCategory)
+            return false;
+        return n.approved == (filter.approval == Approval::Approved);
+    };
+
+    std::function<bool(int, bool)> visit = [&](int index, bool textInherited) {
+        const Node &n = nodes[index];
+        const bool textOk = textInherited || textMatches(n);
+        bool shown = textOk && attributesMatch(n);
+        for (int child : n.children)
+            shown |= visit(child, n.isCategory && textOk);
+        visible[index] = shown;
+        return shown;
+    };
+    for (int root : rootNodes)
+        visit(root, false);
+    return visible;
+}
@@ -0,0 +1,67 @@
+#ifndef TREEPATHINDEX_H
+#define TREEPATHINDEX_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+#include "categorymanager.h"
+#include "templatemanager.h"
+
+// Снимок дерева проекта: категории и шаблоны с готовыми номерами ("2.3.1"),
+// типом и статусом утверждения.
+//
+// Строится один раз по двум запросам (категории и шаблоны проекта), по нему
+// создаётся дерево и работает фильтр панели - набор в строке фильтра базу не
+// трогает. После правок дерева снимок устаревает и строится заново.
+class TreePathIndex {
+public:
+    struct Node {
+        int     id;
+        bool    isCategory;
+        int     parent = -1;        // индекс родителя, -1 - верхний уровень
+        int     position;
+        QString name;
+        QString path;               // номер узла, как в дереве
+        QString type;               // "category", "table", "listing", "graph"
+        bool    dynamic = false;
+        bool    approved = false;
+        QVector<int> children;      // по position
+    };
+
+    enum class Approval { Any, Approved, NotApproved };
+
+    struct Filter {
+        QString  text;              // часть имени или префикс номера ("2.3")
+        QString  type;              // пусто - любой тип
+        Approval approval = Approval::Any;
+
+        bool isEmpty() const {
+            return text.trimmed().isEmpty() && type.isEmpty() && approval == Approval::Any;
+        }
+    };
+
+    void build(const QVector<Category> &categories, const QVector<TemplateNode> &templates);
+    void clear();
+
+    int size() const { return nodes.size(); }
+    const Node &node(int index) const { return nodes[index]; }
+    const QVector<int> &roots() const { return rootNodes; }
+    int indexOf(int id, bool isCategory) const { return lookup.value(key(id, isCategory), -1); }
+
+    // Видимость по индексу узла: узел подходит под фильтр или содержит
+    // подходящий. Совпадение текста с категорией распространяется на всё её
+    // содержимое
+    QVector<bool> match(const Filter &filter) const;
+
+private:
+    static quint64 key(int id, bool isCategory) {
+        return (quint64(quint32(id)) << 1) | (isCategory ? 1u : 0u);
+    }
+    void assignPaths(int index, const QString &parentPath);
+
+    QVector<Node>          nodes;
+    QVector<int>           rootNodes;
+    QHash<quint64, int>    lookup;
+};
+
+#endif // TREEPATHINDEX_H
@@ -0,0 +1,639 @@
+#include "versionmanager.h"
+#include "bulkinserter.h"
+#include "sqldialect.h"
+#include "querystats.h"
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <QDebug>
+#include <algorithm>
+
+namespace {
+
+constexpr quint32 kTemplateMagic = 0x41545654;     // "ATVT"
+constexpr quint32 kTreeMagic     = 0x41545643;     // "ATVC"
+constexpr quint16 kFormat        = 1;
+constexpr int     kChunk         = 500;            // шаблонов на запрос IN (...)
+
+QString idList(const QVector<int> &ids, int from, int count) {
+    QStringList parts;
+    parts.reserve(count);
+    for (int i = from; i < from + count && i < ids.size(); ++i)
+        parts << QString::number(ids[i]);
+    return parts.join(',');
+}
+
+QByteArray digestOf(const QByteArray &data) {
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha1).toHex();
+}
+
+// Место шаблона (template_id, категория, позиция) в blob не пишется: оно
+// в version_template, и одинаковое содержимое разных шаблонов совпадает
+QByteArray encodeTemplate(const FrozenTemplate &t) {
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_6_0);
+    out << kTemplateMagic << kFormat
+        << t.name << t.subtitle << t.notes << t.programmingNotes << t.type
+        << t.dynamic << t.approved << qint32(t.relatedTemplateId);
+    out << quint32(t.cells.size());
+    for (const FrozenCell &c : t.cells)
+        out << c.header << qint32(c.row) << qint32(c.col) << qint32(c.rowSpan) << qint32(c.colSpan)
+            << c.content << c.colour;
+    out << quint32(t.graphs.size());
+    for (const FrozenGraph &g : t.graphs)
+        out << g.name << g.graphType << g.image;
+    return data;
+}
+
+bool decodeTemplate(const QByteArray &data, FrozenTemplate &t) {
+    QDataStream in(data);
+    in.setVersion(QDataStream::Qt_6_0);
+    quint32 magic = 0;
+    quint16 format = 0;
+    in >> magic >> format;
+    if (magic != kTemplateMagic || format != kFormat)
+        return false;
+
+    qint32 related = -1;
+    in >> t.name >> t.subtitle >> t.notes >> t.programmingNotes >> t.type
+       >> t.dynamic >> t.approved >> related;
+    t.relatedTemplateId = related;
+
+    quint32 count = 0;
+    in >> count;
+    t.cells.resize(count);
+    for (FrozenCell &c : t.cells) {
+        qint32 row, col, rowSpan, colSpan;
+        in >> c.header >> row >> col >> rowSpan >> colSpan >> c.content >> c.colour;
+        c.row = row;
+        c.col = col;
+        c.rowSpan = rowSpan;
+        c.colSpan = colSpan;
+    }
+    in >> count;
+    t.graphs.resize(count);
+    for (FrozenGraph &g : t.graphs)
+        in >> g.name >> g.graphType >> g.image;
+    return in.status() == QDataStream::Ok;
+}
+
+QByteArray encodeTree(const QVector<FrozenCategory> &categories) {
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_6_0);
+    out << kTreeMagic << kFormat << quint32(categories.size());
+    for (const FrozenCategory &c : categories)
+        out << qint32(c.categoryId) << qint32(c.parentId) << c.name
+            << qint32(c.position) << qint32(c.depth);
+    return data;
+}
+
+bool decodeTree(const QByteArray &data, QVector<FrozenCategory> &categories) {
+    QDataStream in(data);
+    in.setVersion(QDataStream::Qt_6_0);
+    quint32 magic = 0, count = 0;
+    quint16 format = 0;
+    in >> magic >> format >> count;
+    if (magic != kTreeMagic || format != kFormat)
+        return false;
+    categories.resize(count);
+    for (FrozenCategory &c : categories) {
+        qint32 id, parent, position, depth;
+        in >> id >> parent >> c.name >> position >> depth;
+        c.categoryId = id;
+        c.parentId = parent;
+        c.position = position;
+        c.depth = depth;
+    }
+    return in.status() == QDataStream::Ok;
+}
+
+} // namespace
+
+VersionManager::VersionManager(QSqlDatabase &db) : db(db) {}
+
+VersionManager::~VersionManager() {}
+
+int VersionManager::freezeVersion(int projectId, const QString &label) {
+    if (!db.transaction()) {
+        qDebug() << "VersionManager: не удалось начать транзакцию" << db.lastError();
+        return -1;
+    }
+    auto fail = [&](const QString &what) {
+        qDebug() << "VersionManager::freezeVersion:" << what;
+        db.rollback();
+        return -1;
+    };
+
+    QSqlQuery q(db);
+    // Заморозки одного проекта идут по очереди (SQLite пишет и так по одному):
+    // иначе две параллельные получили бы одного родителя
+    if (!SqlDialect::isSqlite(db)) {
+        q.prepare("SELECT 1 FROM project WHERE project_id = ? FOR UPDATE");
+        q.addBindValue(projectId);
+        if (!QUERY_EXEC(q))
+            return fail(q.lastError().text());
+    }
+    // Родитель - последняя созданная версия этого проекта. Под блокировкой
+    // номера версий проекта растут в порядке создания; created_at для этого
+    // не годится - в PostgreSQL это время начала транзакции, а не вставки
+    q.prepare("SELECT version_id FROM project_version WHERE project_id = ? "
+              "ORDER BY version_id DESC LIMIT 1");
+    q.addBindValue(projectId);
+    if (!QUERY_EXEC(q))
+        return fail(q.lastError().text());
+    const int parentId = q.next() ? q.value(0).toInt() : 0;
+
+    QHash<int, Entry> previous;
+    if (parentId > 0 && !resolve(parentId, previous))
+        return fail("не удалось восстановить прошлую версию");
+
+    // change_seq читается раньше содержимого: правка между ними даст в
+    // версии старый номер, и следующая заморозка перечитает шаблон
+    QHash<int, Entry> current;
+    if (!currentEntries(projectId, current))
+        return fail("не удалось прочитать шаблоны проекта");
+
+    QVector<int> changed, removed;
+    for (auto it = current.cbegin(); it != current.cend(); ++it) {
+        const auto prev = previous.constFind(it.key());
+        if (prev == previous.cend() || prev->changeSeq != it->changeSeq)
+            changed.append(it.key());
+    }
+    for (auto it = previous.cbegin(); it != previous.cend(); ++it)
+        if (!current.contains(it.key()))
+            removed.append(it.key());
+    std::sort(changed.begin(), changed.end());
+    std::sort(removed.begin(), removed.end());
+
+    QByteArray tree;
+    if (!serializeTree(projectId, tree))
+        return fail("не удалось прочитать категории");
+    const int treeBlob = storeBlob(tree);
+    if (treeBlob < 0)
+        return fail("не удалось записать дерево категорий");
+
+    q.prepare("INSERT INTO project_version (project_id, parent_version_id, label, "
+              "tree_blob_id, template_count, stored_count) VALUES (?, ?, ?, ?, ?, ?)"
+              + SqlDialect::returningId("version_id"));
+    q.addBindValue(projectId);
+    q.addBindValue(parentId > 0 ? QVariant(parentId) : QVariant());
+    q.addBindValue(label);
+    q.addBindValue(treeBlob);
+    q.addBindValue(current.size());
+    q.addBindValue(changed.size());
+    if (!QUERY_EXEC(q))
+        return fail(q.lastError().text());
+    const int versionId = SqlDialect::insertedId(q);
+    if (versionId <= 0)
+        return fail("нет id новой версии");
+
+    BulkInserter rows(db, "version_template",
+                      {"version_id", "template_id", "change_seq", "category_id", "position", "blob_id"});
+    // Изменённые шаблоны читаются пачками: в памяти не больше kChunk сразу
+    for (int from = 0; from < changed.size(); from += kChunk) {
+        const QVector<int> chunk = changed.mid(from, kChunk);
+        QHash<int, FrozenTemplate> frozen;
+        if (!readTemplates(chunk, frozen))
+            return fail("не удалось прочитать шаблоны");
+        for (int templateId : chunk) {
+            const auto t = frozen.constFind(templateId);
+            if (t == frozen.cend())
+                continue;               // удалён после чтения change_seq
+            const int blob = storeBlob(encodeTemplate(*t));
+            if (blob < 0)
+                return fail("не удалось записать шаблон");
+            const Entry &e = current[templateId];
+            if (!rows.add({versionId, templateId, e.changeSeq, e.categoryId, e.position, blob}))
+                return fail("ошибка вставки version_template");
+        }
+    }
+    for (int templateId : std::as_const(removed))
+        if (!rows.add({versionId, templateId, 0, QVariant(), 0, QVariant()}))
+            return fail("ошибка вставки version_template");
+    if (!rows.flush())
+        return fail("ошибка вставки version_template");
+
+    if (!db.commit())
+        return fail(db.lastError().text());
+    return versionId;
+}
+
+QVector<ProjectVersion> VersionManager::getVersions(int projectId) const {
+    QVector<ProjectVersion> versions;
+    QSqlQuery q(db);
+    q.prepare("SELECT version_id, parent_version_id, label, created_at, template_count, stored_count "
+              "FROM project_version WHERE project_id = ? ORDER BY version_id");
+    q.addBindValue(projectId);
+    if (!QUERY_EXEC(q)) {
+        qDebug() << "Ошибка чтения версий проекта:" << q.lastError().text();
+        return versions;
+    }
+    while (q.next()) {
+        versions.append({q.value(0).toInt(),
+                         q.value(1).isNull() ? -1 : q.value(1).toInt(),
+                         q.value(2).toString(),
+                         q.value(3).toDateTime(),
+                         q.value(4).toInt(),
+                         q.value(5).toInt()});
+    }
+    return versions;
+}
+
+bool VersionManager::deleteVersion(int versionId) {
+    if (!db.transaction()) {
+        qDebug() << "VersionManager: не удалось начать транзакцию" << db.lastError();
+        return false;
+    }
+    // Дочерние версии уходят каскадом: без родителя их изменения не к чему применить
+    QSqlQuery q(db);
+    q.prepare("DELETE FROM project_version WHERE version_id = ?");
+    q.addBindValue(versionId);
+    if (!QUERY_EXEC(q) || !purgeUnusedBlobs() || !db.commit()) {
+        qDebug() << "Ошибка удаления версии:" << q.lastError().text();
+        db.rollback();
+        return false;
+    }
+    return true;
+}
+
+bool VersionManager::purgeUnusedBlobs() {
+    QSqlQuery q(db);
+    if (!QUERY_EXEC_SQL(q, "DELETE FROM version_blob WHERE "
+                           "NOT EXISTS (SELECT 1 FROM version_template vt "
+                           "            WHERE vt.blob_id = version_blob.blob_id) "
+                           "AND NOT EXISTS (SELECT 1 FROM project_version v "
+                           "                WHERE v.tree_blob_id = version_blob.blob_id)")) {
+        qDebug() << "Ошибка очистки version_blob:" << q.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+bool VersionManager::diffVersions(int fromVersionId, int toVersionId, VersionDiff &diff) const {
+    diff = VersionDiff();
+    QHash<int, Entry> from, to;
+    if (!resolve(fromVersionId, from) || !resolve(toVersionId, to))
+        return false;
+
+    // Содержимое не читается: одинаковые данные - один blob_id
+    for (auto it = to.cbegin(); it != to.cend(); ++it) {
+        const auto old = from.constFind(it.key());
+        if (old == from.cend())
+            diff.added.append(it.key());
+        else if (old->blobId != it->blobId)
+            diff.modified.append(it.key());
+        else if (old->categoryId != it->categoryId || old->position != it->position)
+            diff.moved.append(it.key());
+    }
+    for (auto it = from.cbegin(); it != from.cend(); ++it)
+        if (!to.contains(it.key()))
+            diff.removed.append(it.key());
+
+    diff.treeChanged = treeDigest(fromVersionId) != treeDigest(toVersionId);
+    std::sort(diff.added.begin(), diff.added.end());
+    std::sort(diff.removed.begin(), diff.removed.end());
+    std::sort(diff.modified.begin(), diff.modified.end());
+    std::sort(diff.moved.begin(), diff.moved.end());
+    return true;
+}
+
+bool VersionManager::diffWithProject(int versionId, VersionDiff &diff) const {
+    diff = VersionDiff();
+    int projectId = -1;
+    QHash<int, Entry> frozen, current;
+    if (!resolve(versionId, frozen, &projectId) || !currentEntries(projectId, current))
+        return false;
+
+    QVector<int> suspects;
+    for (auto it = current.cbegin(); it != current.cend(); ++it) {
+        const auto old = frozen.constFind(it.key());
+        if (old == frozen.cend())
+            diff.added.append(it.key());
+        else if (old->changeSeq != it->changeSeq)
+            suspects.append(it.key());
+    }
+    for (auto it = frozen.cbegin(); it != frozen.cend(); ++it)
+        if (!current.contains(it.key()))
+            diff.removed.append(it.key());
+
+    // Шаблоны с новым change_seq сверяются по хешу содержимого
+    std::sort(suspects.begin(), suspects.end());
+    for (int from = 0; from < suspects.size(); from += kChunk) {
+        const QVector<int> chunk = suspects.mid(from, kChunk);
+        QHash<int, FrozenTemplate> live;
+        if (!readTemplates(chunk, live))
+            return false;
+
+        QStringList blobIds;
+        for (int templateId : chunk)
+            blobIds << QString::number(frozen[templateId].blobId);
+        QHash<int, QByteArray> digests;
+        QSqlQuery q(db);
+        if (!QUERY_EXEC_SQL(q, QString("SELECT blob_id, digest FROM version_blob "
+                                       "WHERE blob_id IN (%1)").arg(blobIds.join(',')))) {
+            qDebug() << "Ошибка чтения version_blob:" << q.lastError().text();
+            return false;
+        }
+        while (q.next())
+            digests.insert(q.value(0).toInt(), q.value(1).toByteArray());
+
+        for (int templateId : chunk) {
+            const auto t = live.constFind(templateId);
+            if (t == live.cend())
+                continue;
+            const Entry &old = frozen[templateId];
+            const Entry &now = current[templateId];
+            if (digests.value(old.blobId) != digestOf(encodeTemplate(*t)))
+                diff.modified.append(templateId);
+            else if (old.categoryId != now.categoryId || old.position != now.position)
+                diff.moved.append(templateId);
+        }
+    }
+
+    QByteArray tree;
+    if (!serializeTree(projectId, tree))
+        return false;
+    diff.treeChanged = treeDigest(versionId) != digestOf(tree);
+    std::sort(diff.added.begin(), diff.added.end());
+    std::sort(diff.removed.begin(), diff.removed.end());
+    std::sort(diff.modified.begin(), diff.modified.end());
+    std::sort(diff.moved.begin(), diff.moved.end());
+    return true;
+}
+
+bool VersionManager::loadTree(int versionId, QVector<FrozenCategory> &categories) const {
+    QSqlQuery q(db);
+    q.prepare("SELECT tree_blob_id FROM project_version WHERE version_id = ?");
+    q.addBindValue(versionId);
+    if (!QUERY_EXEC(q) || !q.next()) {
+        qDebug() << "Версия не найдена" << versionId << q.lastError().text();
+        return false;
+    }
+    QByteArray data;
+    return readBlob(q.value(0).toInt(), data) && decodeTree(data, categories);
+}
+
+bool VersionManager::loadTemplates(int versionId, QVector<FrozenTemplate> &templates) const {
+    templates.clear();
+    QHash<int, Entry> entries;
+    if (!resolve(versionId, entries))
+        return false;
+
+    // Один blob может принадлежать нескольким шаблонам
+    QHash<int, QVector<int>> byBlob;
+    for (auto it = entries.cbegin(); it != entries.cend(); ++it)
+        byBlob[it->blobId].append(it.key());
+    QVector<int> blobIds = byBlob.keys();
+    std::sort(blobIds.begin(), blobIds.end());
+
+    templates.reserve(entries.size());
+    for (int from = 0; from < blobIds.size(); from += kChunk) {
+        QSqlQuery q(db);
+        q.setForwardOnly(true);
+        if (!QUERY_EXEC_SQL(q, QString("SELECT blob_id, data FROM version_blob WHERE blob_id IN (%1)")
+                                   .arg(idList(blobIds, from, kChunk)))) {
+            qDebug() << "Ошибка чтения version_blob:" << q.lastError().text();
+            return false;
+        }
+        while (q.next()) {
+            FrozenTemplate t;
+            if (!decodeTemplate(qUncompress(q.value(1).toByteArray()), t)) {
+                qDebug() << "Повреждён blob версии" << q.value(0).toInt();
+                return false;
+            }
+            for (int templateId : byBlob.value(q.value(0).toInt())) {
+                const Entry &e = entries[templateId];
+                t.templateId = templateId;
+                t.categoryId = e.categoryId;
+                t.position   = e.position;
+                templates.append(t);
+            }
+        }
+    }
+    std::sort(templates.begin(), templates.end(), [](const FrozenTemplate &a, const FrozenTemplate &b) {
+        return a.templateId < b.templateId;
+    });
+    return true;
+}
+
+bool VersionManager::loadTemplate(int versionId, int templateId, FrozenTemplate &t) const {
+    QHash<int, Entry> entries;
+    if (!resolve(versionId, entries))
+        return false;
+    const auto e = entries.constFind(templateId);
+    if (e == entries.cend())
+        return false;
+    QByteArray data;
+    if (!readBlob(e->blobId, data) || !decodeTemplate(data, t))
+        return false;
+    t.templateId = templateId;
+    t.categoryId = e->categoryId;
+    t.position   = e->position;
+    return true;
+}
+
+bool VersionManager::resolve(int versionId, QHash<int, Entry> &entries, int *projectId) const {
+    entries.clear();
+
+    // Цепочка родителей: все версии проекта одним запросом
+    QSqlQuery q(db);
+    q.prepare("SELECT version_id, parent_version_id, project_id FROM project_version "
+              "WHERE project_id = (SELECT project_id FROM project_version WHERE version_id = ?)");
+    q.addBindValue(versionId);
+    if (!QUERY_EXEC(q)) {
+        qDebug() << "Ошибка чтения версий:" << q.lastError().text();
+        return false;
+    }
+    QHash<int, int> parents;
+    int project = -1;
+    while (q.next()) {
+        parents.insert(q.value(0).toInt(), q.value(1).isNull() ? -1 : q.value(1).toInt());
+        project = q.value(2).toInt();
+    }
+    if (!parents.contains(versionId)) {
+        qDebug() << "Версия не найдена" << versionId;
+        return false;
+    }
+    if (projectId)
+        *projectId = project;
+
+    QVector<int> chain;
+    for (int v = versionId; v > 0; v = parents.value(v, -1))
+        chain.append(v);
+    std::sort(chain.begin(), chain.end());
+
+    // Версии создаются по возрастанию id: поздние изменения ложатся сверху
+    q.setForwardOnly(true);
+    if (!QUERY_EXEC_SQL(q, QString("SELECT template_id, change_seq, category_id, position, blob_id "
+                                   "FROM version_template WHERE version_id IN (%1) "
+                                   "ORDER BY version_id").arg(idList(chain, 0, chain.size())))) {
+        qDebug() << "Ошибка чтения version_template:" << q.lastError().text();
+        return false;
+    }
+    while (q.next()) {
+        const int templateId = q.value(0).toInt();
+        if (q.value(4).isNull())
+            entries.remove(templateId);
+        else
+            entries.insert(templateId, {q.value(1).toLongLong(), q.value(2).toInt(),
+                                        q.value(3).toInt(), q.value(4).toInt()});
+    }
+    return true;
+}
+
+bool VersionManager::currentEntries(int projectId, QHash<int, Entry> &entries) const {
+    entries.clear();
+    QSqlQuery q(db);
+    q.setForwardOnly(true);
+    q.prepare("SELECT t.template_id, t.change_seq, t.category_id, t.position FROM template t "
+              "JOIN category c ON t.category_id = c.category_id "
+              "WHERE c.project_id = ?");
+    q.addBindValue(projectId);
+    if (!QUERY_EXEC(q)) {
+        qDebug() << "Ошибка чтения change_seq шаблонов:" << q.lastError().text();
+        return false;
+    }
+    while (q.next())
+        entries.insert(q.value(0).toInt(), {q.value(1).toLongLong(), q.value(2).toInt(),
+                                            q.value(3).toInt(), -1});
+    return true;
+}
+
+QByteArray VersionManager::treeDigest(int versionId) const {
+    QSqlQuery q(db);
+    q.prepare("SELECT b.digest FROM project_version v "
+              "JOIN version_blob b ON b.blob_id = v.tree_blob_id WHERE v.version_id = ?");
+    q.addBindValue(versionId);
+    if (!QUERY_EXEC(q) || !q.next())
+        return QByteArray();
+    return q.value(0).toByteArray();
+}
+
+bool VersionManager::serializeTree(int projectId, QByteArray &data) const {
+    QSqlQuery q(db);
+    q.setForwardOnly(true);
+    q.prepare("SELECT category_id, parent_id, name, position, depth "
+              "FROM category WHERE project_id = ? ORDER BY category_id");
+    q.addBindValue(projectId);
+    if (!QUERY_EXEC(q)) {
+        qDebug() << "Ошибка чтения категорий:" << q.lastError().text();
+        return false;
+    }
+    QVector<FrozenCategory> categories;
+    while (q.next())
+        categories.append({q.value(0).toInt(),
+                           q.value(1).isNull() ? -1 : q.value(1).toInt(),
+                           q.value(2).toString(),
+                           q.value(3).toInt(),
+                           q.value(4).toInt()});
+    data = encodeTree(categories);
+    return true;
+}
+
+bool VersionManager::readTemplates(const QVector<int> &templateIds,
+                                   QHash<int, FrozenTemplate> &templates) const {
+    templates.clear();
+    if (templateIds.isEmpty())
+        return true;
+    const QString ids = idList(templateIds, 0, templateIds.size());
+
+    QSqlQuery q(db);
+    q.setForwardOnly(true);
+    if (!QUERY_EXEC_SQL(q, QString("SELECT template_id, name, subtitle, notes, programming_notes, "
+                                   "template_type, is_dynamic, approved, related_template_id "
+                                   "FROM template WHERE template_id IN (%1)").arg(ids))) {
+        qDebug() << "Ошибка чтения шаблонов:" << q.lastError().text();
+        return false;
+    }
+    while (q.next()) {
+        FrozenTemplate t;
+        t.templateId       = q.value(0).toInt();
+        t.name             = q.value(1).toString();
+        t.subtitle         = q.value(2).toString();
+        t.notes            = q.value(3).toString();
+        t.programmingNotes = q.value(4).toString();
+        t.type             = q.value(5).toString();
+        t.dynamic          = q.value(6).toBool();
+        t.approved         = q.value(7).toBool();
+        t.relatedTemplateId = q.value(8).isNull() ? -1 : q.value(8).toInt();
+        templates.insert(t.templateId, t);
+    }
+
+    // Порядок ячеек и графиков фиксирован - от него зависит хеш
+    if (!QUERY_EXEC_SQL(q, QString("SELECT t.template_id, g.cell_type, g.row_index, g.col_index, "
+                                   "COALESCE(g.row_span, 1), COALESCE(g.col_span, 1), g.content, g.colour "
+                                   "FROM template t JOIN grid_cells g "
+                                   "ON g.template_id = COALESCE(t.content_source_id, t.template_id) "
+                                   "WHERE t.template_id IN (%1) "
+                                   "ORDER BY t.template_id, g.cell_type, g.row_index, g.col_index").arg(ids))) {
+        qDebug() << "Ошибка чтения ячеек:" << q.lastError().text();
+        return false;
+    }
+    while (q.next()) {
+        auto t = templates.find(q.value(0).toInt());
+        if (t == templates.end())
+            continue;
+        t->cells.append({q.value(1).toString() == QLatin1String("header"),
+                         q.value(2).toInt(), q.value(3).toInt(),
+                         q.value(4).toInt(), q.value(5).toInt(),
+                         q.value(6).toString(), q.value(7).toString()});
+    }
+
+    if (!QUERY_EXEC_SQL(q, QString("SELECT template_id, name, graph_type, image FROM graph "
+                                   "WHERE template_id IN (%1) "
+                                   "ORDER BY template_id, graph_type, name").arg(ids))) {
+        qDebug() << "Ошибка чтения графиков:" << q.lastError().text();
+        return false;
+    }
+    while (q.next()) {
+        auto t = templates.find(q.value(0).toInt());
+        if (t != templates.end())
+            t->graphs.append({q.value(1).toString(), q.value(2).toString(), q.value(3).toByteArray()});
+    }
+    return true;
+}
+
+int VersionManager::storeBlob(const QByteArray &data) {
+    const QByteArray digest = digestOf(data);
+    QSqlQuery q(db);
+    auto find = [&]() {
+        q.prepare("SELECT blob_id FROM version_blob WHERE digest = ?");
+        q.addBindValue(QString::fromLatin1(digest));
+        if (!QUERY_EXEC(q)) {
+            qDebug() << "Ошибка поиска в version_blob:" << q.lastError().text();
+            return -1;
+        }
+        return q.next() ? q.value(0).toInt() : 0;
+    };
+    const int existing = find();
+    if (existing != 0)
+        return existing;
+
+    // Те же данные может одновременно записывать другая заморозка:
+    // её строка остаётся, наша вставка пропускается без ошибки ключа
+    q.prepare("INSERT INTO version_blob (digest, data) VALUES (?, ?) "
+              "ON CONFLICT (digest) DO NOTHING");
+    q.addBindValue(QString::fromLatin1(digest));
+    q.addBindValue(qCompress(data));
+    if (!QUERY_EXEC(q)) {
+        qDebug() << "Ошибка записи в version_blob:" << q.lastError().text();
+        return -1;
+    }
+    const int id = find();
+    return id > 0 ? id : -1;
+}
+
+bool VersionManager::readBlob(int blobId, QByteArray &data) const {
+    QSqlQuery q(db);
+    q.prepare("SELECT data FROM version_blob WHERE blob_id = ?");
+    q.addBindValue(blobId);
+    if (!QUERY_EXEC(q) || !q.next()) {
+        qDebug() << "blob версии не найден" << blobId << q.lastError().text();
+        return false;
+    }
+    data = qUncompress(q.value(0).toByteArray());
+    return !data.isEmpty();
+}
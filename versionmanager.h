@@ -0,0 +1,125 @@
+#ifndef VERSIONMANAGER_H
+#define VERSIONMANAGER_H
+
+#include <QSqlDatabase>
+#include <QVector>
+#include <QHash>
+#include <QString>
+#include <QByteArray>
+#include <QDateTime>
+
+struct ProjectVersion {
+    int       versionId;
+    int       parentVersionId;     // -1 у первой версии проекта
+    QString   label;
+    QDateTime createdAt;
+    int       templateCount;       // шаблонов в версии
+    int       storedCount;         // из них записано заново, остальные - из прошлых версий
+};
+
+// Содержимое шаблона в замороженной версии
+struct FrozenCell {
+    bool    header;
+    int     row;
+    int     col;
+    int     rowSpan;
+    int     colSpan;
+    QString content;
+    QString colour;
+};
+
+struct FrozenGraph {
+    QString    name;
+    QString    graphType;
+    QByteArray image;
+};
+
+struct FrozenTemplate {
+    int     templateId = 0;
+    int     categoryId = 0;
+    int     position   = 0;
+    QString name;
+    QString subtitle;
+    QString notes;
+    QString programmingNotes;
+    QString type;
+    bool    dynamic  = false;
+    bool    approved = false;
+    int     relatedTemplateId = -1;
+    QVector<FrozenCell>  cells;
+    QVector<FrozenGraph> graphs;
+};
+
+struct FrozenCategory {
+    int     categoryId;
+    int     parentId;              // -1 у корневых
+    QString name;
+    int     position;
+    int     depth;
+};
+
+// Разница двух версий (или версии и текущего проекта) по template_id
+struct VersionDiff {
+    QVector<int> added;
+    QVector<int> removed;
+    QVector<int> modified;         // другое содержимое
+    QVector<int> moved;            // то же содержимое в другой категории или позиции
+    bool treeChanged = false;      // категории переименованы, добавлены или перенесены
+
+    bool isEmpty() const {
+        return added.isEmpty() && removed.isEmpty() && modified.isEmpty()
+               && moved.isEmpty() && !treeChanged;
+    }
+};
+
+// Замороженные версии проекта вместо полной копии через copyProject().
+//
+// Версия хранит только то, что изменилось с предыдущей версии проекта:
+// шаблоны с тем же change_seq (006_change_tracking) не читаются и не
+// пишутся, содержимое остальных сериализуется в version_blob и
+// разделяется по SHA-1 - одинаковые шаблоны лежат одной строкой. Состояние
+// версии - наложение изменений по цепочке родителей. Заморозка и сравнение
+// версий стоят O(изменений), а не O(проекта)
+class VersionManager {
+public:
+    explicit VersionManager(QSqlDatabase &db);
+    ~VersionManager();
+
+    // Новая версия поверх последней версии проекта; id или -1
+    int freezeVersion(int projectId, const QString &label);
+    QVector<ProjectVersion> getVersions(int projectId) const;
+    // Удаляет версию вместе с версиями, построенными на ней
+    bool deleteVersion(int versionId);
+    // Данные, на которые не ссылается ни одна версия (после удаления проекта)
+    bool purgeUnusedBlobs();
+
+    bool diffVersions(int fromVersionId, int toVersionId, VersionDiff &diff) const;
+    // Что изменилось в проекте после версии. Перечитываются только шаблоны
+    // со сдвинувшимся change_seq; отменённая вручную правка в modified не попадёт
+    bool diffWithProject(int versionId, VersionDiff &diff) const;
+
+    bool loadTree(int versionId, QVector<FrozenCategory> &categories) const;
+    bool loadTemplates(int versionId, QVector<FrozenTemplate> &templates) const;
+    bool loadTemplate(int versionId, int templateId, FrozenTemplate &t) const;
+
+private:
+    // Шаблон в состоянии версии
+    struct Entry {
+        qint64 changeSeq;
+        int    categoryId;
+        int    position;
+        int    blobId;
+    };
+
+    bool resolve(int versionId, QHash<int, Entry> &entries, int *projectId = nullptr) const;
+    QByteArray treeDigest(int versionId) const;
+    bool serializeTree(int projectId, QByteArray &data) const;
+    bool readTemplates(const QVector<int> &templateIds, QHash<int, FrozenTemplate> &templates) const;
+    int storeBlob(const QByteArray &data);
+    bool readBlob(int blobId, QByteArray &data) const;
+    bool currentEntries(int projectId, QHash<int, Entry> &entries) const;
+
+    QSqlDatabase &db;
+};
+
+#endif // VERSIONMANAGER_H
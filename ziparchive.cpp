@@ -0,0 +1,207 @@
+#include "ziparchive.h"
+#include <QtEndian>
+#include <zlib.h>
+#include <limits>
+
+namespace {
+
+constexpr quint32 LocalHeaderSignature   = 0x04034b50;
+constexpr quint32 CentralHeaderSignature = 0x02014b50;
+constexpr quint32 EndOfDirectorySignature = 0x06054b50;
+constexpr int     EndOfDirectorySize = 22;
+constexpr quint16 MethodStored  = 0;
+constexpr quint16 MethodDeflate = 8;
+
+quint16 u16(const char *p) { return qFromLittleEndian<quint16>(p); }
+quint32 u32(const char *p) { return qFromLittleEndian<quint32>(p); }
+
+// Сжатые данные записи читаются из архива окнами по ChunkSize и
+// распаковываются в буфер вызывающего
+class ZipEntryDevice : public QIODevice {
+public:
+    ZipEntryDevice(QFile *file, qint64 dataOffset, quint32 compressedSize, quint16 method)
+        : file(file), position(dataOffset), remaining(compressedSize), method(method) {
+        stream.zalloc = Z_NULL;
+        stream.zfree = Z_NULL;
+        stream.opaque = Z_NULL;
+        stream.avail_in = 0;
+        stream.next_in = Z_NULL;
+        if (method == MethodDeflate)
+            inflating = inflateInit2(&stream, -MAX_WBITS) == Z_OK;   // raw deflate без заголовка zlib
+    }
+    ~ZipEntryDevice() override {
+        if (inflating)
+            inflateEnd(&stream);
+    }
+
+    bool isSequential() const override { return true; }
+    bool usable() const { return method == MethodStored || inflating; }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override {
+        if (method == MethodStored)
+            return readCompressed(data, qMin<qint64>(maxSize, remaining));
+
+        if (finished)
+            return 0;
+        const uInt capacity = uInt(qMin<qint64>(maxSize, std::numeric_limits<uInt>::max()));
+        stream.next_out = reinterpret_cast<Bytef *>(data);
+        stream.avail_out = capacity;
+        while (stream.avail_out > 0 && !finished) {
+            if (stream.avail_in == 0) {
+                const qint64 got = readCompressed(chunk, ChunkSize);
+                if (got < 0)
+                    return -1;
+                stream.next_in = reinterpret_cast<Bytef *>(chunk);
+                stream.avail_in = uInt(got);
+            }
+            const int rc = inflate(&stream, Z_NO_FLUSH);
+            if (rc == Z_STREAM_END) {
+                finished = true;
+            } else if (rc != Z_OK) {
+                // Z_BUF_ERROR без входных данных - архив обрезан
+                setErrorString(QStringLiteral("inflate: ")
+                               + QString::fromLatin1(stream.msg ? stream.msg : "truncated data"));
+                return -1;
+            }
+        }
+        return capacity - stream.avail_out;
+    }
+    qint64 writeData(const char *, qint64) override { return -1; }
+
+private:
+    qint64 readCompressed(char *out, qint64 maxSize) {
+        maxSize = qMin<qint64>(maxSize, remaining);
+        if (maxSize <= 0)
+            return 0;
+        // Один QFile на архив: позиция выставляется перед каждым чтением
+        if (!file->seek(position))
+            return -1;
+        const qint64 got = file->read(out, maxSize);
+        if (got <= 0)
+            return -1;
+        position += got;
+        remaining -= quint32(got);
+        return got;
+    }
+
+    static constexpr int ChunkSize = 64 * 1024;
+
+    QFile   *file;
+    qint64   position;
+    quint32  remaining;
+    quint16  method;
+    z_stream stream;
+    bool     inflating = false;
+    bool     finished = false;
+    char     chunk[ChunkSize];
+};
+
+} // namespace
+
+ZipArchive::ZipArchive(const QString &filename) : file(filename) {}
+
+ZipArchive::~ZipArchive() {}
+
+bool ZipArchive::open() {
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+        return false;
+    }
+    return readCentralDirectory();
+}
+
+bool ZipArchive::readCentralDirectory() {
+    // Запись конца каталога - в последних 22 байтах + комментарий (до 64 КБ)
+    const qint64 tailSize = qMin<qint64>(file.size(), EndOfDirectorySize + 0xFFFF);
+    file.seek(file.size() - tailSize);
+    const QByteArray tail = file.read(tailSize);
+    int eocd = -1;
+    for (int i = tail.size() - EndOfDirectorySize; i >= 0; --i) {
+        if (u32(tail.constData() + i) == EndOfDirectorySignature) {
+            eocd = i;
+            break;
+        }
+    }
+    if (eocd < 0) {
+        error = QStringLiteral("not a ZIP archive");
+        return false;
+    }
+
+    const char *end = tail.constData() + eocd;
+    const quint16 count = u16(end + 10);
+    const quint32 dirSize = u32(end + 12);
+    const quint32 dirOffset = u32(end + 16);
+    if (dirOffset == 0xFFFFFFFF || count == 0xFFFF) {
+        error = QStringLiteral("ZIP64 archives are not supported");
+        return false;
+    }
+
+    file.seek(dirOffset);
+    const QByteArray dir = file.read(dirSize);
+    if (dir.size() != int(dirSize)) {
+        error = QStringLiteral("truncated central directory");
+        return false;
+    }
+
+    int pos = 0;
+    for (int i = 0; i < count; ++i) {
+        if (pos + 46 > dir.size() || u32(dir.constData() + pos) != CentralHeaderSignature) {
+            error = QStringLiteral("corrupted central directory");
+            return false;
+        }
+        const char *h = dir.constData() + pos;
+        Entry e;
+        e.method = u16(h + 10);
+        e.compressedSize = u32(h + 20);
+        e.size = u32(h + 24);
+        const quint16 nameLen = u16(h + 28);
+        const quint16 extraLen = u16(h + 30);
+        const quint16 commentLen = u16(h + 32);
+        e.localHeaderOffset = u32(h + 42);
+        index.insert(QString::fromUtf8(h + 46, nameLen), e);
+        pos += 46 + nameLen + extraLen + commentLen;
+    }
+    return true;
+}
+
+std::unique_ptr<QIODevice> ZipArchive::openEntry(const QString &name) {
+    auto it = index.constFind(name);
+    if (it == index.cend()) {
+        error = QStringLiteral("%1: no such entry").arg(name);
+        return nullptr;
+    }
+    const Entry &e = *it;
+    if (e.method != MethodStored && e.method != MethodDeflate) {
+        error = QStringLiteral("%1: unsupported compression method %2").arg(name).arg(e.method);
+        return nullptr;
+    }
+
+    // Длина extra в локальном заголовке может отличаться от центрального
+    char local[30];
+    if (!file.seek(e.localHeaderOffset) || file.read(local, 30) != 30
+        || u32(local) != LocalHeaderSignature) {
+        error = QStringLiteral("%1: corrupted local header").arg(name);
+        return nullptr;
+    }
+    const qint64 dataOffset = qint64(e.localHeaderOffset) + 30 + u16(local + 26) + u16(local + 28);
+
+    auto device = std::make_unique<ZipEntryDevice>(&file, dataOffset, e.compressedSize, e.method);
+    if (!device->usable() || !device->open(QIODevice::ReadOnly)) {
+        error = QStringLiteral("%1: cannot initialise decompression").arg(name);
+        return nullptr;
+    }
+    return device;
+}
+
+QByteArray ZipArchive::readEntry(const QString &name) {
+    std::unique_ptr<QIODevice> device = openEntry(name);
+    if (!device)
+        return QByteArray();
+    QByteArray data = device->readAll();
+    if (data.size() != int(index.value(name).size)) {
+        error = QStringLiteral("%1: %2").arg(name, device->errorString());
+        return QByteArray();
+    }
+    return data;
+}
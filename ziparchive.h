@@ -0,0 +1,48 @@
+#ifndef ZIPARCHIVE_H
+#define ZIPARCHIVE_H
+
+#include <QFile>
+#include <QHash>
+#include <QIODevice>
+#include <QString>
+#include <QStringList>
+#include <memory>
+
+// Чтение ZIP-архива (XLSX и подобные контейнеры Office Open XML).
+//
+// Оглавление читается из центрального каталога; содержимое записи
+// распаковывается потоком (zlib, raw deflate) по мере чтения устройства,
+// поэтому большой лист книги не поднимается в память целиком.
+// Поддерживаются методы stored и deflate; ZIP64 и шифрование - нет.
+class ZipArchive {
+public:
+    explicit ZipArchive(const QString &filename);
+    ~ZipArchive();
+
+    bool open();
+    QString errorString() const { return error; }
+
+    QStringList entries() const { return index.keys(); }
+    bool contains(const QString &name) const { return index.contains(name); }
+
+    // Устройство только для чтения; архив должен жить дольше устройства.
+    // nullptr - записи нет или она повреждена
+    std::unique_ptr<QIODevice> openEntry(const QString &name);
+    // Небольшие записи целиком (workbook.xml, sharedStrings.xml)
+    QByteArray readEntry(const QString &name);
+
+private:
+    struct Entry {
+        quint16 method;
+        quint32 compressedSize;
+        quint32 size;
+        quint32 localHeaderOffset;
+    };
+    bool readCentralDirectory();
+
+    QFile file;
+    QHash<QString, Entry> index;
+    QString error;
+};
+
+#endif // ZIPARCHIVE_H